@@ -0,0 +1,149 @@
+#!/bin/bash
+# End-to-end throughput benchmark: one router between two hosts, over veth pairs in network
+# namespaces (no mininet). The generator in h0 sends UDP to the sink in h1 through the router,
+# for every frame size and offered rate, and a line per run reports the forwarded rate, the
+# drops and the latency percentiles. Run as root from anywhere.
+#
+#   h0 (192.168.0.2) --- r-0 [ router ] r-1 --- h1 (192.168.1.2)
+#                               rr-0-1 --- stub (192.0.1.2)
+
+set -u
+
+usage() {
+	cat >&2 <<EOF
+Usage: $0 [-t rtable] [-r "rates"] [-s "sizes"] [-d seconds] [-f flows] [-w workers] [-c cpus] [-l] [-k]
+  -t  routing table, relative to build/ (default rtable0.txt)
+  -r  offered rates in pps, 0 = as fast as the generator goes (default "10000 100000 0")
+  -s  frame sizes in bytes, FCS included (default "64 512 1518")
+  -d  seconds per run (default 5)
+  -f  UDP flows, spread over the router workers by the fanout hash (default 4)
+  -w  router workers, -c the CPUs to pin them to (router defaults)
+  -l  have the router measure its wire-to-wire latency (router -t), printed after the runs
+  -k  keep the namespaces and the router when done
+EOF
+	exit 1
+}
+
+RTABLE=rtable0.txt
+RATES="10000 100000 0"
+SIZES="64 512 1518"
+DURATION=5
+FLOWS=4
+ROUTER_ARGS=()
+KEEP=
+LATENCY=
+
+while getopts "t:r:s:d:f:w:c:lkh" opt; do
+	case $opt in
+		t) RTABLE=$OPTARG ;;
+		r) RATES=$OPTARG ;;
+		s) SIZES=$OPTARG ;;
+		d) DURATION=$OPTARG ;;
+		f) FLOWS=$OPTARG ;;
+		w) ROUTER_ARGS+=(-w "$OPTARG") ;;
+		c) ROUTER_ARGS+=(-c "$OPTARG") ;;
+		l) ROUTER_ARGS+=(-t); LATENCY=1 ;;
+		k) KEEP=1 ;;
+		*) usage ;;
+	esac
+done
+
+[ "$(id -u)" = 0 ] || { echo "$0: must run as root" >&2; exit 1; }
+
+BUILD=$(cd "$(dirname "$0")/.." && pwd)
+NAMESPACES="r0 h0 h1 stub"
+LOG=$(mktemp -d)
+ROUTER_PID=
+SINK_PID=
+
+cleanup() {
+	for pid in $SINK_PID $ROUTER_PID; do kill "$pid" 2>/dev/null && wait "$pid" 2>/dev/null; done
+	for ns in $NAMESPACES; do ip netns del "$ns" 2>/dev/null; done
+	rm -rf "$LOG"
+}
+
+[ -z "$KEEP" ] && trap cleanup EXIT
+for ns in $NAMESPACES; do ip netns del "$ns" 2>/dev/null; done
+
+make -s -C "$BUILD" router trafgen trafsink || exit 1
+
+# ---- TOPOLOGY ----
+for ns in $NAMESPACES; do
+	ip netns add "$ns"
+	ip -n "$ns" link set lo up
+done
+
+ip link add h-0 netns h0 type veth peer name r-0 netns r0
+ip link add h-1 netns h1 type veth peer name r-1 netns r0
+ip link add rr-0-1 netns r0 type veth peer name rr-0-1 netns stub
+
+for h in 0 1; do
+	ip -n r0 addr add 192.168.$h.1/24 dev r-$h
+	ip -n r0 link set r-$h address de:fe:c8:ed:00:0$h arp off up
+	ip -n h$h addr add 192.168.$h.2/24 dev h-$h
+	ip -n h$h link set h-$h address de:ad:be:ef:00:0$h up
+	ip -n h$h route add default via 192.168.$h.1
+	# The router forwards what it reads from the socket, so the frames must be complete.
+	ip netns exec h$h ethtool -K h-$h tx off rx off >/dev/null 2>&1
+done
+ip -n r0 addr add 192.0.1.1/24 dev rr-0-1
+ip -n r0 link set rr-0-1 arp off up
+ip -n stub addr add 192.0.1.2/24 dev rr-0-1
+ip -n stub link set rr-0-1 up
+
+# The kernel of the router namespace must neither forward nor answer on its own.
+ip netns exec r0 sysctl -qw net.ipv4.ip_forward=0 net.ipv4.icmp_echo_ignore_all=1
+
+# ---- ROUTER ----
+(cd "$BUILD" && exec ip netns exec r0 ./router "${ROUTER_ARGS[@]}" "$RTABLE" rr-0-1 r-0 r-1) \
+	> "$LOG/router.out" 2>&1 &
+ROUTER_PID=$!
+sleep 1
+kill -0 "$ROUTER_PID" 2>/dev/null || { cat "$LOG/router.out" >&2; exit 1; }
+
+# Resolve the next hops once, so the first run does not measure the ARP queue.
+ip netns exec h0 "$BUILD/trafgen" -r 100 -d 0.2 192.168.1.2 >/dev/null
+
+# ---- RUNS ----
+field() {
+	sed -n "s/.*\b$1=\([^ ]*\).*/\1/p" "$2"
+}
+
+printf "%6s %10s %10s %10s %7s %9s %9s %9s %9s\n" \
+	size offered forwarded sent drop% p50_us p99_us p999_us max_us
+for size in $SIZES; do
+	for rate in $RATES; do
+		ip netns exec h1 "$BUILD/trafsink" -t 0 > "$LOG/sink" 2>&1 &
+		SINK_PID=$!
+		sleep 0.2
+
+		ip netns exec h0 "$BUILD/trafgen" -r "$rate" -s "$size" -d "$DURATION" -f "$FLOWS" 192.168.1.2 \
+			> "$LOG/gen" || exit 1
+		# Let the queues drain before the sink stops counting.
+		sleep 0.5
+		kill -INT "$SINK_PID"
+		wait "$SINK_PID"
+		SINK_PID=
+
+		sent=$(field sent "$LOG/gen")
+		received=$(field received "$LOG/sink")
+		offered=$([ "$rate" = 0 ] && echo max || echo "$rate")
+		forwarded=$(awk -v r="$received" -v s="$(field seconds "$LOG/gen")" 'BEGIN { printf "%.0f", r / s }')
+		drop=$(awk -v r="$received" -v s="$sent" 'BEGIN { printf "%.2f", s ? 100 * (s - r) / s : 0 }')
+
+		printf "%6s %10s %10s %10s %7s %9s %9s %9s %9s\n" "$size" "$offered" "$forwarded" \
+			"$(field pps "$LOG/gen")" "$drop" "$(field p50_us "$LOG/sink")" "$(field p99_us "$LOG/sink")" \
+			"$(field p999_us "$LOG/sink")" "$(field max_us "$LOG/sink")"
+	done
+done
+
+# The router prints its latency with its counters, on SIGUSR1.
+if [ -n "$LATENCY" ]; then
+	kill -USR1 "$ROUTER_PID"
+	sleep 0.2
+	echo
+	grep -E "^[^ ]+ +tx " "$LOG/router.out"
+fi
+
+[ -n "$KEEP" ] && echo "router pid $ROUTER_PID, output in $LOG"
+exit 0
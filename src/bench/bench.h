@@ -0,0 +1,191 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <linux/perf_event.h>
+
+#include "../res/ipv4/ipv4_table.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Monotonic wall clock, in nanoseconds.
+static inline uint64_t Bench_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Time stamp counter (reference cycles), 0 where there is none.
+static inline uint64_t Bench_Cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Keep the compiler from hoisting or dropping the work on a value between iterations.
+#define BENCH_KEEP(value) __asm__ volatile("" : : "g"(value) : "memory")
+
+// Deterministic xorshift generator, so every run replays the same inputs.
+static inline uint64_t Bench_Random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// Synthetic IPv4 table drawn from a seed, with a prefix length mix close to a full Internet table.
+// A prefix may come more than once, Bench_Unique_Routes keeps one. NULL if memory allocation fails.
+static inline route* Bench_Routes(int count, uint64_t seed) {
+    route *routes = (route *)malloc(count * sizeof(route));
+    if (!routes) return NULL;
+
+    for (int idx = 0; idx < count; idx++) {
+        int pick = (int)(Bench_Random(&seed) % 100), len;
+        if (pick < 55)      len = 24;
+        else if (pick < 75) len = 22 + (int)(Bench_Random(&seed) % 2);
+        else if (pick < 95) len = 16 + (int)(Bench_Random(&seed) % 6);
+        else if (pick < 98) len = 8 + (int)(Bench_Random(&seed) % 8);
+        else                len = 25 + (int)(Bench_Random(&seed) % 8);
+
+        uint32_t mask = (uint32_t)(~0ull << (32 - len));
+        routes[idx].prefix = htonl((uint32_t)Bench_Random(&seed) & mask);
+        routes[idx].mask = htonl(mask);
+        routes[idx].next_hop = htonl(0x0a000000u | (uint32_t)(Bench_Random(&seed) & 0xffff));
+        routes[idx].interface = (int)(Bench_Random(&seed) % 3);
+    }
+    return routes;
+}
+
+// Orders routes by prefix, then by next hop (their position in the table while Bench_Unique_Routes sorts).
+static inline int Bench_Compare_Routes(const void *left, const void *right) {
+    const route *a = (const route *)left, *b = (const route *)right;
+    uint64_t ka = (uint64_t)ntohl(a->mask) << 32 | (ntohl(a->prefix) & ntohl(a->mask));
+    uint64_t kb = (uint64_t)ntohl(b->mask) << 32 | (ntohl(b->prefix) & ntohl(b->mask));
+    if (ka != kb) return ka < kb ? -1 : 1;
+    return (a->next_hop > b->next_hop) - (a->next_hop < b->next_hop);
+}
+
+// Keep one route per prefix, the last one of the table: the engines make the repeated prefixes
+// multipath routes, which answer with their group rather than a next hop. The routes are compacted
+// in place (their order changes), the number kept is returned.
+static inline int Bench_Unique_Routes(route *routes, int count) {
+    // The next hop field holds the position while sorting, so the last route of a prefix sorts last.
+    uint32_t *hops = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (!hops) return count;
+    for (int idx = 0; idx < count; idx++) {
+        hops[idx] = routes[idx].next_hop;
+        routes[idx].next_hop = (uint32_t)idx;
+    }
+    qsort(routes, count, sizeof(route), Bench_Compare_Routes);
+
+    int kept = 0;
+    for (int idx = 0; idx < count; idx++) {
+        bool last = idx + 1 == count || routes[idx].mask != routes[idx + 1].mask ||
+                    (routes[idx].prefix & routes[idx].mask) != (routes[idx + 1].prefix & routes[idx + 1].mask);
+        if (!last) continue;
+        routes[kept] = routes[idx];
+        routes[kept++].next_hop = hops[routes[idx].next_hop];
+    }
+    free(hops);
+    return kept;
+}
+
+// Zipf distribution over ranks 0..n-1, P(rank) proportional to 1 / (rank + 1)^s.
+typedef struct bench_zipf {
+    double *cdf;
+    uint32_t n;
+} bench_zipf;
+
+static inline bool Bench_Zipf_Init(bench_zipf *zipf, uint32_t n, double s) {
+    zipf->cdf = (double *)malloc(n * sizeof(double));
+    if (!zipf->cdf) return false;
+    zipf->n = n;
+
+    double sum = 0;
+    for (uint32_t rank = 0; rank < n; rank++) zipf->cdf[rank] = sum += 1.0 / pow(rank + 1.0, s);
+    for (uint32_t rank = 0; rank < n; rank++) zipf->cdf[rank] /= sum;
+    return true;
+}
+
+// Draw a rank by binary search of the cumulative distribution.
+static inline uint32_t Bench_Zipf_Next(const bench_zipf *zipf, uint64_t *state) {
+    double u = (double)(Bench_Random(state) >> 11) * 0x1.0p-53;
+    uint32_t lo = 0, hi = zipf->n - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (zipf->cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static inline void Bench_Zipf_Free(bench_zipf *zipf) {
+    free(zipf->cdf);
+    zipf->cdf = NULL;
+}
+
+// Last level cache misses of the calling thread (user space), -1 where the PMU is not available.
+static inline int Bench_Misses_Open(void) {
+    static int fd = -2;
+    if (fd == -2) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+
+static inline uint64_t Bench_Misses(void) {
+    uint64_t misses = 0;
+    int fd = Bench_Misses_Open();
+    if (fd >= 0 && read(fd, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+    return misses;
+}
+
+// A timed run: wall time, cycles and cache misses for a number of operations.
+typedef struct bench_run {
+    uint64_t start_ns, start_cycles, start_misses;
+    uint64_t ns, cycles, misses;
+} bench_run;
+
+static inline void Bench_Start(bench_run *run) {
+    run->start_misses = Bench_Misses();
+    run->start_ns = Bench_Now();
+    run->start_cycles = Bench_Cycles();
+}
+
+static inline void Bench_Stop(bench_run *run) {
+    run->cycles = Bench_Cycles() - run->start_cycles;
+    run->ns = Bench_Now() - run->start_ns;
+    run->misses = Bench_Misses() - run->start_misses;
+}
+
+// Print one result line: operations per second, ns and cycles (and cache misses) per operation.
+static inline void Bench_Report(const char *name, const bench_run *run, uint64_t ops) {
+    double ns = (double)run->ns / (double)ops;
+    printf("%-32s %10.2f Mops/s %9.2f ns/op %9.1f cycles/op", name, ops * 1e3 / (double)run->ns, ns,
+           (double)run->cycles / (double)ops);
+    if (Bench_Misses_Open() >= 0) printf(" %7.2f misses/op", (double)run->misses / (double)ops);
+    printf("\n");
+}
+
+#endif /* BENCH_H_ */
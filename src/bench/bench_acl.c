@@ -0,0 +1,409 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../include/router.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_LOOKUPS     2000000
+#define DEFAULT_CHECKS      200000
+#define DEFAULT_REPLACES    200
+#define DEFAULT_READERS     2
+#define CHECK_BUDGET        2000000000ull       // Rule comparisons the reference may spend.
+#define NETWORKS            64                  // Sites the rules' prefixes are carved out of.
+#define SECTION             64                  // Packets per read-side section, a pipeline vector.
+
+// Prefix lengths of the synthetic rules, in percent, close to the firewall sets of ClassBench:
+// mostly hosts and subnets, the sources wildcarded at times, the destinations hardly ever.
+typedef struct length_share {
+    int len;
+    int percent;
+} length_share;
+
+static const length_share src_mix[] = {
+    {32, 30}, {24, 25}, {0, 15}, {16, 10}, {28, 10}, {20, 5}, {8, 5},
+};
+static const length_share dst_mix[] = {
+    {32, 45}, {24, 30}, {28, 10}, {16, 10}, {20, 5},
+};
+
+// Well known destination ports of the exact port rules.
+static const uint16_t well_known[] = {22, 25, 53, 80, 110, 123, 143, 443, 993, 995, 3306, 5432, 8080};
+
+static int Pick_Length(const length_share *mix, size_t shares, uint64_t *seed) {
+    int pick = (int)(Bench_Random(seed) % 100);
+    for (size_t share = 0, sum = 0; share < shares; share++) {
+        sum += (size_t)mix[share].percent;
+        if ((size_t)pick < sum) return mix[share].len;
+    }
+    return mix[0].len;
+}
+
+static inline uint32_t Mask_Of(int len) {
+    return len ? ~0u << (32 - len) : 0;
+}
+
+/**
+ * @brief Generate a synthetic rule set, the prefixes within a few /16 sites so that rules overlap.
+ *
+ * A third of the rules deny. The protocols are mostly TCP and UDP, with exact well-known
+ * destination ports, the ephemeral range or any; the source ports mostly any.
+ *
+ * @param count The number of rules.
+ * @param seed  The generator's seed, a different one for a different rule set.
+ * @return      The rules, or NULL if memory allocation fails.
+ */
+static acl_rule* Synthetic_Rules(int count, uint64_t seed) {
+    acl_rule *rules = (acl_rule *)calloc(count ? (size_t)count : 1, sizeof(acl_rule));
+    if (!rules) return NULL;
+
+    uint32_t networks[NETWORKS];
+    for (int idx = 0; idx < NETWORKS; idx++) networks[idx] = (uint32_t)Bench_Random(&seed) & Mask_Of(16);
+
+    for (int idx = 0; idx < count; idx++) {
+        acl_rule *rule = &rules[idx];
+        rule->src_len = (uint8_t)Pick_Length(src_mix, sizeof(src_mix) / sizeof(src_mix[0]), &seed);
+        rule->dst_len = (uint8_t)Pick_Length(dst_mix, sizeof(dst_mix) / sizeof(dst_mix[0]), &seed);
+        uint32_t src = networks[Bench_Random(&seed) % NETWORKS] | ((uint32_t)Bench_Random(&seed) & 0xffff);
+        uint32_t dst = networks[Bench_Random(&seed) % NETWORKS] | ((uint32_t)Bench_Random(&seed) & 0xffff);
+        rule->src = src & Mask_Of(rule->src_len);
+        rule->dst = dst & Mask_Of(rule->dst_len);
+        rule->action = Bench_Random(&seed) % 3 ? ACL_PERMIT : ACL_DENY;
+        rule->line = idx + 1;
+
+        int proto = (int)(Bench_Random(&seed) % 100);
+        rule->proto = proto < 55 ? IPPROTO_TCP : proto < 85 ? IPPROTO_UDP : proto < 90 ? IPPROTO_ICMP : ACL_ANY_PROTO;
+        rule->sport_lo = rule->dport_lo = 0;
+        rule->sport_hi = rule->dport_hi = UINT16_MAX;
+        if (rule->proto != IPPROTO_TCP && rule->proto != IPPROTO_UDP) continue;
+
+        int ports = (int)(Bench_Random(&seed) % 100);
+        if (ports < 60) {
+            rule->dport_lo = rule->dport_hi = well_known[Bench_Random(&seed) % (sizeof(well_known) / sizeof(well_known[0]))];
+            rule->flags |= ACL_DPORT;
+        } else if (ports < 80) {
+            rule->dport_lo = 1024;
+            rule->flags |= ACL_DPORT;
+        }
+        if (Bench_Random(&seed) % 10 == 0) {
+            rule->sport_lo = 1024;
+            rule->flags |= ACL_SPORT;
+        }
+    }
+    return rules;
+}
+
+/**
+ * @brief A packet matching a random rule, its wildcards filled at random.
+ */
+static acl_key Rule_Packet(const acl_rule *rules, int count, uint64_t *seed) {
+    const acl_rule *rule = &rules[Bench_Random(seed) % (uint64_t)count];
+    acl_key key;
+    key.src = rule->src | ((uint32_t)Bench_Random(seed) & ~Mask_Of(rule->src_len));
+    key.dst = rule->dst | ((uint32_t)Bench_Random(seed) & ~Mask_Of(rule->dst_len));
+    key.proto = rule->proto == ACL_ANY_PROTO ? IPPROTO_TCP : (uint8_t)rule->proto;
+    key.ports = key.proto == IPPROTO_TCP || key.proto == IPPROTO_UDP;
+    key.sport = key.dport = 0;
+    if (key.ports) {
+        key.sport = (uint16_t)(rule->sport_lo + Bench_Random(seed) % ((uint32_t)rule->sport_hi - rule->sport_lo + 1));
+        key.dport = (uint16_t)(rule->dport_lo + Bench_Random(seed) % ((uint32_t)rule->dport_hi - rule->dport_lo + 1));
+    }
+    return key;
+}
+
+/**
+ * @brief A packet with random addresses and ports, TCP or UDP, its destination in the rules' sites.
+ */
+static acl_key Random_Packet(const acl_rule *rules, int count, uint64_t *seed) {
+    acl_key key;
+    key.src = (uint32_t)Bench_Random(seed);
+    key.dst = (uint32_t)Bench_Random(seed);
+    if (count) key.dst = (rules[Bench_Random(seed) % (uint64_t)count].dst & Mask_Of(16)) | (key.dst & 0xffff);
+    key.proto = Bench_Random(seed) % 2 ? IPPROTO_TCP : IPPROTO_UDP;
+    key.ports = true;
+    key.sport = (uint16_t)Bench_Random(seed);
+    key.dport = Bench_Random(seed) % 2 ? well_known[Bench_Random(seed) % (sizeof(well_known) / sizeof(well_known[0]))] :
+                                         (uint16_t)Bench_Random(seed);
+    return key;
+}
+
+/**
+ * @brief Reference classifier: every rule in order, the first match wins.
+ */
+static int Classify_Reference(const acl_rule *rules, int count, const acl_key *key) {
+    for (int idx = 0; idx < count; idx++) {
+        if (Match_ACL_Rule(&rules[idx], key)) return idx;
+    }
+    return -1;
+}
+
+/**
+ * @brief Compare the classifier with the linear scan on rule and random packets.
+ *
+ * @return The number of mismatches.
+ */
+static uint64_t Check_Table(const acl_table *acl, const acl_rule *rules, int count, uint64_t checks) {
+    uint64_t seed = 0xac1c4ec, mismatches = 0;
+    for (uint64_t done = 0; done < checks; done++) {
+        acl_key key = done % 2 && count ? Rule_Packet(rules, count, &seed) : Random_Packet(rules, count, &seed);
+        int expected = Classify_Reference(rules, count, &key), got = Classify_ACL(acl, &key, NULL);
+        if (got == expected) continue;
+
+        if (mismatches++ < 5) {
+            fprintf(stderr, "classify: %08x -> %08x proto %u ports %u -> %u: rule %d, expected %d\n", key.src, key.dst,
+                    key.proto, key.sport, key.dport, got, expected);
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Time the classifier on a packet stream, and report the tuples it probed per packet.
+ */
+static void Bench_Stream(const acl_table *acl, const char *name, const acl_key *stream, uint64_t len) {
+    bench_run run;
+    char label[64];
+    uint64_t probes = 0, denied = 0;
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) BENCH_KEEP(Filter_ACL(acl, &stream[pos]));
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "tuples %s", name);
+    Bench_Report(label, &run, len);
+
+    for (uint64_t pos = 0; pos < len; pos++) {
+        int probed;
+        int rule = Classify_ACL(acl, &stream[pos], &probed);
+        probes += (uint64_t)probed;
+        denied += (rule < 0 ? acl->fallback : acl->rules[rule].action) == ACL_DENY;
+    }
+    printf("%-32s %10.1f tuples/packet %9.1f%% denied\n", label, (double)probes / len, 100.0 * denied / len);
+}
+
+/**
+ * @brief Time the linear scan, on as many packets as the budget allows.
+ */
+static void Bench_Reference(const acl_rule *rules, int count, const char *name, const acl_key *stream, uint64_t len) {
+    bench_run run;
+    char label[64];
+    if (count && len * (uint64_t)count > CHECK_BUDGET / 4) len = CHECK_BUDGET / 4 / (uint64_t)count;
+    if (!len) return;
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) BENCH_KEEP(Classify_Reference(rules, count, &stream[pos]));
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "linear %s", name);
+    Bench_Report(label, &run, len);
+}
+
+// A worker classifying vectors with whatever rule set is installed.
+typedef struct reader {
+    routing route;
+    const acl_key *stream;
+    uint64_t len;
+    uint64_t packets;
+    uint64_t sections;
+    _Atomic bool *stop;
+    pthread_t thread;
+} reader;
+
+static void* Reader_Loop(void *arg) {
+    reader *self = (reader *)arg;
+    uint64_t pos = 0;
+
+    while (!atomic_load_explicit(self->stop, memory_order_relaxed)) {
+        const acl_table *acl = Enter_ACL(&self->route);
+        for (int packet = 0; packet < SECTION; packet++) {
+            BENCH_KEEP(acl ? Filter_ACL(acl, &self->stream[pos]) : ACL_PERMIT);
+            if (++pos == self->len) pos = 0;
+        }
+        Exit_ACL(&self->route);
+        self->packets += SECTION;
+        self->sections++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Replace the rule set again and again while readers classify, as SIGHUP does under traffic.
+ *
+ * Two rule sets of the same size take turns; each replacement builds the new one, swaps it in and
+ * frees the old one once the readers' sections on it are closed. The readers' rate is compared
+ * with their rate without replacements.
+ *
+ * @return False if a rule set fails to build.
+ */
+static bool Bench_Replace(const acl_rule *rules, const acl_rule *other, int count, const acl_key *stream,
+                          uint64_t len, int num_readers, int replaces) {
+    control *ctrl = (control *)calloc(1, sizeof(control));
+    reader *readers = (reader *)calloc((size_t)num_readers, sizeof(reader));
+    if (!ctrl || !readers) {
+        free(ctrl);
+        free(readers);
+        return false;
+    }
+    atomic_init(&ctrl->acl, Build_ACL_Table(rules, count, ACL_PERMIT));
+    pthread_mutex_init(&ctrl->acl_lock, NULL);
+    _Atomic bool stop;
+    bool ok = atomic_load(&ctrl->acl) != NULL;
+
+    for (int phase = 0; phase < 2 && ok; phase++) {
+        atomic_init(&stop, false);
+        for (int idx = 0; idx < num_readers; idx++) {
+            readers[idx] = (reader){.stream = stream, .len = len, .stop = &stop};
+            readers[idx].route.ctrl = ctrl;
+            readers[idx].route.worker = idx;
+            pthread_create(&readers[idx].thread, NULL, Reader_Loop, &readers[idx]);
+        }
+
+        uint64_t start = Bench_Now(), build_ns = 0, swap_ns = 0, worst_swap = 0;
+        if (phase) {
+            for (int round = 0; round < replaces && ok; round++) {
+                uint64_t built = Bench_Now();
+                acl_table *acl = Build_ACL_Table(round % 2 ? rules : other, count, ACL_PERMIT);
+                uint64_t swapped = Bench_Now();
+                ok = acl != NULL;
+                if (ok) Replace_ACL(ctrl, acl);
+                uint64_t done = Bench_Now();
+                build_ns += swapped - built;
+                swap_ns += done - swapped;
+                if (done - swapped > worst_swap) worst_swap = done - swapped;
+            }
+        } else {
+            usleep(200000);
+        }
+        uint64_t elapsed = Bench_Now() - start;
+        atomic_store(&stop, true);
+
+        uint64_t packets = 0;
+        for (int idx = 0; idx < num_readers; idx++) {
+            pthread_join(readers[idx].thread, NULL);
+            packets += readers[idx].packets;
+        }
+        printf("%-32s %10.2f Mpkts/s over %d readers", phase ? "readers, replacing" : "readers, steady",
+               packets * 1e3 / (double)elapsed, num_readers);
+        if (phase && replaces) {
+            printf(", %d replacements: %.2f ms build, %.1f us swap (%.1f us worst)", replaces,
+                   build_ns / 1e6 / replaces, swap_ns / 1e3 / replaces, worst_swap / 1e3);
+        }
+        printf("\n");
+    }
+
+    Replace_ACL(ctrl, NULL);
+    pthread_mutex_destroy(&ctrl->acl_lock);
+    free(readers);
+    free(ctrl);
+    return ok;
+}
+
+/**
+ * @brief Build the classifier of a rule set, check it against the linear scan and benchmark it.
+ *
+ * @param title    The name of the rule set.
+ * @param rules    The rules.
+ * @param other    A rule set of the same size, to replace it with; NULL to skip the replacements.
+ * @param count    The number of rules.
+ * @param fallback The action of the packets no rule matches.
+ * @return         False if the classifier disagrees with the linear scan or fails to build.
+ */
+static bool Bench_Rules(const char *title, const acl_rule *rules, const acl_rule *other, int count, uint8_t fallback,
+                        uint64_t lookups, uint64_t checks, int num_readers, int replaces) {
+    acl_key *streams[2] = {(acl_key *)malloc(lookups * sizeof(acl_key)), (acl_key *)malloc(lookups * sizeof(acl_key))};
+    acl_table *acl = NULL;
+    bool ok = streams[0] && streams[1];
+    if (!ok) goto out;
+
+    if (count && checks * (uint64_t)count > CHECK_BUDGET) checks = CHECK_BUDGET / (uint64_t)count;
+    printf("=== %s: %d rules, %llu packets checked against the linear scan\n", title, count,
+           (unsigned long long)checks);
+
+    uint64_t start = Bench_Now();
+    acl = Build_ACL_Table(rules, count, fallback);
+    if (!acl) {
+        fprintf(stderr, "%s: cannot build the classifier\n", title);
+        ok = false;
+        goto out;
+    }
+    size_t bytes = Size_ACL_Table(acl);
+    printf("%-32s %10.2f MB %9.1f B/rule %9.1f ms to build\n", "tuples", bytes / 1048576.0,
+           count ? (double)bytes / count : 0.0, (Bench_Now() - start) / 1e6);
+    printf("%-32s %10u tuples %zu slots\n", "tuples", acl->num_tuples, acl->num_slots);
+
+    uint64_t mismatches = Check_Table(acl, rules, count, checks);
+    printf("%-32s %10llu mismatches\n", "tuples", (unsigned long long)mismatches);
+    ok = !mismatches;
+
+    uint64_t seed = 42;
+    for (uint64_t pos = 0; pos < lookups; pos++) {
+        streams[0][pos] = count ? Rule_Packet(rules, count, &seed) : Random_Packet(rules, count, &seed);
+        streams[1][pos] = Random_Packet(rules, count, &seed);
+    }
+    Bench_Stream(acl, "rule packets", streams[0], lookups);
+    Bench_Stream(acl, "random packets", streams[1], lookups);
+    Bench_Reference(rules, count, "rule packets", streams[0], lookups);
+    Bench_Reference(rules, count, "random packets", streams[1], lookups);
+
+    if (other && num_readers > 0) {
+        ok = Bench_Replace(rules, other, count, streams[0], lookups, num_readers, replaces) && ok;
+    }
+
+out:
+    Free_ACL_Table(&acl);
+    free(streams[0]);
+    free(streams[1]);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint64_t lookups = DEFAULT_LOOKUPS, checks = DEFAULT_CHECKS;
+    int sizes[8] = {1000, 10000}, num_sizes = 2, num_readers = DEFAULT_READERS, replaces = DEFAULT_REPLACES;
+    bool custom = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:s:r:R:")) != -1) {
+        switch (opt) {
+            case 'n': lookups = strtoull(optarg, NULL, 10); break;
+            case 'c': checks = strtoull(optarg, NULL, 10); break;
+            case 's':
+                if (!custom) num_sizes = 0;
+                custom = true;
+                if (num_sizes < 8) sizes[num_sizes++] = atoi(optarg);
+                break;
+            case 'r': num_readers = atoi(optarg); break;
+            case 'R': replaces = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n lookups] [-c checks] [-s synthetic rules]... [-r readers] "
+                        "[-R replacements] [acl...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (lookups < 1) lookups = 1;
+    if (num_readers > MAX_WORKERS) num_readers = MAX_WORKERS;
+
+    bool ok = true;
+    if (optind == argc) {
+        for (int size = 0; size < num_sizes; size++) {
+            acl_rule *rules = Synthetic_Rules(sizes[size], 0xac1), *other = Synthetic_Rules(sizes[size], 0xac2);
+            char title[64];
+            snprintf(title, sizeof(title), "synthetic %d rules", sizes[size]);
+            ok = rules && other && Bench_Rules(title, rules, other, sizes[size], ACL_PERMIT, lookups, checks,
+                                               num_readers, replaces) && ok;
+            free(rules);
+            free(other);
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for (int file = optind; file < argc; file++) {
+        int count = 0;
+        uint8_t fallback;
+        acl_rule *rules = Read_ACL_Rules(argv[file], &count, &fallback);
+        if (!rules) return EXIT_FAILURE;
+        ok = Bench_Rules(argv[file], rules, rules, count, fallback, lookups, checks, num_readers, replaces) && ok;
+        free(rules);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../utils/checksum.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#define HEADER_LEN      20
+#define PAYLOAD_LEN     1500
+
+/**
+ * @brief Check that every kernel agrees with the reference routine, on all lengths up to 2 KB.
+ *
+ * @return True if all the kernels agree.
+ */
+static bool Check_Kernels(void) {
+    static uint8_t data[2048 + 1];
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (size_t byte = 0; byte < sizeof(data); byte++) data[byte] = (uint8_t)Bench_Random(&seed);
+
+    for (size_t offset = 0; offset < 2; offset++) {
+        for (size_t len = 0; len <= 2048; len += 2) {
+            const uint8_t *buf = data + offset;
+            uint16_t expected = htons(Checksum((uint16_t *)(uintptr_t)buf, len));
+
+            uint16_t results[] = {
+                Checksum_Fold(Checksum_Sum_Scalar(buf, len, 0)),
+#if defined(__x86_64__) || defined(__i386__)
+                Checksum_Fold(Checksum_Sum_SSE2(buf, len, 0)),
+                __builtin_cpu_supports("avx2") ? Checksum_Fold(Checksum_Sum_AVX2(buf, len, 0)) : expected,
+#endif
+                Checksum_Fast(buf, len),
+            };
+            for (size_t kernel = 0; kernel < sizeof(results) / sizeof(results[0]); kernel++) {
+                if (results[kernel] != expected) {
+                    fprintf(stderr, "kernel %zu: len %zu offset %zu: %04x != %04x\n",
+                            kernel, len, offset, results[kernel], expected);
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Benchmark every checksum routine on a buffer of the given length.
+ *
+ * @param len   Length of the summed data.
+ * @param iters Number of iterations per routine.
+ */
+static void Bench_Length(size_t len, uint64_t iters) {
+    static uint8_t data[PAYLOAD_LEN + 64];
+    uint64_t seed = 42;
+    for (size_t byte = 0; byte < sizeof(data); byte++) data[byte] = (uint8_t)Bench_Random(&seed);
+
+    // A header carrying its own valid checksum, for the verify routines.
+    uint16_t *check = (uint16_t *)(data + 10);
+    *check = 0;
+    *check = Checksum_Fast(data, len);
+
+    bench_run run;
+    printf("--- %zu bytes\n", len);
+
+    Bench_Start(&run);
+    for (uint64_t iter = 0; iter < iters; iter++) {
+        BENCH_KEEP(data);
+        BENCH_KEEP(Checksum((uint16_t *)data, len));
+    }
+    Bench_Stop(&run);
+    Bench_Report("Checksum (reference)", &run, iters);
+
+    Bench_Start(&run);
+    for (uint64_t iter = 0; iter < iters; iter++) {
+        BENCH_KEEP(data);
+        BENCH_KEEP(Checksum_Fold(Checksum_Sum_Scalar(data, len, 0)));
+    }
+    Bench_Stop(&run);
+    Bench_Report("Checksum_Sum_Scalar (64-bit)", &run, iters);
+
+#if defined(__x86_64__) || defined(__i386__)
+    Bench_Start(&run);
+    for (uint64_t iter = 0; iter < iters; iter++) {
+        BENCH_KEEP(data);
+        BENCH_KEEP(Checksum_Fold(Checksum_Sum_SSE2(data, len, 0)));
+    }
+    Bench_Stop(&run);
+    Bench_Report("Checksum_Sum_SSE2", &run, iters);
+
+    if (__builtin_cpu_supports("avx2")) {
+        Bench_Start(&run);
+        for (uint64_t iter = 0; iter < iters; iter++) {
+            BENCH_KEEP(data);
+            BENCH_KEEP(Checksum_Fold(Checksum_Sum_AVX2(data, len, 0)));
+        }
+        Bench_Stop(&run);
+        Bench_Report("Checksum_Sum_AVX2", &run, iters);
+    }
+#endif
+
+    Bench_Start(&run);
+    for (uint64_t iter = 0; iter < iters; iter++) {
+        BENCH_KEEP(data);
+        BENCH_KEEP(Checksum_Fast(data, len));
+    }
+    Bench_Stop(&run);
+    Bench_Report("Checksum_Fast", &run, iters);
+
+    // Verify as Handler_IPV4 used to: save, zero, recompute, compare (writes the header).
+    Bench_Start(&run);
+    for (uint64_t iter = 0; iter < iters; iter++) {
+        BENCH_KEEP(data);
+        uint16_t old_check = *check;
+        *check = 0;
+        bool valid = old_check == htons(Checksum((uint16_t *)data, len));
+        *check = old_check;
+        BENCH_KEEP(valid);
+    }
+    Bench_Stop(&run);
+    Bench_Report("verify: zero + Checksum", &run, iters);
+
+    Bench_Start(&run);
+    for (uint64_t iter = 0; iter < iters; iter++) {
+        BENCH_KEEP(data);
+        BENCH_KEEP(Checksum_Valid(data, len));
+    }
+    Bench_Stop(&run);
+    Bench_Report("verify: Checksum_Valid", &run, iters);
+}
+
+int main(int argc, char **argv) {
+    uint64_t iters = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+
+    if (!Check_Kernels()) {
+        fprintf(stderr, "checksum kernels disagree with the reference\n");
+        return EXIT_FAILURE;
+    }
+    printf("checksum kernels agree with the reference on 0..2048 bytes\n");
+
+    Bench_Length(HEADER_LEN, iters);
+    Bench_Length(PAYLOAD_LEN, iters / 10);
+
+    return EXIT_SUCCESS;
+}
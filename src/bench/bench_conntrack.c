@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../res/nat/conntrack.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_FLOWS       (1u << 20)
+#define DEFAULT_LOOKUPS     4000000
+#define DEFAULT_READERS     2
+#define DEFAULT_CHURN_MS    1000
+#define MAX_READERS         16
+#define VECTOR              256                 // Lookups per batch, a pipeline vector.
+#define STABLE_FLOWS        65536               // Flows the readers look up while the writer churns.
+#define CHURN_PER_SECOND    16384               // Flows the writer creates per second of the table's clock.
+#define NAT_ADDR            0xc0000101u         // 192.0.1.1
+
+// A tuple from a host of 10.0.0.0/8 to anywhere, TCP or UDP, from an ephemeral port.
+static ct_tuple Random_Tuple(uint64_t *seed) {
+    ct_tuple key;
+    memset(&key, 0, sizeof(key));
+    uint64_t bits = Bench_Random(seed);
+    key.saddr = htonl(0x0a000000u | (uint32_t)(bits & 0xffffff));
+    key.daddr = htonl((uint32_t)(bits >> 24));
+    bits = Bench_Random(seed);
+    key.sport = htons((uint16_t)(32768 + (bits & 0x7fff)));
+    key.dport = htons(bits & 0x10000 ? 443 : (uint16_t)(bits >> 17));
+    key.proto = bits & 0x10000 ? IPPROTO_TCP : IPPROTO_UDP;
+    return key;
+}
+
+/**
+ * @brief Fill a table with random flows.
+ *
+ * @param ct      The table.
+ * @param flows   The flows to create.
+ * @param keys    Receives the original and reply tuple of every flow, in turn.
+ * @param seed    The generator's state.
+ * @param created Receives the flows actually created.
+ * @return The time the insertions took.
+ */
+static bench_run Fill_Table(conntrack *ct, uint32_t flows, ct_tuple *keys, uint64_t *seed, uint32_t *created) {
+    bench_run run;
+    *created = 0;
+    Bench_Start(&run);
+    for (uint32_t flow = 0; flow < flows; flow++) {
+        ct_tuple original = Random_Tuple(seed), reply;
+        if (Insert_Conntrack(ct, &original, htonl(NAT_ADDR), &reply) == CT_NONE) continue;
+        keys[2 * *created] = original;
+        keys[2 * *created + 1] = reply;
+        (*created)++;
+    }
+    Bench_Stop(&run);
+    return run;
+}
+
+/**
+ * @brief Time single and batched lookups of a stream of tuples.
+ *
+ * @return The lookups that did not find what was expected: a flow for a hit, none for a miss.
+ */
+static uint64_t Bench_Lookups(const conntrack *ct, const char *name, const ct_tuple *stream, uint64_t len, bool hits) {
+    ct_tuple others[VECTOR];
+    uint32_t refs[VECTOR];
+    uint64_t wrong = 0;
+    char label[64];
+    bench_run run;
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) {
+        uint32_t ref = Lookup_Conntrack(ct, &stream[pos], Hash_CT_Tuple(&stream[pos]), &others[0]);
+        wrong += (ref != CT_NONE) != hits;
+    }
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "lookup %s", name);
+    Bench_Report(label, &run, len);
+
+    Bench_Start(&run);
+    for (uint64_t base = 0; base + VECTOR <= len; base += VECTOR) {
+        Lookup_Conntrack_Batch(ct, &stream[base], VECTOR, refs, others);
+        for (int key = 0; key < VECTOR; key++) wrong += (refs[key] != CT_NONE) != hits;
+    }
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "lookup %s, batch of %d", name, VECTOR);
+    Bench_Report(label, &run, len / VECTOR * VECTOR);
+    return wrong;
+}
+
+// A worker looking up the same flows, both directions, while another creates and expires others.
+typedef struct reader {
+    conntrack *ct;
+    const ct_tuple *keys;           // Original and reply tuple of every stable flow.
+    uint32_t flows;
+    uint64_t lookups;
+    uint64_t lost;                  // Lookups of a stable flow that did not find it.
+    _Atomic bool *stop;
+    pthread_t thread;
+} reader;
+
+static void* Reader_Loop(void *arg) {
+    reader *self = (reader *)arg;
+    ct_tuple others[VECTOR];
+    uint32_t refs[VECTOR];
+    uint32_t keys = 2 * self->flows, pos = 0;
+
+    while (!atomic_load_explicit(self->stop, memory_order_relaxed)) {
+        Lookup_Conntrack_Batch(self->ct, &self->keys[pos], VECTOR, refs, others);
+        for (int key = 0; key < VECTOR; key++) {
+            if (refs[key] == CT_NONE || (refs[key] & 1) != (pos + key) % 2) {
+                self->lost++;
+                continue;
+            }
+            // The replies keep the flows alive, as they would in the pipeline.
+            Touch_Conntrack(self->ct, refs[key], 0);
+        }
+        self->lookups += VECTOR;
+        pos = (pos + VECTOR) % keys;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Look up stable flows from readers while a writer creates short-lived ones and expires them.
+ *
+ * The writer runs the table's clock faster than real time: every CHURN_PER_SECOND flows it
+ * creates it advances the clock a second and expires the flows idle for their timeout, so the
+ * keys keep moving between buckets and the flows keep being reused under the readers.
+ *
+ * @return False if a reader lost a stable flow.
+ */
+static bool Bench_Churn(uint32_t flows, int num_readers, uint64_t churn_ms) {
+    conntrack *ct = Create_Conntrack(flows);
+    ct_tuple *stable = (ct_tuple *)malloc(2 * STABLE_FLOWS * sizeof(ct_tuple));
+    reader *readers = (reader *)calloc((size_t)num_readers, sizeof(reader));
+    if (!ct || !stable || !readers) {
+        Free_Conntrack(&ct);
+        free(stable);
+        free(readers);
+        return false;
+    }
+
+    uint64_t seed = 0xc7c7;
+    uint32_t created;
+    Fill_Table(ct, STABLE_FLOWS, stable, &seed, &created);
+    created -= created % (VECTOR / 2);
+    for (uint32_t key = 1; key < 2 * created; key += 2) {
+        uint32_t ref = Lookup_Conntrack(ct, &stable[key], Hash_CT_Tuple(&stable[key]), &stable[key - 1]);
+        Touch_Conntrack(ct, ref, 0);
+    }
+
+    _Atomic bool stop;
+    atomic_init(&stop, false);
+    for (int idx = 0; idx < num_readers; idx++) {
+        readers[idx] = (reader){.ct = ct, .keys = stable, .flows = created, .stop = &stop};
+        pthread_create(&readers[idx].thread, NULL, Reader_Loop, &readers[idx]);
+    }
+
+    uint64_t start = Bench_Now(), inserts = 0, refused = 0, expired = 0;
+    uint32_t now = 0;
+    while (Bench_Now() - start < churn_ms * 1000000ull) {
+        for (int flow = 0; flow < CHURN_PER_SECOND; flow++) {
+            ct_tuple original = Random_Tuple(&seed), reply;
+            refused += Insert_Conntrack(ct, &original, htonl(NAT_ADDR), &reply) == CT_NONE;
+        }
+        inserts += CHURN_PER_SECOND;
+        expired += Expire_Conntrack(ct, ++now);
+    }
+    uint64_t elapsed = Bench_Now() - start;
+
+    atomic_store(&stop, true);
+    uint64_t lookups = 0, lost = 0;
+    for (int idx = 0; idx < num_readers; idx++) {
+        pthread_join(readers[idx].thread, NULL);
+        lookups += readers[idx].lookups;
+        lost += readers[idx].lost;
+    }
+
+    printf("churn: %d readers, %.2f Mlookups/s each, %llu lost; writer %.2f Minserts/s (%llu refused), "
+           "%llu expired, %u seconds of clock\n", num_readers,
+           num_readers ? lookups * 1e3 / (double)elapsed / num_readers : 0.0, (unsigned long long)lost,
+           inserts * 1e3 / (double)elapsed, (unsigned long long)refused, (unsigned long long)expired, now);
+    Dump_Conntrack(stdout, ct);
+
+    Free_Conntrack(&ct);
+    free(stable);
+    free(readers);
+    return lost == 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t flows = DEFAULT_FLOWS;
+    uint64_t lookups = DEFAULT_LOOKUPS, churn_ms = DEFAULT_CHURN_MS;
+    int num_readers = DEFAULT_READERS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:n:r:d:")) != -1) {
+        switch (opt) {
+            case 'f': flows = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'n': lookups = strtoull(optarg, NULL, 10); break;
+            case 'r': num_readers = atoi(optarg); break;
+            case 'd': churn_ms = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-f flows] [-n lookups] [-r readers] [-d churn ms]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (flows < STABLE_FLOWS) flows = STABLE_FLOWS;
+    if (flows > CT_MAX_FLOWS) flows = CT_MAX_FLOWS;
+    if (lookups < VECTOR) lookups = VECTOR;
+    if (num_readers < 0) num_readers = 0;
+    if (num_readers > MAX_READERS) num_readers = MAX_READERS;
+
+    conntrack *ct = Create_Conntrack(flows);
+    ct_tuple *keys = (ct_tuple *)malloc(2 * (size_t)flows * sizeof(ct_tuple));
+    ct_tuple *stream = (ct_tuple *)malloc(lookups * sizeof(ct_tuple));
+    if (!ct || !keys || !stream) {
+        fprintf(stderr, "ERROR: NO MEMORY FOR %u FLOWS...\n", flows);
+        return EXIT_FAILURE;
+    }
+
+    // Every flow the table holds, the buckets filled to CT_MAX_LOAD percent at most.
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    uint32_t created;
+    bench_run run = Fill_Table(ct, flows, keys, &seed, &created);
+    Bench_Report("insert", &run, flows);
+    Dump_Conntrack(stdout, ct);
+
+    // Hits in both directions, spread over the whole table, then tuples of no flow.
+    for (uint64_t pos = 0; pos < lookups; pos++) {
+        stream[pos] = keys[Bench_Random(&seed) % (2 * (uint64_t)created)];
+    }
+    uint64_t wrong = Bench_Lookups(ct, "hits", stream, lookups, true);
+    for (uint64_t pos = 0; pos < lookups; pos++) stream[pos] = Random_Tuple(&seed);
+    wrong += Bench_Lookups(ct, "misses", stream, lookups, false);
+
+    // Every flow idle past its timeout at once, the worst second of the wheel.
+    Bench_Start(&run);
+    uint64_t expired = Expire_Conntrack(ct, CT_TIMEOUT_NEW);
+    Bench_Stop(&run);
+    Bench_Report("expire", &run, expired ? expired : 1);
+    Dump_Conntrack(stdout, ct);
+
+    Free_Conntrack(&ct);
+    free(keys);
+    free(stream);
+
+    bool ok = Bench_Churn(flows, num_readers, churn_ms);
+    if (wrong) printf("%llu lookups found the wrong answer\n", (unsigned long long)wrong);
+    return ok && !wrong ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../include/router.h"
+#include "../res/ctl/ctl_server.h"
+#include "../res/ipv4/vrf.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_PREFIXES    200000
+#define DEFAULT_BATCH       1000                // Changes per transaction.
+#define DEFAULT_ROUNDS      200                 // Transactions.
+#define DEFAULT_READERS     2
+#define DEFAULT_CHECKS      (1u << 20)
+#define PROBES              64                  // Prefixes every transaction moves together, MAX_BATCH at most.
+#define PROBE_NETWORK       0x64400000u         // 100.64.0.0, the probes' /24s, kept out of the base table.
+#define FAILED_PREFIXES     1000                // Routes of the VRFs of the failed transaction check.
+
+// Trie nodes Pool_Alloc hands out before it fails, -1 for no limit: the link wraps it (--wrap=Pool_Alloc).
+static long pool_budget = -1;
+static uint64_t pool_allocs;
+
+void *__real_Pool_Alloc(huge_pool *pool);
+void *__wrap_Pool_Alloc(huge_pool *pool) {
+    if (!pool_budget) return NULL;
+    if (pool_budget > 0) pool_budget--;
+    pool_allocs++;
+    return __real_Pool_Alloc(pool);
+}
+
+static ctl_op Route_Op(uint8_t op, const route *path) {
+    ctl_op change = {.op = op, .length = (uint8_t)__builtin_popcount(path->mask), .interface = (int8_t)path->interface,
+                     .address = path->prefix};
+    change.next_hop = path->next_hop;
+    return change;
+}
+
+// A worker forwarding vectors with whatever trie is published, checking the probes moved together.
+typedef struct reader {
+    routing route;
+    uint64_t lookups;
+    uint64_t torn;              // Vectors that saw the probes of two transactions.
+    uint64_t seed;
+    _Atomic bool *stop;
+    pthread_t thread;
+} reader;
+
+static void* Reader_Loop(void *arg) {
+    reader *self = (reader *)arg;
+    uint32_t ips[MAX_BATCH];
+    int interfaces[MAX_BATCH] = {0};
+    forward lpms[MAX_BATCH];
+
+    while (!atomic_load_explicit(self->stop, memory_order_relaxed)) {
+        // The probes first, then random addresses as the rest of a vector.
+        for (int pos = 0; pos < MAX_BATCH; pos++) {
+            ips[pos] = pos < PROBES ? htonl(PROBE_NETWORK | (uint32_t)pos << 8 | 1) : (uint32_t)Bench_Random(&self->seed);
+        }
+        Enter_FIB(&self->route);
+        Lookup_Routes(&self->route, ips, interfaces, MAX_BATCH, lpms);
+        Exit_FIB(&self->route);
+
+        for (int pos = 1; pos < PROBES; pos++) {
+            if (lpms[pos].status != lpms[0].status || lpms[pos].next_hop != lpms[0].next_hop) {
+                self->torn++;
+                break;
+            }
+        }
+        self->lookups += MAX_BATCH;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Look up random addresses in the changed table and in one built from the final routes.
+ *
+ * @return The number of mismatches.
+ */
+static uint64_t Check_Table(ipv4_table *changed, const route *routes, const bool *present, int count,
+                            uint32_t probe_hop, uint64_t checks) {
+    route *final = (route *)malloc((count + PROBES) * sizeof(route));
+    if (!final) return checks;
+    int kept = 0;
+    for (int idx = 0; idx < count; idx++) {
+        if (present[idx]) final[kept++] = routes[idx];
+    }
+    for (int probe = 0; probe < PROBES; probe++) {
+        final[kept++] = (route){.prefix = htonl(PROBE_NETWORK | (uint32_t)probe << 8), .next_hop = probe_hop,
+                                .mask = htonl(0xffffff00u), .interface = 0};
+    }
+    ipv4_table *built = Build_IPV4_Table(final, kept);
+    free(final);
+    if (!built) return checks;
+
+    uint64_t seed = 0xc4ec, mismatches = 0;
+    for (uint64_t check = 0; check < checks; check++) {
+        // Half of the addresses in the routes, the others anywhere.
+        uint32_t ip = (uint32_t)Bench_Random(&seed);
+        if (check & 1) {
+            const route *path = &routes[Bench_Random(&seed) % (uint64_t)count];
+            ip = path->prefix | (ip & ~path->mask);
+        }
+        forward want, got;
+        bool found = Lookup_IPV4_Table(built, ip, &want);
+        if (found != Lookup_IPV4_Table(changed, ip, &got) ||
+            (found && (want.next_hop != got.next_hop || want.interface != got.interface))) {
+            if (mismatches++ < 5) {
+                struct in_addr addr = {.s_addr = ip};
+                printf("  mismatch for %s\n", inet_ntoa(addr));
+            }
+        }
+    }
+    Free_IPV4_Table(&built);
+    return mismatches;
+}
+
+// Routes of the base table (none in the first byte of the probes, which move on their own),
+// one per prefix. NULL if memory allocation fails.
+static route* Base_Routes(int prefixes, uint64_t seed, int *count) {
+    route *routes = Bench_Routes(prefixes, seed);
+    if (!routes) return NULL;
+    for (int idx = 0; idx < prefixes; idx++) {
+        if ((ntohl(routes[idx].prefix) >> 24) == (PROBE_NETWORK >> 24)) routes[idx].prefix ^= htonl(0x01000000u);
+    }
+    *count = Bench_Unique_Routes(routes, prefixes);
+    return routes;
+}
+
+// A control state with two VRFs of the same routes, in one VRF set.
+static control* VRF_Control(const route *routes, int count) {
+    control *ctrl = Create_Control(NULL, NULL, false);
+    if (!ctrl) return NULL;
+    ipv4_table *tables[2] = {Build_IPV4_Table(routes, count), Build_IPV4_Table(routes, count)};
+    if (tables[0] && tables[1]) ctrl->vrfs = Create_VRF_Set(tables, 2);
+    if (!ctrl->vrfs) {
+        Free_IPV4_Table(&tables[0]);
+        Free_IPV4_Table(&tables[1]);
+        Free_Control(ctrl);
+        return NULL;
+    }
+    ctrl->ipv4s = ctrl->vrfs->tables[0];
+    return ctrl;
+}
+
+static ctl_op Neighbor_Op(uint32_t address, uint8_t last) {
+    ctl_op change = {.op = CTL_NEIGH_ADD, .address = htonl(address), .mac = {0x02, 0, 0, 0, 0, last}};
+    return change;
+}
+
+// Whether the routes of a VRF are those listed before.
+static bool Same_Routes(const ipv4_table *table, const route *before, int count) {
+    int num_routes = 0;
+    route *now = List_IPV4_Routes(table, &num_routes);
+    bool same = now && num_routes == count && !memcmp(now, before, count * sizeof(route));
+    free(now);
+    return same;
+}
+
+// Whether an address is resolved to the MAC of a Neighbor_Op, or not resolved for 0.
+static bool Resolves_To(control *ctrl, uint32_t address, uint8_t last) {
+    int entry = Get_ARP_Entry(ctrl->macs, htonl(address));
+    return last ? entry >= 0 && ctrl->macs->addrs[entry].mac[5] == last : entry < 0;
+}
+
+/**
+ * @brief Fail a transaction on its second VRF (Pool_Alloc runs out after the first VRF's copy)
+ *        and check that it left the routes of both VRFs and the neighbors as they were, then
+ *        commit it again and check that all of it is seen.
+ *
+ * @return True if the check passed.
+ */
+static bool Check_Failed_Commit(void) {
+    int count = 0;
+    route *routes = Base_Routes(FAILED_PREFIXES, 0xfa11, &count);
+    control *ctrl = routes ? VRF_Control(routes, count) : NULL;
+    control *twin = routes ? VRF_Control(routes, count) : NULL;
+    if (!ctrl || !twin) return false;
+
+    // A static neighbor to replace, then the transaction: the neighbor replaced and a new one,
+    // a route withdrawn and one added in VRF 0, one added in VRF 1.
+    uint32_t index = 0;
+    ctl_op setup = Neighbor_Op(0xc0000201u, 1);
+    bool ok = Commit_Control_Ops(ctrl, &setup, 1, &index) == 1;
+
+    ctl_op ops[5] = {Neighbor_Op(0xc0000201u, 2), Neighbor_Op(0xc0000202u, 3), Route_Op(CTL_ROUTE_DEL, &routes[0])};
+    route added = {.prefix = htonl(PROBE_NETWORK), .next_hop = htonl(0xc0000202u), .mask = htonl(0xffffff00u)};
+    ops[3] = Route_Op(CTL_ROUTE_ADD, &added);
+    added.prefix = htonl(PROBE_NETWORK | 0x10000u);
+    ops[4] = Route_Op(CTL_ROUTE_ADD, &added);
+    ops[4].vrf = 1;
+
+    // The nodes VRF 0's changes take, on a twin of the control state.
+    pool_allocs = 0;
+    ok = ok && Commit_Control_Ops(twin, ops, 4, &index) == 4;
+    long first_vrf = (long)pool_allocs;
+
+    int num_routes[2] = {0, 0};
+    route *before[2] = {List_IPV4_Routes(ctrl->vrfs->tables[0], &num_routes[0]),
+                        List_IPV4_Routes(ctrl->vrfs->tables[1], &num_routes[1])};
+    pool_budget = first_vrf;
+    int status = Commit_Control_Ops(ctrl, ops, 5, &index);
+    pool_budget = -1;
+    bool failed = status == CTL_ENOMEM && index == 4;
+    bool unchanged = before[0] && before[1] && Same_Routes(ctrl->vrfs->tables[0], before[0], num_routes[0]) &&
+                     Same_Routes(ctrl->vrfs->tables[1], before[1], num_routes[1]) &&
+                     ctrl->vrfs->tables[0]->size == (size_t)num_routes[0] && Resolves_To(ctrl, 0xc0000201u, 1) &&
+                     Resolves_To(ctrl, 0xc0000202u, 0);
+
+    // Committed again with memory, all of it is seen.
+    forward lpm;
+    bool applied = Commit_Control_Ops(ctrl, ops, 5, &index) == 5 &&
+                   Lookup_IPV4_Table(ctrl->vrfs->tables[0], htonl(PROBE_NETWORK | 1), &lpm) &&
+                   Lookup_IPV4_Table(ctrl->vrfs->tables[1], htonl(PROBE_NETWORK | 0x10001u), &lpm) &&
+                   ctrl->vrfs->tables[0]->size == (size_t)num_routes[0] && Resolves_To(ctrl, 0xc0000201u, 2) &&
+                   Resolves_To(ctrl, 0xc0000202u, 3);
+
+    printf("%-32s %s after %ld nodes of VRF 0, %s, %s when committed again\n", "failed transaction",
+           failed ? "ENOMEM on VRF 1" : "did not fail", first_vrf, unchanged ? "tables unchanged" : "TABLES CHANGED",
+           applied ? "applied" : "NOT APPLIED");
+
+    free(before[0]);
+    free(before[1]);
+    Free_Control(twin);
+    Free_Control(ctrl);
+    free(routes);
+    return ok && failed && unchanged && applied;
+}
+
+int main(int argc, char **argv) {
+    int prefixes = DEFAULT_PREFIXES, batch = DEFAULT_BATCH, rounds = DEFAULT_ROUNDS, num_readers = DEFAULT_READERS;
+    uint64_t checks = DEFAULT_CHECKS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:b:r:w:c:")) != -1) {
+        switch (opt) {
+            case 's': prefixes = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'w': num_readers = atoi(optarg); break;
+            case 'c': checks = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s prefixes] [-b changes per transaction] [-r transactions] [-w readers] "
+                        "[-c checks]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (prefixes < 1 || batch < PROBES || batch > CTL_MAX_OPS || rounds < 1 || num_readers < 0 ||
+        num_readers > MAX_WORKERS) {
+        fprintf(stderr, "at least %d changes per transaction, at most %d; at most %d readers\n", PROBES, CTL_MAX_OPS,
+                MAX_WORKERS);
+        return EXIT_FAILURE;
+    }
+
+    if (!Check_Failed_Commit()) return EXIT_FAILURE;
+
+    int count = 0;
+    route *routes = Base_Routes(prefixes, 0x5eed, &count);
+    if (!routes) return EXIT_FAILURE;
+    bool *present = (bool *)malloc(count * sizeof(bool));
+    ctl_op *ops = (ctl_op *)malloc(batch * sizeof(ctl_op));
+    reader *readers = (reader *)calloc(num_readers ? num_readers : 1, sizeof(reader));
+    control *ctrl = Create_Control(NULL, NULL, false);
+    if (!present || !ops || !readers || !ctrl) return EXIT_FAILURE;
+    for (int idx = 0; idx < count; idx++) present[idx] = true;
+    ctrl->ipv4s = Build_IPV4_Table(routes, count);
+    if (!ctrl->ipv4s) return EXIT_FAILURE;
+    size_t nodes = ctrl->ipv4s->nodes;
+    printf("%d prefixes, %zu nodes, %d transactions of %d changes, %d readers\n", count, nodes, rounds, batch,
+           num_readers);
+
+    _Atomic bool stop;
+    atomic_init(&stop, false);
+    for (int idx = 0; idx < num_readers; idx++) {
+        readers[idx] = (reader){.seed = 0x10c4 + (uint64_t)idx, .stop = &stop};
+        readers[idx].route.ctrl = ctrl;
+        readers[idx].route.worker = idx;
+        pthread_create(&readers[idx].thread, NULL, Reader_Loop, &readers[idx]);
+    }
+
+    // Every transaction moves the probes to a next hop of its own, and withdraws or restores
+    // (with another next hop) random routes of the base table.
+    uint64_t seed = 0xc0de, took = 0, worst = 0;
+    uint32_t probe_hop = 0;
+    bool ok = true;
+    for (int round = 0; round < rounds && ok; round++) {
+        probe_hop = htonl(0xac100000u | (uint32_t)round);
+        for (int probe = 0; probe < PROBES; probe++) {
+            route path = {.prefix = htonl(PROBE_NETWORK | (uint32_t)probe << 8), .next_hop = probe_hop,
+                          .mask = htonl(0xffffff00u), .interface = 0};
+            ops[probe] = Route_Op(CTL_ROUTE_ADD, &path);
+        }
+        for (int change = PROBES; change < batch; change++) {
+            route *path = &routes[Bench_Random(&seed) % (uint64_t)count];
+            if (present[path - routes]) {
+                ops[change] = Route_Op(CTL_ROUTE_DEL, path);
+            } else {
+                path->next_hop = htonl(0x0a000000u | (uint32_t)(Bench_Random(&seed) & 0xffff));
+                ops[change] = Route_Op(CTL_ROUTE_ADD, path);
+            }
+            present[path - routes] = !present[path - routes];
+        }
+
+        uint32_t index = 0;
+        uint64_t start = Bench_Now();
+        int status = Check_Control_Ops(ctrl, ops, batch, &index);
+        if (status == CTL_OK) status = Commit_Control_Ops(ctrl, ops, batch, &index);
+        uint64_t done = Bench_Now() - start;
+        if (status != batch) {
+            fprintf(stderr, "transaction %d failed: %d at change %u\n", round, status, index);
+            ok = false;
+        }
+        took += done;
+        if (done > worst) worst = done;
+    }
+    atomic_store(&stop, true);
+
+    uint64_t lookups = 0, torn = 0;
+    for (int idx = 0; idx < num_readers; idx++) {
+        pthread_join(readers[idx].thread, NULL);
+        lookups += readers[idx].lookups;
+        torn += readers[idx].torn;
+    }
+    if (!ok) return EXIT_FAILURE;
+
+    uint64_t changes = (uint64_t)rounds * (uint64_t)batch;
+    printf("%-32s %10.0f changes/s %9.1f us/transaction (%.1f us worst)\n", "Commit_Control_Ops",
+           changes * 1e9 / (double)took, took / 1e3 / rounds, worst / 1e3);
+    printf("%-32s %10.2f Mlookups/s meanwhile, %llu vectors saw two transactions\n", "readers",
+           took ? lookups * 1e3 / (double)took : 0.0, (unsigned long long)torn);
+    printf("%-32s %10zu nodes, %zu garbage, %.1f MB\n", "table", ctrl->ipv4s->nodes, ctrl->ipv4s->garbage,
+           Size_IPV4_Table(ctrl->ipv4s) / 1048576.0);
+
+    uint64_t mismatches = Check_Table(ctrl->ipv4s, routes, present, count, probe_hop, checks);
+    printf("%llu lookups checked against a table built from the final routes, %llu mismatches\n",
+           (unsigned long long)checks, (unsigned long long)mismatches);
+
+    Free_Control(ctrl);
+    free(readers);
+    free(ops);
+    free(present);
+    free(routes);
+    return mismatches || torn ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../res/ipv4/ipv4_table.h"
+#include "../res/ipv4/flow_cache.h"
+
+#include <arpa/inet.h>
+
+#define RTABLE          "rtable0.txt"
+#define STREAM_LEN      (1 << 20)
+
+/**
+ * @brief Collect one destination per route of a routing table file, a random host inside its prefix.
+ *
+ * @param file  The routing table file.
+ * @param count Set to the number of destinations.
+ * @return The destinations (network order) or NULL on failure.
+ */
+static uint32_t* Load_Destinations(const char *file, uint32_t *count) {
+    FILE *fin = fopen(file, "r");
+    if (!fin) return NULL;
+
+    size_t cap = 1024;
+    uint32_t *daddrs = (uint32_t *)malloc(cap * sizeof(uint32_t));
+    char prefix[32], next_hop[32], mask[32];
+    uint64_t seed = 7;
+    *count = 0;
+
+    while (daddrs && fscanf(fin, "%31s %31s %31s %*d", prefix, next_hop, mask) == 3) {
+        struct in_addr net, netmask;
+        if (!inet_aton(prefix, &net) || !inet_aton(mask, &netmask)) continue;
+
+        if (*count == cap) {
+            uint32_t *grown = (uint32_t *)realloc(daddrs, (cap *= 2) * sizeof(uint32_t));
+            if (!grown) free(daddrs);
+            daddrs = grown;
+            if (!daddrs) break;
+        }
+        uint32_t host = (uint32_t)Bench_Random(&seed) & ~netmask.s_addr;
+        daddrs[(*count)++] = net.s_addr | host;
+    }
+
+    fclose(fin);
+    return daddrs;
+}
+
+/**
+ * @brief Benchmark the plain FIB walk against the flow cache on one destination stream.
+ *
+ * @param name    The name of the distribution.
+ * @param table   The FIB.
+ * @param stream  The destinations, in arrival order.
+ * @param len     The length of the stream.
+ */
+static void Bench_Stream(const char *name, ipv4_table *table, const uint32_t *stream, uint64_t len) {
+    bench_run run;
+    forward lpm;
+    printf("--- %s\n", name);
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) {
+        BENCH_KEEP(Lookup_IPV4_Table(table, stream[pos], &lpm));
+        BENCH_KEEP(lpm);
+    }
+    Bench_Stop(&run);
+    Bench_Report("Lookup_IPV4_Table", &run, len);
+
+    flow_cache *cache = Create_Flow_Cache();
+    if (!cache) return;
+
+    // Same work as the lookup and rewrite stages: probe, fall back to the FIB, fill.
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) {
+        const flow_entry *flow = Lookup_Flow(cache, stream[pos], 0, 1);
+        if (!flow) {
+            flow_entry entry = {.daddr = stream[pos], .generation = 1};
+            if (Lookup_IPV4_Table(table, stream[pos], &lpm)) {
+                entry.next_hop = lpm.next_hop;
+                entry.interface = (int16_t)lpm.interface;
+            }
+            Insert_Flow(cache, &entry);
+            flow = &entry;
+        }
+        BENCH_KEEP(flow->next_hop);
+    }
+    Bench_Stop(&run);
+    Bench_Report("Lookup_Flow + fallback", &run, len);
+
+    uint64_t hits = COUNTER_GET(cache->hits), misses = COUNTER_GET(cache->misses);
+    printf("%-32s %10.2f %% hits\n", "flow cache", 100.0 * hits / (hits + misses));
+    Free_Flow_Cache(&cache);
+}
+
+int main(int argc, char **argv) {
+    char *file = argc > 1 ? argv[1] : RTABLE;
+
+    ipv4_table *table = Create_IPV4_Table(file);
+    uint32_t count = 0;
+    uint32_t *daddrs = Load_Destinations(file, &count);
+    uint32_t *stream = (uint32_t *)malloc(STREAM_LEN * sizeof(uint32_t));
+    if (!table || !daddrs || !count || !stream) {
+        fprintf(stderr, "cannot load %s\n", file);
+        return EXIT_FAILURE;
+    }
+    printf("%u destinations, %d lookups per run\n", count, STREAM_LEN);
+
+    uint64_t seed = 42;
+    for (int pos = 0; pos < STREAM_LEN; pos++) stream[pos] = daddrs[Bench_Random(&seed) % count];
+    Bench_Stream("uniform", table, stream, STREAM_LEN);
+
+    const double exponents[] = {0.9, 1.1};
+    for (size_t exp = 0; exp < sizeof(exponents) / sizeof(exponents[0]); exp++) {
+        bench_zipf zipf;
+        if (!Bench_Zipf_Init(&zipf, count, exponents[exp])) return EXIT_FAILURE;
+        for (int pos = 0; pos < STREAM_LEN; pos++) stream[pos] = daddrs[Bench_Zipf_Next(&zipf, &seed)];
+        Bench_Zipf_Free(&zipf);
+
+        char name[32];
+        snprintf(name, sizeof(name), "zipf s=%.1f", exponents[exp]);
+        Bench_Stream(name, table, stream, STREAM_LEN);
+    }
+
+    free(stream);
+    free(daddrs);
+    Free_IPV4_Table(&table);
+    return EXIT_SUCCESS;
+}
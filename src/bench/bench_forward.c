@@ -0,0 +1,564 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "./fake_link.h"
+#include "../include/router.h"
+#include "../res/ipv4/ipv4.h"
+#include "../res/arp/arp.h"
+#include "../res/icmp/icmp.h"
+#include "../res/pipeline/pipeline.h"
+
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_PACKETS     2000000
+#define DEFAULT_DESTS       1000
+#define DEFAULT_FRAME_LEN   60
+#define TRACE_LEN           8192
+#define UDP_HDR_LEN         8
+#define FRAG_MTU            576             // Egress MTU of the fragmentation check.
+#define FRAG_FRAME_LEN      1400            // Its frame, with options, fragmented in three.
+
+// Traffic mixes replayed against the forwarding code.
+typedef enum mix {
+    MIX_FORWARD,            // Resolved destinations, everything goes out.
+    MIX_ARP_MISS,           // The neighbors are forgotten every vector, every packet waits for ARP.
+    MIX_TTL_EXPIRED,        // TTL 1, every packet gets an ICMP Time Exceeded.
+    MIX_BAD_CHECKSUM,       // Corrupted IPv4 checksum, every packet is dropped.
+    MIX_ECHO,               // Echo requests to the ingress interface, every packet is answered.
+    MIX_PCAP,               // Frames of a capture, neighbors of its destinations resolved.
+} mix;
+
+static const char *mix_names[] = {"all-forward", "arp-miss", "ttl-expired", "bad-checksum", "echo", "pcap"};
+
+// A synthetic or captured trace and the neighbors it needs resolved.
+typedef struct trace {
+    fake_frame frames[TRACE_LEN];
+    char *memory;                   // Backing store of the synthetic frames.
+    size_t count;
+    uint32_t *next_hops;            // Next hops of the trace's destinations.
+    size_t num_next_hops;
+} trace;
+
+static const uint8_t host_mac[6] = {0x02, 0xaa, 0x00, 0x00, 0x00, 0x01};
+
+// Options of the fragmentation check: a Router Alert, copied into every fragment, then a
+// timestamp, only in the first one (RFC 791).
+static const uint8_t frag_options[] = {0x94, 4, 0, 0, 0x44, 8, 5, 0, 0, 0, 0, 0};
+#define FRAG_COPIED         4               // Bytes of the options the later fragments repeat.
+
+// The packet the fragmentation check sends, and what the fragments sent for it added up to.
+static struct fragment_check {
+    const struct iphdr *packet;
+    uint64_t fragments;
+    uint64_t bytes;                 // Data carried, every copy of the packet's.
+    uint64_t errors;
+} frag_check;
+
+/**
+ * @brief Give the in-memory interfaces addresses no route of the tables points to.
+ */
+static void Setup_Interfaces(void) {
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t)(interface + 1)};
+        uint32_t ip = htonl(0x0affff01u | (uint32_t)interface << 8);    // 10.255.<interface>.1
+        Fake_Link_Interface(interface, ip, mac);
+    }
+}
+
+/**
+ * @brief Pick destinations with a valid route, spread over a routing table file.
+ *
+ * @param ctrl   The control state, its FIB loaded from the file.
+ * @param file   The routing table file.
+ * @param daddrs Array receiving the destinations (network order).
+ * @param max    Maximum number of destinations.
+ * @return       The number of destinations picked.
+ */
+static size_t Pick_Destinations(control *ctrl, const char *file, uint32_t *daddrs, size_t max) {
+    FILE *fin = fopen(file, "r");
+    if (!fin) return 0;
+
+    // Count the routes first, to take every n-th one.
+    size_t lines = 0;
+    for (int c = fgetc(fin); c != EOF; c = fgetc(fin)) lines += c == '\n';
+    rewind(fin);
+    size_t stride = lines > max ? lines / max : 1;
+
+    char prefix[32], next_hop[32], mask[32];
+    uint64_t seed = 7;
+    size_t count = 0;
+
+    for (size_t line = 0; count < max && fscanf(fin, "%31s %31s %31s %*d", prefix, next_hop, mask) == 3; line++) {
+        struct in_addr net, netmask;
+        if (line % stride || !inet_aton(prefix, &net) || !inet_aton(mask, &netmask)) continue;
+
+        // A host inside the prefix, kept if the FIB sends it out of an existing interface.
+        uint32_t daddr = net.s_addr | ((uint32_t)Bench_Random(&seed) & ~netmask.s_addr);
+        forward lpm;
+        if (!Lookup_IPV4_Table(ctrl->ipv4s, daddr, &lpm)) continue;
+        if (lpm.interface < 0 || lpm.interface >= ROUTER_NUM_INTERFACES) continue;
+
+        daddrs[count++] = daddr;
+    }
+
+    fclose(fin);
+    return count;
+}
+
+/**
+ * @brief Build an Ethernet / IPv4 / UDP frame.
+ *
+ * @param buf       The frame buffer.
+ * @param len       The frame length.
+ * @param interface The ingress interface.
+ * @param daddr     The destination (network order).
+ * @param ttl       The TTL.
+ * @param bad_check Whether to corrupt the IPv4 checksum.
+ */
+static void Build_Frame(char *buf, size_t len, int interface, uint32_t daddr, uint8_t ttl, bool bad_check) {
+    memset(buf, 0, len);
+
+    struct ethhdr *eth_hdr = (struct ethhdr *)buf;
+    Get_MAC_Interface(interface, eth_hdr->ether_dhost);
+    memcpy(eth_hdr->ether_shost, host_mac, MAC_SIZE);
+    eth_hdr->ether_type = IP_TYPE;
+
+    struct iphdr *ip_hdr = (struct iphdr *)(buf + sizeof(struct ethhdr));
+    ip_hdr->version = IPV4_VERSION;
+    ip_hdr->ihl = IPV4_IHL;
+    ip_hdr->tot_len = htons((uint16_t)(len - sizeof(struct ethhdr)));
+    ip_hdr->id = htons(1);
+    ip_hdr->ttl = ttl;
+    ip_hdr->protocol = IPPROTO_UDP;
+    ip_hdr->saddr = htonl(0x0afe0001u + (uint32_t)interface);   // 10.254.0.<interface + 1>
+    ip_hdr->daddr = daddr;
+    ip_hdr->check = Checksum_Fast(ip_hdr, sizeof(struct iphdr));
+    if (bad_check) ip_hdr->check ^= htons(0x0100);
+
+    uint16_t *udp = (uint16_t *)(buf + sizeof(struct ethhdr) + sizeof(struct iphdr));
+    udp[0] = htons(1234);
+    udp[1] = htons(5678);
+    udp[2] = htons((uint16_t)(len - sizeof(struct ethhdr) - sizeof(struct iphdr)));
+}
+
+/**
+ * @brief Turn a frame built by Build_Frame into an echo request for the router's interface.
+ *
+ * @param buf       The frame buffer.
+ * @param len       The frame length.
+ * @param interface The ingress interface.
+ */
+static void Build_Echo(char *buf, size_t len, int interface) {
+    struct iphdr *ip_hdr = (struct iphdr *)(buf + sizeof(struct ethhdr));
+    ip_hdr->protocol = IPPROTO_ICMP;
+    ip_hdr->daddr = Get_IPV4_Interface(interface);
+    ip_hdr->check = 0;
+    ip_hdr->check = Checksum_Fast(ip_hdr, sizeof(struct iphdr));
+
+    struct icmphdr *icmp_hdr = (struct icmphdr *)(buf + sizeof(struct ethhdr) + sizeof(struct iphdr));
+    size_t icmp_len = len - sizeof(struct ethhdr) - sizeof(struct iphdr);
+    memset(icmp_hdr, 0, sizeof(struct icmphdr));
+    icmp_hdr->type = ICMP_ECHO_REQUEST;
+    icmp_hdr->un.echo.id = htons(1);
+    icmp_hdr->checksum = Checksum_Fast(icmp_hdr, icmp_len);
+}
+
+/**
+ * @brief Build the synthetic trace of a mix: random picks among the destinations,
+ * received round-robin on the interfaces.
+ *
+ * @param tr     The trace.
+ * @param kind   The mix.
+ * @param daddrs The destinations.
+ * @param count  The number of destinations.
+ * @param len    The frame length.
+ * @return       False if memory allocation fails.
+ */
+static bool Build_Trace(trace *tr, mix kind, const uint32_t *daddrs, size_t count, size_t len) {
+    tr->memory = (char *)malloc((size_t)TRACE_LEN * len);
+    if (!tr->memory) return false;
+    tr->count = TRACE_LEN;
+
+    uint64_t seed = 42;
+    for (size_t frame = 0; frame < TRACE_LEN; frame++) {
+        int interface = (int)(frame % ROUTER_NUM_INTERFACES);
+        uint32_t daddr = daddrs[Bench_Random(&seed) % count];
+
+        tr->frames[frame] = (fake_frame){tr->memory + frame * len, len, interface};
+        Build_Frame(tr->frames[frame].buf, len, interface, daddr,
+                    kind == MIX_TTL_EXPIRED ? 1 : DEFAULT_TTL, kind == MIX_BAD_CHECKSUM);
+        if (kind == MIX_ECHO) Build_Echo(tr->frames[frame].buf, len, interface);
+    }
+    return true;
+}
+
+/**
+ * @brief Load the Ethernet frames of a pcap capture (up to TRACE_LEN of them).
+ *
+ * @param tr   The trace.
+ * @param file The capture (classic pcap, Ethernet link type).
+ * @return     False if the file cannot be read.
+ */
+static bool Load_Pcap(trace *tr, const char *file) {
+    FILE *fin = fopen(file, "rb");
+    if (!fin) return false;
+
+    uint32_t header[6];
+    if (fread(header, sizeof(header), 1, fin) != 1) {
+        fclose(fin);
+        return false;
+    }
+    // Microsecond or nanosecond timestamps, in either byte order.
+    bool swapped = header[0] == 0xd4c3b2a1u || header[0] == 0x4d3cb2a1u;
+    uint32_t linktype = swapped ? __builtin_bswap32(header[5]) : header[5];
+    if ((!swapped && header[0] != 0xa1b2c3d4u && header[0] != 0xa1b23c4du) || linktype != 1) {
+        fclose(fin);
+        return false;
+    }
+
+    tr->memory = (char *)malloc((size_t)TRACE_LEN * MAX_PACKET_LEN);
+    if (!tr->memory) {
+        fclose(fin);
+        return false;
+    }
+
+    uint32_t record[4];
+    tr->count = 0;
+    while (tr->count < TRACE_LEN && fread(record, sizeof(record), 1, fin) == 1) {
+        uint32_t caplen = swapped ? __builtin_bswap32(record[2]) : record[2];
+        char *buf = tr->memory + tr->count * MAX_PACKET_LEN;
+
+        if (caplen > MAX_PACKET_LEN) {
+            if (fseek(fin, caplen, SEEK_CUR)) break;
+            continue;
+        }
+        if (fread(buf, 1, caplen, fin) != caplen) break;
+        if (caplen < sizeof(struct ethhdr)) continue;
+
+        tr->frames[tr->count] = (fake_frame){buf, caplen, (int)(tr->count % ROUTER_NUM_INTERFACES)};
+        tr->count++;
+    }
+
+    fclose(fin);
+    return tr->count > 0;
+}
+
+/**
+ * @brief Collect the next hops the IPv4 frames of a trace are routed to.
+ *
+ * @param tr   The trace.
+ * @param ctrl The control state.
+ * @return     False if memory allocation fails.
+ */
+static bool Collect_Next_Hops(trace *tr, control *ctrl) {
+    tr->next_hops = (uint32_t *)malloc(tr->count * sizeof(uint32_t));
+    if (!tr->next_hops) return false;
+    tr->num_next_hops = 0;
+
+    for (size_t frame = 0; frame < tr->count; frame++) {
+        const fake_frame *fr = &tr->frames[frame];
+        if (fr->len < sizeof(struct ethhdr) + sizeof(struct iphdr)) continue;
+        if (((const struct ethhdr *)fr->buf)->ether_type != IP_TYPE) continue;
+
+        const struct iphdr *ip_hdr = (const struct iphdr *)(fr->buf + sizeof(struct ethhdr));
+        forward lpm;
+        if (Lookup_IPV4_Table(ctrl->ipv4s, ip_hdr->daddr, &lpm)) tr->next_hops[tr->num_next_hops++] = lpm.next_hop;
+    }
+    return true;
+}
+
+/**
+ * @brief Replace the ARP table, resolving the given neighbors (the flow caches go stale).
+ *
+ * @param ctrl      The control state.
+ * @param next_hops The neighbors to resolve, NULL for none.
+ * @param count     The number of neighbors.
+ */
+static void Reset_Neighbors(control *ctrl, const uint32_t *next_hops, size_t count) {
+    Free_ARP_Table(&ctrl->macs);
+    ctrl->macs = Create_ARP_Table();
+    DIE(!ctrl->macs, "%s", "Create_ARP_Table");
+
+    for (size_t hop = 0; next_hops && hop < count; hop++) {
+        arp_entry entry = {.ip = next_hops[hop]};
+        Fake_Link_MAC(entry.ip, entry.mac);
+        Insert_ARP_Entry(ctrl->macs, &entry);
+    }
+    Bump_Generation(ctrl);
+}
+
+/**
+ * @brief Free the packets left waiting for a neighbor.
+ *
+ * @param ctrl The control state.
+ */
+static void Drop_Waiting(control *ctrl) {
+    while (!EmptyQueue(ctrl->waiting)) {
+        packet *pkt = (packet *)Dequeue(ctrl->waiting);
+        free(pkt->buf);
+        free(pkt);
+    }
+    ctrl->waiting_len = 0;
+}
+
+/**
+ * @brief Receive and handle one frame with the scalar handlers, as the router did before the pipeline.
+ *
+ * @param route The routing context, its buffer set.
+ * @return      False when there is nothing to receive.
+ */
+static bool Run_Scalar(routing *route) {
+    int interface = Recv_FromAny_Link(route->buf, &route->len);
+    if (interface < 0) return false;
+
+    route->interface = interface;
+    route->eth_hdr = (struct ethhdr *)route->buf;
+    if (route->eth_hdr->ether_type == IP_TYPE) Handler_IPV4(route);
+    else if (route->eth_hdr->ether_type == ARP_TYPE) Handler_ARP(route);
+    return true;
+}
+
+/**
+ * @brief Replay a trace through the pipeline or the scalar handlers and report the rate.
+ *
+ * @param ctrl     The control state.
+ * @param tr       The trace.
+ * @param kind     The mix.
+ * @param scalar   Whether to run the scalar handlers instead of the pipeline.
+ * @param packets  The number of trace frames to replay.
+ */
+static void Run_Mix(control *ctrl, trace *tr, mix kind, bool scalar, uint64_t packets) {
+    routing *route = Create_Router(ctrl, 0, -1);
+    char *buf = (char *)malloc(MAX_PACKET_LEN);
+    DIE(!route || !buf, "%s", "Create_Router");
+    route->buf = buf;
+
+    bool forget = kind == MIX_ARP_MISS;
+    Reset_Neighbors(ctrl, forget ? NULL : tr->next_hops, tr->num_next_hops);
+    Fake_Link_Reset();
+    Fake_Link_Answer_ARP(true);
+    Fake_Link_Replay(tr->frames, tr->count);
+
+    bench_run run;
+    uint64_t received = 0;
+    Bench_Start(&run);
+    while (received < packets) {
+        // The ARP-miss mix resolves every neighbor again for each vector.
+        if (forget) Reset_Neighbors(ctrl, NULL, 0);
+
+        if (scalar) {
+            for (int frame = 0; frame < VECTOR_SIZE; frame++) Run_Scalar(route);
+        } else {
+            Run_Pipeline(route);
+        }
+        received = Fake_Link_Received();
+    }
+    Bench_Stop(&run);
+
+    // Let the last ARP replies release their waiting packets, outside of the timed run.
+    Fake_Link_Replay(NULL, 0);
+    while (Fake_Link_Pending()) Run_Pipeline(route);
+    Drop_Waiting(ctrl);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s / %s", mix_names[kind], scalar ? "scalar" : "pipeline");
+    Bench_Report(name, &run, received);
+
+    fake_link_stats stats;
+    Fake_Link_Stats(&stats);
+    printf("%-32s %10.2f tx/pkt %10.2f arp requests/pkt\n", "",
+           (double)stats.tx / (double)received, (double)stats.arp_requests / (double)received);
+
+    free(buf);
+    Free_Router(route);
+}
+
+/**
+ * @brief Check a sent fragment against the packet of the fragmentation check (Fake_Link_Tap).
+ *
+ * A fragment fits the MTU, has a valid checksum, all the options if it is the first one and
+ * the copied ones otherwise, and the packet's data at its offset.
+ */
+static void Check_Fragment(int interface, const char *frame, size_t len) {
+    (void)interface;
+    const struct ethhdr *eth_hdr = (const struct ethhdr *)frame;
+    if (len < sizeof(struct ethhdr) + sizeof(struct iphdr) || eth_hdr->ether_type != IP_TYPE) return;
+
+    const struct iphdr *packet = frag_check.packet;
+    const struct iphdr *ip_hdr = (const struct iphdr *)(frame + sizeof(struct ethhdr));
+    size_t packet_ihl = packet->ihl * 4u, data_len = ntohs(packet->tot_len) - packet_ihl;
+    size_t ihl = ip_hdr->ihl * 4u, ip_len = len - sizeof(struct ethhdr);
+    uint16_t frag_off = ntohs(ip_hdr->frag_off);
+    size_t offset = (size_t)(frag_off & IPV4_OFFSET) * 8, chunk = ip_len - ihl;
+
+    bool first = offset == 0;
+    size_t options = first ? sizeof(frag_options) : FRAG_COPIED;
+    bool ok = ip_len <= FRAG_MTU && ihl == sizeof(struct iphdr) + options && ihl < ip_len &&
+              ntohs(ip_hdr->tot_len) == ip_len && Checksum_Valid(ip_hdr, ihl) &&
+              !memcmp(ip_hdr + 1, frag_options, options) && offset + chunk <= data_len &&
+              !memcmp((const char *)ip_hdr + ihl, (const char *)packet + packet_ihl + offset, chunk) &&
+              !!(frag_off & IPV4_MF) == (offset + chunk < data_len) && (first || chunk % 8 == 0 || !(frag_off & IPV4_MF));
+
+    frag_check.fragments++;
+    if (ok) frag_check.bytes += chunk;
+    else frag_check.errors++;
+}
+
+/**
+ * @brief Send a packet with options over a lowered egress MTU, through the pipeline and through
+ * the scalar handlers, and check its fragments.
+ *
+ * @param ctrl  The control state.
+ * @param daddr A destination with a route.
+ * @return      False if a fragment is wrong or data is missing.
+ */
+static bool Check_Fragments(control *ctrl, uint32_t daddr) {
+    forward lpm;
+    if (!Lookup_IPV4_Table(ctrl->ipv4s, daddr, &lpm)) return false;
+    int ingress = (lpm.interface + 1) % ROUTER_NUM_INTERFACES;
+
+    // A UDP packet with the options inserted after its 20 byte header.
+    char *buf = (char *)malloc(FRAG_FRAME_LEN + MAX_PACKET_LEN);
+    routing *route = Create_Router(ctrl, 0, -1);
+    DIE(!buf || !route, "%s", "Create_Router");
+    route->buf = buf + FRAG_FRAME_LEN;
+
+    Build_Frame(buf, FRAG_FRAME_LEN, ingress, daddr, DEFAULT_TTL, false);
+    struct iphdr *ip_hdr = (struct iphdr *)(buf + sizeof(struct ethhdr));
+    memmove((char *)(ip_hdr + 1) + sizeof(frag_options), ip_hdr + 1,
+            FRAG_FRAME_LEN - sizeof(struct ethhdr) - sizeof(struct iphdr) - sizeof(frag_options));
+    memcpy(ip_hdr + 1, frag_options, sizeof(frag_options));
+    ip_hdr->ihl = (uint8_t)((sizeof(struct iphdr) + sizeof(frag_options)) / 4);
+    ip_hdr->check = 0;
+    ip_hdr->check = Checksum_Fast(ip_hdr, ip_hdr->ihl * 4u);
+    fake_frame frame = {buf, FRAG_FRAME_LEN, ingress};
+
+    Reset_Neighbors(ctrl, &lpm.next_hop, 1);
+    Fake_Link_MTU(lpm.interface, FRAG_MTU);
+    Fake_Link_Tap(Check_Fragment);
+
+    bool ok = true;
+    for (int scalar = 0; scalar < 2; scalar++) {
+        frag_check = (struct fragment_check){.packet = ip_hdr};
+        Fake_Link_Reset();
+        Fake_Link_Replay(&frame, 1);
+        if (scalar) Run_Scalar(route);
+        else Run_Pipeline(route);
+        Fake_Link_Replay(NULL, 0);
+
+        uint64_t packets = Fake_Link_Received();
+        uint64_t data_len = ntohs(ip_hdr->tot_len) - ip_hdr->ihl * 4u;
+        printf("%-32s %10llu packets %10llu fragments %10llu errors\n", scalar ? "fragments / scalar" : "fragments / pipeline",
+               (unsigned long long)packets, (unsigned long long)frag_check.fragments,
+               (unsigned long long)frag_check.errors);
+        ok = ok && packets && !frag_check.errors && frag_check.bytes == packets * data_len;
+    }
+
+    Fake_Link_Tap(NULL);
+    Fake_Link_MTU(lpm.interface, 0);
+    Free_Router(route);
+    free(buf);
+    if (!ok) fprintf(stderr, "fragments with options are wrong or missing\n");
+    return ok;
+}
+
+/**
+ * @brief Run every mix over a routing table.
+ *
+ * @param file     The routing table file.
+ * @param pcap     A capture to replay as well, or NULL.
+ * @param packets  The number of packets per run.
+ * @param dests    The number of destinations of the synthetic mixes.
+ * @param len      The frame length of the synthetic mixes.
+ * @return         False if the table or the capture cannot be loaded.
+ */
+static bool Bench_Table(char *file, const char *pcap, uint64_t packets, size_t dests, size_t len) {
+    control *ctrl = Create_Control(file, NULL, false);
+    uint32_t *daddrs = (uint32_t *)malloc(dests * sizeof(uint32_t));
+    if (!ctrl || !daddrs) {
+        fprintf(stderr, "cannot load %s\n", file);
+        free(daddrs);
+        Free_Control(ctrl);
+        return false;
+    }
+
+    // The mixes measure the handlers, not the control-plane rate limits: lift them.
+    memset(ctrl->police, 0, sizeof(ctrl->police));
+
+    size_t count = Pick_Destinations(ctrl, file, daddrs, dests);
+    printf("=== %s: %zu destinations, %zu byte frames, %llu packets per run\n",
+           file, count, len, (unsigned long long)packets);
+
+    bool ok = count > 0 && Check_Fragments(ctrl, daddrs[0]);
+    for (int kind = MIX_FORWARD; ok && kind <= MIX_PCAP; kind++) {
+        trace *tr = (trace *)calloc(1, sizeof(trace));
+        if (!tr) {
+            ok = false;
+            break;
+        }
+
+        if (kind == MIX_PCAP) {
+            if (!pcap) {
+                free(tr);
+                break;
+            }
+            ok = Load_Pcap(tr, pcap);
+            if (!ok) fprintf(stderr, "cannot load %s\n", pcap);
+        } else {
+            ok = Build_Trace(tr, (mix)kind, daddrs, count, len);
+        }
+
+        if (ok && Collect_Next_Hops(tr, ctrl)) {
+            Run_Mix(ctrl, tr, (mix)kind, false, packets);
+            Run_Mix(ctrl, tr, (mix)kind, true, packets);
+        }
+
+        free(tr->next_hops);
+        free(tr->memory);
+        free(tr);
+    }
+
+    free(daddrs);
+    Free_Control(ctrl);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint64_t packets = DEFAULT_PACKETS;
+    size_t dests = DEFAULT_DESTS;
+    size_t len = DEFAULT_FRAME_LEN;
+    const char *pcap = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:s:p:")) != -1) {
+        switch (opt) {
+            case 'n': packets = strtoull(optarg, NULL, 10); break;
+            case 'd': dests = strtoull(optarg, NULL, 10); break;
+            case 's': len = strtoull(optarg, NULL, 10); break;
+            case 'p': pcap = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n packets] [-d destinations] [-s frame size] [-p trace.pcap] "
+                        "[rtable...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t min_len = sizeof(struct ethhdr) + sizeof(struct iphdr) + UDP_HDR_LEN;
+    if (!packets || !dests || dests > ARP_SIZE || len < min_len || len > MAX_PACKET_LEN) {
+        fprintf(stderr, "bad options: 1..%d destinations, %zu..%d byte frames\n", ARP_SIZE, min_len, MAX_PACKET_LEN);
+        return EXIT_FAILURE;
+    }
+
+    Setup_Interfaces();
+
+    char *defaults[] = {"rtable0.txt", "rtable1.txt"};
+    char **tables = optind < argc ? argv + optind : defaults;
+    int num_tables = optind < argc ? argc - optind : 2;
+
+    for (int table = 0; table < num_tables; table++) {
+        if (!Bench_Table(tables[table], pcap, packets, dests, len)) return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
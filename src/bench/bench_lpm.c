@@ -0,0 +1,400 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../res/ipv4/fib.h"
+#include "../utils/hugepage.h"
+
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_LOOKUPS     4000000
+#define DEFAULT_CHECKS      2000000
+#define CHECK_BUDGET        100000000000ull     // Route comparisons the reference may spend per table and kind of check.
+#define ZIPF_DESTINATIONS   65536
+#define BATCH               256
+#define ORDER_BITS          21                  // Routes the reference can rank.
+
+// Reference LPM: every route compared with every address, the most specific (then last) match wins.
+typedef struct reference {
+    uint32_t *prefixes;             // Prefixes (host order), masked.
+    uint32_t *masks;                // Masks (host order).
+    uint32_t *ranks;                // (length + 1) << ORDER_BITS | index, 0 never matches.
+    const route *routes;
+    int count;
+} reference;
+
+/**
+ * @brief Build the reference of a set of routes.
+ *
+ * Routes with an empty mask are left out, as the trie does not install them.
+ *
+ * @param ref    The reference.
+ * @param routes The routes.
+ * @param count  The number of routes.
+ * @return       False if memory allocation fails or there are too many routes.
+ */
+static bool Build_Reference(reference *ref, const route *routes, int count) {
+    if (count >= 1 << ORDER_BITS) return false;
+    ref->prefixes = (uint32_t *)malloc(count * sizeof(uint32_t));
+    ref->masks = (uint32_t *)malloc(count * sizeof(uint32_t));
+    ref->ranks = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (!ref->prefixes || !ref->masks || !ref->ranks) return false;
+
+    ref->routes = routes;
+    ref->count = 0;
+    for (int idx = 0; idx < count; idx++) {
+        if (!routes[idx].mask) continue;
+        uint32_t mask = ntohl(routes[idx].mask);
+        ref->masks[ref->count] = mask;
+        ref->prefixes[ref->count] = ntohl(routes[idx].prefix) & mask;
+        ref->ranks[ref->count++] = (uint32_t)(__builtin_popcount(mask) + 1) << ORDER_BITS | (uint32_t)idx;
+    }
+    return true;
+}
+
+static void Free_Reference(reference *ref) {
+    free(ref->prefixes);
+    free(ref->masks);
+    free(ref->ranks);
+}
+
+/**
+ * @brief Longest prefix match by scanning every route, branch free so the compiler can vectorize it.
+ *
+ * @param ref The reference.
+ * @param ip  The address (network order).
+ * @param lpm The forward structure receiving the result.
+ * @return    True if a route matched.
+ */
+#if defined(__x86_64__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+static bool Lookup_Reference(const reference *ref, uint32_t ip, forward *lpm) {
+    uint32_t key = ntohl(ip), best = 0;
+    for (int idx = 0; idx < ref->count; idx++) {
+        uint32_t hit = -(uint32_t)((key & ref->masks[idx]) == ref->prefixes[idx]);
+        uint32_t rank = ref->ranks[idx] & hit;
+        best = rank > best ? rank : best;
+    }
+
+    lpm->status = best != 0;
+    if (best) {
+        const route *match = &ref->routes[best & ((1u << ORDER_BITS) - 1)];
+        lpm->next_hop = match->next_hop;
+        lpm->interface = match->interface;
+    }
+    return lpm->status;
+}
+
+/**
+ * @brief A random address inside the prefix of a random route.
+ *
+ * @param routes The routes.
+ * @param count  The number of routes.
+ * @param seed   The random state.
+ * @return       The address (network order).
+ */
+static uint32_t Routable_Address(const route *routes, int count, uint64_t *seed) {
+    const route *pick = &routes[Bench_Random(seed) % (uint64_t)count];
+    uint32_t mask = ntohl(pick->mask);
+    return htonl((ntohl(pick->prefix) & mask) | ((uint32_t)Bench_Random(seed) & ~mask));
+}
+
+/**
+ * @brief Compare an engine with the reference on a vector of addresses, scalar and batched lookups.
+ *
+ * @param engine The engine.
+ * @param fib    Its lookup structure.
+ * @param ref    The reference.
+ * @param ips    The addresses.
+ * @param count  The number of addresses (at most BATCH).
+ * @param mismatches The number of mismatches so far, the first ones are printed.
+ */
+static void Check_Vector(const fib_engine *engine, void *fib, const reference *ref, const uint32_t *ips, int count,
+                         uint64_t *mismatches) {
+    forward expected, scalar, batch[BATCH];
+
+    if (engine->lookup_batch) engine->lookup_batch(fib, ips, count, batch);
+
+    for (int idx = 0; idx < count; idx++) {
+        Lookup_Reference(ref, ips[idx], &expected);
+        engine->lookup(fib, ips[idx], &scalar);
+
+        for (int mode = 0; mode < (engine->lookup_batch ? 2 : 1); mode++) {
+            const forward *got = mode ? &batch[idx] : &scalar;
+            bool same = got->status == expected.status &&
+                        (!got->status || (got->next_hop == expected.next_hop && got->interface == expected.interface));
+            if (same) continue;
+
+            if ((*mismatches)++ < 5) {
+                char addr[INET_ADDRSTRLEN], got_hop[INET_ADDRSTRLEN], want_hop[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &ips[idx], addr, sizeof(addr));
+                inet_ntop(AF_INET, &got->next_hop, got_hop, sizeof(got_hop));
+                inet_ntop(AF_INET, &expected.next_hop, want_hop, sizeof(want_hop));
+                fprintf(stderr, "%s%s: %s -> %s %s/%d, expected %s %s/%d\n", engine->name, mode ? " (batch)" : "",
+                        addr, got->status ? "route" : "none", got_hop, got->interface,
+                        expected.status ? "route" : "none", want_hop, expected.interface);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Compare an engine with the reference: the edges of every route, then random and routable addresses.
+ *
+ * @param engine The engine.
+ * @param fib    Its lookup structure.
+ * @param ref    The reference.
+ * @param checks The number of random addresses.
+ * @return       The number of mismatches.
+ */
+static uint64_t Check_Engine(const fib_engine *engine, void *fib, const reference *ref, uint64_t checks) {
+    uint64_t seed = 0xd1ff, mismatches = 0;
+    uint32_t ips[BATCH];
+    int count = 0;
+
+    // First and last address of the prefixes and their neighbors, where the prefix lengths matter.
+    // The linear scan is the slow part, on large tables only every n-th prefix is checked.
+    uint64_t edge_checks = 4 * (uint64_t)ref->count;
+    int stride = edge_checks * ref->count > CHECK_BUDGET ? (int)(edge_checks * ref->count / CHECK_BUDGET) + 1 : 1;
+    for (int idx = 0; idx < ref->count; idx += stride) {
+        uint32_t base = ref->prefixes[idx], last = base | ~ref->masks[idx];
+        uint32_t edges[] = {base, last, base - 1, last + 1};
+        for (int edge = 0; edge < 4; edge++) {
+            ips[count++] = htonl(edges[edge]);
+            if (count == BATCH) {
+                Check_Vector(engine, fib, ref, ips, count, &mismatches);
+                count = 0;
+            }
+        }
+    }
+    Check_Vector(engine, fib, ref, ips, count, &mismatches);
+
+    for (uint64_t done = 0; done < checks; done += BATCH) {
+        count = checks - done < BATCH ? (int)(checks - done) : BATCH;
+        for (int idx = 0; idx < count; idx++) {
+            ips[idx] = Bench_Random(&seed) % 2 ? (uint32_t)Bench_Random(&seed)
+                                               : Routable_Address(ref->routes, ref->count, &seed);
+        }
+        Check_Vector(engine, fib, ref, ips, count, &mismatches);
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Time an engine on an address stream, one address at a time and in batches.
+ *
+ * @param engine The engine.
+ * @param fib    Its lookup structure.
+ * @param title  The name of the engine (and pages) in the report.
+ * @param name   The name of the stream.
+ * @param stream The addresses.
+ * @param len    The number of addresses.
+ */
+static void Bench_Stream(const fib_engine *engine, void *fib, const char *title, const char *name, const uint32_t *stream, uint64_t len) {
+    bench_run run;
+    forward lpm, lpms[BATCH];
+    char label[64];
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) {
+        BENCH_KEEP(engine->lookup(fib, stream[pos], &lpm));
+        BENCH_KEEP(lpm);
+    }
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "%s %s", title, name);
+    Bench_Report(label, &run, len);
+
+    if (!engine->lookup_batch) return;
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos + BATCH <= len; pos += BATCH) {
+        engine->lookup_batch(fib, stream + pos, BATCH, lpms);
+        BENCH_KEEP(lpms);
+    }
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "%s %s (batch)", title, name);
+    Bench_Report(label, &run, len / BATCH * BATCH);
+}
+
+/**
+ * @brief Build an engine on some pages, then check and benchmark it.
+ *
+ * @param engine  The engine.
+ * @param name    The name of the engine (and pages) in the report.
+ * @param routes  The routes.
+ * @param count   The number of routes.
+ * @param ref     The reference, NULL to skip the checks.
+ * @param streams The uniform, routable and zipf address streams.
+ * @param lookups The number of lookups per stream.
+ * @param checks  The number of addresses compared with the reference.
+ * @return        False if the engine disagrees with the reference or fails to build.
+ */
+static bool Bench_Engine(const fib_engine *engine, const char *name, const route *routes, int count,
+                         const reference *ref, uint32_t *const streams[3], uint64_t lookups, uint64_t checks) {
+    uint64_t start = Bench_Now();
+    void *fib = engine->build(routes, count);
+    if (!fib) {
+        fprintf(stderr, "cannot build %s\n", name);
+        return false;
+    }
+    size_t bytes = engine->memory(fib);
+    printf("%-32s %10.2f MB %9.1f B/route %9.1f ms to build\n", name,
+           bytes / 1048576.0, (double)bytes / count, (Bench_Now() - start) / 1e6);
+
+    // Only the engines allocating from hugepage.c have regions to report.
+    size_t mapped, huge;
+    Huge_Usage(HUGE_FIB, &mapped, &huge);
+    if (mapped) {
+        printf("%-32s %10.2f MB mapped, %.2f MB on 2 MB pages\n", name, mapped / 1048576.0, huge / 1048576.0);
+    }
+
+    bool ok = true;
+    if (ref) {
+        // The structure is the same on any pages, it is described once.
+        fib_stats stats;
+        Inspect_FIB(engine, fib, &stats);
+        Print_FIB_Stats(stdout, name, &stats);
+
+        uint64_t mismatches = Check_Engine(engine, fib, ref, checks);
+        printf("%-32s %10llu mismatches\n", name, (unsigned long long)mismatches);
+        ok = !mismatches;
+    }
+
+    Bench_Stream(engine, fib, name, "uniform", streams[0], lookups);
+    Bench_Stream(engine, fib, name, "routable", streams[1], lookups);
+    Bench_Stream(engine, fib, name, "zipf", streams[2], lookups);
+
+    engine->destroy(fib);
+    return ok;
+}
+
+/**
+ * @brief Check and benchmark the engines on a set of routes.
+ *
+ * Every engine is built once per page mode, on the same address streams, so the runs only
+ * differ by the pages under the lookup structure.
+ *
+ * @param title   The name of the table.
+ * @param routes  The routes.
+ * @param count   The number of routes.
+ * @param only    The engine to run, NULL for all.
+ * @param modes   The pages to build every engine on (checked on the first only).
+ * @param nmodes  The number of page modes.
+ * @param lookups The number of lookups per stream.
+ * @param checks  The number of addresses compared with the reference.
+ * @return        False if an engine disagrees with the reference or fails to build.
+ */
+static bool Bench_Table(const char *title, const route *routes, int count, const char *only,
+                        const huge_mode *modes, int nmodes, uint64_t lookups, uint64_t checks) {
+    reference ref = {0};
+    uint32_t *streams[3] = {0};
+    for (int kind = 0; kind < 3; kind++) streams[kind] = (uint32_t *)malloc(lookups * sizeof(uint32_t));
+    uint32_t *hot = (uint32_t *)malloc(ZIPF_DESTINATIONS * sizeof(uint32_t));
+    bench_zipf zipf = {0};
+    bool ok = streams[0] && streams[1] && streams[2] && hot && Build_Reference(&ref, routes, count) && ref.count &&
+              Bench_Zipf_Init(&zipf, ZIPF_DESTINATIONS, 1.0);
+    if (!ok) {
+        fprintf(stderr, "%s: cannot build the reference\n", title);
+        goto out;
+    }
+
+    // Keep the random checks within the budget of the linear scan as well.
+    if (checks * (uint64_t)ref.count > CHECK_BUDGET) checks = CHECK_BUDGET / (uint64_t)ref.count;
+    printf("=== %s: %d routes, %llu addresses checked against the linear scan\n",
+           title, count, (unsigned long long)checks);
+
+    uint64_t seed = 42;
+    for (int idx = 0; idx < ZIPF_DESTINATIONS; idx++) hot[idx] = Routable_Address(routes, count, &seed);
+    for (uint64_t pos = 0; pos < lookups; pos++) {
+        streams[0][pos] = (uint32_t)Bench_Random(&seed);
+        streams[1][pos] = Routable_Address(routes, count, &seed);
+        streams[2][pos] = hot[Bench_Zipf_Next(&zipf, &seed)];
+    }
+
+    for (int engine_idx = 0; fib_engines[engine_idx]; engine_idx++) {
+        const fib_engine *engine = fib_engines[engine_idx];
+        if (only && strcmp(only, engine->name)) continue;
+
+        for (int mode = 0; mode < nmodes; mode++) {
+            char name[64];
+            snprintf(name, sizeof(name), nmodes > 1 ? "%s [%s]" : "%s", engine->name, huge_mode_names[modes[mode]]);
+            Set_Huge_Mode(modes[mode]);
+            ok = Bench_Engine(engine, name, routes, count, mode ? NULL : &ref, streams, lookups, checks) && ok;
+        }
+    }
+
+out:
+    Bench_Zipf_Free(&zipf);
+    Free_Reference(&ref);
+    free(hot);
+    for (int kind = 0; kind < 3; kind++) free(streams[kind]);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint64_t lookups = DEFAULT_LOOKUPS, checks = DEFAULT_CHECKS;
+    int synthetic = 0;
+    const char *only = NULL;
+    huge_mode modes[HUGE_MODES] = {HUGE_ON};
+    int nmodes = 1, mode;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:n:c:s:H:")) != -1) {
+        switch (opt) {
+            case 'e': only = optarg; break;
+            case 'n': lookups = strtoull(optarg, NULL, 10); break;
+            case 'c': checks = strtoull(optarg, NULL, 10); break;
+            case 's': synthetic = atoi(optarg); break;
+            case 'H':
+                // Page modes to compare, e.g. off,thp,on.
+                nmodes = 0;
+                for (char *token = strtok(optarg, ","); token; token = strtok(NULL, ",")) {
+                    if ((mode = Parse_Huge_Mode(token)) < 0 || nmodes == HUGE_MODES) {
+                        fprintf(stderr, "bad page modes (off, thp, on)\n");
+                        return EXIT_FAILURE;
+                    }
+                    modes[nmodes++] = (huge_mode)mode;
+                }
+                if (!nmodes) return EXIT_FAILURE;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-e engine] [-n lookups] [-c checks] [-s synthetic prefixes] "
+                        "[-H off,thp,on] [rtable...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (only && !Find_FIB_Engine(only)) {
+        fprintf(stderr, "unknown engine %s\n", only);
+        return EXIT_FAILURE;
+    }
+    if (lookups < BATCH) lookups = BATCH;
+
+    bool ok = true;
+    if (synthetic > 0) {
+        route *routes = Bench_Routes(synthetic, 0x5eed);
+        int count = routes ? Bench_Unique_Routes(routes, synthetic) : 0;
+        char title[64];
+        snprintf(title, sizeof(title), "synthetic %d prefixes", synthetic);
+        ok = routes && Bench_Table(title, routes, count, only, modes, nmodes, lookups, checks);
+        free(routes);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    char *defaults[] = {"rtable0.txt", "rtable1.txt"};
+    char **tables = optind < argc ? argv + optind : defaults;
+    int num_tables = optind < argc ? argc - optind : 2;
+
+    for (int table = 0; table < num_tables; table++) {
+        int count = 0;
+        route *routes = Read_IPV4_Routes(tables[table], &count);
+        if (!routes) {
+            fprintf(stderr, "cannot load %s\n", tables[table]);
+            return EXIT_FAILURE;
+        }
+        count = Bench_Unique_Routes(routes, count);
+        ok = Bench_Table(tables[table], routes, count, only, modes, nmodes, lookups, checks) && ok;
+        free(routes);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../res/ipv6/ipv6_table.h"
+#include "../utils/hugepage.h"
+
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_LOOKUPS     4000000
+#define DEFAULT_CHECKS      1000000
+#define DEFAULT_PREFIXES    200000              // About the size of the IPv6 Internet table.
+#define CHECK_BUDGET        10000000000ull      // Route comparisons the reference may spend per kind of check.
+#define ZIPF_DESTINATIONS   65536
+#define BATCH               256
+#define ORDER_BITS          21                  // Routes the reference can rank.
+
+// Prefix lengths of the synthetic table, in percent, close to the IPv6 BGP table: /48 (end sites)
+// first, then the /32 allocations and the /44, /40, /36 and /29 blocks carved out of them.
+static const struct length_share {
+    int len;
+    int percent;
+} length_mix[] = {
+    {48, 48}, {32, 12}, {44, 8}, {40, 6}, {36, 4}, {29, 3}, {47, 3}, {46, 2}, {42, 2}, {45, 2}, {56, 2},
+    {28, 1}, {30, 1}, {33, 1}, {34, 1}, {35, 1}, {38, 1}, {64, 1}, {24, 1},
+};
+
+// 128-bit key, host order halves.
+typedef struct key6 {
+    uint64_t hi, lo;
+} key6;
+
+static key6 Key_Of(const struct in6_addr *addr) {
+    key6 key = {0, 0};
+    for (int byte = 0; byte < 8; byte++) {
+        key.hi = key.hi << 8 | addr->s6_addr[byte];
+        key.lo = key.lo << 8 | addr->s6_addr[byte + 8];
+    }
+    return key;
+}
+
+static struct in6_addr Addr_Of(key6 key) {
+    struct in6_addr addr;
+    for (int byte = 7; byte >= 0; byte--) {
+        addr.s6_addr[byte] = (uint8_t)key.hi;
+        addr.s6_addr[byte + 8] = (uint8_t)key.lo;
+        key.hi >>= 8;
+        key.lo >>= 8;
+    }
+    return addr;
+}
+
+static key6 Mask_Of(int len) {
+    key6 mask;
+    mask.hi = len >= 64 ? ~0ull : len ? ~0ull << (64 - len) : 0;
+    mask.lo = len >= 128 ? ~0ull : len > 64 ? ~0ull << (128 - len) : 0;
+    return mask;
+}
+
+// Reference LPM: every route compared with every address, the most specific (then last) match wins.
+typedef struct reference {
+    key6 *prefixes;                 // Prefixes, masked.
+    key6 *masks;
+    uint32_t *ranks;                // (length + 1) << ORDER_BITS | index.
+    const route6 *routes;
+    int count;
+} reference;
+
+static bool Build_Reference(reference *ref, const route6 *routes, int count) {
+    if (count >= 1 << ORDER_BITS) return false;
+    ref->prefixes = (key6 *)malloc(count * sizeof(key6));
+    ref->masks = (key6 *)malloc(count * sizeof(key6));
+    ref->ranks = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (!ref->prefixes || !ref->masks || !ref->ranks) return false;
+
+    ref->routes = routes;
+    ref->count = count;
+    for (int idx = 0; idx < count; idx++) {
+        key6 key = Key_Of(&routes[idx].prefix), mask = Mask_Of(routes[idx].len);
+        ref->masks[idx] = mask;
+        ref->prefixes[idx] = (key6){key.hi & mask.hi, key.lo & mask.lo};
+        ref->ranks[idx] = (uint32_t)(routes[idx].len + 1) << ORDER_BITS | (uint32_t)idx;
+    }
+    return true;
+}
+
+static void Free_Reference(reference *ref) {
+    free(ref->prefixes);
+    free(ref->masks);
+    free(ref->ranks);
+}
+
+/**
+ * @brief Longest prefix match by scanning every route, branch free so the compiler can vectorize it.
+ *
+ * @param ref The reference.
+ * @param ip  The address.
+ * @param lpm The forward structure receiving the result.
+ * @return    True if a route matched.
+ */
+static bool Lookup_Reference(const reference *ref, const struct in6_addr *ip, forward6 *lpm) {
+    key6 key = Key_Of(ip);
+    uint32_t best = 0;
+    for (int idx = 0; idx < ref->count; idx++) {
+        uint32_t hit = -(uint32_t)(((key.hi & ref->masks[idx].hi) == ref->prefixes[idx].hi) &
+                                   ((key.lo & ref->masks[idx].lo) == ref->prefixes[idx].lo));
+        uint32_t rank = ref->ranks[idx] & hit;
+        best = rank > best ? rank : best;
+    }
+
+    lpm->status = best != 0;
+    if (best) {
+        const route6 *match = &ref->routes[best & ((1u << ORDER_BITS) - 1)];
+        static const struct in6_addr on_link;
+        lpm->next_hop = memcmp(&match->next_hop, &on_link, sizeof(on_link)) ? match->next_hop : *ip;
+        lpm->interface = match->interface;
+    }
+    return lpm->status;
+}
+
+/**
+ * @brief Generate a synthetic table with the prefix length mix of the IPv6 Internet table.
+ *
+ * Prefixes longer than /32 are carved out of one of a set of /32 allocations, as in the real
+ * table, so the markers and their best matching prefixes are exercised; the shorter ones are
+ * anywhere in 2000::/3. One route in a hundred is directly connected (next hop ::).
+ *
+ * @param count The number of prefixes.
+ * @return      The routes, or NULL if memory allocation fails.
+ */
+static route6* Synthetic_Routes(int count) {
+    route6 *routes = (route6 *)malloc(count * sizeof(route6));
+    int num_allocations = count / 16 + 1;
+    uint64_t *allocations = (uint64_t *)malloc(num_allocations * sizeof(uint64_t));
+    if (!routes || !allocations) {
+        free(routes);
+        free(allocations);
+        return NULL;
+    }
+
+    uint64_t seed = 0x5eed6;
+    for (int idx = 0; idx < num_allocations; idx++) {
+        allocations[idx] = (0x2000000000000000ull | (Bench_Random(&seed) & 0x1fffffffffffffffull)) & Mask_Of(32).hi;
+    }
+
+    for (int idx = 0; idx < count; idx++) {
+        int pick = (int)(Bench_Random(&seed) % 100), len = length_mix[0].len;
+        for (size_t share = 0, sum = 0; share < sizeof(length_mix) / sizeof(length_mix[0]); share++) {
+            sum += (size_t)length_mix[share].percent;
+            if ((size_t)pick < sum) {
+                len = length_mix[share].len;
+                break;
+            }
+        }
+
+        key6 key = {Bench_Random(&seed), Bench_Random(&seed)}, mask = Mask_Of(len);
+        if (len > 32) key.hi = allocations[Bench_Random(&seed) % (uint64_t)num_allocations] | (key.hi & 0xffffffffull);
+        else key.hi = 0x2000000000000000ull | (key.hi & 0x1fffffffffffffffull);
+        routes[idx].prefix = Addr_Of((key6){key.hi & mask.hi, key.lo & mask.lo});
+        routes[idx].len = len;
+
+        key6 hop = {0xfe80000000000000ull, Bench_Random(&seed) & 0xffff};
+        if (!(Bench_Random(&seed) % 100)) hop = (key6){0, 0};
+        routes[idx].next_hop = Addr_Of(hop);
+        routes[idx].interface = (int)(Bench_Random(&seed) % 3);
+    }
+
+    free(allocations);
+    return routes;
+}
+
+/**
+ * @brief A random address inside the prefix of a random route.
+ */
+static struct in6_addr Routable_Address(const reference *ref, uint64_t *seed) {
+    int idx = (int)(Bench_Random(seed) % (uint64_t)ref->count);
+    key6 key = {Bench_Random(seed), Bench_Random(seed)};
+    key.hi = ref->prefixes[idx].hi | (key.hi & ~ref->masks[idx].hi);
+    key.lo = ref->prefixes[idx].lo | (key.lo & ~ref->masks[idx].lo);
+    return Addr_Of(key);
+}
+
+/**
+ * @brief A random address of 2000::/3, the global unicast space the routes are in.
+ */
+static struct in6_addr Global_Address(uint64_t *seed) {
+    key6 key = {0x2000000000000000ull | (Bench_Random(seed) & 0x1fffffffffffffffull), Bench_Random(seed)};
+    return Addr_Of(key);
+}
+
+/**
+ * @brief Compare the table with the reference on a vector of addresses, scalar and batched lookups.
+ *
+ * @param table      The IPv6 routing table.
+ * @param ref        The reference.
+ * @param ips        The addresses.
+ * @param count      The number of addresses (at most BATCH).
+ * @param mismatches The number of mismatches so far, the first ones are printed.
+ */
+static void Check_Vector(const ipv6_table *table, const reference *ref, const struct in6_addr *ips, int count,
+                         uint64_t *mismatches) {
+    forward6 expected, scalar, batch[BATCH];
+    Lookup_IPV6_Batch(table, ips, count, batch);
+
+    for (int idx = 0; idx < count; idx++) {
+        Lookup_Reference(ref, &ips[idx], &expected);
+        Lookup_IPV6_Table(table, &ips[idx], &scalar);
+
+        for (int mode = 0; mode < 2; mode++) {
+            const forward6 *got = mode ? &batch[idx] : &scalar;
+            bool same = got->status == expected.status &&
+                        (!got->status || (!memcmp(&got->next_hop, &expected.next_hop, sizeof(got->next_hop)) &&
+                                          got->interface == expected.interface));
+            if (same) continue;
+
+            if ((*mismatches)++ < 5) {
+                char addr[INET6_ADDRSTRLEN], got_hop[INET6_ADDRSTRLEN], want_hop[INET6_ADDRSTRLEN];
+                inet_ntop(AF_INET6, &ips[idx], addr, sizeof(addr));
+                inet_ntop(AF_INET6, &got->next_hop, got_hop, sizeof(got_hop));
+                inet_ntop(AF_INET6, &expected.next_hop, want_hop, sizeof(want_hop));
+                fprintf(stderr, "lookup%s: %s -> %s %s/%d, expected %s %s/%d\n", mode ? " (batch)" : "",
+                        addr, got->status ? "route" : "none", got_hop, got->interface,
+                        expected.status ? "route" : "none", want_hop, expected.interface);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Compare the table with the reference: the edges of every route, then random and routable addresses.
+ *
+ * @return The number of mismatches.
+ */
+static uint64_t Check_Table(const ipv6_table *table, const reference *ref, uint64_t checks) {
+    uint64_t seed = 0xd1ff6, mismatches = 0;
+    struct in6_addr ips[BATCH];
+    int count = 0;
+
+    // First and last address of the prefixes and their neighbors, where the prefix lengths matter.
+    uint64_t edge_checks = 4 * (uint64_t)ref->count;
+    int stride = edge_checks * ref->count > CHECK_BUDGET ? (int)(edge_checks * ref->count / CHECK_BUDGET) + 1 : 1;
+    for (int idx = 0; idx < ref->count; idx += stride) {
+        key6 base = ref->prefixes[idx];
+        key6 last = {base.hi | ~ref->masks[idx].hi, base.lo | ~ref->masks[idx].lo};
+        key6 before = {base.hi - (base.lo == 0), base.lo - 1}, after = {last.hi + (last.lo == ~0ull), last.lo + 1};
+        key6 edges[] = {base, last, before, after};
+        for (int edge = 0; edge < 4; edge++) {
+            ips[count++] = Addr_Of(edges[edge]);
+            if (count == BATCH) {
+                Check_Vector(table, ref, ips, count, &mismatches);
+                count = 0;
+            }
+        }
+    }
+    Check_Vector(table, ref, ips, count, &mismatches);
+
+    for (uint64_t done = 0; done < checks; done += BATCH) {
+        count = checks - done < BATCH ? (int)(checks - done) : BATCH;
+        for (int idx = 0; idx < count; idx++) {
+            ips[idx] = Bench_Random(&seed) % 2 ? Global_Address(&seed) : Routable_Address(ref, &seed);
+        }
+        Check_Vector(table, ref, ips, count, &mismatches);
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Time the table on an address stream, one address at a time and in batches.
+ */
+static void Bench_Stream(const ipv6_table *table, const char *name, const struct in6_addr *stream, uint64_t len) {
+    bench_run run;
+    forward6 lpm, lpms[BATCH];
+    char label[64];
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos < len; pos++) {
+        BENCH_KEEP(Lookup_IPV6_Table(table, &stream[pos], &lpm));
+        BENCH_KEEP(lpm);
+    }
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "lengths %s", name);
+    Bench_Report(label, &run, len);
+
+    Bench_Start(&run);
+    for (uint64_t pos = 0; pos + BATCH <= len; pos += BATCH) {
+        Lookup_IPV6_Batch(table, stream + pos, BATCH, lpms);
+        BENCH_KEEP(lpms);
+    }
+    Bench_Stop(&run);
+    snprintf(label, sizeof(label), "lengths %s (batch)", name);
+    Bench_Report(label, &run, len / BATCH * BATCH);
+}
+
+/**
+ * @brief Build the table of a set of routes, check it against the reference and benchmark it.
+ *
+ * @param title   The name of the table.
+ * @param routes  The routes.
+ * @param count   The number of routes.
+ * @param lookups The number of lookups per stream.
+ * @param checks  The number of addresses compared with the reference.
+ * @return        False if the table disagrees with the reference or fails to build.
+ */
+static bool Bench_Table(const char *title, const route6 *routes, int count, uint64_t lookups, uint64_t checks) {
+    reference ref = {0};
+    ipv6_table *table = NULL;
+    struct in6_addr *streams[3] = {0};
+    for (int kind = 0; kind < 3; kind++) streams[kind] = (struct in6_addr *)malloc(lookups * sizeof(struct in6_addr));
+    struct in6_addr *hot = (struct in6_addr *)malloc(ZIPF_DESTINATIONS * sizeof(struct in6_addr));
+    bench_zipf zipf = {0};
+    bool ok = count && streams[0] && streams[1] && streams[2] && hot && Build_Reference(&ref, routes, count) &&
+              Bench_Zipf_Init(&zipf, ZIPF_DESTINATIONS, 1.0);
+    if (!ok) {
+        fprintf(stderr, "%s: cannot build the reference\n", title);
+        goto out;
+    }
+
+    if (checks * (uint64_t)ref.count > CHECK_BUDGET) checks = CHECK_BUDGET / (uint64_t)ref.count;
+    printf("=== %s: %d routes, %llu addresses checked against the linear scan\n",
+           title, count, (unsigned long long)checks);
+
+    int histogram[IPV6_BITS + 1] = {0};
+    for (int idx = 0; idx < count; idx++) histogram[routes[idx].len]++;
+    printf("lengths:");
+    for (int len = 0; len <= IPV6_BITS; len++) {
+        if (histogram[len] * 100 >= count) printf(" /%d %.0f%%", len, histogram[len] * 100.0 / count);
+    }
+    printf("\n");
+
+    uint64_t start = Bench_Now();
+    table = Build_IPV6_Table(routes, count);
+    if (!table) {
+        fprintf(stderr, "%s: cannot build the table\n", title);
+        ok = false;
+        goto out;
+    }
+    size_t bytes = Size_IPV6_Table(table);
+    printf("%-32s %10.2f MB %9.1f B/route %9.1f ms to build\n", "lengths", bytes / 1048576.0,
+           (double)bytes / count, (Bench_Now() - start) / 1e6);
+    printf("%-32s %10zu routes %zu markers %d lengths (%d probes at most)\n", "lengths", table->size,
+           table->markers, table->num_lengths, 32 - __builtin_clz((unsigned)table->num_lengths | 1));
+    size_t mapped, huge;
+    Huge_Usage(HUGE_FIB, &mapped, &huge);
+    printf("%-32s %10.2f MB mapped, %.2f MB on 2 MB pages\n", "lengths", mapped / 1048576.0, huge / 1048576.0);
+
+    uint64_t mismatches = Check_Table(table, &ref, checks);
+    printf("%-32s %10llu mismatches\n", "lengths", (unsigned long long)mismatches);
+    ok = !mismatches;
+
+    uint64_t seed = 42;
+    for (int idx = 0; idx < ZIPF_DESTINATIONS; idx++) hot[idx] = Routable_Address(&ref, &seed);
+    for (uint64_t pos = 0; pos < lookups; pos++) {
+        streams[0][pos] = Global_Address(&seed);
+        streams[1][pos] = Routable_Address(&ref, &seed);
+        streams[2][pos] = hot[Bench_Zipf_Next(&zipf, &seed)];
+    }
+
+    Bench_Stream(table, "uniform", streams[0], lookups);
+    Bench_Stream(table, "routable", streams[1], lookups);
+    Bench_Stream(table, "zipf", streams[2], lookups);
+
+out:
+    Free_IPV6_Table(&table);
+    Bench_Zipf_Free(&zipf);
+    Free_Reference(&ref);
+    free(hot);
+    for (int kind = 0; kind < 3; kind++) free(streams[kind]);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint64_t lookups = DEFAULT_LOOKUPS, checks = DEFAULT_CHECKS;
+    int synthetic = DEFAULT_PREFIXES, mode;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:s:H:")) != -1) {
+        switch (opt) {
+            case 'n': lookups = strtoull(optarg, NULL, 10); break;
+            case 'c': checks = strtoull(optarg, NULL, 10); break;
+            case 's': synthetic = atoi(optarg); break;
+            case 'H':
+                if ((mode = Parse_Huge_Mode(optarg)) < 0) {
+                    fprintf(stderr, "bad page mode (off, thp, on)\n");
+                    return EXIT_FAILURE;
+                }
+                Set_Huge_Mode((huge_mode)mode);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n lookups] [-c checks] [-s synthetic prefixes] [-H off|thp|on] [rtable6...]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (lookups < BATCH) lookups = BATCH;
+
+    bool ok = true;
+    if (optind == argc) {
+        route6 *routes = Synthetic_Routes(synthetic);
+        char title[64];
+        snprintf(title, sizeof(title), "synthetic %d prefixes", synthetic);
+        ok = routes && Bench_Table(title, routes, synthetic, lookups, checks);
+        free(routes);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for (int table = optind; table < argc; table++) {
+        int count = 0;
+        route6 *routes = Read_IPV6_Routes(argv[table], &count);
+        if (!routes) {
+            fprintf(stderr, "cannot load %s\n", argv[table]);
+            return EXIT_FAILURE;
+        }
+        ok = Bench_Table(argv[table], routes, count, lookups, checks) && ok;
+        free(routes);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "./fake_link.h"
+#include "../utils/qos.h"
+#include "../utils/stats.h"
+
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+
+#define DEFAULT_RATE_MBIT   1000
+#define DEFAULT_LOAD        1.2                 // Offered load, a fraction of the shaper rate.
+#define DEFAULT_DURATION_MS 2000                // Simulated time of a run.
+#define DEFAULT_VECTORS     200000              // Vectors of the cost run.
+#define VECTOR              256                 // Frames per vector, as the pipeline's.
+#define STEP_NS             10000               // Simulated time between two vectors.
+#define HEADER_LEN          (ETH_HLEN + 20)
+
+// Traffic mix: share of the frames, DSCP and frame size of every class.
+static const struct traffic_class {
+    double share;
+    uint8_t dscp;
+    size_t len;
+} mix[QOS_CLASSES] = {
+    [QOS_PRIORITY]    = {0.05, 46, 200},        // EF: voice.
+    [QOS_INTERACTIVE] = {0.10, 34, 600},        // AF41: video, interactive.
+    [QOS_DEFAULT]     = {0.60, 0, 1514},
+    [QOS_BULK]        = {0.25, 10, 1514},       // AF11: backups, downloads.
+};
+
+static char *interface_names[] = {"if0"};
+
+// Class of the next frame of the mix.
+static qos_class Next_Class(uint64_t *seed) {
+    double u = (double)(Bench_Random(seed) >> 11) * 0x1.0p-53, sum = 0;
+    for (int class = 0; class < QOS_CLASSES - 1; class++) {
+        if (u < (sum += mix[class].share)) return (qos_class)class;
+    }
+    return QOS_BULK;
+}
+
+// Write the Ethernet and IPv4 headers of a frame of a class, its TOS 0 unless `marked`.
+static void Build_Frame(char *frame, qos_class class, bool marked) {
+    memset(frame, 0, HEADER_LEN);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+    frame[ETH_HLEN] = 0x45;
+    frame[ETH_HLEN + 1] = (char)(marked ? mix[class].dscp << 2 : 0);
+}
+
+/**
+ * @brief Offer a shaped interface more than its rate in simulated time, and print how long the
+ *        frames of every class waited.
+ *
+ * Every STEP_NS a vector of the frames that arrived in the meantime is queued, then the queues
+ * drained, as the pipeline does. Unmarked, every frame goes through the same FIFO: the time
+ * the priority frames would wait without classes.
+ *
+ * @return The frames of the priority class dropped.
+ */
+static uint64_t Simulate(const char *name, bool marked, uint64_t rate_bits, double load, uint64_t duration_ms) {
+    qos_rate rates[ROUTER_NUM_INTERFACES];
+    memset(rates, 0, sizeof(rates));
+    rates[0] = (qos_rate){.enabled = true, .rate = rate_bits};
+    qos *queues = Create_QoS(rates, 1);
+    char *memory = (char *)malloc((size_t)VECTOR * MAX_PACKET_LEN);
+    if (!queues || !memory) {
+        fprintf(stderr, "ERROR: NO MEMORY FOR THE QUEUES...\n");
+        exit(EXIT_FAILURE);
+    }
+    char *bufs[VECTOR];
+    for (int frame = 0; frame < VECTOR; frame++) bufs[frame] = memory + (size_t)frame * MAX_PACKET_LEN;
+
+    uint64_t seed = 0x5eed, offered[QOS_CLASSES] = {0}, dropped[QOS_CLASSES] = {0};
+    uint64_t now = QoS_Now(), end = now + duration_ms * 1000000ull;
+    double credit = 0, bytes_per_step = load * (double)rate_bits / 8 * STEP_NS / 1e9;
+    qos_class next = Next_Class(&seed);
+    Fake_Link_Reset();
+
+    for (; now < end; now += STEP_NS) {
+        credit += bytes_per_step;
+        for (int frame = 0; frame < VECTOR && credit >= (double)mix[next].len; frame++) {
+            credit -= (double)mix[next].len;
+            Build_Frame(bufs[frame], next, marked);
+            offered[next]++;
+            if (!Enqueue_QoS(queues, 0, &bufs[frame], mix[next].len, 0, &(link_offload){0}, now)) dropped[next]++;
+            next = Next_Class(&seed);
+        }
+        Drain_QoS(queues, now);
+    }
+
+    fake_link_stats link;
+    Fake_Link_Stats(&link);
+    printf("%s: %.0f Mbit/s offered to %llu Mbit/s, %.1f Mbit/s sent\n", name,
+           load * (double)rate_bits / 1e6, (unsigned long long)(rate_bits / 1000000),
+           link.tx_bytes * 8 / (duration_ms * 1e3));
+    for (int class = 0; class < QOS_CLASSES; class++) {
+        printf("  %-11s %10llu offered %10llu dropped (%.1f%%)\n", qos_names[class], (unsigned long long)offered[class],
+               (unsigned long long)dropped[class], offered[class] ? 100.0 * dropped[class] / offered[class] : 0.0);
+    }
+    Dump_QoS(stdout, &queues, 1, interface_names, 1);
+
+    uint64_t lost = dropped[QOS_PRIORITY];
+    Free_QoS(&queues);
+    free(memory);
+    return lost;
+}
+
+/**
+ * @brief Time the queueing and the scheduling per frame, at line rate (no shaper): every
+ *        vector of the mix queued, then sent.
+ */
+static void Bench_Cost(uint64_t vectors) {
+    qos_rate rates[ROUTER_NUM_INTERFACES];
+    memset(rates, 0, sizeof(rates));
+    rates[0].enabled = true;
+    qos *queues = Create_QoS(rates, 1);
+    char *memory = (char *)malloc((size_t)VECTOR * MAX_PACKET_LEN);
+    if (!queues || !memory) {
+        fprintf(stderr, "ERROR: NO MEMORY FOR THE QUEUES...\n");
+        exit(EXIT_FAILURE);
+    }
+    char *bufs[VECTOR];
+    size_t lens[VECTOR];
+    for (int frame = 0; frame < VECTOR; frame++) bufs[frame] = memory + (size_t)frame * MAX_PACKET_LEN;
+
+    uint64_t seed = 0xc057, queued = 0;
+    link_offload plain = {0};
+    bench_run run;
+    Bench_Start(&run);
+    for (uint64_t vector = 0; vector < vectors; vector++) {
+        uint64_t now = QoS_Now();
+        for (int frame = 0; frame < VECTOR; frame++) {
+            qos_class class = Next_Class(&seed);
+            Build_Frame(bufs[frame], class, true);
+            lens[frame] = mix[class].len;
+        }
+        for (int frame = 0; frame < VECTOR; frame++) {
+            queued += Enqueue_QoS(queues, 0, &bufs[frame], lens[frame], 0, &plain, now);
+        }
+        BENCH_KEEP(Drain_QoS(queues, now));
+    }
+    Bench_Stop(&run);
+    Bench_Report("queue + schedule, per frame", &run, vectors * VECTOR);
+    if (queued != vectors * VECTOR) printf("%llu frames dropped\n", (unsigned long long)(vectors * VECTOR - queued));
+
+    Free_QoS(&queues);
+    free(memory);
+}
+
+// The select timeouts of the shaper waits around the second boundaries: rounded up to the
+// microsecond, and never a tv_usec of a whole second (select fails with EINVAL on it).
+static bool Check_Link_Timeout(void) {
+    static const struct {
+        int64_t ns;
+        long sec, usec;
+    } waits[] = {
+        {0, 0, 0}, {1, 0, 1}, {1000, 0, 1}, {1001, 0, 2}, {999999000, 0, 999999},
+        {999999001, 1, 0}, {999999500, 1, 0}, {999999999, 1, 0}, {1000000000, 1, 0},
+        {1999999999, 2, 0}, {2000000001, 2, 1},
+    };
+    size_t count = sizeof(waits) / sizeof(waits[0]);
+
+    bool ok = true;
+    for (size_t idx = 0; idx < count; idx++) {
+        struct timeval timeout = Link_Timeout(waits[idx].ns);
+        if (timeout.tv_sec != waits[idx].sec || timeout.tv_usec != waits[idx].usec) {
+            printf("wait of %lld ns: %ld s %ld us, %ld s %ld us expected\n", (long long)waits[idx].ns,
+                   (long)timeout.tv_sec, (long)timeout.tv_usec, waits[idx].sec, waits[idx].usec);
+            ok = false;
+        }
+    }
+    printf("%-32s %10zu waits checked, %s\n", "Link_Timeout", count, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint64_t rate_mbit = DEFAULT_RATE_MBIT, duration_ms = DEFAULT_DURATION_MS, vectors = DEFAULT_VECTORS;
+    double load = DEFAULT_LOAD;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:l:d:n:")) != -1) {
+        switch (opt) {
+            case 'r': rate_mbit = strtoull(optarg, NULL, 10); break;
+            case 'l': load = atof(optarg); break;
+            case 'd': duration_ms = strtoull(optarg, NULL, 10); break;
+            case 'n': vectors = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-r Mbit/s] [-l load] [-d simulated ms] [-n vectors]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (rate_mbit < 1) rate_mbit = 1;
+    if (load <= 0) load = DEFAULT_LOAD;
+    if (duration_ms < 1) duration_ms = 1;
+
+    if (!Check_Link_Timeout()) return EXIT_FAILURE;
+    Bench_Cost(vectors);
+
+    // The same frames, first all in one FIFO, then by class.
+    Simulate("fifo", false, rate_mbit * 1000000, load, duration_ms);
+    uint64_t lost = Simulate("qos", true, rate_mbit * 1000000, load, duration_ms);
+    if (lost) printf("%llu priority frames dropped\n", (unsigned long long)lost);
+    return lost ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+
+#include "./bench.h"
+#include "../res/ipv4/vrf.h"
+
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_PREFIXES    200000
+#define DEFAULT_VRFS        MAX_VRFS
+#define DEFAULT_DELTA       1.0                 // Routes of a VRF that differ from the base table, in percent.
+#define DEFAULT_LOOKUPS     (1u << 24)
+#define DEFAULT_CHECKS      (1u << 20)
+#define STREAM              (1u << 20)          // Addresses of the timed stream, replayed.
+
+/**
+ * @brief Routes of a VRF: the base table, a share of its routes through other next hops and as
+ *        many prefixes of its own (10.vrf.x.y/24 customers).
+ *
+ * @param base  The base routes.
+ * @param count The number of base routes, receives the number of routes of the VRF.
+ * @param vrf   The VRF, 0 is the base table as it is.
+ * @param delta The share of the routes that differ, in percent.
+ * @return The routes, or NULL if memory allocation fails.
+ */
+static route* VRF_Routes(const route *base, int *count, int vrf, double delta) {
+    int changes = vrf ? (int)(*count * delta / 100) : 0;
+    route *routes = (route *)malloc((*count + changes) * sizeof(route));
+    if (!routes) return NULL;
+    memcpy(routes, base, *count * sizeof(route));
+
+    uint64_t seed = 0xf00d + (uint64_t)vrf;
+    for (int change = 0; change < changes; change++) {
+        route *changed = &routes[Bench_Random(&seed) % (uint64_t)*count];
+        changed->next_hop = htonl(0xac100000u | (uint32_t)vrf << 12 | (uint32_t)(Bench_Random(&seed) & 0xfff));
+    }
+    for (int own = 0; own < changes; own++) {
+        route *added = &routes[*count + own];
+        added->prefix = htonl(0x0a000000u | (uint32_t)vrf << 16 | (uint32_t)(own & 0xffff) << 8);
+        added->mask = htonl(0xffffff00u);
+        added->next_hop = htonl(0xc0a80000u | (uint32_t)vrf << 8 | (uint32_t)(own & 0xff));
+        added->interface = vrf % 3;
+    }
+    // The customers of a large delta wrap around, a repeated prefix would be a multipath route.
+    *count += changes < 0x10000 ? changes : 0x10000;
+    return routes;
+}
+
+/**
+ * @brief Look up random addresses in every shared table and in its copy built apart.
+ *
+ * @return The number of mismatches.
+ */
+static uint64_t Check_Tables(ipv4_table **apart, const vrf_set *set, uint64_t checks) {
+    uint64_t seed = 0xc4ec, mismatches = 0;
+    for (uint64_t check = 0; check < checks; check++) {
+        int vrf = (int)(Bench_Random(&seed) % (uint64_t)set->count);
+        uint32_t ip = (uint32_t)Bench_Random(&seed);
+        forward want, got;
+        bool found = Lookup_IPV4_Table(apart[vrf], ip, &want);
+        if (found != Lookup_IPV4_Table(set->tables[vrf], ip, &got) ||
+            (found && (want.next_hop != got.next_hop || want.interface != got.interface))) {
+            if (mismatches++ < 5) {
+                struct in_addr addr = {.s_addr = ip};
+                printf("  mismatch in vrf %d for %s\n", vrf, inet_ntoa(addr));
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Time the batched lookups of a stream of addresses, each in the table of its VRF.
+ */
+static void Bench_Lookups(const char *name, ipv4_table **tables, int vrfs, uint64_t lookups) {
+    uint32_t *ips = (uint32_t *)malloc(STREAM * sizeof(uint32_t));
+    ipv4_table **owners = (ipv4_table **)malloc(STREAM * sizeof(ipv4_table *));
+    if (!ips || !owners) {
+        free(ips);
+        free(owners);
+        return;
+    }
+    uint64_t seed = 0x10c4;
+    for (uint32_t idx = 0; idx < STREAM; idx++) {
+        ips[idx] = (uint32_t)Bench_Random(&seed);
+        owners[idx] = tables[Bench_Random(&seed) % (uint64_t)vrfs];
+    }
+
+    forward lpms[MAX_BATCH];
+    uint64_t done = 0;
+    bench_run run;
+    Bench_Start(&run);
+    while (done < lookups) {
+        for (uint32_t idx = 0; idx < STREAM && done < lookups; idx += MAX_BATCH, done += MAX_BATCH) {
+            Lookup_IPV4_Tables(owners + idx, ips + idx, MAX_BATCH, lpms);
+            BENCH_KEEP(lpms[0].next_hop);
+        }
+    }
+    Bench_Stop(&run);
+    Bench_Report(name, &run, done);
+    free(ips);
+    free(owners);
+}
+
+int main(int argc, char **argv) {
+    int prefixes = DEFAULT_PREFIXES, vrfs = DEFAULT_VRFS;
+    double delta = DEFAULT_DELTA;
+    uint64_t lookups = DEFAULT_LOOKUPS, checks = DEFAULT_CHECKS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:v:d:n:c:")) != -1) {
+        switch (opt) {
+            case 's': prefixes = atoi(optarg); break;
+            case 'v': vrfs = atoi(optarg); break;
+            case 'd': delta = atof(optarg); break;
+            case 'n': lookups = strtoull(optarg, NULL, 10); break;
+            case 'c': checks = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s prefixes] [-v vrfs] [-d percent different] [-n lookups] [-c checks]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (prefixes < 1 || vrfs < 1 || vrfs > MAX_VRFS || delta < 0) {
+        fprintf(stderr, "1 to %d vrfs, at least one prefix\n", MAX_VRFS);
+        return EXIT_FAILURE;
+    }
+
+    route *base = Bench_Routes(prefixes, 0x5eed);
+    if (!base) return EXIT_FAILURE;
+    int count = Bench_Unique_Routes(base, prefixes);
+
+    // Every VRF twice: its table apart, and the one the set takes over.
+    ipv4_table *apart[MAX_VRFS], *shared[MAX_VRFS];
+    size_t apart_bytes = 0;
+    for (int vrf = 0; vrf < vrfs; vrf++) {
+        int routes_count = count;
+        route *routes = VRF_Routes(base, &routes_count, vrf, delta);
+        apart[vrf] = routes ? Build_IPV4_Table(routes, routes_count) : NULL;
+        shared[vrf] = routes ? Build_IPV4_Table(routes, routes_count) : NULL;
+        free(routes);
+        if (!apart[vrf] || !shared[vrf]) {
+            fprintf(stderr, "cannot build the table of vrf %d\n", vrf);
+            return EXIT_FAILURE;
+        }
+        apart_bytes += Size_IPV4_Table(apart[vrf]);
+    }
+    free(base);
+
+    uint64_t start = Bench_Now();
+    vrf_set *set = Create_VRF_Set(shared, vrfs);
+    uint64_t took = Bench_Now() - start;
+    if (!set) {
+        fprintf(stderr, "cannot share the tables\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%d vrfs of %d prefixes, %.1f%% different: %zu nodes apart (%.1f MB), %zu shared (%.1f MB), "
+           "%.2fx the memory of one table, shared in %.1f ms\n", vrfs, count, delta, set->apart,
+           apart_bytes / 1048576.0, set->nodes, Size_VRF_Set(set) / 1048576.0,
+           (double)Size_VRF_Set(set) / (double)Size_IPV4_Table(apart[0]), took / 1e6);
+
+    uint64_t mismatches = Check_Tables(apart, set, checks);
+    printf("%llu lookups checked, %llu mismatches\n", (unsigned long long)checks, (unsigned long long)mismatches);
+
+    Bench_Lookups("Lookup_IPV4_Tables, apart", apart, vrfs, lookups);
+    Bench_Lookups("Lookup_IPV4_Tables, shared", set->tables, vrfs, lookups);
+
+    for (int vrf = 0; vrf < vrfs; vrf++) Free_IPV4_Table(&apart[vrf]);
+    Free_VRF_Set(&set);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+
+#include "./fake_link.h"
+#include "../res/arp/arp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+// In-memory stand-in for the link layer of lib.c, so the forwarding code runs without sockets.
+// Received frames are copied from a replayed trace (as the kernel copies them from its ring),
+// sent frames are only counted. Single threaded: the bench runs one worker.
+
+// Interface table, set by the bench instead of read from the kernel.
+static struct interface_info {
+	uint32_t ip;
+	uint8_t mac[6];
+	int mtu;			// 0 for the default, a frame of MAX_PACKET_LEN.
+} interfaces_info[ROUTER_NUM_INTERFACES];
+
+// Replayed trace and the position of the next frame to receive.
+static const fake_frame *trace;
+static size_t trace_len, trace_pos;
+
+// Frames received before the trace, a ring filled by the ARP responder.
+static struct injected_frame {
+	char buf[sizeof(struct ethhdr) + sizeof(struct arphdr)];
+	size_t len;
+	int interface;
+} inject_ring[FAKE_LINK_INJECT];
+static size_t inject_head, inject_tail;
+
+static bool answer_arp;
+static fake_link_tap tap;
+static fake_link_stats stats;
+
+/*********************************************************************************/
+
+// Set the addresses of an interface of the in-memory link.
+void Fake_Link_Interface(int interface, uint32_t ip, const uint8_t *mac) {
+	interfaces_info[interface].ip = ip;
+	memcpy(interfaces_info[interface].mac, mac, 6);
+}
+
+// Set the MTU of an interface of the in-memory link, 0 for the default.
+void Fake_Link_MTU(int interface, int mtu) {
+	interfaces_info[interface].mtu = mtu;
+}
+
+// Hand every frame sent to a function, NULL to only count them.
+void Fake_Link_Tap(fake_link_tap fn) {
+	tap = fn;
+}
+
+// Replay a trace on the receive side, from its start, cyclically; NULL stops it.
+void Fake_Link_Replay(const fake_frame *frames, size_t count) {
+	trace = frames;
+	trace_len = frames ? count : 0;
+	trace_pos = 0;
+}
+
+// Answer every ARP request sent, in the next receive burst.
+void Fake_Link_Answer_ARP(bool answer) {
+	answer_arp = answer;
+}
+
+// MAC address the link answers ARP requests with: 02:00 followed by the IPv4 address.
+void Fake_Link_MAC(uint32_t ip, uint8_t *mac) {
+	mac[0] = 0x02;
+	mac[1] = 0x00;
+	memcpy(mac + 2, &ip, sizeof(ip));
+}
+
+// Queue a frame for the next receive bursts, ahead of the trace.
+// Returns false (and counts a drop) when the ring is full or the frame is too long.
+bool Fake_Link_Inject(const char *buf, size_t len, int interface) {
+	if (inject_tail - inject_head == FAKE_LINK_INJECT || len > sizeof(inject_ring[0].buf)) {
+		stats.dropped++;
+		return false;
+	}
+
+	struct injected_frame *frame = &inject_ring[inject_tail++ % FAKE_LINK_INJECT];
+	memcpy(frame->buf, buf, len);
+	frame->len = len;
+	frame->interface = interface;
+	return true;
+}
+
+// Number of frames waiting in the inject ring.
+size_t Fake_Link_Pending(void) {
+	return inject_tail - inject_head;
+}
+
+// Number of trace frames received since the last reset.
+uint64_t Fake_Link_Received(void) {
+	return stats.rx;
+}
+
+// Read the link counters.
+void Fake_Link_Stats(fake_link_stats *out) {
+	*out = stats;
+}
+
+// Reset the link counters and drop the injected frames.
+void Fake_Link_Reset(void) {
+	memset(&stats, 0, sizeof(stats));
+	inject_head = inject_tail = 0;
+}
+
+// Answer an ARP request sent on an interface, as the neighbor it asks for would.
+static void Answer_ARP_Request(const char *frame_data, size_t len, int interface) {
+	if (len < sizeof(struct ethhdr) + sizeof(struct arphdr)) return;
+
+	char reply[sizeof(struct ethhdr) + sizeof(struct arphdr)];
+	struct ethhdr *eth_hdr = (struct ethhdr *)reply;
+	struct arphdr *arp_hdr = (struct arphdr *)(reply + sizeof(struct ethhdr));
+	memcpy(reply, frame_data, sizeof(reply));
+
+	uint32_t target = arp_hdr->tpa;
+	uint8_t mac[6];
+	Fake_Link_MAC(target, mac);
+
+	arp_hdr->op = OP_REPLY;
+	memcpy(arp_hdr->tha, arp_hdr->sha, MAC_SIZE);
+	arp_hdr->tpa = arp_hdr->spa;
+	memcpy(arp_hdr->sha, mac, MAC_SIZE);
+	arp_hdr->spa = target;
+
+	memcpy(eth_hdr->ether_dhost, eth_hdr->ether_shost, MAC_SIZE);
+	memcpy(eth_hdr->ether_shost, mac, MAC_SIZE);
+
+	Fake_Link_Inject(reply, sizeof(reply), interface);
+}
+
+// Count a sent frame, and answer it if it is an ARP request.
+static void Transmit(int interface, const char *frame_data, size_t len) {
+	stats.tx++;
+	stats.tx_bytes += len;
+	if (tap) tap(interface, frame_data, len);
+
+	const struct ethhdr *eth_hdr = (const struct ethhdr *)frame_data;
+	if (len < sizeof(struct ethhdr) + sizeof(struct arphdr) || eth_hdr->ether_type != ARP_TYPE) return;
+
+	const struct arphdr *arp_hdr = (const struct arphdr *)(frame_data + sizeof(struct ethhdr));
+	if (arp_hdr->op != OP_REQUEST) return;
+
+	stats.arp_requests++;
+	if (answer_arp) Answer_ARP_Request(frame_data, len, interface);
+}
+
+/*********************************************************************************/
+
+// Frames are not timestamped, the bench times the whole run instead.
+void Enable_Link_Timestamps(void) {
+}
+
+// The trace frames are plain, there is no kernel to coalesce them.
+void Enable_Link_Offload(void) {
+}
+
+// The trace frames are at most MAX_PACKET_LEN.
+size_t Get_Frame_Size(void) {
+	return MAX_PACKET_LEN;
+}
+
+// The interfaces are set with Fake_Link_Interface, the names are only kept by the real link.
+void Init_Network(int argc, char *argv[], int workers) {
+	(void)argc;
+	(void)argv;
+	(void)workers;
+}
+
+// A single worker, nothing to bind.
+void Bind_Worker_Link(int worker) {
+	(void)worker;
+}
+
+// The trace never runs dry, nothing to wait for.
+void Set_Link_Wait(int64_t ns) {
+	(void)ns;
+}
+
+// No timestamps, no latency.
+void Dump_Link_Latency(FILE *out) {
+	(void)out;
+}
+
+// Send a network message to a specific network interface.
+int Send_To_Link(int interface, char *frame_data, size_t length) {
+	Transmit(interface, frame_data, length);
+	return (int)length;
+}
+
+// Send a network message to a specific network interface, its timestamp is ignored.
+int Send_Stamped_Link(int interface, char *frame_data, size_t length, uint64_t stamp, int path) {
+	(void)stamp;
+	(void)path;
+	return Send_To_Link(interface, frame_data, length);
+}
+
+// Send a network message to a specific network interface, its offload state is ignored.
+int Send_Offload_Link(int interface, char *frame_data, size_t length, const link_offload *offload,
+                      uint64_t stamp, int path) {
+	(void)offload;
+	return Send_Stamped_Link(interface, frame_data, length, stamp, path);
+}
+
+// Send a burst of network messages to a specific network interface.
+int Send_Burst_Link(int interface, char **frames, size_t *lengths, int count, const uint64_t *stamps,
+                    link_offload *offloads, int path) {
+	(void)stamps;
+	(void)offloads;
+	(void)path;
+	for (int frame = 0; frame < count; frame++) {
+		Transmit(interface, frames[frame], lengths[frame]);
+	}
+	return count;
+}
+
+// Receive a burst of frames: the injected ones first, then the next frames of the trace.
+// Returns the number of frames received, 0 when there is nothing to replay.
+int Recv_Burst_Link(char **frames, size_t *lengths, int *ifaces, uint64_t *stamps, link_offload *offloads, int max) {
+	int count = 0;
+	if (stamps) memset(stamps, 0, (size_t)max * sizeof(*stamps));
+	if (offloads) memset(offloads, 0, (size_t)max * sizeof(*offloads));
+
+	while (count < max && inject_head != inject_tail) {
+		struct injected_frame *frame = &inject_ring[inject_head++ % FAKE_LINK_INJECT];
+		memcpy(frames[count], frame->buf, frame->len);
+		lengths[count] = frame->len;
+		ifaces[count++] = frame->interface;
+		stats.injected++;
+	}
+
+	while (count < max && trace_len) {
+		const fake_frame *frame = &trace[trace_pos];
+		if (++trace_pos == trace_len) trace_pos = 0;
+
+		memcpy(frames[count], frame->buf, frame->len);
+		lengths[count] = frame->len;
+		ifaces[count++] = frame->interface;
+		stats.rx++;
+	}
+
+	return count;
+}
+
+// Receive a single frame, -1 when there is nothing to replay.
+int Recv_FromAny_Link(char *frame_data, size_t *length) {
+	int interface;
+	return Recv_Burst_Link(&frame_data, length, &interface, NULL, NULL, 1) ? interface : -1;
+}
+
+/*********************************************************************************/
+
+// Get the IP address as a string for a given network interface.
+char *Get_IP_Interface(int interface) {
+	struct in_addr addr = { .s_addr = interfaces_info[interface].ip };
+	return inet_ntoa(addr);
+}
+
+// Get the IPv4 address as an integer for a given network interface.
+uint32_t Get_IPV4_Interface(int interface) {
+	return interfaces_info[interface].ip;
+}
+
+// The in-memory link has no IPv6 addresses.
+const struct in6_addr *Get_IPV6_Interface(int interface, int *count) {
+	(void)interface;
+	*count = 0;
+	return NULL;
+}
+
+// Get the MAC address for a given network interface.
+void Get_MAC_Interface(int interface, uint8_t *mac) {
+	memcpy(mac, interfaces_info[interface].mac, 6);
+}
+
+// An interface of the in-memory link sends any frame of MAX_PACKET_LEN, unless given a lower MTU.
+int Get_MTU_Interface(int interface) {
+	if (interfaces_info[interface].mtu) return interfaces_info[interface].mtu;
+	return MAX_PACKET_LEN - (int)sizeof(struct ethhdr);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef FAKE_LINK_H_
+#define FAKE_LINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../utils/lib.h"
+
+#define FAKE_LINK_INJECT 4096       // Frames the link can hold for the next receive bursts.
+
+// A frame of a replayed trace, received on a given interface.
+typedef struct fake_frame {
+    char *buf;                      // Frame data.
+    size_t len;                     // Frame length.
+    int interface;                  // Ingress interface.
+} fake_frame;
+
+// Function the sent frames are handed to, as they leave.
+typedef void (*fake_link_tap)(int interface, const char *frame, size_t len);
+
+// Counters of the in-memory link, since the last reset.
+typedef struct fake_link_stats {
+    uint64_t rx;                    // Trace frames received.
+    uint64_t injected;              // Frames received from the inject ring (ARP replies).
+    uint64_t tx;                    // Frames sent.
+    uint64_t tx_bytes;              // Bytes sent.
+    uint64_t arp_requests;          // ARP requests sent.
+    uint64_t dropped;               // Frames the inject ring had no room for.
+} fake_link_stats;
+
+/** @brief Set the addresses of an interface of the in-memory link. */
+void    Fake_Link_Interface     (int interface, uint32_t ip, const uint8_t *mac);
+/** @brief Set the MTU of an interface of the in-memory link, 0 for the default. */
+void    Fake_Link_MTU           (int interface, int mtu);
+/** @brief Hand every frame sent to a function, NULL to only count them. */
+void    Fake_Link_Tap           (fake_link_tap tap);
+/** @brief Replay a trace on the receive side, from its start, cyclically; NULL stops it. */
+void    Fake_Link_Replay        (const fake_frame *frames, size_t count);
+/** @brief Answer every ARP request sent, in the next receive burst. */
+void    Fake_Link_Answer_ARP    (bool answer);
+/** @brief Queue a frame for the next receive bursts, ahead of the trace. */
+bool    Fake_Link_Inject        (const char *buf, size_t len, int interface);
+/** @brief Number of frames waiting in the inject ring. */
+size_t  Fake_Link_Pending       (void);
+
+/** @brief Number of trace frames received since the last reset. */
+uint64_t Fake_Link_Received     (void);
+/** @brief Read the link counters. */
+void    Fake_Link_Stats         (fake_link_stats *stats);
+/** @brief Reset the link counters and drop the injected frames. */
+void    Fake_Link_Reset         (void);
+
+/** @brief MAC address the link answers ARP requests with for an IPv4 address. */
+void    Fake_Link_MAC           (uint32_t ip, uint8_t *mac);
+
+#endif /* FAKE_LINK_H_ */
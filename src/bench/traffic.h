@@ -0,0 +1,26 @@
+#pragma once
+#ifndef TRAFFIC_H_
+#define TRAFFIC_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#define TRAFFIC_MAGIC   0x5254u         // "RT"
+#define TRAFFIC_PORT    9000
+#define TRAFFIC_HEADERS (14 + 20 + 8 + 4) // Ethernet, IPv4, UDP headers and FCS of a probe frame.
+
+// Payload of every generated frame, read back by the sink. Fits a 64 byte frame.
+typedef struct traffic_probe {
+    uint16_t magic;
+    uint16_t flow;                      // Source port offset, so fanout spreads the flows.
+    uint32_t seq;                       // Sequence number within the flow.
+    uint64_t sent_ns;                   // CLOCK_MONOTONIC when sent, the namespaces share the clock.
+} traffic_probe;
+
+static inline uint64_t Traffic_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* TRAFFIC_H_ */
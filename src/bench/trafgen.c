@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+
+#include "./traffic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_FLOWS       256
+#define BURST           32
+#define MAX_FRAME_LEN   1518
+
+/**
+ * @brief Open one UDP socket per flow, each bound to its own source port.
+ *
+ * UDP checksums are left out (SO_NO_CHECK), so the frames are complete when the router reads
+ * them from a veth with checksum offload.
+ *
+ * @param sockets Array receiving the sockets.
+ * @param flows   The number of flows.
+ * @param dest    The sink address.
+ * @return        False if a socket cannot be set up.
+ */
+static bool Open_Flows(int *sockets, int flows, const struct sockaddr_in *dest) {
+    for (int flow = 0; flow < flows; flow++) {
+        sockets[flow] = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockets[flow] < 0) return false;
+
+        int no_check = 1;
+        setsockopt(sockets[flow], SOL_SOCKET, SO_NO_CHECK, &no_check, sizeof(no_check));
+
+        struct sockaddr_in src = {.sin_family = AF_INET, .sin_port = htons((uint16_t)(20000 + flow))};
+        if (bind(sockets[flow], (const struct sockaddr *)&src, sizeof(src)) < 0 ||
+            connect(sockets[flow], (const struct sockaddr *)dest, sizeof(*dest)) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    double rate = 0, duration = 5;
+    int size = 64, flows = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:d:f:")) != -1) {
+        switch (opt) {
+            case 'r': rate = atof(optarg); break;
+            case 's': size = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'f': flows = atoi(optarg); break;
+            default: goto usage;
+        }
+    }
+    if (optind != argc - 1) goto usage;
+
+    // Frame size on the wire, FCS included as in RFC 2544: headers, then the probe, padded.
+    int min_size = TRAFFIC_HEADERS + (int)sizeof(traffic_probe);
+    if (size < min_size || size > MAX_FRAME_LEN || flows < 1 || flows > MAX_FLOWS || rate < 0 || duration <= 0) {
+        fprintf(stderr, "frame size %d..%d, 1..%d flows\n", min_size, MAX_FRAME_LEN, MAX_FLOWS);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_in dest = {.sin_family = AF_INET, .sin_port = htons(TRAFFIC_PORT)};
+    if (!inet_aton(argv[optind], &dest.sin_addr)) goto usage;
+
+    int sockets[MAX_FLOWS];
+    if (!Open_Flows(sockets, flows, &dest)) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    static char payloads[BURST][MAX_FRAME_LEN];
+    struct iovec iovs[BURST];
+    struct mmsghdr msgs[BURST];
+    size_t payload_len = (size_t)(size - TRAFFIC_HEADERS);
+    for (int msg = 0; msg < BURST; msg++) {
+        iovs[msg] = (struct iovec){payloads[msg], payload_len};
+        memset(&msgs[msg], 0, sizeof(msgs[msg]));
+        msgs[msg].msg_hdr.msg_iov = &iovs[msg];
+        msgs[msg].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint32_t seqs[MAX_FLOWS] = {0};
+    uint64_t sent = 0, failed = 0;
+    uint64_t start = Traffic_Now(), end = start + (uint64_t)(duration * 1e9);
+    // At low rates the bursts shrink, so the pacing stays smooth.
+    int burst = rate > 0 && rate < 100000 ? 1 : BURST;
+
+    for (int flow = 0; Traffic_Now() < end; flow = (flow + 1) % flows) {
+        // Pace against the start time, a late burst is caught up rather than lost.
+        if (rate > 0) {
+            uint64_t due = start + (uint64_t)((double)sent * 1e9 / rate);
+            while (Traffic_Now() < due) {}
+        }
+
+        uint64_t now = Traffic_Now();
+        for (int msg = 0; msg < burst; msg++) {
+            traffic_probe probe = {TRAFFIC_MAGIC, (uint16_t)flow, seqs[flow]++, now};
+            memcpy(payloads[msg], &probe, sizeof(probe));
+        }
+
+        int ret = sendmmsg(sockets[flow], msgs, burst, 0);
+        if (ret < 0) {
+            // A full socket buffer drops the burst, as a NIC queue would. A port unreachable from
+            // the sink host (no sink yet) only fails the next send.
+            if (errno != ENOBUFS && errno != EAGAIN && errno != ECONNREFUSED) {
+                fprintf(stderr, "sendmmsg: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+            }
+            failed += burst;
+            seqs[flow] -= burst;
+            continue;
+        }
+        sent += ret;
+        seqs[flow] -= burst - ret;
+    }
+
+    double elapsed = (Traffic_Now() - start) / 1e9;
+    printf("sent=%llu failed=%llu seconds=%.3f pps=%.0f size=%d flows=%d\n", (unsigned long long)sent,
+           (unsigned long long)failed, elapsed, sent / elapsed, size, flows);
+    return EXIT_SUCCESS;
+
+usage:
+    fprintf(stderr, "Usage: %s [-r pps, 0 = max] [-s frame size] [-d seconds] [-f flows] sink-ip\n", argv[0]);
+    return EXIT_FAILURE;
+}
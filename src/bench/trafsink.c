@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+
+#include "./traffic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_FLOWS       256
+#define BURST           64
+#define MAX_SAMPLES     (1 << 22)   // Latencies kept for the percentiles, a uniform sample beyond.
+#define MAX_PAYLOAD     1500
+
+static volatile sig_atomic_t stop;
+
+static void On_Signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static int Compare_U64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Percentile of sorted samples, in microseconds.
+ *
+ * @param samples The sorted latencies (ns).
+ * @param count   The number of samples.
+ * @param pct     The percentile (0..100).
+ * @return        The latency in microseconds.
+ */
+static double Percentile(const uint64_t *samples, uint64_t count, double pct) {
+    if (!count) return 0;
+    uint64_t idx = (uint64_t)(pct / 100.0 * (double)(count - 1) + 0.5);
+    return samples[idx] / 1e3;
+}
+
+int main(int argc, char **argv) {
+    double idle = 2;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': idle = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t idle seconds before exiting, 0 = until SIGINT]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(TRAFFIC_PORT)};
+    int rcvbuf = 64 << 20;
+    struct timeval timeout = {.tv_usec = 100000};
+    if (sock < 0 || bind(sock, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    signal(SIGINT, On_Signal);
+    signal(SIGTERM, On_Signal);
+
+    uint64_t *samples = (uint64_t *)malloc(MAX_SAMPLES * sizeof(uint64_t));
+    if (!samples) return EXIT_FAILURE;
+
+    static char payloads[BURST][MAX_PAYLOAD];
+    struct iovec iovs[BURST];
+    struct mmsghdr msgs[BURST];
+    for (int msg = 0; msg < BURST; msg++) {
+        iovs[msg] = (struct iovec){payloads[msg], MAX_PAYLOAD};
+        memset(&msgs[msg], 0, sizeof(msgs[msg]));
+        msgs[msg].msg_hdr.msg_iov = &iovs[msg];
+        msgs[msg].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint64_t next_seq[MAX_FLOWS] = {0};
+    uint64_t received = 0, bytes = 0, reordered = 0, count = 0, seed = 88172645463325252ull;
+    uint64_t first = 0, last = 0;
+
+    while (!stop) {
+        int ret = recvmmsg(sock, msgs, BURST, MSG_WAITFORONE, NULL);
+        uint64_t now = Traffic_Now();
+        if (ret <= 0) {
+            if (idle > 0 && received && now - last > (uint64_t)(idle * 1e9)) break;
+            continue;
+        }
+
+        if (!received) first = now;
+        last = now;
+
+        for (int msg = 0; msg < ret; msg++) {
+            traffic_probe probe;
+            if (msgs[msg].msg_len < sizeof(probe)) continue;
+            memcpy(&probe, payloads[msg], sizeof(probe));
+            if (probe.magic != TRAFFIC_MAGIC || probe.flow >= MAX_FLOWS) continue;
+
+            received++;
+            bytes += msgs[msg].msg_len + TRAFFIC_HEADERS;
+
+            // Losses are counted from the highest sequence number seen on each flow.
+            if (probe.seq < next_seq[probe.flow]) reordered++;
+            else next_seq[probe.flow] = probe.seq + 1;
+
+            // Reservoir sampling keeps a uniform sample of the latencies once the array is full.
+            uint64_t latency = now - probe.sent_ns;
+            if (count < MAX_SAMPLES) {
+                samples[count++] = latency;
+            } else {
+                seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+                uint64_t slot = seed % received;
+                if (slot < MAX_SAMPLES) samples[slot] = latency;
+            }
+        }
+    }
+
+    uint64_t expected = 0;
+    for (int flow = 0; flow < MAX_FLOWS; flow++) expected += next_seq[flow];
+    uint64_t lost = expected > received - reordered ? expected - (received - reordered) : 0;
+
+    qsort(samples, count, sizeof(uint64_t), Compare_U64);
+    double seconds = received > 1 ? (last - first) / 1e9 : 0;
+
+    printf("received=%llu lost=%llu reordered=%llu seconds=%.3f pps=%.0f mbps=%.1f "
+           "p50_us=%.1f p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+           (unsigned long long)received, (unsigned long long)lost, (unsigned long long)reordered, seconds,
+           seconds > 0 ? received / seconds : 0, seconds > 0 ? bytes * 8 / seconds / 1e6 : 0,
+           Percentile(samples, count, 50), Percentile(samples, count, 90), Percentile(samples, count, 99),
+           Percentile(samples, count, 99.9), count ? samples[count - 1] / 1e3 : 0);
+
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,390 @@
+#include "./include/router.h"
+#include "./res/ipv4/ipv4.h"
+#include "./res/ipv4/aggregate.h"
+#include "./res/arp/arp.h"
+#include "./res/pipeline/pipeline.h"
+
+#include <sched.h>
+
+/* -------------------------------------------------- ROUTING CONTEXT -------------------------------------------------- */
+
+/**
+ * @brief Initialize the control state shared by all the workers.
+ * 
+ * Allocate memory for the control structure and initializes its fields,
+ * including the IPv4 / IPv6 routing tables, the ARP table, the neighbor cache and the waiting queues. If any of the
+ * initialization steps fail, it deallocates previously allocated memory and returns NULL.
+ * 
+ * @param file  A path to the file containing IPv4 routing table information,
+ *              NULL if the workers map a shared FIB instead.
+ * @param file6 A path to the file containing IPv6 routing table information,
+ *              NULL if IPv6 is not routed.
+ * @param aggregate True to aggregate the IPv4 routes (ORTC) before building the routing table.
+ * @return      A pointer to the initialized control structure or NULL on failure.
+ */
+control* Create_Control(char *file, char *file6, bool aggregate) {
+    control *ctrl = (control*)calloc(1, sizeof(control));
+    if (!ctrl) return NULL;
+    pthread_mutex_init(&ctrl->waiting_lock, NULL);
+    pthread_mutex_init(&ctrl->acl_lock, NULL);
+    pthread_mutex_init(&ctrl->fib_lock, NULL);
+
+    // Initialize the IPv4 routing table, unless the FIB is shared.
+    if (file && aggregate) {
+        aggregate_report report;
+        ctrl->ipv4s = Create_Aggregated_IPV4_Table(file, &report);
+        if (ctrl->ipv4s) Print_Aggregate_Report(stderr, file, &report);
+    } else {
+        ctrl->ipv4s = file ? Create_IPV4_Table(file) : NULL;
+    }
+    ctrl->fib_name = NULL;
+    if (file && !ctrl->ipv4s) {
+        Free_Control(ctrl);
+        return NULL;
+    }
+
+    // Initialize the IPv6 routing table, when IPv6 is routed.
+    ctrl->ipv6s = file6 ? Create_IPV6_Table(file6) : NULL;
+    if (file6 && !ctrl->ipv6s) {
+        Free_Control(ctrl);
+        return NULL;
+    }
+
+    // Initialize the ARP table and the neighbor cache.
+    ctrl->macs = Create_ARP_Table();
+    ctrl->neighbors = Create_ND_Table();
+    if (!ctrl->macs || !ctrl->neighbors) {
+        Free_Control(ctrl);
+        return NULL;
+    }
+
+    // Initialize the waiting queues
+    ctrl->waiting = Queue();
+    ctrl->waiting6 = Queue();
+    if (!ctrl->waiting || !ctrl->waiting6) {
+        Free_Control(ctrl);
+        return NULL;
+    }
+    ctrl->waiting_len = 0;
+    atomic_init(&ctrl->generation, 1);
+
+    // Every packet gets in until an ACL is installed.
+    atomic_init(&ctrl->acl, NULL);
+
+    // Nothing is translated until the caller creates the conntrack (-n).
+    ctrl->conntrack = NULL;
+
+    // The counters are created by the caller, which knows the workers and interfaces.
+    ctrl->stats = NULL;
+
+    // Default control-plane rates, for a single worker until told otherwise.
+    Default_Police(ctrl->police);
+    ctrl->workers = 1;
+
+    return ctrl;
+}
+
+/**
+ * @brief Free the control state and its associated data structures.
+ * 
+ * @param ctrl   A pointer to the control structure to be freed.
+ */
+void Free_Control(control *ctrl) {
+    if (!ctrl) return;
+    if (ctrl->waiting) FreeQueue(ctrl->waiting);
+    if (ctrl->waiting6) FreeQueue(ctrl->waiting6);
+    if (ctrl->macs)    Free_ARP_Table(&ctrl->macs);
+    if (ctrl->neighbors) Free_ND_Table(&ctrl->neighbors);
+    if (ctrl->vrfs) {
+        // The default table is the set's.
+        Free_VRF_Set(&ctrl->vrfs);
+        ctrl->ipv4s = NULL;
+    }
+    if (ctrl->ipv4s)   Free_IPV4_Table(&ctrl->ipv4s);
+    if (ctrl->ipv6s)   Free_IPV6_Table(&ctrl->ipv6s);
+    Free_Stats(&ctrl->stats);
+    acl_table *acl = atomic_load_explicit(&ctrl->acl, memory_order_relaxed);
+    Free_ACL_Table(&acl);
+    Free_Conntrack(&ctrl->conntrack);
+    pthread_mutex_destroy(&ctrl->acl_lock);
+    pthread_mutex_destroy(&ctrl->fib_lock);
+    pthread_mutex_destroy(&ctrl->waiting_lock);
+    free(ctrl);
+}
+
+/**
+ * @brief Load the routing tables of the other VRFs and share their tries with the default one.
+ *
+ * The tables are loaded as the default one was (aggregated with -a), then hash-consed into one
+ * VRF set: the default table becomes the set's first, the others follow in the order of files.
+ * The interfaces are mapped to their VRF by the caller (ctrl->vrf).
+ *
+ * @param ctrl      The control state, its default table loaded.
+ * @param files     The routing table files of the VRFs after the default one.
+ * @param count     The number of files.
+ * @param aggregate True to aggregate the routes of every file (ORTC).
+ * @return 0, or -1 if a file cannot be loaded or memory allocation fails.
+ */
+int Load_VRFs(control *ctrl, char **files, int count, bool aggregate) {
+    ipv4_table *tables[MAX_VRFS] = {ctrl->ipv4s};
+    if (!ctrl->ipv4s || count < 1 || count >= MAX_VRFS) return -1;
+
+    for (int vrf = 1; vrf <= count; vrf++) {
+        if (aggregate) {
+            aggregate_report report;
+            tables[vrf] = Create_Aggregated_IPV4_Table(files[vrf - 1], &report);
+            if (tables[vrf]) Print_Aggregate_Report(stderr, files[vrf - 1], &report);
+        } else {
+            tables[vrf] = Create_IPV4_Table(files[vrf - 1]);
+        }
+        if (!tables[vrf]) {
+            for (int loaded = 1; loaded < vrf; loaded++) Free_IPV4_Table(&tables[loaded]);
+            return -1;
+        }
+    }
+
+    // The set takes the tables over, frees them if it fails.
+    ctrl->ipv4s = NULL;
+    ctrl->vrfs = Create_VRF_Set(tables, count + 1);
+    if (!ctrl->vrfs) return -1;
+    ctrl->ipv4s = ctrl->vrfs->tables[0];
+    return 0;
+}
+
+/**
+ * @brief Initialize a per-worker routing context bound to the shared control state.
+ * 
+ * @param ctrl   The shared control state.
+ * @param worker The worker index.
+ * @param cpu    The core the worker is pinned to, or -1 to leave it unpinned.
+ * @return       A pointer to the initialized routing structure or NULL on failure.
+ */
+routing* Create_Router(control *ctrl, int worker, int cpu) {
+    routing *route = (routing*)calloc(1, sizeof(routing));
+    if (!route) return NULL;
+
+    route->ctrl = ctrl;
+    route->worker = worker;
+    route->cpu = cpu;
+
+    // Initialize the worker's frame vector.
+    route->pipe = Create_Pipeline();
+    if (!route->pipe) {
+        free(route);
+        return NULL;
+    }
+
+    // Initialize the worker's destination cache.
+    route->flows = Create_Flow_Cache();
+    if (!route->flows) {
+        Free_Pipeline(&route->pipe);
+        free(route);
+        return NULL;
+    }
+
+    // Initialize the worker's stage histograms, when profiling is compiled in.
+    route->profile = Create_Profile();
+    if (PROFILE_ENABLED && !route->profile) {
+        Free_Flow_Cache(&route->flows);
+        Free_Pipeline(&route->pipe);
+        free(route);
+        return NULL;
+    }
+
+    // Initialize the worker's share of the control-plane rate limiters.
+    route->policer = Create_Policer(ctrl->police, ctrl->workers);
+    if (!route->policer) {
+        Free_Profile(&route->profile);
+        Free_Flow_Cache(&route->flows);
+        Free_Pipeline(&route->pipe);
+        free(route);
+        return NULL;
+    }
+
+    // Initialize the worker's counters of the ECMP paths.
+    route->paths = (nh_counters*)calloc(1, sizeof(nh_counters));
+    if (!route->paths) {
+        Free_Policer(&route->policer);
+        Free_Profile(&route->profile);
+        Free_Flow_Cache(&route->flows);
+        Free_Pipeline(&route->pipe);
+        free(route);
+        return NULL;
+    }
+
+    // Initialize the worker's egress queues, with its share of the shaper rates.
+    if (Any_QoS(ctrl->qos)) {
+        route->qos = Create_QoS(ctrl->qos, ctrl->workers);
+        if (!route->qos) {
+            free(route->paths);
+            Free_Policer(&route->policer);
+            Free_Profile(&route->profile);
+            Free_Flow_Cache(&route->flows);
+            Free_Pipeline(&route->pipe);
+            free(route);
+            return NULL;
+        }
+    }
+
+    // Map the shared FIB, each worker on its own so it switches images without the others.
+    if (ctrl->fib_name) {
+        route->fib = Open_Shared_FIB(ctrl->fib_name);
+        if (!route->fib) {
+            Free_QoS(&route->qos);
+            free(route->paths);
+            Free_Policer(&route->policer);
+            Free_Profile(&route->profile);
+            Free_Flow_Cache(&route->flows);
+            Free_Pipeline(&route->pipe);
+            free(route);
+            return NULL;
+        }
+    }
+
+    // Initialize other route fields.
+    route->next_hop = 0;
+    route->interface = 0;
+
+    return route;
+}
+
+/**
+ * @brief Free the memory allocated for a per-worker routing context.
+ * 
+ * @param route   A pointer to the routing structure to be freed.
+ */
+void Free_Router(routing *route) {
+    if (!route) return;
+    Close_Shared_FIB(&route->fib);
+    Free_QoS(&route->qos);
+    free(route->paths);
+    Free_Policer(&route->policer);
+    Free_Profile(&route->profile);
+    Free_Flow_Cache(&route->flows);
+    Free_Pipeline(&route->pipe);
+    free(route);
+}
+
+/* -------------------------------------------------- ROUTING CONTEXT -------------------------------------------------- */
+/* ---------------------------------------------------- INGRESS ACL ---------------------------------------------------- */
+
+/**
+ * @brief Install a new ACL while the workers run, freeing the old one once no worker uses it.
+ *
+ * The rule set is swapped whole: a packet is classified by the old rules or the new ones, never
+ * a mix. The workers only hold the rule set within a read-side section (a vector's ACL stage,
+ * or one packet of the slow path), so the wait is for the sections open at the swap to close;
+ * an idle worker, blocked in the receive, holds none.
+ *
+ * @param ctrl The shared control state.
+ * @param acl  The new rule set, NULL to let every packet in.
+ */
+void Replace_ACL(control *ctrl, acl_table *acl) {
+    pthread_mutex_lock(&ctrl->acl_lock);
+    acl_table *old = atomic_exchange_explicit(&ctrl->acl, acl, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // A worker whose count is odd may have loaded the old rule set, wait for the count to move.
+    for (int worker = 0; old && worker < MAX_WORKERS; worker++) {
+        uint32_t seq = atomic_load_explicit(&ctrl->acl_readers[worker].seq, memory_order_acquire);
+        if (!(seq & 1)) continue;
+        while (atomic_load_explicit(&ctrl->acl_readers[worker].seq, memory_order_acquire) == seq) {
+            sched_yield();
+        }
+    }
+
+    Free_ACL_Table(&old);
+    pthread_mutex_unlock(&ctrl->acl_lock);
+}
+
+/**
+ * @brief Wait for a grace period of the FIB: until every worker that was handling a vector when
+ * called is done with it.
+ *
+ * The roots and ARP entries the changes published before the call are the only ones the workers
+ * can hold afterwards: the nodes and entries they replaced can then be freed. Called with
+ * fib_lock held, off the forwarding path.
+ *
+ * @param ctrl The shared control state.
+ */
+void Sync_FIB(control *ctrl) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // A worker whose count is odd may hold what was replaced, wait for the count to move.
+    for (int worker = 0; worker < MAX_WORKERS; worker++) {
+        uint32_t seq = atomic_load_explicit(&ctrl->fib_readers[worker].seq, memory_order_acquire);
+        if (!(seq & 1)) continue;
+        while (atomic_load_explicit(&ctrl->fib_readers[worker].seq, memory_order_acquire) == seq) {
+            sched_yield();
+        }
+    }
+}
+
+/* ---------------------------------------------------- INGRESS ACL ---------------------------------------------------- */
+/* -------------------------------------------------- WAITING PACKETS -------------------------------------------------- */
+
+/**
+ * @brief Create and initialize a new packet based on the provided routing information.
+ * 
+ * Allocate memory for a new packet, copies the packet data and routing
+ * information from the given routing structure, and returns the newly created packet.
+ * 
+ * @param route   A pointer to the routing structure containing packet and routing information.
+ * @return        A pointer to the newly created packet, or NULL if memory allocation fails.
+ */
+packet* Send_Packet(routing *route) {
+    if (!route) return NULL;
+
+    // Allocate memory for a new packet structure.
+    packet *pkt = (packet*)malloc(sizeof(packet));
+    if (!pkt) return NULL;
+
+    // Allocate memory for the packet buffer, as long as the frame (a super-packet with -g).
+    pkt->buf = malloc(route->len);
+
+    if (!pkt->buf) {
+        free(pkt);
+        return NULL;
+    }
+
+    // Copy packet data, length, interface, and next hop information.
+    memcpy(pkt->buf, route->buf, route->len);
+    pkt->len = route->len;
+    pkt->interface = route->interface;
+    pkt->next_hop = route->next_hop;
+    pkt->next_hop6 = route->next_hop6;
+    pkt->stamp = route->stamp;
+    pkt->offload = route->offload;
+
+    return pkt;
+}
+
+/**
+ * @brief Initialize the routing structure using a waiting packet.
+ * 
+ * Extract relevant information from a waiting packet and sets up
+ * the routing structure for further processing.
+ * 
+ * @param route A pointer to the routing structure to be initialized.
+ * @param pkt   A pointer to the waiting packet containing Ethernet and IP headers.
+ * @param mac   The resolved MAC address of its next hop.
+ */
+void Waiting_Packet(routing *route, packet *pkt, const uint8_t *mac) {
+    // Extract Ethernet and IP headers from the waiting packet.
+	route->eth_hdr = (struct ethhdr *)pkt->buf;
+	route->ip_hdr = (struct iphdr *)(pkt->buf + sizeof *route->eth_hdr);
+
+    // Set packet length, interface, and next hop information.
+	route->len = pkt->len;
+	route->interface = pkt->interface;
+	route->next_hop = pkt->next_hop;
+    // Set the Ethernet frame type to IP.
+	route->eth_hdr->ether_type = IP_TYPE;
+
+    // Copy the resolved destination MAC address to the Ethernet header.
+	memcpy(route->eth_hdr->ether_dhost, mac, MAC_SIZE);
+    // Get the source MAC address of the current interface.
+	Get_MAC_Interface(route->interface, route->eth_hdr->ether_shost);
+}
+
+/* -------------------------------------------------- WAITING PACKETS -------------------------------------------------- */
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <unistd.h>
+#include <netinet/in.h>
 
 typedef struct arphdr*  arphdr;
 
@@ -60,3 +61,44 @@ struct icmphdr {
 		} frag;                        	/* path mtu discovery */
 	} un;
 };
+
+typedef struct ip6hdr*  ip6hdr;
+
+/* IPv6 Header from RFC 8200 */
+struct ip6hdr {
+	uint32_t   vtc_flow;				/* version 6, traffic class, flow label */
+	uint16_t   payload_len;				/* length of everything after this header */
+	uint8_t    next_header;				/* only ICMPv6 is looked into */
+	uint8_t    hop_limit;				/* the TTL of IPv6, there is no header checksum to patch */
+	struct in6_addr saddr;				/* source address */
+	struct in6_addr daddr;				/* the destination of the packet */
+};
+
+typedef struct icmp6hdr* icmp6hdr;
+
+/* ICMPv6 Header from RFC 4443 */
+struct icmp6hdr {
+	uint8_t type;						/* message type */
+	uint8_t code;						/* type sub-code */
+	uint16_t checksum;					/* over the pseudo-header and the message */
+	union {
+		struct {
+			uint16_t id;
+			uint16_t sequence;
+		} echo;							/* echo request / reply */
+		uint32_t flags;					/* neighbor advertisement flags */
+		uint32_t mtu;					/* packet too big */
+		uint32_t unused;				/* time exceeded, destination unreachable */
+	} un;
+};
+
+typedef struct nd_msg*  nd_msg;
+
+/* Neighbor Solicitation / Advertisement with its link-layer address option, RFC 4861 */
+struct nd_msg {
+	struct icmp6hdr icmp6;				/* type 135 / 136, reserved or advertisement flags */
+	struct in6_addr target;				/* address being resolved */
+	uint8_t opt_type;					/* 1 source, 2 target link-layer address */
+	uint8_t opt_len;					/* in units of 8 bytes, 1 for Ethernet */
+	uint8_t lladdr[6];					/* link-layer address */
+};
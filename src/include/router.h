@@ -5,45 +5,255 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 
 #include "../utils/lib.h"
 #include "../utils/queue.h"
+#include "../utils/profile.h"
+#include "../utils/stats.h"
+#include "../utils/policer.h"
+#include "../utils/qos.h"
+#include "../utils/hugepage.h"
 
 #include "../include/protocols.h"
 
 #include "../res/arp/arp_table.h"
 #include "../res/ipv4/ipv4_table.h"
+#include "../res/ipv4/vrf.h"
+#include "../res/ipv4/shared_fib.h"
+#include "../res/ipv4/flow_cache.h"
+#include "../res/ipv6/ipv6_table.h"
+#include "../res/ndp/nd_table.h"
+#include "../res/acl/acl_table.h"
+#include "../res/nat/conntrack.h"
+
+#define MAX_WAITING 1024					/* Frames held for ARP / ND resolution, the rest are dropped */
+
+/* A worker's read-side sections on the FIB and the ARP table, one per vector: the nodes and
+ * entries the changes replaced are freed only once no worker can still hold them. Odd while
+ * the worker is inside a section. */
+typedef struct fib_reader {
+	_Atomic uint32_t seq;
+} __attribute__((aligned(64))) fib_reader;
 
 typedef struct packet {
 	char *buf;
 	size_t len;
 	int interface;
 	uint32_t next_hop;
+	struct in6_addr next_hop6;				/* Next hop of an IPv6 packet, waiting for ND */
+	uint64_t stamp;							/* Kernel RX timestamp (ns), 0 without -t */
+	link_offload offload;					/* Offload state of a super-packet (-g), zero for a plain frame */
 } packet;
 
-typedef struct routing {
-	ipv4_table *ipv4s;						/* ROUTING TABLE */
-	arp_table  *macs;						/* ARP TABLE ~ MAC TABLE */
+/* Control state shared by every worker, read-mostly on the forwarding path. */
+typedef struct control {
+	ipv4_table *ipv4s;						/* ROUTING TABLE, read-only once workers run, NULL with fib_name */
+	vrf_set *vrfs;							/* Routing tables of the VRFs (-V), ipv4s the default one; NULL with one table */
+	uint8_t vrf[ROUTER_NUM_INTERFACES];		/* VRF of every ingress interface, 0 for the default table */
+	const char *fib_name;					/* Shared FIB the workers map instead, NULL for ipv4s */
+	arp_table  *macs;						/* ARP TABLE ~ MAC TABLE, lock-free lookups */
+	ipv6_table *ipv6s;						/* IPv6 ROUTING TABLE, NULL when IPv6 is not routed */
+	nd_table   *neighbors;					/* IPv6 neighbor cache, lock-free lookups */
 
 	queue waiting;							/* Waiting packets, ARP Reply type packets */
+	queue waiting6;							/* Waiting IPv6 packets, Neighbor Advertisement type packets */
+	pthread_mutex_t waiting_lock;			/* Guards both waiting queues (ARP / ND slow path only) */
+	int waiting_len;						/* Frames in the waiting queues, under waiting_lock */
+
+	atomic_uint generation;					/* Bumped on FIB / neighbor changes, never 0 */
+	fib_reader fib_readers[MAX_WORKERS];	/* Workers handling a vector, for Sync_FIB to wait on */
+	pthread_mutex_t fib_lock;				/* Serializes the FIB and neighbor changes (control socket, SIGHUP) */
+	uint64_t transactions;					/* Changes committed through the control socket, under fib_lock */
+
+	_Atomic(acl_table *) acl;				/* Ingress ACL of the IPv4 packets, NULL to let every packet in */
+	acl_reader acl_readers[MAX_WORKERS];	/* Workers classifying with the ACL, for Replace_ACL to wait on */
+	pthread_mutex_t acl_lock;				/* Serializes the ACL replacements */
+
+	conntrack *conntrack;					/* Flows of the source NAT, NULL without NAT */
+	bool nat_inside[ROUTER_NUM_INTERFACES];	/* Interfaces whose packets leave the others translated */
+
+	router_stats *stats;					/* Per-worker counters, shared with routerstat */
+
+	police_rate police[ROUTER_NUM_INTERFACES][POLICE_TYPES];	/* Rates of the messages the router generates */
+	qos_rate qos[ROUTER_NUM_INTERFACES];	/* Egress queues and shaper rates (-Q) */
+	int workers;							/* Workers sharing these rates */
+} control;
+
+struct pipeline;
+
+/* Per-worker forwarding context, owns its buffers and scratch headers. */
+typedef struct routing {
+	control *ctrl;							/* Shared control state */
+	struct pipeline *pipe;					/* Frame vector and its stages */
+	flow_cache *flows;						/* Destination cache in front of the FIB */
+	stage_profile *profile;					/* Per-stage histograms, NULL unless built with PROFILE=1 */
+	policer *policer;						/* Worker's share of the control-plane rates */
+	shared_fib *fib;						/* Worker's mapping of the shared FIB, NULL for ipv4s */
+	nh_counters *paths;						/* Packets the worker sent through every ECMP path */
+	qos *qos;								/* Worker's egress queues, NULL without -Q */
+
+	int worker;								/* Worker index */
+	int cpu;								/* Core the worker is pinned to, -1 unpinned */
+	pthread_t thread;						/* Worker thread */
 
 	ethhdr eth_hdr;							/* Ethernet Header */
 	iphdr ip_hdr;							/* IP Header */
 	arphdr arp_hdr;							/* ARP Header */
 	icmphdr icmp_hdr;						/* ICMP Header */
+	ip6hdr ip6_hdr;							/* IPv6 Header */
 
-	char buf[MAX_PACKET_LEN];				/* Packet buffer */
+	char *buf;								/* Packet buffer, the frame being handled */
 	size_t len;								/* Length of the buffer, read from the network */
+	uint64_t stamp;							/* Kernel RX timestamp of the frame (ns), 0 without -t */
+	link_offload offload;					/* Offload state of the frame (-g), zero for a plain frame */
+	bool filtered;							/* The frame went through the pipeline's ACL stage already */
+	bool translated;						/* The pipeline translated the frame's source already (SNAT) */
 
 	uint32_t next_hop;						/* Next hop best forwarding interface to send the packet */
+	struct in6_addr next_hop6;				/* Next hop of an IPv6 packet */
 	int interface;							/* Interface to receive/send packets */
 } routing;
 
+/** @brief Invalidate the flow caches of all the workers after a FIB or neighbor change. */
+static inline void Bump_Generation(control *ctrl) {
+	atomic_fetch_add_explicit(&ctrl->generation, 1, memory_order_release);
+}
+
+/**
+ * @brief Enter a read-side section on the ACL: the rule set returned stays valid until Exit_ACL.
+ *
+ * The worker's count turns odd before the rule set is loaded, fenced so that Replace_ACL either
+ * sees it odd or the worker loads the new rule set.
+ * @return The rule set, NULL if there is none.
+ */
+static inline const acl_table* Enter_ACL(routing *route) {
+	acl_reader *reader = &route->ctrl->acl_readers[route->worker];
+	uint32_t seq = atomic_load_explicit(&reader->seq, memory_order_relaxed);
+	atomic_store_explicit(&reader->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	return atomic_load_explicit(&route->ctrl->acl, memory_order_acquire);
+}
+
+/** @brief Leave a read-side section on the ACL, the rule set it returned may then be freed. */
+static inline void Exit_ACL(routing *route) {
+	acl_reader *reader = &route->ctrl->acl_readers[route->worker];
+	uint32_t seq = atomic_load_explicit(&reader->seq, memory_order_relaxed);
+	atomic_store_explicit(&reader->seq, seq + 1, memory_order_release);
+}
+
+/**
+ * @brief Enter a read-side section on the FIB and the ARP table, for a vector of frames: the nodes
+ * and entries looked up stay valid until Exit_FIB.
+ *
+ * Fenced as Enter_ACL, so that Sync_FIB either sees the count odd or the worker loads the new roots.
+ */
+static inline void Enter_FIB(routing *route) {
+	fib_reader *reader = &route->ctrl->fib_readers[route->worker];
+	uint32_t seq = atomic_load_explicit(&reader->seq, memory_order_relaxed);
+	atomic_store_explicit(&reader->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+/** @brief Leave a read-side section on the FIB, what the changes replaced meanwhile may then be freed. */
+static inline void Exit_FIB(routing *route) {
+	fib_reader *reader = &route->ctrl->fib_readers[route->worker];
+	uint32_t seq = atomic_load_explicit(&reader->seq, memory_order_relaxed);
+	atomic_store_explicit(&reader->seq, seq + 1, memory_order_release);
+}
+
+/** @brief Routing table of the VRF of an ingress interface, ipv4s without VRFs. */
+static inline ipv4_table* VRF_Table(const control *ctrl, int interface) {
+	return ctrl->vrfs ? ctrl->vrfs->tables[ctrl->vrf[interface]] : ctrl->ipv4s;
+}
+
+/** @brief Longest prefix match in the worker's FIB (the VRF of the ingress interface), the shared image if it maps one. */
+static inline bool Lookup_Route(routing *route, int interface, uint32_t ip, forward *lpm) {
+	if (route->fib) return Lookup_FIB_Image(route->fib->image, ip, lpm);
+	return Lookup_IPV4_Table(VRF_Table(route->ctrl, interface), ip, lpm);
+}
+
+/**
+ * @brief Longest prefix match of a vector of addresses (at most MAX_BATCH) in the worker's FIB,
+ * each in the VRF of its packet's ingress interface.
+ */
+static inline void Lookup_Routes(routing *route, const uint32_t *ips, const int *interfaces, int count, forward *lpms) {
+	if (route->fib) {
+		Lookup_FIB_Batch(route->fib->image, ips, count, lpms);
+	} else if (route->ctrl->vrfs) {
+		ipv4_table *tables[MAX_BATCH];
+		for (int pos = 0; pos < count && pos < MAX_BATCH; pos++) tables[pos] = VRF_Table(route->ctrl, interfaces[pos]);
+		Lookup_IPV4_Tables(tables, ips, count, lpms);
+	} else {
+		Lookup_IPV4_Batch(route->ctrl->ipv4s, ips, count, lpms);
+	}
+}
+
+/**
+ * @brief Pick the path of a multipath route for a flow, in the groups of the worker's FIB.
+ * The VRFs share one table of groups, the default table's.
+ * The route becomes the path's next hop and interface; the path is counted once the packet is sent.
+ * @return The index of the path in its group.
+ */
+static inline int Select_Path(routing *route, forward *lpm, uint32_t hash) {
+	nh_member path;
+	int member;
+	if (route->fib) {
+		member = Select_NH_Member(&FIB_Groups(route->fib->image)[lpm->next_hop], hash, &path);
+	} else {
+		member = Select_NH_Member(&route->ctrl->ipv4s->groups->groups[lpm->next_hop], hash, &path);
+	}
+	lpm->next_hop = path.next_hop;
+	lpm->interface = path.interface;
+	return member;
+}
+
+/**
+ * @brief Length of the largest IP packet a frame leaves the router as, for the egress MTU.
+ *
+ * A super-packet leaves as segments of its headers and at most gso_size bytes of payload, its
+ * transport header starting where the kernel left the checksum to finish (csum_start).
+ *
+ * @param frame   The Ethernet frame.
+ * @param len     Its length.
+ * @param offload Its offload state.
+ * @return The length of the packet, or of its largest segment.
+ */
+static inline size_t Wire_Packet_Len(const char *frame, size_t len, const link_offload *offload) {
+	size_t packet = len - sizeof(struct ethhdr);
+	if (offload->gso_type == LINK_GSO_NONE) return packet;
+
+	size_t transport = offload->csum_start;
+	if (!(offload->flags & LINK_CSUM_PARTIAL) || transport < sizeof(struct ethhdr) || transport + 20 > len) {
+		return packet;
+	}
+	// UDP has a fixed header, the TCP one its data offset.
+	size_t header = (offload->gso_type & ~LINK_GSO_ECN) == LINK_GSO_UDP_L4 ?
+					8 : ((uint8_t)frame[transport + 12] >> 4) * 4u;
+	size_t segment = transport - sizeof(struct ethhdr) + header + offload->gso_size;
+	return segment < packet ? segment : packet;
+}
+
+/** @brief Initialize the control state shared by all the workers. */
+control* Create_Control(char *file, char *file6, bool aggregate);
+/** @brief Load the routing tables of the other VRFs and share their tries with the default one. */
+int Load_VRFs(control *ctrl, char **files, int count, bool aggregate);
+/** @brief Free the control state and its associated data structures. */
+void Free_Control(control *ctrl);
+/** @brief Install a new ACL while the workers run, freeing the old one once no worker uses it. */
+void Replace_ACL(control *ctrl, acl_table *acl);
+/** @brief Wait until no worker is in a read-side section on the FIB that started before the call. */
+void Sync_FIB(control *ctrl);
+/** @brief Initialize a per-worker routing context bound to the shared control state. */
+routing* Create_Router(control *ctrl, int worker, int cpu);
+/** @brief Free the memory allocated for a per-worker routing context. */
+void Free_Router(routing *route);
+
 /** @brief Pack a network message for transmission. */
 extern packet* Send_Packet(routing *route);
 
 /** @brief  Pack a waiting message for transmission. */
-extern void Waiting_Packet(routing *route, packet *pkt);
+extern void Waiting_Packet(routing *route, packet *pkt, const uint8_t *mac);
 
-#endif /* ROUTER_H_ */
\ No newline at end of file
+#endif /* ROUTER_H_ */
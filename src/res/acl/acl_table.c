@@ -0,0 +1,537 @@
+#include "./acl_table.h"
+
+#include <errno.h>
+#include <arpa/inet.h>
+
+#define MAX_ACL_LINE    256
+#define ACL_TOKEN       48
+
+/* ---------------------------------------------------- RULE FIELDS ----------------------------------------------------- */
+
+/**
+ * @brief Mask of a prefix length, host order.
+ */
+static inline uint32_t Mask_Of(int len) {
+    return len ? ~0u << (32 - len) : 0;
+}
+
+/**
+ * @brief Parse a prefix: "any", an address (a /32) or PREFIX/LENGTH.
+ *
+ * @return True if the prefix is valid, its host bits cleared.
+ */
+static bool Parse_Prefix(const char *token, uint32_t *prefix, uint8_t *len) {
+    if (!strcmp(token, "any")) {
+        *prefix = 0;
+        *len = 0;
+        return true;
+    }
+
+    char addr[INET_ADDRSTRLEN];
+    const char *slash = strchr(token, '/');
+    size_t addr_len = slash ? (size_t)(slash - token) : strlen(token);
+    if (addr_len >= sizeof(addr)) return false;
+    memcpy(addr, token, addr_len);
+    addr[addr_len] = '\0';
+
+    long bits = 32;
+    if (slash) {
+        char *end;
+        errno = 0;
+        bits = strtol(slash + 1, &end, 10);
+        if (errno || end == slash + 1 || *end || bits < 0 || bits > 32) return false;
+    }
+
+    struct in_addr in;
+    if (inet_pton(AF_INET, addr, &in) != 1) return false;
+    *len = (uint8_t)bits;
+    *prefix = ntohl(in.s_addr) & Mask_Of((int)bits);
+    return true;
+}
+
+/**
+ * @brief Parse a protocol: "any", "tcp", "udp", "icmp" or its number.
+ */
+static bool Parse_Proto(const char *token, int16_t *proto) {
+    if (!strcmp(token, "any"))  *proto = ACL_ANY_PROTO;
+    else if (!strcmp(token, "tcp"))  *proto = IPPROTO_TCP;
+    else if (!strcmp(token, "udp"))  *proto = IPPROTO_UDP;
+    else if (!strcmp(token, "icmp")) *proto = IPPROTO_ICMP;
+    else {
+        char *end;
+        errno = 0;
+        long number = strtol(token, &end, 10);
+        if (errno || end == token || *end || number < 0 || number > 255) return false;
+        *proto = (int16_t)number;
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a port range: "any", a port or LOW-HIGH.
+ *
+ * @return True if the range is valid; `any` is set for every port.
+ */
+static bool Parse_Ports(const char *token, uint16_t *lo, uint16_t *hi, bool *any) {
+    *any = !strcmp(token, "any");
+    if (*any) {
+        *lo = 0;
+        *hi = UINT16_MAX;
+        return true;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long low = strtoul(token, &end, 10), high = low;
+    if (errno || end == token) return false;
+    if (*end == '-') {
+        const char *second = end + 1;
+        high = strtoul(second, &end, 10);
+        if (errno || end == second) return false;
+    }
+    if (*end || low > high || high > UINT16_MAX) return false;
+
+    *lo = (uint16_t)low;
+    *hi = (uint16_t)high;
+    *any = low == 0 && high == UINT16_MAX;
+    return true;
+}
+
+/**
+ * @brief Parse the fields of a rule line.
+ *
+ * @return NULL if the rule is valid, else the name of the first bad field.
+ */
+static const char* Parse_Rule(char tokens[][ACL_TOKEN], int fields, acl_rule *rule) {
+    memset(rule, 0, sizeof(*rule));
+
+    if (!strcmp(tokens[0], "permit")) rule->action = ACL_PERMIT;
+    else if (!strcmp(tokens[0], "deny")) rule->action = ACL_DENY;
+    else return "action";
+
+    if (fields < 3) return "destination";
+    if (!Parse_Prefix(tokens[1], &rule->src, &rule->src_len)) return "source";
+    if (!Parse_Prefix(tokens[2], &rule->dst, &rule->dst_len)) return "destination";
+    if (!Parse_Proto(fields > 3 ? tokens[3] : "any", &rule->proto)) return "protocol";
+
+    bool any;
+    if (!Parse_Ports(fields > 4 ? tokens[4] : "any", &rule->sport_lo, &rule->sport_hi, &any)) return "source ports";
+    if (!any) rule->flags |= ACL_SPORT;
+    if (!Parse_Ports(fields > 5 ? tokens[5] : "any", &rule->dport_lo, &rule->dport_hi, &any)) return "destination ports";
+    if (!any) rule->flags |= ACL_DPORT;
+
+    // Only TCP and UDP have ports, a rule on them for another protocol would never match.
+    if (rule->flags && rule->proto != ACL_ANY_PROTO && rule->proto != IPPROTO_TCP && rule->proto != IPPROTO_UDP) {
+        return "ports (tcp or udp only)";
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------- RULE FIELDS ----------------------------------------------------- */
+/* -------------------------------------------------- CREATE ACL TABLE -------------------------------------------------- */
+
+/**
+ * @brief Read ACL rules from a file into an array of acl_rule structures.
+ *
+ * Each line holds ACTION SOURCE DESTINATION [PROTOCOL [SOURCE_PORTS [DESTINATION_PORTS]]], e.g.
+ * "deny 10.0.0.0/8 192.168.1.0/24 tcp any 22-23": the action permit or deny, prefixes (or any),
+ * a protocol (tcp, udp, icmp, a number or any) and port ranges (a port, LOW-HIGH or any), the
+ * omitted fields any. "default deny" (or permit) sets the action of the packets no rule matches.
+ * Blank lines and comments (#) are skipped. Unlike a routing table, a bad line fails the whole
+ * file: a rule silently left out would let through what it was written to stop.
+ *
+ * @param file     The name of the file containing the rules.
+ * @param count    Set to the number of rules read from the file.
+ * @param fallback Set to the action of the packets no rule matches.
+ * @return The rules in file order (to be freed by the caller), or NULL on failure.
+ */
+acl_rule* Read_ACL_Rules(const char *file, int *count, uint8_t *fallback) {
+    FILE *fin = fopen(file, "r");
+    if (!fin) {
+        fprintf(stderr, "acl: cannot open %s (%s)\n", file, strerror(errno));
+        return NULL;
+    }
+
+    int capacity = 1024;
+    acl_rule *rules = (acl_rule*)malloc(capacity * sizeof(acl_rule));
+    if (!rules) {
+        fclose(fin);
+        return NULL;
+    }
+
+    int num_rules = 0, line_no = 0;
+    char line[MAX_ACL_LINE];
+    *fallback = ACL_PERMIT;
+
+    while (fgets(line, sizeof(line), fin)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char tokens[7][ACL_TOKEN];
+        int fields = sscanf(line, "%47s %47s %47s %47s %47s %47s %47s",
+                            tokens[0], tokens[1], tokens[2], tokens[3], tokens[4], tokens[5], tokens[6]);
+        if (fields <= 0) continue;
+
+        const char *bad = NULL;
+        if (!strcmp(tokens[0], "default")) {
+            if (fields == 2 && !strcmp(tokens[1], "permit")) *fallback = ACL_PERMIT;
+            else if (fields == 2 && !strcmp(tokens[1], "deny")) *fallback = ACL_DENY;
+            else bad = "default action";
+        } else if (fields > 6) {
+            bad = "trailing field";
+        } else {
+            if (num_rules == capacity) {
+                acl_rule *grown = (acl_rule*)realloc(rules, 2 * capacity * sizeof(acl_rule));
+                if (!grown) {
+                    free(rules);
+                    fclose(fin);
+                    return NULL;
+                }
+                rules = grown;
+                capacity *= 2;
+            }
+            bad = Parse_Rule(tokens, fields, &rules[num_rules]);
+            rules[num_rules].line = line_no;
+            if (!bad) num_rules++;
+        }
+
+        if (bad) {
+            fprintf(stderr, "acl: %s:%d: bad %s\n", file, line_no, bad);
+            free(rules);
+            fclose(fin);
+            return NULL;
+        }
+    }
+
+    fclose(fin);
+    *count = num_rules;
+    return rules;
+}
+
+// A rule as sorted into its tuple and prefix pair.
+typedef struct acl_order {
+    uint32_t src, dst;          // Prefixes cut to the tuple's lengths.
+    uint32_t rule;
+    uint8_t src_len, dst_len;   // Lengths of the tuple.
+} acl_order;
+
+static int Compare_Order(const void *left, const void *right) {
+    const acl_order *a = (const acl_order *)left, *b = (const acl_order *)right;
+    if (a->src_len != b->src_len) return a->src_len < b->src_len ? -1 : 1;
+    if (a->dst_len != b->dst_len) return a->dst_len < b->dst_len ? -1 : 1;
+    if (a->src != b->src) return a->src < b->src ? -1 : 1;
+    if (a->dst != b->dst) return a->dst < b->dst ? -1 : 1;
+    return a->rule < b->rule ? -1 : a->rule > b->rule;
+}
+
+static int Compare_Tuple(const void *left, const void *right) {
+    const acl_tuple *a = (const acl_tuple *)left, *b = (const acl_tuple *)right;
+    return a->first < b->first ? -1 : a->first > b->first;
+}
+
+/**
+ * @brief Length of the tuple of a prefix: its length rounded down to a multiple of 8.
+ */
+static inline uint8_t Tuple_Length(uint8_t len) {
+    return (uint8_t)(len & ~7u);
+}
+
+/**
+ * @brief Hash a prefix pair (Fibonacci hashing): the slot and bitmap indexes are its top bits.
+ */
+static inline uint64_t Hash_Pair(uint32_t src, uint32_t dst) {
+    return ((uint64_t)src << 32 | dst) * 0x9e3779b97f4a7c15ull;
+}
+
+/**
+ * @brief Count the prefix pairs of the tuple starting at a position of the sorted rules.
+ *
+ * @param order The sorted rules.
+ * @param start The first rule of the tuple.
+ * @param count The number of rules.
+ * @param end   Receives the position past the tuple's last rule.
+ * @param first Receives the tuple's first rule in file order.
+ * @return      The number of prefix pairs.
+ */
+static int Scan_Tuple(const acl_order *order, int start, int count, int *end, uint32_t *first) {
+    int pairs = 0, pos = start;
+    *first = UINT32_MAX;
+    for (; pos < count && order[pos].src_len == order[start].src_len && order[pos].dst_len == order[start].dst_len; pos++) {
+        if (pos == start || order[pos].src != order[pos - 1].src || order[pos].dst != order[pos - 1].dst) pairs++;
+        if (order[pos].rule < *first) *first = order[pos].rule;
+    }
+    *end = pos;
+    return pairs;
+}
+
+/**
+ * @brief Bits of the slot index of a tuple's hash table: at least twice as many slots as pairs.
+ */
+static inline int Slot_Bits(int pairs) {
+    int bits = 1;
+    while ((1 << bits) < 2 * pairs) bits++;
+    return bits;
+}
+
+/**
+ * @brief Compile an array of rules into a classifier.
+ *
+ * The rules are sorted by tuple, prefixes cut to the tuple's lengths and position: every run of
+ * the same tuple is a hash table, every run of the same prefixes within it a slot of the table
+ * (half full at most), its rules in file order. Last, the tuples are sorted by their first rule.
+ *
+ * @param rules    The rules, in priority order.
+ * @param count    The number of rules.
+ * @param fallback The action of the packets no rule matches.
+ * @return A pointer to the new classifier, or NULL on failure.
+ */
+acl_table* Build_ACL_Table(const acl_rule *rules, int count, uint8_t fallback) {
+    acl_table *acl = (acl_table*)calloc(1, sizeof(acl_table));
+    if (!acl) return NULL;
+    acl->fallback = fallback;
+    acl->count = (uint32_t)count;
+
+    size_t entries = count ? (size_t)count : 1;
+    acl->rules = (acl_rule*)malloc(entries * sizeof(acl_rule));
+    acl->matches = (acl_match*)malloc(entries * sizeof(acl_match));
+    acl_order *order = (acl_order*)malloc(entries * sizeof(acl_order));
+    if (!acl->rules || !acl->matches || !order) {
+        free(order);
+        Free_ACL_Table(&acl);
+        return NULL;
+    }
+    memcpy(acl->rules, rules, (size_t)count * sizeof(acl_rule));
+
+    for (int idx = 0; idx < count; idx++) {
+        uint8_t src_len = Tuple_Length(rules[idx].src_len), dst_len = Tuple_Length(rules[idx].dst_len);
+        order[idx] = (acl_order){
+            .src = rules[idx].src & Mask_Of(src_len),
+            .dst = rules[idx].dst & Mask_Of(dst_len),
+            .rule = (uint32_t)idx,
+            .src_len = src_len,
+            .dst_len = dst_len,
+        };
+    }
+    qsort(order, (size_t)count, sizeof(acl_order), Compare_Order);
+
+    // Tuples, the slots of their hash tables and the words of their bitmaps (64 bits at least).
+    uint32_t num_tuples = 0;
+    size_t num_slots = 0, num_filters = 0;
+    for (int start = 0, end; start < count; start = end) {
+        uint32_t first;
+        int bits = Slot_Bits(Scan_Tuple(order, start, count, &end, &first));
+        num_slots += (size_t)1 << bits;
+        num_filters += bits + 3 > 6 ? (size_t)1 << (bits + 3 - 6) : 1;
+        num_tuples++;
+    }
+
+    acl->tuples = (acl_tuple*)malloc((num_tuples ? num_tuples : 1) * sizeof(acl_tuple));
+    acl->slots = (acl_slot*)calloc(num_slots ? num_slots : 1, sizeof(acl_slot));
+    acl->filters = (uint64_t*)calloc(num_filters ? num_filters : 1, sizeof(uint64_t));
+    if (!acl->tuples || !acl->slots || !acl->filters) {
+        free(order);
+        Free_ACL_Table(&acl);
+        return NULL;
+    }
+    acl->num_tuples = num_tuples;
+    acl->num_slots = num_slots;
+    acl->num_filters = num_filters;
+
+    uint32_t tuple_idx = 0, slot_base = 0, filter_base = 0;
+    for (int start = 0, end; start < count; start = end) {
+        uint32_t first;
+        int bits = Slot_Bits(Scan_Tuple(order, start, count, &end, &first));
+        uint32_t words = bits + 3 > 6 ? 1u << (bits + 3 - 6) : 1;
+
+        acl_tuple *tuple = &acl->tuples[tuple_idx++];
+        *tuple = (acl_tuple){
+            .src_mask = Mask_Of(order[start].src_len),
+            .dst_mask = Mask_Of(order[start].dst_len),
+            .first = first,
+            .slots = slot_base,
+            .filter = filter_base,
+            .slot_shift = (uint8_t)(64 - bits),
+            .filter_shift = (uint8_t)(64 - (bits + 3 > 6 ? bits + 3 : 6)),
+            .src_len = order[start].src_len,
+            .dst_len = order[start].dst_len,
+        };
+
+        // One slot per prefix pair, its rules next to each other in the matches.
+        acl_slot *slots = acl->slots + slot_base;
+        uint64_t *filter = acl->filters + filter_base;
+        uint32_t mask = (1u << bits) - 1;
+        for (int pos = start; pos < end; ) {
+            uint64_t hash = Hash_Pair(order[pos].src, order[pos].dst);
+            uint64_t bit = hash >> tuple->filter_shift;
+            filter[bit / 64] |= 1ull << (bit % 64);
+
+            uint32_t idx = (uint32_t)(hash >> tuple->slot_shift);
+            while (slots[idx].count) idx = (idx + 1) & mask;
+            slots[idx].src = order[pos].src;
+            slots[idx].dst = order[pos].dst;
+            slots[idx].first = (uint32_t)pos;
+
+            for (; pos < end && order[pos].src == slots[idx].src && order[pos].dst == slots[idx].dst; pos++) {
+                const acl_rule *rule = &rules[order[pos].rule];
+                acl->matches[pos] = (acl_match){
+                    .src = rule->src & Mask_Of(rule->src_len), .src_mask = Mask_Of(rule->src_len),
+                    .dst = rule->dst & Mask_Of(rule->dst_len), .dst_mask = Mask_Of(rule->dst_len),
+                    .rule = order[pos].rule,
+                    .proto = rule->proto,
+                    .flags = rule->flags,
+                    .action = rule->action,
+                    .sport_lo = rule->sport_lo, .sport_hi = rule->sport_hi,
+                    .dport_lo = rule->dport_lo, .dport_hi = rule->dport_hi,
+                };
+                slots[idx].count++;
+            }
+        }
+        slot_base += mask + 1;
+        filter_base += words;
+    }
+    free(order);
+
+    qsort(acl->tuples, num_tuples, sizeof(acl_tuple), Compare_Tuple);
+    return acl;
+}
+
+/**
+ * @brief Create a classifier from a file of rules.
+ *
+ * @param file The name of the file containing the rules.
+ * @return A pointer to the new classifier, or NULL if the file cannot be read or has a bad line.
+ */
+acl_table* Create_ACL_Table(const char *file) {
+    int count = 0;
+    uint8_t fallback = ACL_PERMIT;
+    acl_rule *rules = Read_ACL_Rules(file, &count, &fallback);
+    if (!rules) return NULL;
+
+    acl_table *acl = Build_ACL_Table(rules, count, fallback);
+    free(rules);
+    return acl;
+}
+
+/**
+ * @brief Free a classifier.
+ *
+ * @param acl A pointer to the classifier pointer to be freed.
+ */
+void Free_ACL_Table(acl_table **acl) {
+    if (!acl || !(*acl)) return;
+    free((*acl)->rules);
+    free((*acl)->tuples);
+    free((*acl)->slots);
+    free((*acl)->filters);
+    free((*acl)->matches);
+    free(*acl);
+    *acl = NULL;
+}
+
+/**
+ * @brief Bytes of memory taken by a classifier.
+ */
+size_t Size_ACL_Table(const acl_table *acl) {
+    if (!acl) return 0;
+    return sizeof(*acl) + acl->count * (sizeof(acl_rule) + sizeof(acl_match)) +
+           acl->num_tuples * sizeof(acl_tuple) + acl->num_slots * sizeof(acl_slot) +
+           acl->num_filters * sizeof(uint64_t);
+}
+
+/* -------------------------------------------------- CREATE ACL TABLE -------------------------------------------------- */
+/* ---------------------------------------------------- CLASSIFY ACL ---------------------------------------------------- */
+
+/**
+ * @brief Whether a packet has the protocol and ports a rule wants.
+ */
+static inline bool Match_Fields(int16_t proto, uint8_t flags, uint16_t sport_lo, uint16_t sport_hi,
+                                uint16_t dport_lo, uint16_t dport_hi, const acl_key *key) {
+    if (proto != ACL_ANY_PROTO && proto != key->proto) return false;
+    if (!flags) return true;
+    // A packet without ports only matches the rules for any port.
+    if (!key->ports) return false;
+    if ((flags & ACL_SPORT) && (key->sport < sport_lo || key->sport > sport_hi)) return false;
+    if ((flags & ACL_DPORT) && (key->dport < dport_lo || key->dport > dport_hi)) return false;
+    return true;
+}
+
+/**
+ * @brief Whether a rule matches a packet.
+ *
+ * @param rule The rule.
+ * @param key  The fields of the packet.
+ * @return True if every field of the rule matches.
+ */
+bool Match_ACL_Rule(const acl_rule *rule, const acl_key *key) {
+    return ((key->src ^ rule->src) & Mask_Of(rule->src_len)) == 0 &&
+           ((key->dst ^ rule->dst) & Mask_Of(rule->dst_len)) == 0 &&
+           Match_Fields(rule->proto, rule->flags, rule->sport_lo, rule->sport_hi, rule->dport_lo, rule->dport_hi, key);
+}
+
+/**
+ * @brief Find the first rule matching a packet.
+ *
+ * Every tuple that may still hold a better rule is probed once: the packet's addresses cut to
+ * the tuple's lengths give its prefix pair, tested in the tuple's bitmap first, then looked up
+ * in its hash table; the pair's rules are checked in order up to the first match. The tuples
+ * come by their first rule, so the search ends at the first tuple whose rules all come after
+ * the best match.
+ *
+ * @param acl    The classifier.
+ * @param key    The fields of the packet.
+ * @param probes Receives the number of tuples probed, NULL if not wanted.
+ * @return The index of the first matching rule, or -1 if none matches.
+ */
+int Classify_ACL(const acl_table *acl, const acl_key *key, int *probes) {
+    uint32_t best = UINT32_MAX;
+    uint32_t tuple_idx = 0;
+
+    for (; tuple_idx < acl->num_tuples; tuple_idx++) {
+        const acl_tuple *tuple = &acl->tuples[tuple_idx];
+        if (tuple->first >= best) break;
+
+        uint32_t src = key->src & tuple->src_mask, dst = key->dst & tuple->dst_mask;
+        uint64_t hash = Hash_Pair(src, dst), bit = hash >> tuple->filter_shift;
+        if (!(acl->filters[tuple->filter + bit / 64] & (1ull << (bit % 64)))) continue;
+
+        const acl_slot *slots = acl->slots + tuple->slots;
+        uint32_t mask = (uint32_t)(UINT64_MAX >> tuple->slot_shift);
+        for (uint32_t idx = (uint32_t)(hash >> tuple->slot_shift); slots[idx].count; idx = (idx + 1) & mask) {
+            if (slots[idx].src != src || slots[idx].dst != dst) continue;
+
+            const acl_match *match = &acl->matches[slots[idx].first];
+            for (uint32_t pos = 0; pos < slots[idx].count && match[pos].rule < best; pos++) {
+                if (((key->src ^ match[pos].src) & match[pos].src_mask) == 0 &&
+                    ((key->dst ^ match[pos].dst) & match[pos].dst_mask) == 0 &&
+                    Match_Fields(match[pos].proto, match[pos].flags, match[pos].sport_lo, match[pos].sport_hi,
+                                 match[pos].dport_lo, match[pos].dport_hi, key)) {
+                    best = match[pos].rule;
+                    break;
+                }
+            }
+            break;
+        }
+    }
+
+    if (probes) *probes = (int)tuple_idx;
+    return best == UINT32_MAX ? -1 : (int)best;
+}
+
+/* ---------------------------------------------------- CLASSIFY ACL ---------------------------------------------------- */
+
+/**
+ * @brief Print the rules, tuples and memory of a classifier.
+ *
+ * @param out  The output stream.
+ * @param file The file the rules came from.
+ * @param acl  The classifier.
+ */
+void Print_ACL_Table(FILE *out, const char *file, const acl_table *acl) {
+    uint32_t denies = 0;
+    for (uint32_t rule = 0; rule < acl->count; rule++) denies += acl->rules[rule].action == ACL_DENY;
+
+    fprintf(out, "acl %s: %u rules (%u deny), %u tuples, %zu slots, %.1f KB, default %s\n", file, acl->count,
+            denies, acl->num_tuples, acl->num_slots, Size_ACL_Table(acl) / 1024.0,
+            acl->fallback == ACL_DENY ? "deny" : "permit");
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#ifndef ACL_TABLE_H_
+#define ACL_TABLE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define ACL_PERMIT      0
+#define ACL_DENY        1
+#define ACL_ANY_PROTO   (-1)            // Protocol of a rule for every protocol.
+#define ACL_SPORT       0x01            // The rule matches a range of source ports, not any.
+#define ACL_DPORT       0x02            // The rule matches a range of destination ports, not any.
+
+// RULES ARE CLASSIFIED BY TUPLE SPACE SEARCH (Srinivasan et al.), ONE HASH PROBE PER TUPLE:
+// the rules whose source and destination prefix lengths round down to the same multiples of 8
+// form a tuple (TupleMerge, Daly et al.: at most 25 of them whatever the lengths), a hash table
+// of their prefix pairs cut to those lengths, under which the rules of a pair wait in priority
+// order for the rest of their prefixes, protocol and ports. A bitmap in front of every table,
+// 8 bits per pair, turns most misses away without touching the table. The tuples are searched
+// in the order of their first rule and the search stops at the first tuple that cannot hold a
+// rule before the best match so far, so the first rules of the file answer in a few probes.
+
+// A rule as written, its prefixes masked. The first matching rule of the file decides.
+typedef struct acl_rule {
+    uint32_t src;               // Source prefix, host order.
+    uint32_t dst;               // Destination prefix, host order.
+    uint8_t src_len;            // Source prefix length, 0 to 32.
+    uint8_t dst_len;            // Destination prefix length, 0 to 32.
+    uint8_t action;             // ACL_PERMIT / ACL_DENY.
+    uint8_t flags;              // ACL_SPORT / ACL_DPORT.
+    int16_t proto;              // IP protocol, ACL_ANY_PROTO for every protocol.
+    uint16_t sport_lo, sport_hi;// Source ports, inclusive.
+    uint16_t dport_lo, dport_hi;// Destination ports, inclusive.
+    int line;                   // Line of the rule in its file.
+} acl_rule;
+
+// The fields of a packet the rules look at.
+typedef struct acl_key {
+    uint32_t src;               // Source address, host order.
+    uint32_t dst;               // Destination address, host order.
+    uint16_t sport;             // Source port, TCP / UDP only.
+    uint16_t dport;             // Destination port.
+    uint8_t proto;              // IP protocol.
+    bool ports;                 // The packet has ports: TCP / UDP, not a fragment past the first.
+} acl_key;
+
+// A rule under its prefix pair, with what is left to check.
+typedef struct acl_match {
+    uint32_t src, src_mask;     // Source prefix and mask, host order.
+    uint32_t dst, dst_mask;     // Destination prefix and mask.
+    uint32_t rule;              // Index of the rule, its priority (lower first).
+    int16_t proto;              // IP protocol, ACL_ANY_PROTO for every protocol.
+    uint8_t flags;              // ACL_SPORT / ACL_DPORT.
+    uint8_t action;             // ACL_PERMIT / ACL_DENY.
+    uint16_t sport_lo, sport_hi;
+    uint16_t dport_lo, dport_hi;
+} acl_match;
+
+// Hash table slot: a prefix pair of a tuple and its rules.
+typedef struct acl_slot {
+    uint32_t src;               // Source prefix, cut to the tuple's length.
+    uint32_t dst;               // Destination prefix.
+    uint32_t first;             // First of the pair's rules in the matches.
+    uint32_t count;             // Rules of the pair, 0 for a free slot.
+} acl_slot;
+
+// Rules of the same rounded prefix lengths.
+typedef struct acl_tuple {
+    uint32_t src_mask;          // Source mask, host order.
+    uint32_t dst_mask;          // Destination mask.
+    uint32_t first;             // First rule of the tuple, no rule of it can match before.
+    uint32_t slots;             // First slot of the tuple's hash table.
+    uint32_t filter;            // First word of the tuple's bitmap.
+    uint8_t slot_shift;         // 64 minus the bits of a slot index, taken from the top of the hash.
+    uint8_t filter_shift;       // 64 minus the bits of a bitmap index, 3 more than the slot's.
+    uint8_t src_len, dst_len;   // Rounded lengths.
+} acl_tuple;
+
+// A compiled rule set, immutable once built: replaced whole, never changed in place.
+typedef struct acl_table {
+    acl_rule *rules;            // Rules in file order.
+    uint32_t count;             // Number of rules.
+    acl_tuple *tuples;          // Tuples, by their first rule.
+    uint32_t num_tuples;
+    acl_slot *slots;            // Hash tables of all the tuples, back to back.
+    size_t num_slots;
+    uint64_t *filters;          // Bitmaps of all the tuples, back to back.
+    size_t num_filters;         // Words of the bitmaps.
+    acl_match *matches;         // Rules by prefix pair, each pair's in priority order.
+    uint8_t fallback;           // Action when no rule matches ("default" line, permit if none).
+} acl_table;
+
+// A worker's read-side sections on the rule set, counted so a replaced one is freed only once
+// no worker can still be classifying with it. Odd while the worker is inside a section.
+typedef struct acl_reader {
+    _Atomic uint32_t seq;
+} __attribute__((aligned(64))) acl_reader;
+
+/** @brief Read ACL rules (action src dst [proto [sport [dport]]]) from a file. */
+acl_rule*       Read_ACL_Rules          (const char *file, int *count, uint8_t *fallback);
+/** @brief Compile an array of rules into a classifier. */
+acl_table*      Build_ACL_Table         (const acl_rule *rules, int count, uint8_t fallback);
+/** @brief Create a classifier from a file of rules. */
+acl_table*      Create_ACL_Table        (const char *file);
+/** @brief Free a classifier. */
+void            Free_ACL_Table          (acl_table **acl);
+/** @brief Bytes of memory taken by a classifier. */
+size_t          Size_ACL_Table          (const acl_table *acl);
+
+/** @brief Whether a rule matches a packet. */
+bool            Match_ACL_Rule          (const acl_rule *rule, const acl_key *key);
+/** @brief Find the first rule matching a packet. */
+int             Classify_ACL            (const acl_table *acl, const acl_key *key, int *probes);
+
+/**
+ * @brief Action of a rule set for a packet: its first matching rule's, the fallback if none matches.
+ */
+static inline uint8_t Filter_ACL(const acl_table *acl, const acl_key *key) {
+    int rule = Classify_ACL(acl, key, NULL);
+    return rule < 0 ? acl->fallback : acl->rules[rule].action;
+}
+
+/** @brief Print the rules, tuples and memory of a classifier. */
+void            Print_ACL_Table         (FILE *out, const char *file, const acl_table *acl);
+
+#endif /* ACL_TABLE_H_ */
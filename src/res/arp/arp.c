@@ -1,4 +1,5 @@
 #include "./arp.h"
+#include "../ipv4/ipv4.h"
 
 /* -----------------------------------------------------  ARP REPLY  ----------------------------------------------------- */
 
@@ -89,6 +90,7 @@ static void Update_ARP_Length(routing *rout) {
  * @param rout The rout structure to store the ARP request packet.
  */
 void Request_ARP(routing *rout) {
+    STATS_EVENT(ARP_REQUESTS_OUT, 1);
     // Initialize the Ethernet header for ARP requests.
     Init_ETH_Header(rout);
     // Initialize the ARP header for ARP requests.
@@ -101,63 +103,114 @@ void Request_ARP(routing *rout) {
 /* ------------------------------------------------- HANDLER ARP PACKETS ------------------------------------------------- */
 
 /**
- * @brief Handle incoming ARP packets in the rout.
+ * @brief Answer an ARP request, or learn the neighbor of an ARP reply.
  * 
- * @param rout The rout structure containing the received packet and ARP information.
+ * @param rout    The rout structure containing the received packet and ARP information.
+ * @param learned Receives the neighbor of a reply, cached unless the ARP table is full.
+ * @return        True when a reply was learned, its waiting packets can be released.
  */
-void Handler_ARP(routing *rout) {
+bool Learn_ARP(routing *rout, arp_entry *learned) {
     // Check if the rout and packet type are valid for ARP processing.
-    if (!rout || rout->eth_hdr->ether_type != ARP_TYPE) return;
+    if (!rout || rout->eth_hdr->ether_type != ARP_TYPE) return false;
 
     // Point to the ARP header within the received packet.
     rout->arp_hdr = (struct arphdr *)(rout->buf + sizeof *rout->eth_hdr);
 
     // Check if the ARP operation is a request.
     if (rout->arp_hdr->op == OP_REQUEST) {
+        STATS_EVENT(ARP_REQUESTS_IN, 1);
+        // Over the reply rate, the request is dropped before anything is rewritten.
+        if (!Police(rout->policer, rout->interface, POLICE_ARP_REPLY)) return false;
+        STATS_EVENT(ARP_REPLIES_OUT, 1);
         // Reply to the ARP request.
         Reply_ARP(rout);
         // Send the ARP reply back to the sender.
         Send_To_Link(rout->interface, rout->buf, rout->len);
-        return;
+        return false;
     }
 
     // Check if the ARP operation is a reply.
-    if (rout->arp_hdr->op != OP_REPLY) return;
-
-    arp_entry *entry = malloc(sizeof(arp_entry));
-    if (entry) {
-        entry->ip = rout->arp_hdr->spa;
-        memcpy(entry->mac, rout->arp_hdr->sha, MAC_SIZE);
-    } else {
-        free(entry);
-        return;
-    }
+    if (rout->arp_hdr->op != OP_REPLY) return false;
+    STATS_EVENT(ARP_REPLIES_IN, 1);
+
+    learned->ip = rout->arp_hdr->spa;
+    memcpy(learned->mac, rout->arp_hdr->sha, MAC_SIZE);
 
     // Cache the new MAC address associated with the sender's IP address.
-    Insert_ARP_Entry(rout->macs, entry);
+    // Any neighbor change invalidates the decisions the workers cached.
+    if (Insert_ARP_Entry(rout->ctrl->macs, learned)) Bump_Generation(rout->ctrl);
+    return true;
+}
 
-    // Process and send waiting packets to the newly resolved MAC address.
-    while (!EmptyQueue(rout->waiting)) {
-        packet *pkt = Dequeue(rout->waiting);
+// Orders learned neighbors by address, for Release_Waiting's binary search.
+static int Compare_Learned(const void *left, const void *right) {
+    uint32_t a = ((const arp_entry *)left)->ip, b = ((const arp_entry *)right)->ip;
+    return (a > b) - (a < b);
+}
 
-        // Check if the waiting packet's destination matches the sender's IP address.
-        if (pkt->next_hop == rout->arp_hdr->spa) {
+/**
+ * @brief Send the waiting packets whose next hop was just learned, or is in the ARP table.
+ * 
+ * The queue is shared by the workers, it is walked exactly once under its lock, however many
+ * replies were learned before: the pipeline releases the packets of a whole vector of replies at once.
+ * The next hop of a packet is searched among the learned neighbors first (with the MAC of their
+ * reply, cached or not), then in the ARP table for those resolved before it was queued.
+ * 
+ * @param rout    The rout structure, its context is overwritten by the packets sent.
+ * @param learned The neighbors learned, sorted in place.
+ * @param count   Their number.
+ */
+void Release_Waiting(routing *rout, arp_entry *learned, int count) {
+    arp_table *macs = rout->ctrl->macs;
+    qsort(learned, count, sizeof(*learned), Compare_Learned);
+
+    pthread_mutex_lock(&rout->ctrl->waiting_lock);
+    queue pending = Queue();
+    while (!EmptyQueue(rout->ctrl->waiting)) {
+        packet *pkt = Dequeue(rout->ctrl->waiting);
+
+        // Check if the waiting packet's next hop is resolved.
+        arp_entry key = {.ip = pkt->next_hop};
+        const arp_entry *reply = (const arp_entry *)bsearch(&key, learned, count, sizeof(*learned), Compare_Learned);
+        const uint8_t *mac = reply ? reply->mac : NULL;
+        if (!mac) {
+            int entry_idx = Get_ARP_Entry(macs, pkt->next_hop);
+            if (entry_idx >= 0) mac = macs->addrs[entry_idx].mac;
+        }
+
+        if (mac) {
             // Process the waiting packet.
-            Waiting_Packet(rout, pkt);
+            Waiting_Packet(rout, pkt, mac);
 
-            // Send the packet to the resolved MAC address.
-            Send_To_Link(rout->interface, pkt->buf, rout->len);
+            // Send the packet to the resolved MAC address (in fragments if over the MTU), its latency counts the wait.
+            Send_IPV4(rout->interface, pkt->buf, rout->len, &pkt->offload, pkt->stamp, PATH_ARP);
 
             // Free the packet's resources.
             free(pkt->buf);
             free(pkt);
+            rout->ctrl->waiting_len--;
         } else {
-            // Re-enqueue packets that are not intended for the resolved address.
-            Enqueue(rout->waiting, (void *)pkt);
+            // Re-enqueue packets whose next hop is still unresolved.
+            Enqueue(pending, (void *)pkt);
         }
     }
+    // Keep the unresolved packets in their original order.
+    while (!EmptyQueue(pending)) {
+        Enqueue(rout->ctrl->waiting, Dequeue(pending));
+    }
+    pthread_mutex_unlock(&rout->ctrl->waiting_lock);
+    FreeQueue(pending);
+}
 
-    free(entry);
+/**
+ * @brief Handle incoming ARP packets in the rout.
+ * 
+ * @param rout The rout structure containing the received packet and ARP information.
+ */
+void Handler_ARP(routing *rout) {
+    // Process and send waiting packets to the newly resolved MAC address.
+    arp_entry learned;
+    if (Learn_ARP(rout, &learned)) Release_Waiting(rout, &learned, 1);
 }
 
 /* ------------------------------------------------- HANDLER ARP PACKETS ------------------------------------------------- */
@@ -21,6 +21,10 @@
 extern void        Request_ARP         (routing *rout);
 /** @brief Generate an ARP request packet in the rout structure. */
 extern void        Reply_ARP           (routing *rout);
+/** @brief Answer an ARP request, or learn the neighbor of an ARP reply. */
+extern bool        Learn_ARP           (routing *rout, arp_entry *learned);
+/** @brief Send the waiting packets whose next hop was just learned, or is in the ARP table. */
+extern void        Release_Waiting     (routing *rout, arp_entry *learned, int count);
 /** @brief Handle incoming ARP packets in the rout. */
 extern void        Handler_ARP         (routing *rout);
 
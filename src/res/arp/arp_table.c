@@ -1,4 +1,5 @@
 #include "./arp_table.h"
+#include "../../utils/hugepage.h"
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -17,15 +18,16 @@ arp_table* Create_ARP_Table(void) {
     arp_table *arp = malloc(sizeof(*arp));
     if (!arp) return NULL;
 
-    // Allocate memory for the ARP table's address entries.
-    arp->addrs = malloc(sizeof(*arp->addrs) * ARP_SIZE);
+    // Allocate memory for the ARP table's address entries, on 2 MB pages when the host has them.
+    arp->addrs = Huge_Alloc(sizeof(*arp->addrs) * ARP_SIZE, HUGE_NEIGHBORS);
     if (!arp->addrs) {
         free(arp);
         return NULL;
     }
 
     // Initialize the ARP table's length to 0.
-    arp->len = 0;
+    atomic_init(&arp->len, 0);
+    pthread_mutex_init(&arp->lock, NULL);
     return arp;
 }
 
@@ -42,8 +44,9 @@ arp_table* Create_ARP_Table(void) {
 void Free_ARP_Table(arp_table **arp) {
     if (!arp || !(*arp)) return;
     // Free the memory occupied by the ARP table's address entries.
-    free((*arp)->addrs);
-     // Free the memory occupied by the ARP table structure.
+    Huge_Free((*arp)->addrs);
+    pthread_mutex_destroy(&(*arp)->lock);
+    // Free the memory occupied by the ARP table structure.
     free(*arp);
     // Prevent further access.
     *arp = NULL;
@@ -56,6 +59,8 @@ void Free_ARP_Table(arp_table **arp) {
  * @brief Get the index of an ARP table entry.
  * 
  * Searches for an ARP table entry with a given IP address and returns its index.
+ * Lock-free: only the entries published before the acquire load of the length are scanned,
+ * and only the live ones (learned or static), their state loaded before their address.
  * 
  * @param arp The ARP table to search in.
  * @param ip  The IP address to search for.
@@ -63,8 +68,10 @@ void Free_ARP_Table(arp_table **arp) {
  */
 int Get_ARP_Entry(arp_table *arp, uint32_t ip) {
     if (!arp || !arp->addrs) return -1;
+    int len = atomic_load_explicit(&arp->len, memory_order_acquire);
     // Iterate through the ARP table's address entries.
-    for (int entry = 0; entry < arp->len; entry++) {
+    for (int entry = 0; entry < len; entry++) {
+        if (atomic_load_explicit(&arp->addrs[entry].state, memory_order_acquire) > ARP_STATIC) continue;
         if (arp->addrs[entry].ip == ip) { // match the givne ip
             return entry;
         }
@@ -76,28 +83,156 @@ int Get_ARP_Entry(arp_table *arp, uint32_t ip) {
 /* ---------------------------------------------------   GET ARP ENTRY  --------------------------------------------------- */
 /* --------------------------------------------------  INSERT ARP ENTRY  -------------------------------------------------- */
 
+/**
+ * @brief Write an entry into a free slot of the ARP table, or after its last one.
+ *
+ * The address is written first, then published to the lookups by a release store of the
+ * state (and of the length for a new slot). Called with the lock held.
+ *
+ * @param arp   The ARP table.
+ * @param ip    The IP address.
+ * @param mac   The MAC address.
+ * @param state ARP_LEARNED or ARP_STATIC.
+ * @return The index of the entry, -1 if the table is full.
+ */
+static int Write_ARP_Entry(arp_table *arp, uint32_t ip, const uint8_t mac[MAC_SIZE], uint8_t state) {
+    int len = atomic_load_explicit(&arp->len, memory_order_relaxed);
+    int slot = 0;
+    while (slot < len && atomic_load_explicit(&arp->addrs[slot].state, memory_order_relaxed) != ARP_FREE) slot++;
+    if (slot == ARP_SIZE) return -1;
+
+    arp->addrs[slot].ip = ip;
+    memcpy(arp->addrs[slot].mac, mac, MAC_SIZE);
+    atomic_store_explicit(&arp->addrs[slot].state, state, memory_order_release);
+    if (slot == len) atomic_store_explicit(&arp->len, len + 1, memory_order_release);
+    return slot;
+}
+
 /**
  * @brief Insert an ARP table entry into the ARP table.
  * 
  * Insert a new ARP table entry with the given IP address and MAC address
  * into the ARP table, using the information parsed from a file.
+ * The entry takes the slot of a released one or a new one (see Write_ARP_Entry).
  * 
  * @param arp  The ARP table to insert into.
  * @param path The path to the file containing the ARP table entry.
- * @return The number of unique entries added to the ARP table.
+ * @return True if the entry was added, false if it was already there or the table is full.
  */
-void Insert_ARP_Entry(arp_table *arp, arp_entry *new_entry) {
-    if (!arp || !arp->addrs || arp->len >= ARP_SIZE) return;
+bool Insert_ARP_Entry(arp_table *arp, arp_entry *new_entry) {
+    if (!arp || !arp->addrs) return false;
 
+    pthread_mutex_lock(&arp->lock);
     // Check if the arp address already exists in the ARPs structure.
     int idx_entry = Get_ARP_Entry(arp, new_entry->ip);
 
-    if (idx_entry < 0) {
-        // Cache the new arp address if it doesn't exist in the ARPs structure.
-        arp->addrs[arp->len].ip = new_entry->ip;
-        memcpy(arp->addrs[arp->len].mac, new_entry->mac, MAC_SIZE);
-        arp->len++;
-    }
+    // Cache the new arp address if it doesn't exist in the ARPs structure.
+    bool inserted = idx_entry < 0 && Write_ARP_Entry(arp, new_entry->ip, new_entry->mac, ARP_LEARNED) >= 0;
+    pthread_mutex_unlock(&arp->lock);
+
+    return inserted;
 }
 
 /* --------------------------------------------------  INSERT ARP ENTRY  -------------------------------------------------- */
+/* ---------------------------------------------------  SET ARP ENTRY  --------------------------------------------------- */
+
+/**
+ * @brief Whether the static entry an IP address has is the one to set, the index of its entry if it has one.
+ *
+ * Called with the lock held.
+ */
+static bool Static_ARP_Entry(arp_table *arp, uint32_t ip, const uint8_t mac[MAC_SIZE], int *old) {
+    *old = Get_ARP_Entry(arp, ip);
+    return *old >= 0 && atomic_load_explicit(&arp->addrs[*old].state, memory_order_relaxed) == ARP_STATIC &&
+           !memcmp(arp->addrs[*old].mac, mac, MAC_SIZE);
+}
+
+/**
+ * @brief Set the static ARP table entries of IP addresses, replacing the ones they have; all of them or none.
+ *
+ * The slots the new entries take are counted first, free or after the last one, so a table
+ * too full for them is left as it was. The entries are never changed while published: a new
+ * one is written first, then the old one removed, so the lookups always find one of the two.
+ * As with Remove_ARP_Entry, the old slots are reused only after Release_ARP_Entries.
+ *
+ * @param arp      The ARP table.
+ * @param entries  The IP addresses (in network byte order) and their MAC addresses, one per address.
+ * @param count    The number of entries.
+ * @param replaced Set to true if an entry was removed, its slot to be released.
+ * @return True if the entries were set, false if the table has no room for them.
+ */
+bool Set_ARP_Entries(arp_table *arp, const arp_entry *entries, int count, bool *replaced) {
+    *replaced = false;
+    if (!arp || !arp->addrs) return false;
+
+    pthread_mutex_lock(&arp->lock);
+    int len = atomic_load_explicit(&arp->len, memory_order_relaxed), room = ARP_SIZE - len, needed = 0, old;
+    for (int slot = 0; slot < len; slot++) {
+        room += atomic_load_explicit(&arp->addrs[slot].state, memory_order_relaxed) == ARP_FREE;
+    }
+    for (int entry = 0; entry < count; entry++) {
+        needed += !Static_ARP_Entry(arp, entries[entry].ip, entries[entry].mac, &old);
+    }
+
+    bool set = needed <= room;
+    for (int entry = 0; set && entry < count; entry++) {
+        if (Static_ARP_Entry(arp, entries[entry].ip, entries[entry].mac, &old)) continue;
+        Write_ARP_Entry(arp, entries[entry].ip, entries[entry].mac, ARP_STATIC);
+        if (old >= 0) {
+            atomic_store_explicit(&arp->addrs[old].state, ARP_DEAD, memory_order_release);
+            *replaced = true;
+        }
+    }
+    pthread_mutex_unlock(&arp->lock);
+
+    return set;
+}
+
+/* ---------------------------------------------------  SET ARP ENTRY  --------------------------------------------------- */
+/* -------------------------------------------------  REMOVE ARP ENTRY  -------------------------------------------------- */
+
+/**
+ * @brief Remove the ARP table entry of an IP address, learned or static.
+ *
+ * The lookups stop finding it at once, but one may still hold its index: the slot is reused
+ * only after Release_ARP_Entries, once no lookup can.
+ *
+ * @param arp The ARP table.
+ * @param ip  The IP address, in network byte order.
+ * @return True if the entry was removed, false if there was none.
+ */
+bool Remove_ARP_Entry(arp_table *arp, uint32_t ip) {
+    if (!arp || !arp->addrs) return false;
+
+    pthread_mutex_lock(&arp->lock);
+    int entry = Get_ARP_Entry(arp, ip);
+    if (entry >= 0) atomic_store_explicit(&arp->addrs[entry].state, ARP_DEAD, memory_order_release);
+    pthread_mutex_unlock(&arp->lock);
+
+    return entry >= 0;
+}
+
+/**
+ * @brief Free the slots of the removed entries for the next insertions.
+ *
+ * Called once no lookup started before the removals runs anymore (after a grace period).
+ *
+ * @param arp The ARP table.
+ * @return The number of slots freed.
+ */
+int Release_ARP_Entries(arp_table *arp) {
+    if (!arp || !arp->addrs) return 0;
+
+    pthread_mutex_lock(&arp->lock);
+    int len = atomic_load_explicit(&arp->len, memory_order_relaxed), released = 0;
+    for (int entry = 0; entry < len; entry++) {
+        if (atomic_load_explicit(&arp->addrs[entry].state, memory_order_relaxed) != ARP_DEAD) continue;
+        atomic_store_explicit(&arp->addrs[entry].state, ARP_FREE, memory_order_relaxed);
+        released++;
+    }
+    pthread_mutex_unlock(&arp->lock);
+
+    return released;
+}
+
+/* -------------------------------------------------  REMOVE ARP ENTRY  -------------------------------------------------- */
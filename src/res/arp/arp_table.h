@@ -8,32 +8,48 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #define MAC_SIZE 6
 #define ARP_SIZE 1001
 
 // ROUTES ARE STATIC ALLOCATED!
 
+// State of an ARP entry, only the learned and static ones are looked up.
+#define ARP_LEARNED 0       // From an ARP reply.
+#define ARP_STATIC  1       // From the control socket, replies do not change it.
+#define ARP_DEAD    2       // Removed, the lookups may still hold its index.
+#define ARP_FREE    3       // Removed a grace period ago, reused by the next insertion.
+
 // ARP (Address Resolution Protocol) entry
 typedef struct arp_entry {
     uint32_t ip;            // IP address in network byte order
     uint8_t mac[MAC_SIZE];  // MAC address in binary form
+    _Atomic uint8_t state;  // ARP_LEARNED / ARP_STATIC / ARP_DEAD / ARP_FREE, published with release semantics.
 } arp_entry;
 
 // ARP (Address Resolution Protocol) table.
 typedef struct arp_table {
-    arp_entry *addrs;       // Array of ARP entries.
-    int len;                // Number entries in the table.
+    arp_entry *addrs;       // Array of ARP entries, never modified until removed and released.
+    atomic_int len;         // Number entries in the table, published with release semantics.
+    pthread_mutex_t lock;   // Serializes writers, lookups never take it.
 } arp_table;
 
 /** @brief Create a new ARP table. */
 arp_table*      Create_ARP_Table        (void);
-/** @brief Free an ARP table.
+/** @brief Free an ARP table. */
 void            Free_ARP_Table          (arp_table **arp);
 
 /** @brief Get the index of an ARP table entry.  */
 int             Get_ARP_Entry           (arp_table *arp, uint32_t ip);
 /** @brief Insert an ARP table entry. */
-void            Insert_ARP_Entry        (arp_table *arp, arp_entry *new_entry);
+bool            Insert_ARP_Entry        (arp_table *arp, arp_entry *new_entry);
+/** @brief Set the static ARP table entries of IP addresses, all or none; the slots they replace are released later. */
+bool            Set_ARP_Entries         (arp_table *arp, const arp_entry *entries, int count, bool *replaced);
+/** @brief Remove the ARP table entry of an IP address, its slot is released later. */
+bool            Remove_ARP_Entry        (arp_table *arp, uint32_t ip);
+/** @brief Free the slots of the removed entries, once no lookup can hold them. */
+int             Release_ARP_Entries     (arp_table *arp);
 
 #endif /* ARP_TABLE_H_ */
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#ifndef CTL_PROTO_H_
+#define CTL_PROTO_H_
+
+#include <stdint.h>
+
+// Binary protocol of the control socket (router -C path, routerctl), in host byte order but for
+// the addresses (network byte order, as in the routing tables). A request is a header followed by
+// its records; the router answers every request with a reply, followed by the records it asked for.
+
+#define CTL_MAGIC       0x5243u     // "RC", first of every header and reply.
+#define CTL_VERSION     1
+#define CTL_MAX_OPS     65536       // Changes of one request at most.
+#define CTL_MAX_CLIENTS 8           // Connections served at once, the others wait to be accepted.
+
+// Requests.
+#define CTL_APPLY       1           // count ctl_op changes follow, applied as one transaction.
+#define CTL_DUMP_FIB    2           // count is the VRF, the reply is followed by its routes as CTL_ROUTE_ADD changes.
+#define CTL_DUMP_STATS  3           // The reply is followed by ctl_counter records.
+
+// Changes.
+#define CTL_ROUTE_ADD   1           // Set the single path of a prefix (address/length via next_hop dev interface).
+#define CTL_ROUTE_DEL   2           // Remove a prefix.
+#define CTL_NEIGH_ADD   3           // Set the static MAC address of a neighbor, replies no longer change it.
+#define CTL_NEIGH_DEL   4           // Remove a neighbor, learned or static.
+
+// Status of a reply.
+#define CTL_OK          0
+#define CTL_EREQUEST    (-1)        // Bad header: magic, version, type or count.
+#define CTL_EOP         (-2)        // Bad change, the reply's index is the first one; nothing was applied.
+#define CTL_ENOFIB      (-3)        // No routing table to change (shared FIB, -f) or no such VRF.
+#define CTL_ENOMEM      (-4)        // Out of memory copying the routes of the VRF of the reply's index; nothing was applied.
+#define CTL_EFULL       (-5)        // No room in the ARP table for the neighbors, the reply's index is the first; nothing was applied.
+
+// Header of a request, 8 bytes.
+typedef struct ctl_header {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;               // CTL_APPLY / CTL_DUMP_FIB / CTL_DUMP_STATS.
+    uint32_t count;             // Changes that follow, or the VRF of a dump.
+} ctl_header;
+
+// One change of a transaction, 16 bytes.
+typedef struct ctl_op {
+    uint8_t op;                 // CTL_ROUTE_ADD / CTL_ROUTE_DEL / CTL_NEIGH_ADD / CTL_NEIGH_DEL.
+    uint8_t vrf;                // VRF of a route, 0 for the default table; 0 for a neighbor.
+    uint8_t length;             // Prefix length of a route, 1 to 32.
+    int8_t interface;           // Interface of a route's path.
+    uint32_t address;           // Prefix of a route, address of a neighbor.
+    union {
+        uint32_t next_hop;      // Next hop of a route's path.
+        uint8_t mac[8];         // MAC address of a neighbor, its first 6 bytes.
+    };
+} ctl_op;
+
+// Reply to a request, 16 bytes.
+typedef struct ctl_reply {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;               // Type of the request.
+    int32_t status;             // CTL_OK or a negative CTL_E* error.
+    uint32_t count;             // Changes applied, or records that follow.
+    uint32_t index;             // Change an error is about.
+} ctl_reply;
+
+// Kinds of counters of a stats dump.
+#define CTL_STAT_LINK   1           // index: CTL_LINK_*, interface: the interface.
+#define CTL_STAT_DROP   2           // index: drop_reason.
+#define CTL_STAT_EVENT  3           // index: stats_event.
+#define CTL_STAT_FIB    4           // index: CTL_FIB_*, interface: the VRF (-1 for the whole router).
+
+#define CTL_LINK_RX_PACKETS     0
+#define CTL_LINK_RX_BYTES       1
+#define CTL_LINK_TX_PACKETS     2
+#define CTL_LINK_TX_BYTES       3
+
+#define CTL_FIB_ROUTES          0   // Prefixes of the VRF's table.
+#define CTL_FIB_NODES           1   // Trie nodes of the table.
+#define CTL_FIB_GARBAGE         2   // Nodes replaced by changes, not compacted yet.
+#define CTL_FIB_GENERATION      3   // Generation of the flow caches.
+#define CTL_FIB_TRANSACTIONS    4   // Transactions committed.
+
+// One counter of a stats dump, summed over the workers, 16 bytes.
+typedef struct ctl_counter {
+    uint16_t kind;              // CTL_STAT_*.
+    uint16_t index;             // Counter of the kind.
+    int32_t interface;          // Interface or VRF, -1 for none.
+    uint64_t value;
+} ctl_counter;
+
+#endif /* CTL_PROTO_H_ */
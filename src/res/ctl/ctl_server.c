@@ -0,0 +1,652 @@
+#define _GNU_SOURCE
+
+#include "./ctl_server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#define CTL_SEND_TIMEOUT 5          // Seconds a reply may wait for its client to read, the client is dropped after.
+
+/* --------------------------------------------------- CHECK CHANGES -------------------------------------------------- */
+
+/**
+ * @brief Check one change against the tables of the router.
+ *
+ * @return CTL_OK, CTL_EOP for a malformed change or CTL_ENOFIB for a route without a table.
+ */
+static int Check_Control_Op(const control *ctrl, const ctl_op *op) {
+    switch (op->op) {
+        case CTL_ROUTE_ADD:
+        case CTL_ROUTE_DEL:
+            // The shared FIB (-f) changes with fibload.
+            if (!ctrl->ipv4s || op->vrf >= (ctrl->vrfs ? ctrl->vrfs->count : 1)) return CTL_ENOFIB;
+            // The tries have no default route, as the routing table files.
+            if (op->length < 1 || op->length > 32) return CTL_EOP;
+            if (op->op == CTL_ROUTE_ADD && (op->interface < 0 || op->interface >= ROUTER_NUM_INTERFACES)) return CTL_EOP;
+            return CTL_OK;
+        case CTL_NEIGH_ADD:
+        case CTL_NEIGH_DEL:
+            return op->vrf || !op->address ? CTL_EOP : CTL_OK;
+        default:
+            return CTL_EOP;
+    }
+}
+
+/**
+ * @brief Check the changes of a request against the tables of the router, before any is applied.
+ *
+ * A request with a bad change is rejected whole, so a transaction only fails past this check if
+ * the router runs out of memory or of ARP entries.
+ *
+ * @param ctrl  The shared control state.
+ * @param ops   The changes.
+ * @param count The number of changes.
+ * @param index Receives the first bad change.
+ * @return CTL_OK, or the CTL_E* error of the first bad change.
+ */
+int Check_Control_Ops(const control *ctrl, const ctl_op *ops, uint32_t count, uint32_t *index) {
+    for (uint32_t op = 0; op < count; op++) {
+        int status = Check_Control_Op(ctrl, &ops[op]);
+        if (status != CTL_OK) {
+            *index = op;
+            return status;
+        }
+    }
+    return CTL_OK;
+}
+
+/* --------------------------------------------------- CHECK CHANGES -------------------------------------------------- */
+/* -------------------------------------------------- COMMIT CHANGES -------------------------------------------------- */
+
+// A neighbor change, by address then as given, to keep the last change of every neighbor.
+typedef struct neigh_change {
+    uint32_t address;
+    uint32_t index;
+} neigh_change;
+
+static int Compare_Neighbors(const void *left, const void *right) {
+    const neigh_change *a = (const neigh_change*)left, *b = (const neigh_change*)right;
+    if (a->address != b->address) return a->address < b->address ? -1 : 1;
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+/**
+ * @brief Free the nodes the changes replaced once there are more of them than live ones.
+ *
+ * The live trie is copied into a new pool (shared again with VRFs) and published, then the old
+ * pool goes after a grace period. Called with fib_lock held.
+ *
+ * @param ctrl The shared control state.
+ */
+static void Compact_FIB(control *ctrl) {
+    huge_pool *old = NULL;
+    bool failed = false;
+    if (ctrl->vrfs) {
+        if (2 * Garbage_VRF_Set(ctrl->vrfs) > ctrl->vrfs->nodes) old = Compact_VRF_Set(ctrl->vrfs, &failed);
+    } else if (ctrl->ipv4s && ctrl->ipv4s->garbage > ctrl->ipv4s->nodes) {
+        old = Compact_IPV4_Table(ctrl->ipv4s, &failed);
+    }
+    // Out of memory, the next transaction tries again.
+    if (!old) return;
+
+    Sync_FIB(ctrl);
+    Free_Huge_Pool(&old);
+}
+
+/**
+ * @brief Apply checked changes as one transaction and publish them to the workers, all of them or none.
+ *
+ * Of the changes of a neighbor, only the last counts; of those of a prefix, the last one wins too.
+ * The tries of every VRF are copied with their changes first, none published (see Prepare_IPV4_Routes);
+ * then the new neighbors are set together, if the ARP table has room for all of them, so the new
+ * routes resolve through them at once; then the new tries are published, each with one store; then
+ * the removed neighbors go, once no new route leads to them. A transaction that runs out of memory
+ * or of ARP entries drops the copies and leaves the tables as they were. The flow caches are
+ * invalidated, and after a grace period the ARP entries removed are freed, and the trie compacted
+ * if the changes left too many nodes behind. The transactions are serialized by fib_lock, with
+ * SIGHUP's path reloads.
+ *
+ * @param ctrl  The shared control state.
+ * @param ops   The changes, checked by Check_Control_Ops.
+ * @param count The number of changes.
+ * @param index Receives the change an error is about: the first route change of the VRF that ran
+ *              out of memory, or the first neighbor addition if the ARP table has no room for them.
+ * @return The number of changes applied, or a negative CTL_E* error.
+ */
+int Commit_Control_Ops(control *ctrl, const ctl_op *ops, uint32_t count, uint32_t *index) {
+    route_change *changes = (route_change*)malloc((count ? count : 1) * sizeof(route_change));
+    neigh_change *neighbors = (neigh_change*)malloc((count ? count : 1) * sizeof(neigh_change));
+    arp_entry *entries = (arp_entry*)calloc(count ? count : 1, sizeof(arp_entry));
+    *index = 0;
+    if (!changes || !neighbors || !entries) {
+        free(changes);
+        free(neighbors);
+        free(entries);
+        return CTL_ENOMEM;
+    }
+
+    // The last change of every neighbor, sorted after the others.
+    uint32_t num_neighbors = 0, kept = 0;
+    for (uint32_t op = 0; op < count; op++) {
+        if (ops[op].op == CTL_NEIGH_ADD || ops[op].op == CTL_NEIGH_DEL) {
+            neighbors[num_neighbors++] = (neigh_change){.address = ops[op].address, .index = op};
+        }
+    }
+    qsort(neighbors, num_neighbors, sizeof(neigh_change), Compare_Neighbors);
+    for (uint32_t neighbor = 0; neighbor < num_neighbors; neighbor++) {
+        if (neighbor + 1 < num_neighbors && neighbors[neighbor + 1].address == neighbors[neighbor].address) continue;
+        neighbors[kept++] = neighbors[neighbor];
+    }
+
+    // The neighbors set, and the first change adding one.
+    int num_entries = 0;
+    uint32_t first_entry = count;
+    for (uint32_t neighbor = 0; neighbor < kept; neighbor++) {
+        const ctl_op *op = &ops[neighbors[neighbor].index];
+        if (op->op != CTL_NEIGH_ADD) continue;
+        entries[num_entries].ip = op->address;
+        memcpy(entries[num_entries++].mac, op->mac, MAC_SIZE);
+        if (neighbors[neighbor].index < first_entry) first_entry = neighbors[neighbor].index;
+    }
+
+    pthread_mutex_lock(&ctrl->fib_lock);
+    int status = CTL_OK;
+    ipv4_change copies[MAX_VRFS];
+    bool copied[MAX_VRFS] = {false};
+    for (int vrf = 0; status == CTL_OK && vrf < MAX_VRFS; vrf++) {
+        int batch = 0;
+        uint32_t first = 0;
+        for (uint32_t op = 0; op < count; op++) {
+            if ((ops[op].op != CTL_ROUTE_ADD && ops[op].op != CTL_ROUTE_DEL) || ops[op].vrf != vrf) continue;
+            if (!batch) first = op;
+            route_change *change = &changes[batch++];
+            change->route.prefix = ops[op].address;
+            change->route.mask = htonl((uint32_t)(~0ull << (32 - ops[op].length)));
+            change->route.next_hop = ops[op].next_hop;
+            change->route.interface = ops[op].interface;
+            change->withdraw = ops[op].op == CTL_ROUTE_DEL;
+        }
+        if (!batch) continue;
+
+        copied[vrf] = ctrl->vrfs ? Prepare_VRF_Routes(ctrl->vrfs, vrf, changes, batch, &copies[vrf]) :
+                                   Prepare_IPV4_Routes(ctrl->ipv4s, ctrl->ipv4s->pool, changes, batch, &copies[vrf]);
+        if (!copied[vrf]) {
+            status = CTL_ENOMEM;
+            *index = first;
+        }
+    }
+
+    // The slots of the neighbors replaced or removed are released after a grace period.
+    bool removed = false;
+    if (status == CTL_OK && num_entries && !Set_ARP_Entries(ctrl->macs, entries, num_entries, &removed)) {
+        status = CTL_EFULL;
+        *index = first_entry;
+    }
+
+    for (int vrf = 0; vrf < MAX_VRFS; vrf++) {
+        if (!copied[vrf]) continue;
+        ipv4_table *table = ctrl->vrfs ? ctrl->vrfs->tables[vrf] : ctrl->ipv4s;
+        if (status == CTL_OK) Publish_IPV4_Routes(table, &copies[vrf]);
+        else Drop_IPV4_Routes(table, &copies[vrf]);
+    }
+
+    for (uint32_t neighbor = 0; status == CTL_OK && neighbor < kept; neighbor++) {
+        const ctl_op *op = &ops[neighbors[neighbor].index];
+        if (op->op == CTL_NEIGH_DEL) removed |= Remove_ARP_Entry(ctrl->macs, op->address);
+    }
+
+    // Every change applied is seen by the workers' next vectors, not by their flow caches.
+    if (status == CTL_OK) Bump_Generation(ctrl);
+    if (removed) {
+        Sync_FIB(ctrl);
+        Release_ARP_Entries(ctrl->macs);
+    }
+    // The copies of a failed transaction are garbage too.
+    Compact_FIB(ctrl);
+    ctrl->transactions++;
+    pthread_mutex_unlock(&ctrl->fib_lock);
+
+    free(changes);
+    free(neighbors);
+    free(entries);
+    return status == CTL_OK ? (int)count : status;
+}
+
+/* -------------------------------------------------- COMMIT CHANGES -------------------------------------------------- */
+/* ------------------------------------------------------ DUMPS ------------------------------------------------------- */
+
+/**
+ * @brief The routes of a VRF as route additions, one per path.
+ *
+ * @param ctrl    The shared control state.
+ * @param vrf     The VRF.
+ * @param records Receives the routes (to be freed by the caller).
+ * @param count   Receives the number of routes.
+ * @return CTL_OK, CTL_ENOFIB without such a table or CTL_ENOMEM.
+ */
+static int Dump_FIB(control *ctrl, uint32_t vrf, ctl_op **records, uint32_t *count) {
+    *records = NULL;
+    *count = 0;
+
+    pthread_mutex_lock(&ctrl->fib_lock);
+    const ipv4_table *table = NULL;
+    if (ctrl->vrfs) {
+        if (vrf < (uint32_t)ctrl->vrfs->count) table = ctrl->vrfs->tables[vrf];
+    } else if (!vrf) {
+        table = ctrl->ipv4s;
+    }
+    int num_routes = 0;
+    route *routes = table ? List_IPV4_Routes(table, &num_routes) : NULL;
+    pthread_mutex_unlock(&ctrl->fib_lock);
+
+    if (!table) return CTL_ENOFIB;
+    if (!routes) return CTL_ENOMEM;
+    *records = (ctl_op*)calloc(num_routes ? num_routes : 1, sizeof(ctl_op));
+    if (!*records) {
+        free(routes);
+        return CTL_ENOMEM;
+    }
+    for (int path = 0; path < num_routes; path++) {
+        ctl_op *record = &(*records)[path];
+        record->op = CTL_ROUTE_ADD;
+        record->vrf = (uint8_t)vrf;
+        record->length = (uint8_t)__builtin_popcount(routes[path].mask);
+        record->interface = (int8_t)routes[path].interface;
+        record->address = routes[path].prefix;
+        record->next_hop = routes[path].next_hop;
+    }
+    *count = (uint32_t)num_routes;
+    free(routes);
+    return CTL_OK;
+}
+
+/**
+ * @brief The counters of the router summed over its workers, and those of its FIB.
+ *
+ * @param ctrl    The shared control state.
+ * @param records Receives the counters (to be freed by the caller).
+ * @param count   Receives the number of counters.
+ * @return CTL_OK or CTL_ENOMEM.
+ */
+static int Dump_Counters(control *ctrl, ctl_counter **records, uint32_t *count) {
+    const router_stats *stats = ctrl->stats;
+    size_t most = ROUTER_NUM_INTERFACES * 4 + DROP_REASONS + STATS_EVENTS + MAX_VRFS * 3 + 2;
+    ctl_counter *counters = (ctl_counter*)calloc(most, sizeof(ctl_counter));
+    *records = counters;
+    *count = 0;
+    if (!counters) return CTL_ENOMEM;
+
+    uint32_t next = 0;
+    for (uint32_t interface = 0; stats && interface < stats->interfaces; interface++) {
+        uint64_t link[4] = {0};
+        for (uint32_t worker = 0; worker < stats->workers; worker++) {
+            const stats_link *traffic = &stats->worker[worker].links[interface];
+            link[CTL_LINK_RX_PACKETS] += COUNTER_GET(traffic->rx_packets);
+            link[CTL_LINK_RX_BYTES] += COUNTER_GET(traffic->rx_bytes);
+            link[CTL_LINK_TX_PACKETS] += COUNTER_GET(traffic->tx_packets);
+            link[CTL_LINK_TX_BYTES] += COUNTER_GET(traffic->tx_bytes);
+        }
+        for (int kind = 0; kind < 4; kind++) {
+            counters[next++] = (ctl_counter){CTL_STAT_LINK, (uint16_t)kind, (int32_t)interface, link[kind]};
+        }
+    }
+    for (int reason = 0; stats && reason < DROP_REASONS; reason++) {
+        uint64_t drops = 0;
+        for (uint32_t worker = 0; worker < stats->workers; worker++) drops += COUNTER_GET(stats->worker[worker].drops[reason]);
+        counters[next++] = (ctl_counter){CTL_STAT_DROP, (uint16_t)reason, -1, drops};
+    }
+    for (int event = 0; stats && event < STATS_EVENTS; event++) {
+        uint64_t events = 0;
+        for (uint32_t worker = 0; worker < stats->workers; worker++) events += COUNTER_GET(stats->worker[worker].events[event]);
+        counters[next++] = (ctl_counter){CTL_STAT_EVENT, (uint16_t)event, -1, events};
+    }
+
+    pthread_mutex_lock(&ctrl->fib_lock);
+    int vrfs = ctrl->vrfs ? ctrl->vrfs->count : (ctrl->ipv4s != NULL);
+    for (int vrf = 0; vrf < vrfs; vrf++) {
+        const ipv4_table *table = ctrl->vrfs ? ctrl->vrfs->tables[vrf] : ctrl->ipv4s;
+        counters[next++] = (ctl_counter){CTL_STAT_FIB, CTL_FIB_ROUTES, vrf, table->size};
+        counters[next++] = (ctl_counter){CTL_STAT_FIB, CTL_FIB_NODES, vrf, table->nodes};
+        counters[next++] = (ctl_counter){CTL_STAT_FIB, CTL_FIB_GARBAGE, vrf, table->garbage};
+    }
+    counters[next++] = (ctl_counter){CTL_STAT_FIB, CTL_FIB_GENERATION, -1,
+                                     atomic_load_explicit(&ctrl->generation, memory_order_relaxed)};
+    counters[next++] = (ctl_counter){CTL_STAT_FIB, CTL_FIB_TRANSACTIONS, -1, ctrl->transactions};
+    pthread_mutex_unlock(&ctrl->fib_lock);
+
+    *count = next;
+    return CTL_OK;
+}
+
+/* ------------------------------------------------------ DUMPS ------------------------------------------------------- */
+/* ----------------------------------------------------- REQUESTS ----------------------------------------------------- */
+
+/**
+ * @brief Send a whole buffer on a blocking socket, without SIGPIPE if the client is gone.
+ *
+ * @return False if the client is gone or did not read for CTL_SEND_TIMEOUT seconds.
+ */
+static bool Send_All(int fd, const void *data, size_t len) {
+    const char *bytes = (const char*)data;
+    while (len) {
+        ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        bytes += sent;
+        len -= (size_t)sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Answer a request, followed by its records.
+ *
+ * A client that cannot be answered is closed once the requests received are handled.
+ */
+static void Reply(ctl_server *server, int client, uint8_t type, int status, uint32_t count, uint32_t index,
+                  const void *records, size_t size) {
+    ctl_client *peer = &server->clients[client];
+    if (peer->closed) return;
+
+    ctl_reply reply = {.magic = CTL_MAGIC, .version = CTL_VERSION, .type = type, .status = status,
+                       .count = count, .index = index};
+    if (!Send_All(peer->fd, &reply, sizeof(reply)) || (size && !Send_All(peer->fd, records, size))) {
+        peer->closed = true;
+    }
+}
+
+/**
+ * @brief Commit the requests merged so far as one transaction, then answer them.
+ *
+ * An error is reported to every request of the transaction, its index to the request it is about
+ * (the others get their count as index).
+ */
+static void Flush_Batch(ctl_server *server) {
+    if (!server->pendings) return;
+
+    uint32_t index = 0;
+    int status = Commit_Control_Ops(server->ctrl, server->batch, server->batched, &index);
+    for (int request = 0; request < server->pendings; request++) {
+        const ctl_pending *pending = &server->pending[request];
+        if (status >= 0) {
+            Reply(server, pending->client, CTL_APPLY, CTL_OK, pending->count, 0, NULL, 0);
+            continue;
+        }
+        bool mine = index >= pending->start && index - pending->start < pending->count;
+        Reply(server, pending->client, CTL_APPLY, status, 0, mine ? index - pending->start : pending->count, NULL, 0);
+    }
+    server->pendings = 0;
+    server->batched = 0;
+}
+
+/**
+ * @brief Merge a request's changes into the next transaction, or reject it whole.
+ *
+ * @param server The control server.
+ * @param client The client that sent it.
+ * @param body   Its changes.
+ * @param count  The number of changes.
+ */
+static void Apply_Request(ctl_server *server, int client, const char *body, uint32_t count) {
+    if (server->pendings == CTL_MAX_PENDING || server->batched + count > CTL_MAX_OPS) Flush_Batch(server);
+
+    ctl_op *ops = server->batch + server->batched;
+    memcpy(ops, body, count * sizeof(ctl_op));
+    uint32_t index = 0;
+    int status = Check_Control_Ops(server->ctrl, ops, count, &index);
+    if (status != CTL_OK) {
+        // The requests before it are answered first.
+        Flush_Batch(server);
+        Reply(server, client, CTL_APPLY, status, 0, index, NULL, 0);
+        return;
+    }
+    server->pending[server->pendings++] = (ctl_pending){.client = client, .start = server->batched, .count = count};
+    server->batched += count;
+}
+
+/**
+ * @brief Answer a dump, after committing the changes requested before it.
+ */
+static void Dump_Request(ctl_server *server, int client, const ctl_header *header) {
+    Flush_Batch(server);
+
+    void *records = NULL;
+    uint32_t count = 0;
+    size_t size = 0;
+    int status;
+    if (header->type == CTL_DUMP_FIB) {
+        status = Dump_FIB(server->ctrl, header->count, (ctl_op**)&records, &count);
+        size = count * sizeof(ctl_op);
+    } else {
+        status = Dump_Counters(server->ctrl, (ctl_counter**)&records, &count);
+        size = count * sizeof(ctl_counter);
+    }
+    Reply(server, client, header->type, status, status == CTL_OK ? count : 0, 0, records, status == CTL_OK ? size : 0);
+    free(records);
+}
+
+/**
+ * @brief Handle the whole requests a client sent, keeping the bytes of the next one.
+ *
+ * @param server The control server.
+ * @param client The client.
+ */
+static void Serve_Client(ctl_server *server, int client) {
+    ctl_client *peer = &server->clients[client];
+    size_t offset = 0;
+
+    while (!peer->closed && peer->len - offset >= sizeof(ctl_header)) {
+        ctl_header header;
+        memcpy(&header, peer->buf + offset, sizeof(header));
+        if (header.magic != CTL_MAGIC || header.version != CTL_VERSION || header.type < CTL_APPLY ||
+            header.type > CTL_DUMP_STATS || (header.type == CTL_APPLY && header.count > CTL_MAX_OPS)) {
+            // The stream cannot be followed past a bad header.
+            Flush_Batch(server);
+            Reply(server, client, header.type, CTL_EREQUEST, 0, 0, NULL, 0);
+            peer->closed = true;
+            break;
+        }
+
+        size_t size = sizeof(header) + (header.type == CTL_APPLY ? header.count * sizeof(ctl_op) : 0);
+        if (peer->len - offset < size) break;
+        const char *body = peer->buf + offset + sizeof(header);
+        offset += size;
+
+        if (header.type == CTL_APPLY) {
+            Apply_Request(server, client, body, header.count);
+        } else {
+            Dump_Request(server, client, &header);
+        }
+    }
+
+    memmove(peer->buf, peer->buf + offset, peer->len - offset);
+    peer->len -= offset;
+}
+
+/* ----------------------------------------------------- REQUESTS ----------------------------------------------------- */
+/* ------------------------------------------------------ SERVER ------------------------------------------------------ */
+
+/**
+ * @brief Read what a client sent without blocking, up to twice the largest request.
+ *
+ * @return False if the client hung up or its buffer cannot grow.
+ */
+static bool Receive_Client(ctl_client *peer) {
+    while (peer->len < 2 * CTL_MAX_REQUEST) {
+        if (peer->len == peer->capacity) {
+            size_t capacity = peer->capacity ? 2 * peer->capacity : 65536;
+            char *grown = (char*)realloc(peer->buf, capacity);
+            if (!grown) return false;
+            peer->buf = grown;
+            peer->capacity = capacity;
+        }
+
+        ssize_t got = recv(peer->fd, peer->buf + peer->len, peer->capacity - peer->len, MSG_DONTWAIT);
+        if (got > 0) {
+            peer->len += (size_t)got;
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    // The rest waits until these requests are handled.
+    return true;
+}
+
+static void Close_Client(ctl_client *peer) {
+    close(peer->fd);
+    free(peer->buf);
+    *peer = (ctl_client){.fd = -1};
+}
+
+/**
+ * @brief Accept a connection into a free slot, its replies bounded by CTL_SEND_TIMEOUT.
+ */
+static void Accept_Client(ctl_server *server) {
+    int fd = accept4(server->fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    struct timeval timeout = {.tv_sec = CTL_SEND_TIMEOUT, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    for (int client = 0; client < CTL_MAX_CLIENTS; client++) {
+        if (server->clients[client].fd >= 0) continue;
+        server->clients[client] = (ctl_client){.fd = fd};
+        return;
+    }
+    close(fd);
+}
+
+/**
+ * @brief Serve the control socket forever.
+ *
+ * Every round reads what the clients sent, handles their whole requests, merging the changes of
+ * all of them into one transaction, and answers them once it is committed. The connections are
+ * accepted while there is a free slot, the others wait.
+ *
+ * @param arg The control server.
+ * @return Never returns.
+ */
+static void* Serve_Control(void *arg) {
+    ctl_server *server = (ctl_server*)arg;
+    struct pollfd fds[CTL_MAX_CLIENTS + 1];
+    int slots[CTL_MAX_CLIENTS + 1];
+
+    while (true) {
+        int polled = 0, served = 0;
+        for (int client = 0; client < CTL_MAX_CLIENTS; client++) {
+            if (server->clients[client].fd < 0) continue;
+            slots[polled] = client;
+            fds[polled++] = (struct pollfd){.fd = server->clients[client].fd, .events = POLLIN};
+            served++;
+        }
+        if (served < CTL_MAX_CLIENTS) {
+            slots[polled] = -1;
+            fds[polled++] = (struct pollfd){.fd = server->fd, .events = POLLIN};
+        }
+        if (poll(fds, (nfds_t)polled, -1) < 0) continue;
+
+        bool hangup[CTL_MAX_CLIENTS] = {false};
+        for (int fd = 0; fd < polled; fd++) {
+            if (slots[fd] < 0 || !fds[fd].revents) continue;
+            hangup[slots[fd]] = !Receive_Client(&server->clients[slots[fd]]);
+        }
+        for (int client = 0; client < CTL_MAX_CLIENTS; client++) {
+            if (server->clients[client].fd >= 0) Serve_Client(server, client);
+        }
+        Flush_Batch(server);
+
+        for (int client = 0; client < CTL_MAX_CLIENTS; client++) {
+            ctl_client *peer = &server->clients[client];
+            if (peer->fd >= 0 && (hangup[client] || peer->closed)) Close_Client(peer);
+        }
+        if (slots[polled - 1] < 0 && (fds[polled - 1].revents & POLLIN)) Accept_Client(server);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create the listening socket at a path.
+ *
+ * A socket left at the path by a router that was killed outright (nobody answers on it) is
+ * replaced; one another router serves, or a file that is not a socket, is not.
+ *
+ * @return The socket, or -1 (with errno).
+ */
+static int Listen_Control(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    struct stat status;
+    if (!stat(path, &status) && S_ISSOCK(status.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool stale = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno == ECONNREFUSED;
+        if (probe >= 0) close(probe);
+        if (stale) unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, CTL_MAX_CLIENTS) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Listen on a Unix-domain socket and serve it from a thread of its own.
+ *
+ * The thread inherits the caller's signal mask: it is created once the signals are blocked.
+ *
+ * @param ctrl The shared control state.
+ * @param path The path of the socket.
+ * @return The server, or NULL (with errno) if the socket cannot be created or the thread started.
+ */
+ctl_server* Create_Control_Server(control *ctrl, const char *path) {
+    ctl_server *server = (ctl_server*)calloc(1, sizeof(ctl_server));
+    if (!server) return NULL;
+    server->ctrl = ctrl;
+    snprintf(server->path, sizeof(server->path), "%s", path);
+    for (int client = 0; client < CTL_MAX_CLIENTS; client++) server->clients[client].fd = -1;
+
+    server->batch = (ctl_op*)malloc(CTL_MAX_OPS * sizeof(ctl_op));
+    server->fd = server->batch ? Listen_Control(path) : -1;
+    if (server->fd < 0) {
+        free(server->batch);
+        free(server);
+        return NULL;
+    }
+
+    int error = pthread_create(&server->thread, NULL, Serve_Control, server);
+    if (error) {
+        unlink(path);
+        close(server->fd);
+        free(server->batch);
+        free(server);
+        errno = error;
+        return NULL;
+    }
+    pthread_detach(server->thread);
+    return server;
+}
+
+/**
+ * @brief Remove the path of the control socket, the thread serves the connections until exit.
+ *
+ * @param server The control server.
+ */
+void Unlink_Control_Server(const ctl_server *server) {
+    if (server) unlink(server->path);
+}
+
+/* ------------------------------------------------------ SERVER ------------------------------------------------------ */
@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef CTL_SERVER_H_
+#define CTL_SERVER_H_
+
+#include "../../include/router.h"
+#include "./ctl_proto.h"
+
+#define CTL_MAX_PENDING 64                                  // Requests merged into one transaction at most.
+#define CTL_MAX_REQUEST (sizeof(ctl_header) + CTL_MAX_OPS * sizeof(ctl_op))
+
+// A connection to the control socket and the bytes it sent that are not a whole request yet.
+typedef struct ctl_client {
+    int fd;                         // Connected socket, -1 for a free slot.
+    char *buf;                      // Received bytes, from the start of a request.
+    size_t len;                     // Bytes in the buffer.
+    size_t capacity;                // Bytes allocated, at most twice the largest request.
+    bool closed;                    // A reply could not be sent or the stream cannot be followed.
+} ctl_client;
+
+// A request merged into the next transaction, answered once it is committed.
+typedef struct ctl_pending {
+    int client;                     // Client that sent it.
+    uint32_t start;                 // Its first change in the batch.
+    uint32_t count;                 // Its changes.
+} ctl_pending;
+
+// Unix-domain control socket, served by a thread of its own off the forwarding path.
+typedef struct ctl_server {
+    control *ctrl;                  // Shared control state the transactions change.
+    int fd;                         // Listening socket.
+    char path[108];                 // Path of the socket, removed at exit.
+    ctl_client clients[CTL_MAX_CLIENTS];
+    ctl_op *batch;                  // Changes of the requests merged into the next transaction, CTL_MAX_OPS.
+    uint32_t batched;               // Changes in the batch.
+    ctl_pending pending[CTL_MAX_PENDING];
+    int pendings;                   // Requests in the batch.
+    pthread_t thread;               // Server thread.
+} ctl_server;
+
+/** @brief Check the changes of a request against the tables of the router, before any is applied. */
+int             Check_Control_Ops       (const control *ctrl, const ctl_op *ops, uint32_t count, uint32_t *index);
+/** @brief Apply checked changes as one transaction and publish them to the workers. */
+int             Commit_Control_Ops      (control *ctrl, const ctl_op *ops, uint32_t count, uint32_t *index);
+
+/** @brief Listen on a Unix-domain socket and serve it from a thread of its own. */
+ctl_server*     Create_Control_Server   (control *ctrl, const char *path);
+/** @brief Remove the path of the control socket, the thread serves until exit. */
+void            Unlink_Control_Server   (const ctl_server *server);
+
+#endif /* CTL_SERVER_H_ */
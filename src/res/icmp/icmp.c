@@ -8,38 +8,43 @@
  * Set the ICMP header fields in the packet buffer of the rout.
  * 
  * It calculates pointers to the ICMP header and updates the total length of the packet.
- * If the ICMP message type is ICMP_TIME_EXCED / ICMP_DEST_UNREACH, it copies the IP header (20 bytes),
- * the next 8 bytes to the packet buffer to include them in the ICMP message.
+ * The offending packet's IP header (options included) and the next 8 bytes follow the ICMP header,
+ * as far as the frame holds them; they are moved before the new headers overwrite them.
  * 
  * @param rout Pointer to the rout data structure.
  * @param type ICMP message type (e.g., ICMP_TIME_EXCED or ICMP_DEST_UNREACH).
  */
 static void Init_ICMP_Header(routing *rout, uint8_t type) {
+    size_t quote = rout->ip_hdr->ihl * 4u + 8;
+    size_t available = rout->len - sizeof *rout->eth_hdr;
+    if (quote > available) quote = available;
+
     // Calculate pointers to the ICMP header and the total length.
     rout->icmp_hdr = (struct icmphdr *)(rout->buf + sizeof *rout->eth_hdr + sizeof *rout->ip_hdr);
     rout->len = sizeof *rout->eth_hdr + sizeof *rout->ip_hdr + sizeof *rout->icmp_hdr;
 
-    // Copy the IP header (20 bytes) and the next 8 bytes if required.
-    if (type == ICMP_TIME_EXCED || type == ICMP_DEST_UNREACH) {
-        memcpy(rout->buf + rout->len, rout->ip_hdr, 28);
-        rout->len += 28;
-    }
+    // Quote the offending packet, the regions overlap when it has IP options.
+    memmove(rout->buf + rout->len, rout->ip_hdr, quote);
+    rout->len += quote;
 
-    // Set ICMP code and type.
+    // Set ICMP code and type, the rest of the header is unused.
     rout->icmp_hdr->code = 0;
     rout->icmp_hdr->type = type;
+    rout->icmp_hdr->un.gateway = 0;
 }
 
 /**
  * @brief Update the ICMP checksum in the rout's packet buffer.
  * 
- * Calculate and update the ICMP checksum in the rout's packet buffer for the ICMP header.
+ * Calculate and update the ICMP checksum in the rout's packet buffer, over the whole message
+ * (header and quoted packet).
  * 
  * @param rout Pointer to the rout data structure.
  */
 static void Checksum_ICMP(routing *rout) {
+    size_t len = rout->len - sizeof *rout->eth_hdr - sizeof *rout->ip_hdr;
     rout->icmp_hdr->checksum = 0;
-    rout->icmp_hdr->checksum = htons(Checksum((uint16_t *)rout->icmp_hdr, sizeof *rout->icmp_hdr));
+    rout->icmp_hdr->checksum = Checksum_Fast(rout->icmp_hdr, len);
 }
 
 /**
@@ -49,10 +54,9 @@ static void Checksum_ICMP(routing *rout) {
  * It is used when creating ICMP replies or error messages (wrapper function)
  * 
  * @param rout Pointer to the rout data structure.
- * @param type   ICMP message type (e.g., ICMP_TIME_EXCED / ICMP_DEST_UNREACH).
  */
-static void Header_NewIP(routing *rout, uint8_t type) { 
-    Header_IPV4(rout, type);
+static void Header_NewIP(routing *rout) { 
+    Header_IPV4(rout);
 }
 
 /**
@@ -69,17 +73,105 @@ static void Header_NewETH(routing *rout) {
 }
 
 /**
- * @brief Generate an ICMP reply message in the rout's packet buffer.
+ * @brief Generate an ICMP error message in the rout's packet buffer.
  * 
- * @param rout Pointer to the rout data structure.
+ * @param rout Pointer to the rout data structure, the interface being the one the packet came in on.
  * @param type ICMP message type (e.g., ICMP_TIME_EXCED / ICMP_DEST_UNREACH).
  */
 void Reply_ICMP(routing *rout, uint8_t type) {
+    if (type == ICMP_TIME_EXCED) STATS_EVENT(ICMP_TIME_EXCEEDED, 1);
+    else if (type == ICMP_DEST_UNREACH) STATS_EVENT(ICMP_UNREACHABLE, 1);
+
     Init_ICMP_Header(rout, type);
     Checksum_ICMP(rout);
     /* ---------------------- */
-    Header_NewIP(rout, type);
+    Header_NewIP(rout);
+    Header_NewETH(rout);
+}
+
+/**
+ * @brief Generate an ICMP Fragmentation Needed message in the rout's packet buffer.
+ *
+ * The Destination Unreachable message carries the MTU the packet was over, for the sender to
+ * send smaller packets (path MTU discovery, RFC 1191).
+ *
+ * @param rout Pointer to the rout data structure, the interface being the one the packet came in on.
+ * @param mtu  MTU of the interface the packet was to leave on.
+ */
+void Reply_ICMP_MTU(routing *rout, uint16_t mtu) {
+    STATS_EVENT(ICMP_TOO_BIG, 1);
+
+    Init_ICMP_Header(rout, ICMP_DEST_UNREACH);
+    rout->icmp_hdr->code = ICMP_FRAG_NEEDED;
+    rout->icmp_hdr->un.frag.mtu = htons(mtu);
+    Checksum_ICMP(rout);
+    /* ---------------------- */
+    Header_NewIP(rout);
     Header_NewETH(rout);
 }
 
 /* ----------------------------------------------------- ICMP REPLY ----------------------------------------------------- */
+/* ----------------------------------------------------- ICMP ECHO ------------------------------------------------------ */
+
+/**
+ * @brief Check that a frame is a complete, unfragmented ICMP echo request.
+ * 
+ * The IPv4 header is expected to be valid (version, checksum).
+ * 
+ * @param frame The Ethernet frame.
+ * @param len   Its length.
+ * @return      True if Echo_ICMP can answer it.
+ */
+bool Is_Echo_Request(const char *frame, size_t len) {
+    const struct iphdr *ip_hdr = (const struct iphdr *)(frame + sizeof(struct ethhdr));
+    size_t ihl = ip_hdr->ihl * 4u;
+
+    if (ip_hdr->protocol != IPPROTO_ICMP || ihl < sizeof(struct iphdr)) return false;
+    if (len < sizeof(struct ethhdr) + ihl + sizeof(struct icmphdr)) return false;
+    // Only the first fragment holds the ICMP header, and the reply would be partial.
+    if (ntohs(ip_hdr->frag_off) & (IPV4_MF | IPV4_OFFSET)) return false;
+
+    const struct icmphdr *icmp_hdr = (const struct icmphdr *)(frame + sizeof(struct ethhdr) + ihl);
+    return icmp_hdr->type == ICMP_ECHO_REQUEST && icmp_hdr->code == 0;
+}
+
+/**
+ * @brief Turn an echo request into its reply, in place.
+ * 
+ * The payload is left untouched: only the addresses and MACs are swapped, the type flipped
+ * and the TTL reset, and both checksums are patched for those words (RFC 1624) instead of
+ * being summed again, so the cost does not grow with the payload.
+ * 
+ * @param frame     An echo request (see Is_Echo_Request).
+ * @param interface The interface it came in on, and the reply leaves by.
+ */
+void Echo_ICMP(char *frame, int interface) {
+    struct ethhdr *eth_hdr = (struct ethhdr *)frame;
+    struct iphdr *ip_hdr = (struct iphdr *)(frame + sizeof(struct ethhdr));
+    struct icmphdr *icmp_hdr = (struct icmphdr *)(frame + sizeof(struct ethhdr) + ip_hdr->ihl * 4u);
+    uint16_t old_word, new_word;
+
+    // Type and code share a word, echo request -> echo reply.
+    memcpy(&old_word, &icmp_hdr->type, sizeof(old_word));
+    icmp_hdr->type = ICMP_RESPONE;
+    memcpy(&new_word, &icmp_hdr->type, sizeof(new_word));
+    icmp_hdr->checksum = Checksum_Adjust(icmp_hdr->checksum, old_word, new_word);
+
+    // Swapping the addresses leaves the header sum unchanged, the TTL does not.
+    uint32_t saddr = ip_hdr->saddr;
+    ip_hdr->saddr = ip_hdr->daddr;
+    ip_hdr->daddr = saddr;
+
+    memcpy(&old_word, &ip_hdr->ttl, sizeof(old_word));
+    ip_hdr->ttl = DEFAULT_TTL;
+    memcpy(&new_word, &ip_hdr->ttl, sizeof(new_word));
+    ip_hdr->check = Checksum_Adjust(ip_hdr->check, old_word, new_word);
+
+    // Back to the sender's MAC, from the interface's.
+    memcpy(eth_hdr->ether_dhost, eth_hdr->ether_shost, MAC_SIZE);
+    Get_MAC_Interface(interface, eth_hdr->ether_shost);
+
+    STATS_EVENT(ICMP_ECHO_REPLIES, 1);
+}
+
+/* ----------------------------------------------------- ICMP ECHO ------------------------------------------------------ */
@@ -5,7 +5,13 @@
 
 #include "../../include/router.h"
 
-/** @brief  Generate an ICMP reply message in the rout's packet buffer. */
+/** @brief  Generate an ICMP error message in the rout's packet buffer. */
 extern void        Reply_ICMP        (routing *rout, uint8_t type);
+/** @brief  Generate an ICMP Fragmentation Needed message in the rout's packet buffer. */
+extern void        Reply_ICMP_MTU    (routing *rout, uint16_t mtu);
+/** @brief  Check that a frame is a complete, unfragmented ICMP echo request. */
+extern bool        Is_Echo_Request   (const char *frame, size_t len);
+/** @brief  Turn an echo request into its reply, in place. */
+extern void        Echo_ICMP         (char *frame, int interface);
 
 #endif /* ICMP_H_ */
\ No newline at end of file
@@ -0,0 +1,541 @@
+#include "./aggregate.h"
+
+#include <arpa/inet.h>
+#include <time.h>
+
+#define ORTC_SLOTS 1024
+#define ORTC_FAILED UINT32_MAX
+
+// What a prefix does with its packets: its paths, in the order the table gave them.
+typedef struct ortc_action {
+    nh_member paths[NH_GROUP_SIZE];
+    uint32_t size;              // Paths in use, 0 for no route.
+} ortc_action;
+
+// A prefix and its action, sorted by length, then network, then position in the table.
+typedef struct ortc_line {
+    uint32_t network;           // Network, in host order.
+    uint32_t length;            // Prefix length.
+    int index;                  // Position of the line in the table.
+    uint32_t action;            // Action of an aggregated prefix.
+} ortc_line;
+
+// Node of the binary trie the passes walk.
+typedef struct ortc_node {
+    uint32_t child[2];          // Indexes of the children, 0 for none (the root is nobody's child).
+    uint32_t action;            // Action of the prefix, of the leaf's addresses once pushed down.
+    uint32_t set_size;          // Actions in the node's set.
+    size_t set;                 // Offset of the node's set of actions in the pool, sorted.
+} ortc_node;
+
+// State of one aggregation.
+typedef struct ortc {
+    ortc_action *actions;       // Distinct actions, 0 is no route.
+    uint32_t num_actions, max_actions;
+    uint32_t *slots;            // Open addressing index of the actions, 0 for an empty slot.
+    uint32_t slot_mask;         // Slots - 1.
+    ortc_node *nodes;           // Trie nodes, the root first.
+    size_t num_nodes, max_nodes;
+    uint32_t *sets;             // Sets of actions of the nodes.
+    size_t set_used, set_room;
+    ortc_line *chosen;          // Aggregated prefixes.
+    int num_chosen, max_chosen;
+    size_t num_paths;           // Lines of the aggregated prefixes.
+} ortc;
+
+/* ---------------------------------------------------- ORTC ACTIONS --------------------------------------------------- */
+
+static uint64_t Hash_Action(const ortc_action *action) {
+    uint64_t hash = action->size;
+    for (uint32_t path = 0; path < action->size; path++) {
+        hash = (hash ^ ((uint64_t)action->paths[path].next_hop << 32 | (uint32_t)action->paths[path].interface)) *
+               0x9e3779b97f4a7c15ull;
+    }
+    // MurmurHash3's finalizer, so the low bits the index keeps depend on every path.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static bool Same_Action(const ortc_action *left, const ortc_action *right) {
+    return left->size == right->size && !memcmp(left->paths, right->paths, left->size * sizeof(nh_member));
+}
+
+/**
+ * @brief Number an action, the same number for the same paths in the same order.
+ *
+ * @param agg    The aggregation.
+ * @param action The action, with at least one path.
+ * @return The number of the action, or ORTC_FAILED if memory allocation fails.
+ */
+static uint32_t Intern_Action(ortc *agg, const ortc_action *action) {
+    // Keep the index at most half full.
+    if (2 * agg->num_actions > agg->slot_mask) {
+        uint32_t mask = 2 * agg->slot_mask + 1;
+        uint32_t *slots = (uint32_t*)calloc((size_t)mask + 1, sizeof(uint32_t));
+        if (!slots) return ORTC_FAILED;
+        for (uint32_t id = 1; id < agg->num_actions; id++) {
+            uint32_t slot = (uint32_t)Hash_Action(&agg->actions[id]) & mask;
+            while (slots[slot]) slot = (slot + 1) & mask;
+            slots[slot] = id;
+        }
+        free(agg->slots);
+        agg->slots = slots;
+        agg->slot_mask = mask;
+    }
+
+    uint32_t slot = (uint32_t)Hash_Action(action) & agg->slot_mask;
+    for (; agg->slots[slot]; slot = (slot + 1) & agg->slot_mask) {
+        if (Same_Action(&agg->actions[agg->slots[slot]], action)) return agg->slots[slot];
+    }
+
+    if (agg->num_actions == agg->max_actions) {
+        ortc_action *grown = (ortc_action*)realloc(agg->actions, 2 * agg->max_actions * sizeof(ortc_action));
+        if (!grown) return ORTC_FAILED;
+        agg->actions = grown;
+        agg->max_actions *= 2;
+    }
+    agg->actions[agg->num_actions] = *action;
+    return agg->slots[slot] = agg->num_actions++;
+}
+
+/* ---------------------------------------------------- ORTC ACTIONS --------------------------------------------------- */
+/* ----------------------------------------------------- ORTC TRIE ----------------------------------------------------- */
+
+/**
+ * @brief Take a new node, with no children, no action and no set.
+ *
+ * @return The index of the node, or 0 if memory allocation fails.
+ */
+static uint32_t New_Node(ortc *agg) {
+    if (agg->num_nodes == agg->max_nodes) {
+        if (agg->max_nodes >= UINT32_MAX / 2) return 0;
+        ortc_node *grown = (ortc_node*)realloc(agg->nodes, 2 * agg->max_nodes * sizeof(ortc_node));
+        if (!grown) return 0;
+        agg->nodes = grown;
+        agg->max_nodes *= 2;
+    }
+    memset(&agg->nodes[agg->num_nodes], 0, sizeof(ortc_node));
+    return (uint32_t)agg->num_nodes++;
+}
+
+/**
+ * @brief Give a prefix its action, creating the nodes on the way.
+ *
+ * @return False if memory allocation fails.
+ */
+static bool Insert_Node(ortc *agg, uint32_t network, uint32_t length, uint32_t action) {
+    uint32_t node = 0;
+    for (uint32_t depth = 0; depth < length; depth++, network <<= 1) {
+        int side = (network & IPV4_TOP_BIT) ? 1 : 0;
+        if (!agg->nodes[node].child[side]) {
+            uint32_t child = New_Node(agg);
+            if (!child) return false;
+            agg->nodes[node].child[side] = child;
+        }
+        node = agg->nodes[node].child[side];
+    }
+    agg->nodes[node].action = action;
+    return true;
+}
+
+static int Compare_Lines(const void *left, const void *right) {
+    const ortc_line *a = (const ortc_line *)left, *b = (const ortc_line *)right;
+    if (a->length != b->length) return a->length < b->length ? -1 : 1;
+    if (a->network != b->network) return a->network < b->network ? -1 : 1;
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+/**
+ * @brief Give every prefix of a table the action the table loads for it.
+ *
+ * The lines of a prefix are taken in the table's order, as Insert_IPV4_Table takes them: a
+ * line writing the prefix as the previous one did adds a path (up to NH_GROUP_SIZE), another
+ * way of writing it replaces the route. The /0 routes are left out, the trie has none.
+ *
+ * @return False if memory allocation fails.
+ */
+static bool Resolve_Routes(ortc *agg, const route *routes, int count) {
+    ortc_line *lines = (ortc_line*)malloc((count ? count : 1) * sizeof(ortc_line));
+    if (!lines) return false;
+
+    int num_lines = 0;
+    for (int idx = 0; idx < count; idx++) {
+        if (!routes[idx].mask) continue;
+        lines[num_lines].network = ntohl(routes[idx].prefix & routes[idx].mask);
+        lines[num_lines].length = (uint32_t)__builtin_popcount(routes[idx].mask);
+        lines[num_lines++].index = idx;
+    }
+    qsort(lines, num_lines, sizeof(ortc_line), Compare_Lines);
+
+    bool ok = true;
+    for (int first = 0, last; ok && first < num_lines; first = last) {
+        ortc_action action = { .size = 0 };
+        uint32_t written = 0;
+
+        for (last = first; last < num_lines && lines[last].length == lines[first].length &&
+                           lines[last].network == lines[first].network; last++) {
+            const route *line = &routes[lines[last].index];
+            nh_member path = { .next_hop = line->next_hop, .interface = line->interface };
+
+            if (!action.size || written != line->prefix) {
+                action.paths[0] = path;
+                action.size = 1;
+                written = line->prefix;
+                continue;
+            }
+            bool known = false;
+            for (uint32_t member = 0; member < action.size; member++) {
+                known |= action.paths[member].next_hop == path.next_hop && action.paths[member].interface == path.interface;
+            }
+            if (!known && action.size < NH_GROUP_SIZE) action.paths[action.size++] = path;
+        }
+
+        uint32_t id = Intern_Action(agg, &action);
+        ok = id != ORTC_FAILED && Insert_Node(agg, lines[first].network, lines[first].length, id);
+    }
+
+    free(lines);
+    return ok;
+}
+
+/* ----------------------------------------------------- ORTC TRIE ----------------------------------------------------- */
+/* ---------------------------------------------------- ORTC PASSES ---------------------------------------------------- */
+
+/**
+ * @brief First pass: give every node none or two children, and the leaves the action of their longest match.
+ *
+ * @param agg       The aggregation.
+ * @param node      The node.
+ * @param inherited The action of the node's longest match above it.
+ * @return False if memory allocation fails.
+ */
+static bool Push_Down(ortc *agg, uint32_t node, uint32_t inherited) {
+    if (agg->nodes[node].action) inherited = agg->nodes[node].action;
+    if (!agg->nodes[node].child[0] && !agg->nodes[node].child[1]) {
+        agg->nodes[node].action = inherited;
+        return true;
+    }
+
+    for (int side = 0; side < 2; side++) {
+        if (agg->nodes[node].child[side]) continue;
+        uint32_t child = New_Node(agg);
+        if (!child) return false;
+        agg->nodes[node].child[side] = child;
+    }
+    agg->nodes[node].action = 0;
+    return Push_Down(agg, agg->nodes[node].child[0], inherited) && Push_Down(agg, agg->nodes[node].child[1], inherited);
+}
+
+/**
+ * @brief Second pass, bottom up: the set of actions a node can take without costing its subtree a route.
+ *
+ * The set of an inner node is the intersection of its children's sets if they share an
+ * action, their union otherwise. No route is kept apart: the trie has no route that stops a
+ * longer match, so a subtree with addresses that have no route can only be covered from below.
+ * Its set is no route alone, and its ancestors' too (none of them had a route to begin with).
+ *
+ * @return False if memory allocation fails.
+ */
+static bool Compute_Sets(ortc *agg, uint32_t node) {
+    uint32_t left = agg->nodes[node].child[0], right = agg->nodes[node].child[1];
+    size_t room = 1;
+    if (left) {
+        if (!Compute_Sets(agg, left) || !Compute_Sets(agg, right)) return false;
+        room = (size_t)agg->nodes[left].set_size + agg->nodes[right].set_size;
+    }
+
+    if (agg->set_used + room > agg->set_room) {
+        size_t grown_room = 2 * agg->set_room > agg->set_used + room ? 2 * agg->set_room : agg->set_used + room;
+        uint32_t *grown = (uint32_t*)realloc(agg->sets, grown_room * sizeof(uint32_t));
+        if (!grown) return false;
+        agg->sets = grown;
+        agg->set_room = grown_room;
+    }
+
+    uint32_t *out = agg->sets + agg->set_used, size = 0;
+    if (!left) {
+        out[size++] = agg->nodes[node].action;
+    } else {
+        const uint32_t *a = agg->sets + agg->nodes[left].set, *b = agg->sets + agg->nodes[right].set;
+        uint32_t na = agg->nodes[left].set_size, nb = agg->nodes[right].set_size, ia = 0, ib = 0;
+
+        if (!a[0] || !b[0]) {
+            out[size++] = 0;
+        } else {
+            while (ia < na && ib < nb) {
+                if (a[ia] == b[ib]) out[size++] = a[ia], ia++, ib++;
+                else if (a[ia] < b[ib]) ia++;
+                else ib++;
+            }
+        }
+        if (!size) {
+            for (ia = ib = 0; ia < na || ib < nb;) {
+                if (ib == nb || (ia < na && a[ia] < b[ib])) out[size++] = a[ia++];
+                else if (ia == na || b[ib] < a[ia]) out[size++] = b[ib++];
+                else out[size++] = a[ia++], ib++;
+            }
+        }
+    }
+
+    agg->nodes[node].set = agg->set_used;
+    agg->nodes[node].set_size = size;
+    agg->set_used += size;
+    return true;
+}
+
+static bool Has_Action(const uint32_t *set, uint32_t size, uint32_t action) {
+    uint32_t low = 0, high = size;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (set[mid] == action) return true;
+        if (set[mid] < action) low = mid + 1;
+        else high = mid;
+    }
+    return false;
+}
+
+/**
+ * @brief Keep a prefix of the aggregated table.
+ *
+ * @return False if memory allocation fails.
+ */
+static bool Choose_Prefix(ortc *agg, uint32_t network, uint32_t length, uint32_t action) {
+    if (agg->num_chosen == agg->max_chosen) {
+        int max_chosen = agg->max_chosen ? 2 * agg->max_chosen : 1024;
+        ortc_line *grown = (ortc_line*)realloc(agg->chosen, max_chosen * sizeof(ortc_line));
+        if (!grown) return false;
+        agg->chosen = grown;
+        agg->max_chosen = max_chosen;
+    }
+    agg->chosen[agg->num_chosen++] = (ortc_line){ .network = network, .length = length, .action = action };
+    agg->num_paths += agg->actions[action].size;
+    return true;
+}
+
+/**
+ * @brief Third pass, top down: keep the action a node inherits if its set has it, otherwise give it a route.
+ *
+ * Any action of the set forwards the subtree with the fewest routes; the lowest one keeps the
+ * result the same from run to run. The root takes no route, the trie has no /0: its children
+ * choose in its place.
+ *
+ * @return False if memory allocation fails.
+ */
+static bool Select_Routes(ortc *agg, uint32_t node, uint32_t depth, uint32_t network, uint32_t inherited) {
+    const ortc_node *entry = &agg->nodes[node];
+    uint32_t chosen = inherited;
+
+    if (!Has_Action(agg->sets + entry->set, entry->set_size, inherited)) {
+        chosen = depth ? agg->sets[entry->set] : 0;
+        if (chosen && !Choose_Prefix(agg, network, depth, chosen)) return false;
+    }
+    if (!entry->child[0]) return true;
+
+    uint32_t right = entry->child[1];
+    return Select_Routes(agg, entry->child[0], depth + 1, network, chosen) &&
+           Select_Routes(agg, right, depth + 1, network | (IPV4_TOP_BIT >> depth), chosen);
+}
+
+/**
+ * @brief Write the aggregated prefixes as routes, one line per path.
+ *
+ * The prefixes go from the shortest to the longest, then by address, so the same table always
+ * aggregates to the same file.
+ *
+ * @return The routes, or NULL if memory allocation fails.
+ */
+static route* Write_Routes(ortc *agg) {
+    route *out = (route*)malloc((agg->num_paths ? agg->num_paths : 1) * sizeof(route));
+    if (!out) return NULL;
+    qsort(agg->chosen, agg->num_chosen, sizeof(ortc_line), Compare_Lines);
+
+    route *line = out;
+    for (int prefix = 0; prefix < agg->num_chosen; prefix++) {
+        const ortc_line *chosen = &agg->chosen[prefix];
+        const ortc_action *paths = &agg->actions[chosen->action];
+        for (uint32_t path = 0; path < paths->size; path++, line++) {
+            line->prefix = htonl(chosen->network);
+            line->mask = htonl(~0u << (32 - chosen->length));
+            line->next_hop = paths->paths[path].next_hop;
+            line->interface = paths->paths[path].interface;
+        }
+    }
+    return out;
+}
+
+/* ---------------------------------------------------- ORTC PASSES ---------------------------------------------------- */
+/* -------------------------------------------------- AGGREGATE ROUTES ------------------------------------------------- */
+
+/**
+ * @brief Compute the smallest set of routes forwarding every address as a set of routes does (ORTC).
+ *
+ * Optimal Routing Table Constructor (Draves et al.): the prefixes are spread over a binary trie,
+ * pushed down to its leaves, and the routes chosen again from the leaves up so that a prefix
+ * gets a route only where its longest match would change. A multipath route is one action, its
+ * paths in the table's order, written again as one line per path. The result forwards every
+ * address the same way, with no more prefixes than the table loads, and with no /0 route.
+ *
+ * @param routes     The routes, as Read_IPV4_Routes reads them.
+ * @param count      The number of routes.
+ * @param aggregated Receives the number of aggregated routes.
+ * @return The aggregated routes (to be freed by the caller), or NULL if memory allocation fails.
+ */
+route* Aggregate_IPV4_Routes(const route *routes, int count, int *aggregated) {
+    ortc agg = { .max_actions = 1024, .slot_mask = ORTC_SLOTS - 1, .max_nodes = 1024 };
+    *aggregated = 0;
+
+    agg.actions = (ortc_action*)calloc(agg.max_actions, sizeof(ortc_action));
+    agg.slots = (uint32_t*)calloc(ORTC_SLOTS, sizeof(uint32_t));
+    agg.nodes = (ortc_node*)calloc(agg.max_nodes, sizeof(ortc_node));
+    agg.num_actions = agg.num_nodes = 1;
+
+    bool ok = agg.actions && agg.slots && agg.nodes && Resolve_Routes(&agg, routes, count) &&
+              Push_Down(&agg, 0, 0) && Compute_Sets(&agg, 0) && Select_Routes(&agg, 0, 0, 0, 0);
+    route *out = ok ? Write_Routes(&agg) : NULL;
+    if (out) *aggregated = (int)agg.num_paths;
+
+    free(agg.actions);
+    free(agg.slots);
+    free(agg.nodes);
+    free(agg.sets);
+    free(agg.chosen);
+    return out;
+}
+
+/* -------------------------------------------------- AGGREGATE ROUTES ------------------------------------------------- */
+/* -------------------------------------------------- COMPARE TABLES --------------------------------------------------- */
+
+/**
+ * @brief Look an address up in two tables, the paths of a group compared rather than its index.
+ *
+ * @return 1 if the tables forward the address differently, 0 otherwise.
+ */
+static uint64_t Compare_Address(ipv4_table *left, ipv4_table *right, uint32_t address, uint64_t *checked) {
+    forward a, b;
+    Lookup_IPV4_Table(left, htonl(address), &a);
+    Lookup_IPV4_Table(right, htonl(address), &b);
+    (*checked)++;
+
+    if (a.status != b.status) return 1;
+    if (!a.status) return 0;
+    if ((a.interface == NH_GROUP) != (b.interface == NH_GROUP)) return 1;
+    if (a.interface != NH_GROUP) return a.next_hop != b.next_hop || a.interface != b.interface;
+
+    const nh_group *ga = &left->groups->groups[a.next_hop], *gb = &right->groups->groups[b.next_hop];
+    return ga->size != gb->size || memcmp(ga->members, gb->members, ga->size * sizeof(nh_member)) != 0;
+}
+
+/**
+ * @brief Compare the tables on the first address of every prefix of a trie, and on the one after its last.
+ */
+static uint64_t Compare_Edges(ipv4_table *left, ipv4_table *right, const ipv4_entry *entry, uint32_t depth,
+                              uint32_t network, uint64_t *checked) {
+    uint64_t mismatches = 0;
+    if (entry->type == 1 && depth) {
+        uint32_t last = network | (depth == 32 ? 0 : ~0u >> depth);
+        mismatches += Compare_Address(left, right, network, checked);
+        if (last != UINT32_MAX) mismatches += Compare_Address(left, right, last + 1, checked);
+    }
+    if (entry->left) mismatches += Compare_Edges(left, right, entry->left, depth + 1, network, checked);
+    if (entry->right) mismatches += Compare_Edges(left, right, entry->right, depth + 1, network | (IPV4_TOP_BIT >> depth), checked);
+    return mismatches;
+}
+
+/**
+ * @brief Compare the lookups of two IPv4 routing tables over the whole address space.
+ *
+ * A lookup only changes where a prefix of either table starts or ends, so comparing the
+ * tables on these edges (and on 0.0.0.0) compares them on every address.
+ *
+ * @param left    A table.
+ * @param right   The other table.
+ * @param checked Receives the number of addresses looked up.
+ * @return The number of addresses the tables forward differently.
+ */
+uint64_t Compare_IPV4_Tables(ipv4_table *left, ipv4_table *right, uint64_t *checked) {
+    *checked = 0;
+    uint64_t mismatches = Compare_Address(left, right, 0, checked);
+    mismatches += Compare_Edges(left, right, left->root, 0, 0, checked);
+    mismatches += Compare_Edges(left, right, right->root, 0, 0, checked);
+    return mismatches;
+}
+
+/* -------------------------------------------------- COMPARE TABLES --------------------------------------------------- */
+/* ------------------------------------------------- AGGREGATED TABLE -------------------------------------------------- */
+
+static double Now_Ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Create an IPv4 routing table from a file, its routes aggregated.
+ *
+ * The table is built as written too, to report what the aggregation saves and to check that
+ * both tables forward every address the same way. If they do not, or the aggregation fails,
+ * the table as written is kept.
+ *
+ * @param file   The name of the file containing IPv4 routing entries.
+ * @param report Receives the prefixes and memory of both tables, and the result of the check.
+ * @return A pointer to the routing table, or NULL on failure.
+ */
+ipv4_table* Create_Aggregated_IPV4_Table(char *file, aggregate_report *report) {
+    memset(report, 0, sizeof(*report));
+    if (!file) return NULL;
+
+    int count = 0, aggregated = 0;
+    route *routes = Read_IPV4_Routes(file, &count);
+    if (!routes) return NULL;
+
+    ipv4_table *written = Build_IPV4_Table(routes, count);
+    double start = Now_Ms();
+    route *compact = written ? Aggregate_IPV4_Routes(routes, count, &aggregated) : NULL;
+    report->ms = Now_Ms() - start;
+    ipv4_table *aggregate = compact ? Build_IPV4_Table(compact, aggregated) : NULL;
+    free(compact);
+    free(routes);
+    if (!written) return NULL;
+
+    report->lines_in = count;
+    report->prefixes_in = written->size;
+    report->nodes_in = written->nodes;
+    report->bytes_in = Size_IPV4_Table(written);
+    if (!aggregate) return written;
+
+    report->lines_out = aggregated;
+    report->prefixes_out = aggregate->size;
+    report->nodes_out = aggregate->nodes;
+    report->bytes_out = Size_IPV4_Table(aggregate);
+    report->mismatches = Compare_IPV4_Tables(written, aggregate, &report->checked);
+    if (report->mismatches) {
+        Free_IPV4_Table(&aggregate);
+        return written;
+    }
+
+    report->applied = true;
+    Free_IPV4_Table(&written);
+    return aggregate;
+}
+
+/**
+ * @brief Print the prefixes and memory of a table before and after aggregation.
+ *
+ * @param out    The output stream.
+ * @param file   The name of the routing table.
+ * @param report The report of Create_Aggregated_IPV4_Table.
+ */
+void Print_Aggregate_Report(FILE *out, const char *file, const aggregate_report *report) {
+    fprintf(out, "aggregate %s: %zu -> %zu prefixes (%d -> %d lines), %zu -> %zu nodes, %.2f -> %.2f MB in %.1f ms, "
+            "%llu addresses checked, %llu differ%s\n", file, report->prefixes_in, report->prefixes_out,
+            report->lines_in, report->lines_out, report->nodes_in, report->nodes_out,
+            report->bytes_in / 1048576.0, report->bytes_out / 1048576.0, report->ms,
+            (unsigned long long)report->checked, (unsigned long long)report->mismatches,
+            report->applied ? "" : ", table kept as written");
+}
+
+/* ------------------------------------------------- AGGREGATED TABLE -------------------------------------------------- */
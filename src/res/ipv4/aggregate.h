@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "./ipv4_table.h"
+
+// A routing table before and after aggregation, and the check of its lookups.
+typedef struct aggregate_report {
+    int lines_in;               // Route lines read.
+    int lines_out;              // Route lines of the aggregated table (one per path).
+    size_t prefixes_in;         // Prefixes of the table as written.
+    size_t prefixes_out;        // Prefixes of the aggregated table.
+    size_t nodes_in;            // Trie nodes of the table as written.
+    size_t nodes_out;           // Trie nodes of the aggregated table.
+    size_t bytes_in;            // Memory of the table as written.
+    size_t bytes_out;           // Memory of the aggregated table.
+    uint64_t checked;           // Addresses looked up in both tables.
+    uint64_t mismatches;        // Addresses the tables disagree on.
+    double ms;                  // Time of the aggregation pass.
+    bool applied;               // False if the table as written was kept.
+} aggregate_report;
+
+/** @brief Compute the smallest set of routes forwarding every address as a set of routes does (ORTC). */
+route*          Aggregate_IPV4_Routes           (const route *routes, int count, int *aggregated);
+/** @brief Compare the lookups of two IPv4 routing tables over the whole address space. */
+uint64_t        Compare_IPV4_Tables             (ipv4_table *left, ipv4_table *right, uint64_t *checked);
+/** @brief Create an IPv4 routing table from a file, its routes aggregated. */
+ipv4_table*     Create_Aggregated_IPV4_Table    (char *file, aggregate_report *report);
+/** @brief Print the prefixes and memory of a table before and after aggregation. */
+void            Print_Aggregate_Report          (FILE *out, const char *file, const aggregate_report *report);
+
+#endif /* AGGREGATE_H_ */
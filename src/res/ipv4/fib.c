@@ -0,0 +1,291 @@
+#include "./fib.h"
+#include "./aggregate.h"
+
+/* ---------------------------------------------------- TRIE ENGINE ---------------------------------------------------- */
+
+/**
+ * @brief Build the binary trie of a set of routes.
+ * 
+ * @param routes The routes, the repeated prefixes become multipath routes.
+ * @param count  The number of routes.
+ * @return A pointer to the IPv4 routing table, or NULL on failure.
+ */
+static void* Build_Trie(const route *routes, int count) {
+    return Build_IPV4_Table(routes, count);
+}
+
+static void Destroy_Trie(void *fib) {
+    ipv4_table *ip_table = (ipv4_table*)fib;
+    Free_IPV4_Table(&ip_table);
+}
+
+static bool Lookup_Trie(void *fib, uint32_t ip, forward *lpm) {
+    return Lookup_IPV4_Table((ipv4_table*)fib, ip, lpm);
+}
+
+static void Lookup_Trie_Batch(void *fib, const uint32_t *ips, int count, forward *lpms) {
+    // The trie walks at most MAX_BATCH addresses at once.
+    for (int done = 0; done < count; done += MAX_BATCH) {
+        int batch = count - done < MAX_BATCH ? count - done : MAX_BATCH;
+        Lookup_IPV4_Batch((ipv4_table*)fib, ips + done, batch, lpms + done);
+    }
+}
+
+static size_t Memory_Trie(void *fib) {
+    return Size_IPV4_Table((const ipv4_table*)fib);
+}
+
+static void Inspect_Trie(void *fib, fib_stats *stats) {
+    Inspect_IPV4_Table((const ipv4_table*)fib, stats);
+}
+
+static const fib_engine trie_engine = {
+    .name = "trie",
+    .build = Build_Trie,
+    .destroy = Destroy_Trie,
+    .lookup = Lookup_Trie,
+    .lookup_batch = Lookup_Trie_Batch,
+    .memory = Memory_Trie,
+    .inspect = Inspect_Trie,
+};
+
+/* ---------------------------------------------------- TRIE ENGINE ---------------------------------------------------- */
+/* ---------------------------------------------------- ORTC ENGINE ---------------------------------------------------- */
+
+/**
+ * @brief Build the binary trie of a set of routes, aggregated first.
+ * 
+ * @param routes The routes, the repeated prefixes become multipath routes.
+ * @param count  The number of routes.
+ * @return A pointer to the IPv4 routing table, or NULL on failure.
+ */
+static void* Build_ORTC(const route *routes, int count) {
+    int aggregated = 0;
+    route *compact = Aggregate_IPV4_Routes(routes, count, &aggregated);
+    if (!compact) return NULL;
+
+    ipv4_table *ip_table = Build_IPV4_Table(compact, aggregated);
+    free(compact);
+    return ip_table;
+}
+
+// The trie of the aggregated routes, walked as the trie of the routes as written.
+static const fib_engine ortc_engine = {
+    .name = "ortc",
+    .build = Build_ORTC,
+    .destroy = Destroy_Trie,
+    .lookup = Lookup_Trie,
+    .lookup_batch = Lookup_Trie_Batch,
+    .memory = Memory_Trie,
+    .inspect = Inspect_Trie,
+};
+
+/* ---------------------------------------------------- ORTC ENGINE ---------------------------------------------------- */
+/* ---------------------------------------------------- IMAGE ENGINE --------------------------------------------------- */
+
+/**
+ * @brief Build the image of a set of routes, as fibload publishes it, in private memory.
+ * 
+ * @param routes The routes, the repeated prefixes become multipath routes.
+ * @param count  The number of routes.
+ * @return A pointer to the image, or NULL on failure.
+ */
+static void* Build_Image(const route *routes, int count) {
+    ipv4_table *ip_table = (ipv4_table*)Build_Trie(routes, count);
+    if (!ip_table) return NULL;
+
+    fib_image *image = (fib_image*)Huge_Alloc(Size_FIB_Image(ip_table), HUGE_FIB);
+    if (image) Write_FIB_Image(ip_table, image, 1);
+    Free_IPV4_Table(&ip_table);
+    return image;
+}
+
+static void Destroy_Image(void *fib) {
+    Huge_Free(fib);
+}
+
+static bool Lookup_Image(void *fib, uint32_t ip, forward *lpm) {
+    return Lookup_FIB_Image((const fib_image*)fib, ip, lpm);
+}
+
+static void Lookup_Image_Batch(void *fib, const uint32_t *ips, int count, forward *lpms) {
+    // The image walks at most MAX_BATCH addresses at once.
+    for (int done = 0; done < count; done += MAX_BATCH) {
+        int batch = count - done < MAX_BATCH ? count - done : MAX_BATCH;
+        Lookup_FIB_Batch((const fib_image*)fib, ips + done, batch, lpms + done);
+    }
+}
+
+static size_t Memory_Image(void *fib) {
+    return ((const fib_image*)fib)->size;
+}
+
+static void Inspect_Image(void *fib, fib_stats *stats) {
+    Inspect_FIB_Image((const fib_image*)fib, stats);
+}
+
+static const fib_engine image_engine = {
+    .name = "image",
+    .build = Build_Image,
+    .destroy = Destroy_Image,
+    .lookup = Lookup_Image,
+    .lookup_batch = Lookup_Image_Batch,
+    .memory = Memory_Image,
+    .inspect = Inspect_Image,
+};
+
+/* ---------------------------------------------------- IMAGE ENGINE --------------------------------------------------- */
+/* ---------------------------------------------------- FIND ENGINE ---------------------------------------------------- */
+
+const fib_engine *const fib_engines[] = {
+    &trie_engine,
+    &ortc_engine,
+    &image_engine,
+    NULL,
+};
+
+/**
+ * @brief Find a FIB engine by name.
+ * 
+ * @param name The name of the engine.
+ * @return The engine, or NULL if there is none with this name.
+ */
+const fib_engine* Find_FIB_Engine(const char *name) {
+    for (int engine = 0; fib_engines[engine]; engine++) {
+        if (!strcmp(fib_engines[engine]->name, name)) return fib_engines[engine];
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------- FIND ENGINE ---------------------------------------------------- */
+/* ---------------------------------------------------- INSPECT FIB ---------------------------------------------------- */
+
+/**
+ * @brief Count a node of a trie and its subtree.
+ *
+ * The addresses of a missing child end their walk at the node, after depth + 1 nodes: a
+ * missing child at depth d holds 2^(31 - d) addresses, the single address of a /32 node ends
+ * there after FIB_MAX_DEPTH nodes.
+ *
+ * @param entry The node.
+ * @param depth Its depth, 0 for the root.
+ * @param stats The statistics.
+ */
+static void Inspect_Entry(const ipv4_entry *entry, int depth, fib_stats *stats) {
+    stats->nodes++;
+    if (entry->type == 1) {
+        stats->routes++;
+        stats->lengths[depth]++;
+    }
+    if (depth == FIB_MAX_LENGTH) {
+        stats->depths[FIB_MAX_DEPTH]++;
+        return;
+    }
+
+    const ipv4_entry *children[2] = { entry->left, entry->right };
+    for (int side = 0; side < 2; side++) {
+        if (children[side]) Inspect_Entry(children[side], depth + 1, stats);
+        else stats->depths[depth + 1] += 1ull << (31 - depth);
+    }
+}
+
+/**
+ * @brief Count the nodes, routes, prefix lengths and lookup depths of an IPv4 routing table.
+ *
+ * @param ip_table The IPv4 routing table.
+ * @param stats    Receives the statistics.
+ */
+void Inspect_IPV4_Table(const ipv4_table *ip_table, fib_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!ip_table) return;
+
+    Inspect_Entry(ip_table->root, 0, stats);
+    stats->groups = ip_table->groups->count;
+    stats->bytes = Size_IPV4_Table(ip_table);
+}
+
+/**
+ * @brief Count a node of an image and its subtree, as Inspect_Entry does.
+ */
+static void Inspect_Node(const fib_image *image, uint32_t index, int depth, fib_stats *stats) {
+    const fib_node *node = &image->nodes[index];
+    stats->nodes++;
+    if (node->interface != FIB_NO_ROUTE) {
+        stats->routes++;
+        stats->lengths[depth]++;
+    }
+    if (depth == FIB_MAX_LENGTH) {
+        stats->depths[FIB_MAX_DEPTH]++;
+        return;
+    }
+
+    for (int side = 0; side < 2; side++) {
+        if (node->child[side]) Inspect_Node(image, node->child[side], depth + 1, stats);
+        else stats->depths[depth + 1] += 1ull << (31 - depth);
+    }
+}
+
+/**
+ * @brief Count the nodes, routes, prefix lengths and lookup depths of a FIB image.
+ *
+ * @param image The image, checked (every child index after its parent and inside the image).
+ * @param stats Receives the statistics.
+ */
+void Inspect_FIB_Image(const fib_image *image, fib_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!image || !image->count) return;
+
+    Inspect_Node(image, 0, 0, stats);
+    stats->groups = image->groups;
+    stats->bytes = image->size;
+}
+
+/**
+ * @brief Describe the structure of any FIB engine, its memory at least.
+ *
+ * @param engine The engine.
+ * @param fib    Its lookup structure.
+ * @param stats  Receives the statistics, only the memory if the engine cannot be inspected.
+ */
+void Inspect_FIB(const fib_engine *engine, void *fib, fib_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (engine->inspect) engine->inspect(fib, stats);
+    stats->bytes = engine->memory(fib);
+}
+
+/**
+ * @brief Print the statistics of a FIB: its size, its prefix lengths and its lookup depths.
+ *
+ * The depths are shares of the address space: how many nodes the lookup of a uniformly random
+ * address visits (every visit a likely cache miss in a FIB larger than the cache).
+ *
+ * @param out   The output stream.
+ * @param name  The name of the FIB.
+ * @param stats The statistics.
+ */
+void Print_FIB_Stats(FILE *out, const char *name, const fib_stats *stats) {
+    fprintf(out, "fib %s: %llu nodes, %llu routes, %llu groups, %.2f MB (%.1f B/node, %.1f B/route)\n", name,
+            (unsigned long long)stats->nodes, (unsigned long long)stats->routes, (unsigned long long)stats->groups,
+            stats->bytes / 1048576.0, stats->nodes ? (double)stats->bytes / stats->nodes : 0.0,
+            stats->routes ? (double)stats->bytes / stats->routes : 0.0);
+    if (!stats->nodes) return;
+
+    fprintf(out, "fib %s: prefix lengths", name);
+    for (int length = 0; length <= FIB_MAX_LENGTH; length++) {
+        if (stats->lengths[length]) fprintf(out, " /%d %llu", length, (unsigned long long)stats->lengths[length]);
+    }
+
+    double mean = 0, space = 4294967296.0;
+    int deepest = 0;
+    fprintf(out, "\nfib %s: lookup depth", name);
+    for (int depth = 1; depth <= FIB_MAX_DEPTH; depth++) {
+        if (!stats->depths[depth]) continue;
+        mean += depth * (stats->depths[depth] / space);
+        deepest = depth;
+        // Below 0.1% of the addresses, only the deepest walk is worth a column.
+        if (stats->depths[depth] >= space / 1000) fprintf(out, " %d %.1f%%", depth, 100.0 * stats->depths[depth] / space);
+    }
+    fprintf(out, ", mean %.2f nodes, deepest %d\n", mean, deepest);
+}
+
+/* ---------------------------------------------------- INSPECT FIB ---------------------------------------------------- */
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef FIB_H_
+#define FIB_H_
+
+#include "./ipv4_table.h"
+#include "./shared_fib.h"
+
+#define FIB_MAX_LENGTH  32              // Longest IPv4 prefix.
+#define FIB_MAX_DEPTH   33              // Nodes a trie walk visits at most: the root, then one per bit.
+
+// What the structure of a FIB engine holds, and how deep its lookups go.
+typedef struct fib_stats {
+    uint64_t nodes;                             // Nodes allocated, the root included.
+    uint64_t routes;                            // Valid entries: prefixes a route ends at.
+    uint64_t groups;                            // Next-hop groups of the multipath routes.
+    uint64_t bytes;                             // Memory of the structure.
+    uint64_t lengths[FIB_MAX_LENGTH + 1];       // Routes per prefix length.
+    uint64_t depths[FIB_MAX_DEPTH + 1];         // Addresses per number of nodes their lookup visits, 2^32 in all.
+} fib_stats;
+
+// A FIB engine: a lookup structure built from a set of routes.
+// The engines must agree on every address, the LPM bench checks them against a linear scan.
+// A multipath route answers with its group (interface NH_GROUP), the caller picks the path.
+typedef struct fib_engine {
+    const char *name;
+    /** @brief Build the lookup structure of a set of routes, NULL on failure. */
+    void*   (*build)        (const route *routes, int count);
+    /** @brief Free the lookup structure. */
+    void    (*destroy)      (void *fib);
+    /** @brief Longest prefix match of one address (network order). */
+    bool    (*lookup)       (void *fib, uint32_t ip, forward *lpm);
+    /** @brief Longest prefix match of a vector of addresses, NULL if the engine has none. */
+    void    (*lookup_batch) (void *fib, const uint32_t *ips, int count, forward *lpms);
+    /** @brief Bytes used by the lookup structure. */
+    size_t  (*memory)       (void *fib);
+    /** @brief Count the nodes, routes and lookup depths of the structure, NULL if the engine has none. */
+    void    (*inspect)      (void *fib, fib_stats *stats);
+} fib_engine;
+
+// Every engine, NULL terminated.
+extern const fib_engine *const fib_engines[];
+
+/** @brief Find a FIB engine by name. */
+const fib_engine*   Find_FIB_Engine     (const char *name);
+
+/** @brief Count the nodes, routes, prefix lengths and lookup depths of an IPv4 routing table. */
+void                Inspect_IPV4_Table  (const ipv4_table *ip_table, fib_stats *stats);
+/** @brief Count the nodes, routes, prefix lengths and lookup depths of a FIB image. */
+void                Inspect_FIB_Image   (const fib_image *image, fib_stats *stats);
+/** @brief Describe the structure of any FIB engine, its memory at least. */
+void                Inspect_FIB         (const fib_engine *engine, void *fib, fib_stats *stats);
+/** @brief Print the statistics of a FIB. */
+void                Print_FIB_Stats     (FILE *out, const char *name, const fib_stats *stats);
+
+#endif /* FIB_H_ */
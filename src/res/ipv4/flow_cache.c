@@ -0,0 +1,102 @@
+#include "./flow_cache.h"
+#include "../../utils/hugepage.h"
+
+/* ------------------------------------------------- CREATE FLOW CACHE ------------------------------------------------- */
+
+/**
+ * @brief Create an empty flow cache.
+ * 
+ * All the entries start in generation 0, which never matches a lookup.
+ * The cache is on 2 MB pages when the host has them.
+ * 
+ * @return A pointer to the new flow cache or NULL if memory allocation fails.
+ */
+flow_cache* Create_Flow_Cache(void) {
+    // The region comes zeroed.
+    return Huge_Alloc(sizeof(flow_cache), HUGE_FLOWS);
+}
+
+/**
+ * @brief Free a flow cache.
+ * 
+ * @param cache A pointer to the flow cache pointer to be freed.
+ */
+void Free_Flow_Cache(flow_cache **cache) {
+    if (!cache || !(*cache)) return;
+    Huge_Free(*cache);
+    *cache = NULL;
+}
+
+/* ------------------------------------------------- CREATE FLOW CACHE ------------------------------------------------- */
+/* ------------------------------------------------- LOOKUP FLOW CACHE ------------------------------------------------- */
+
+/**
+ * @brief Map a destination to its set (multiplicative hashing).
+ * 
+ * @param daddr The destination IP address.
+ * @param vrf   The VRF it is looked up in: the same address in two VRFs goes to different sets.
+ * @return The set index.
+ */
+static inline uint32_t Flow_Set(uint32_t daddr, uint8_t vrf) {
+    return ((daddr ^ vrf) * 2654435761u) >> (32 - __builtin_ctz(FLOW_CACHE_SETS));
+}
+
+/**
+ * @brief Find the entry of a destination resolved in the current generation.
+ * 
+ * Entries of older generations are stale: a FIB or neighbor change bumped the generation.
+ * 
+ * @param cache      The flow cache.
+ * @param daddr      The destination IP address.
+ * @param vrf        The VRF of the packet's ingress interface.
+ * @param generation The current generation of the control state.
+ * @return The entry, or NULL on a miss.
+ */
+const flow_entry* Lookup_Flow(flow_cache *cache, uint32_t daddr, uint8_t vrf, uint32_t generation) {
+    flow_entry *set = cache->sets[Flow_Set(daddr, vrf)];
+
+    for (int way = 0; way < FLOW_CACHE_WAYS; way++) {
+        if (set[way].daddr == daddr && set[way].vrf == vrf && set[way].generation == generation) {
+            COUNTER_ADD(cache->hits, 1);
+            return &set[way];
+        }
+    }
+
+    COUNTER_ADD(cache->misses, 1);
+    return NULL;
+}
+
+/**
+ * @brief Cache the resolved forwarding decision of a destination.
+ * 
+ * The new entry goes to the first way, the others shift down and the last one is evicted,
+ * so a set keeps its most recently resolved destinations.
+ * 
+ * @param cache The flow cache.
+ * @param entry The entry to cache (its generation and VRF must be set).
+ */
+void Insert_Flow(flow_cache *cache, const flow_entry *entry) {
+    flow_entry *set = cache->sets[Flow_Set(entry->daddr, entry->vrf)];
+
+    int way = 0;
+    while (way < FLOW_CACHE_WAYS - 1 && (set[way].daddr != entry->daddr || set[way].vrf != entry->vrf)) way++;
+    memmove(&set[1], &set[0], way * sizeof(flow_entry));
+    set[0] = *entry;
+}
+
+/* ------------------------------------------------- LOOKUP FLOW CACHE ------------------------------------------------- */
+
+/**
+ * @brief Print the hit and miss counters of a flow cache.
+ * 
+ * @param out    The output stream.
+ * @param cache  The flow cache.
+ * @param worker The worker owning the cache.
+ */
+void Dump_Flow_Cache(FILE *out, flow_cache *cache, int worker) {
+    uint64_t hits = COUNTER_GET(cache->hits);
+    uint64_t misses = COUNTER_GET(cache->misses);
+    fprintf(out, "flow cache w%d: %llu hits %llu misses (%.1f%% hit rate)\n", worker,
+            (unsigned long long)hits, (unsigned long long)misses,
+            hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
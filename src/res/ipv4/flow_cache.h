@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef FLOW_CACHE_H_
+#define FLOW_CACHE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../../utils/lib.h"
+
+#define FLOW_CACHE_SETS 1024        // Number of sets, a power of two.
+#define FLOW_CACHE_WAYS 2           // Entries per set, a set fills one cache line.
+#define FLOW_GROUP      -1          // Interface of a multipath destination, the path is picked per packet.
+
+// Resolved forwarding decision for one destination of a VRF, with its L2 rewrite.
+// A multipath destination caches its group: its flows take different paths, the MACs are looked up per frame.
+typedef struct flow_entry {
+    uint32_t daddr;                 // Destination IP address (network order).
+    uint32_t next_hop;              // Next Hop IP address, the index of the group for FLOW_GROUP.
+    uint32_t generation;            // Generation the entry was resolved in, 0 when empty.
+    int16_t interface;              // Egress interface index, or FLOW_GROUP.
+    uint8_t dhost[6];               // Next hop MAC address.
+    uint8_t shost[6];               // Egress interface MAC address.
+    uint8_t vrf;                    // VRF the destination was looked up in, 0 for the default table.
+    uint8_t pad[5];
+} flow_entry;
+
+// Set-associative destination cache, private to a worker.
+typedef struct flow_cache {
+    flow_entry sets[FLOW_CACHE_SETS][FLOW_CACHE_WAYS] __attribute__((aligned(64)));
+    counter hits;                   // Lookups answered by the cache.
+    counter misses;                 // Lookups that fell through to the FIB.
+} flow_cache;
+
+/** @brief Create an empty flow cache. */
+flow_cache*         Create_Flow_Cache       (void);
+/** @brief Free a flow cache. */
+void                Free_Flow_Cache         (flow_cache **cache);
+
+/** @brief Find the entry of a destination resolved in the current generation. */
+const flow_entry*   Lookup_Flow             (flow_cache *cache, uint32_t daddr, uint8_t vrf, uint32_t generation);
+/** @brief Cache the resolved forwarding decision of a destination. */
+void                Insert_Flow             (flow_cache *cache, const flow_entry *entry);
+
+/** @brief Print the hit and miss counters of a flow cache. */
+void                Dump_Flow_Cache         (FILE *out, flow_cache *cache, int worker);
+
+#endif /* FLOW_CACHE_H_ */
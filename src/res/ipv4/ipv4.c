@@ -1,17 +1,19 @@
 #include "./ipv4.h"
 #include "../arp/arp.h"
 #include "../icmp/icmp.h"
+#include "../nat/nat.h"
 
 /* ----------------------------------------------------- HEADER IPV4 ----------------------------------------------------- */
 
 /**
- * @brief Set the IPv4 header fields based on the specified type.
+ * @brief Set the IPv4 header fields of an ICMP message answering the packet in the buffer.
  * 
- * @param route Pointer to the routing information structure.
- * @param type  Type of ICMP packet (ICMP_TIME_EXCED or ICMP_DEST_UNREACH).
+ * @param route Pointer to the routing information structure, its length covering the ICMP message.
  */
-static void Set_IPV4_Fields(routing *route, uint8_t type) {
+static void Set_IPV4_Fields(routing *route) {
     struct iphdr *ip_hdr = route->ip_hdr;
+    // The message goes back to the sender of the packet it answers.
+    uint32_t sender = ip_hdr->saddr;
 
     // Set IP header fields.
     ip_hdr->ihl = IPV4_IHL;
@@ -23,18 +25,12 @@ static void Set_IPV4_Fields(routing *route, uint8_t type) {
     ip_hdr->protocol = 1;
     ip_hdr->check = 0;
 
-    // Compute total length
-    uint16_t total_length = sizeof(struct iphdr) + sizeof(struct icmphdr);
-    if (type == ICMP_TIME_EXCED || type == ICMP_DEST_UNREACH) {
-        total_length += sizeof(struct iphdr) + 8;
-    }
-    ip_hdr->tot_len = htons(total_length);
+    // Total length: the ICMP message built after the header
+    ip_hdr->tot_len = htons((uint16_t)(route->len - sizeof(struct ethhdr)));
 
-    // Set source and destination addresses
-    uint32_t src_addr = Get_IPV4_Interface(route->interface);
-    ip_hdr->saddr = src_addr;
-    // Reverse source and destination
-    ip_hdr->daddr = route->ip_hdr->saddr;
+    // Set source and destination addresses, reversed
+    ip_hdr->saddr = Get_IPV4_Interface(route->interface);
+    ip_hdr->daddr = sender;
 }
 
 /**
@@ -45,21 +41,129 @@ static void Set_IPV4_Fields(routing *route, uint8_t type) {
 static void Update_IPV4_Checksum(routing *route) {
     struct iphdr *ip_hdr = route->ip_hdr;
     ip_hdr->check = 0;    // Update checksum
-    ip_hdr->check = htons(Checksum((uint16_t *)ip_hdr, sizeof(struct iphdr)));
+    ip_hdr->check = Checksum_Fast(ip_hdr, sizeof(struct iphdr));
 }
 
 /**
  * @brief Create the IPv4 header for ICMP packets and update checksum.
  * 
- * @param route Pointer to the routing information structure.
- * @param type  Type of ICMP packet (ICMP_TIME_EXCED or ICMP_DEST_UNREACH).
+ * @param route Pointer to the routing information structure, its length covering the ICMP message.
  */
-void Header_IPV4(routing *route, uint8_t type) {
-    Set_IPV4_Fields(route, type);
+void Header_IPV4(routing *route) {
+    Set_IPV4_Fields(route);
     Update_IPV4_Checksum(route);
 }
 
 /* ----------------------------------------------------- HEADER IPV4 ----------------------------------------------------- */
+/* ---------------------------------------------------- FRAGMENT IPV4 ---------------------------------------------------- */
+
+/**
+ * @brief Keep the options a packet's later fragments repeat, those with the copied flag (RFC 791).
+ *
+ * @param options The options of the packet.
+ * @param len     Their length.
+ * @param copied  Receives the options kept, padded to a multiple of 4 bytes (IPV4_MAX_OPTIONS at most).
+ * @return The length of the options kept.
+ */
+static size_t Copy_IPV4_Options(const uint8_t *options, size_t len, uint8_t *copied) {
+    size_t kept = 0;
+    for (size_t pos = 0; pos < len;) {
+        uint8_t type = options[pos];
+        if (type == 0) break;                           // End of options list
+        if (type == 1) {                                // No operation, a single byte
+            pos++;
+            continue;
+        }
+        if (pos + 1 >= len || options[pos + 1] < 2 || pos + options[pos + 1] > len) break;
+        if ((type & 0x80) && kept + options[pos + 1] <= IPV4_MAX_OPTIONS) {
+            memcpy(copied + kept, options + pos, options[pos + 1]);
+            kept += options[pos + 1];
+        }
+        pos += options[pos + 1];
+    }
+    while (kept % 4) copied[kept++] = 0;
+    return kept;
+}
+
+/**
+ * @brief Send an IPv4 packet over the egress MTU in fragments (RFC 791).
+ *
+ * Every fragment but the last carries a multiple of 8 bytes of the packet's data, the first
+ * one all its options. A fragment being fragmented again keeps its offset and more fragments flag.
+ *
+ * @param interface The egress interface.
+ * @param frame     The frame, its Ethernet header rewritten.
+ * @param len       Its length.
+ * @param mtu       The MTU of the egress interface.
+ * @param stamp     Its RX timestamp (ns), 0 if unknown.
+ * @param path      Path it took through the router.
+ */
+static void Fragment_IPV4(int interface, const char *frame, size_t len, int mtu, uint64_t stamp, int path) {
+    const struct iphdr *ip_hdr = (const struct iphdr *)(frame + sizeof(struct ethhdr));
+    size_t ihl = ip_hdr->ihl * 4u;
+    size_t total = ntohs(ip_hdr->tot_len);
+    if (total > len - sizeof(struct ethhdr)) total = len - sizeof(struct ethhdr);
+    if (ihl < sizeof(*ip_hdr) || total <= ihl || mtu < IPV4_MIN_MTU) return;
+
+    uint16_t frag_off = ntohs(ip_hdr->frag_off);
+    uint8_t copied[IPV4_MAX_OPTIONS];
+    size_t options = Copy_IPV4_Options((const uint8_t *)(ip_hdr + 1), ihl - sizeof(*ip_hdr), copied);
+
+    char *fragment = (char *)malloc(sizeof(struct ethhdr) + (size_t)mtu);
+    if (!fragment) return;
+    memcpy(fragment, frame, sizeof(struct ethhdr) + ihl);
+    struct iphdr *frag_hdr = (struct iphdr *)(fragment + sizeof(struct ethhdr));
+
+    size_t header = ihl;
+    for (size_t data = ihl; data < total;) {
+        size_t chunk = ((size_t)mtu - header) & ~(size_t)7;
+        bool last = total - data <= (size_t)mtu - header;
+        if (last) chunk = total - data;
+
+        uint16_t offset = (uint16_t)((frag_off & IPV4_OFFSET) + (data - ihl) / 8);
+        frag_hdr->ihl = (uint8_t)(header / 4);
+        frag_hdr->tot_len = htons((uint16_t)(header + chunk));
+        frag_hdr->frag_off = htons(offset | (last ? (frag_off & IPV4_MF) : IPV4_MF));
+        frag_hdr->check = 0;
+        frag_hdr->check = Checksum_Fast(frag_hdr, header);
+        memcpy((char *)frag_hdr + header, (const char *)ip_hdr + data, chunk);
+
+        Send_Stamped_Link(interface, fragment, sizeof(struct ethhdr) + header + chunk, stamp, path);
+        STATS_EVENT(IPV4_FRAGMENTS, 1);
+        data += chunk;
+
+        // The later fragments repeat only the copied options.
+        if (header != sizeof(*ip_hdr) + options) {
+            header = sizeof(*ip_hdr) + options;
+            memcpy(frag_hdr + 1, copied, options);
+        }
+    }
+    free(fragment);
+}
+
+/**
+ * @brief Send a routed IPv4 frame, in fragments if it is over the egress MTU.
+ *
+ * The packets not to be fragmented (DF set, super-packets) were answered with Fragmentation
+ * Needed before, the others are sent whole, with their offload state, or in fragments.
+ *
+ * @param interface The egress interface.
+ * @param frame     The frame, its Ethernet header rewritten.
+ * @param len       Its length.
+ * @param offload   Its offload state.
+ * @param stamp     Its RX timestamp (ns), 0 if unknown.
+ * @param path      Path it took through the router.
+ */
+void Send_IPV4(int interface, char *frame, size_t len, const link_offload *offload, uint64_t stamp, int path) {
+    int mtu = Get_MTU_Interface(interface);
+    if (Wire_Packet_Len(frame, len, offload) <= (size_t)mtu) {
+        Send_Offload_Link(interface, frame, len, offload, stamp, path);
+        return;
+    }
+    Fragment_IPV4(interface, frame, len, mtu, stamp, path);
+}
+
+/* ---------------------------------------------------- FRAGMENT IPV4 ---------------------------------------------------- */
 /* ------------------------------------------------- HANDLER ARP PACKETS ------------------------------------------------- */
 
 /**
@@ -70,65 +174,140 @@ void Header_IPV4(routing *route, uint8_t type) {
 void Handler_IPV4(routing *route) {
     // Extract the IPv4 header from the received packet
     route->ip_hdr = (struct iphdr *)(route->buf + sizeof *route->eth_hdr);
+    // The ICMP messages are policed on the interface the packet came in on.
+    int ingress = route->interface;
     
-    // Store the original checksum and reset it for recalculation
-    uint16_t old_check = route->ip_hdr->check;
-    route->ip_hdr->check = 0;
+    // Drop the headers that cannot be followed: the options, their copies in the fragments and
+    // the checksum are all sized by the IHL.
+    size_t ip_len = route->len - sizeof *route->eth_hdr;
+    size_t ihl = route->ip_hdr->ihl * 4u;
+    if (route->len < sizeof *route->eth_hdr + sizeof *route->ip_hdr || route->ip_hdr->version != IPV4_VERSION ||
+        route->ip_hdr->ihl < IPV4_IHL || ihl > ip_len || ihl > ntohs(route->ip_hdr->tot_len)) {
+        STATS_DROP(DROP_MALFORMED, 1);
+        return;
+    }
 
-    // Check if the checksum is invalid, and return early if it doesn't match
-    if (old_check != htons(Checksum((uint16_t *)route->ip_hdr, sizeof *route->ip_hdr))) {
+    // Check if the checksum is invalid without writing to the header, and return early if so
+    if (!Checksum_Valid(route->ip_hdr, ihl)) {
+        STATS_DROP(DROP_CHECKSUM, 1);
         return; // Invalid checksum, drop the packet
     }
 
+    // The packets the pipeline's ACL stage did not see (IP options, the scalar path) are filtered here.
+    if (!route->filtered && !Permit_IPV4(route, route->ip_hdr, route->len - sizeof *route->eth_hdr)) {
+        STATS_DROP(DROP_ACL, 1);
+        return;
+    }
+
+    // A reply to a translated flow goes on to the host that opened it, as on the fast path.
+    if (!route->translated) DNAT_IPV4(route);
+
     // Check if the destination IP address doesn't match the interface's IP
     if (route->ip_hdr->daddr != Get_IPV4_Interface(route->interface)) {
-        // Look up the best route based on the destination IP address
-        forward *best_route = LPM_IPV4_Table(route->ipv4s, route->ip_hdr->daddr);
+        // Look up the best route based on the destination IP address (own or shared FIB, VRF of the ingress interface)
+        forward best_route;
+        Lookup_Route(route, ingress, route->ip_hdr->daddr, &best_route);
 
-        if (best_route) {
-            // Update the routing information with the best route
-            route->next_hop = best_route->next_hop;
-            route->interface = best_route->interface;
+        // A multipath route takes the path of the packet's flow, as on the fast path.
+        int group = -1, member = 0;
+        if (best_route.status && best_route.interface == NH_GROUP) {
+            group = (int)best_route.next_hop;
+            member = Select_Path(route, &best_route, Flow_Hash_IPV4(route->ip_hdr, route->len - sizeof *route->eth_hdr));
+        }
 
-            // Free the memory allocated for the best route entry
-            free(best_route);
+        // Routes through an interface the router was not started with are dropped.
+        if (best_route.status && (best_route.interface < 0 || best_route.interface >= ROUTER_NUM_INTERFACES)) {
+            STATS_DROP(DROP_NO_INTERFACE, 1);
+            return;
+        }
+
+        if (best_route.status) {
+            // Update the routing information with the best route
+            route->next_hop = best_route.next_hop;
+            route->interface = best_route.interface;
 
             // Continue with the main logic since the destination IP doesn't match
             if (route->ip_hdr->ttl > 1) {
-                // Recalculate the checksum for the modified TTL
-                route->ip_hdr->check = 0;
-                route->ip_hdr->check = ~(~old_check +
-                                         ~((uint16_t)route->ip_hdr->ttl) +
-                                         (uint16_t)(route->ip_hdr->ttl - 1)) - 1;
-                route->ip_hdr->ttl -= 1;
+                // Over the egress MTU and not to be fragmented (DF set, or a super-packet): the
+                // sender is told the MTU instead, back where the packet came from.
+                int mtu = Get_MTU_Interface(route->interface);
+                if (Wire_Packet_Len(route->buf, route->len, &route->offload) > (size_t)mtu &&
+                    ((route->ip_hdr->frag_off & htons(IPV4_DF)) || route->offload.gso_type != LINK_GSO_NONE)) {
+                    STATS_DROP(DROP_MTU, 1);
+                    if (!Police(route->policer, ingress, POLICE_ICMP_ERROR)) return;
+                    route->interface = ingress;
+                    Reply_ICMP_MTU(route, (uint16_t)mtu);
+                    Send_Stamped_Link(route->interface, route->buf, route->len, route->stamp, PATH_SLOW);
+                    return;
+                }
+
+                // Leaving the inside for the outside, the source is translated unless the SNAT stage did it.
+                if (!route->translated && !SNAT_IPV4(route, ingress)) {
+                    STATS_DROP(DROP_NAT, 1);
+                    return;
+                }
+
+                // Decrement the TTL and patch the checksum for it
+                Decrement_TTL(route->ip_hdr);
+                if (group >= 0) COUNTER_ADD(route->paths->packets[group][member], 1);
 
                 // Check if there is an ARP entry for the next hop
-                int entry_idx = Get_ARP_Entry(route->macs, route->next_hop);
+                int entry_idx = Get_ARP_Entry(route->ctrl->macs, route->next_hop);
 
                 if (entry_idx < 0) {
-                    // Send an ARP request to resolve the next hop's MAC address
-                    packet *pckg = Send_Packet(route);
-                    if (pckg) Enqueue(route->waiting, (void *)pckg);
+                    // Queue a copy of the packet, unless the queue is full (neighbor not answering).
+                    bool queued = false;
+                    pthread_mutex_lock(&route->ctrl->waiting_lock);
+                    if (route->ctrl->waiting_len < MAX_WAITING) {
+                        packet *pckg = Send_Packet(route);
+                        if (pckg) {
+                            Enqueue(route->ctrl->waiting, (void *)pckg);
+                            route->ctrl->waiting_len++;
+                            queued = true;
+                        }
+                    }
+                    pthread_mutex_unlock(&route->ctrl->waiting_lock);
+                    if (!queued) STATS_DROP(DROP_ARP_QUEUE, 1);
+
+                    // Over the request rate, a later packet for the same next hop asks again.
+                    if (!Police(route->policer, route->interface, POLICE_ARP_REQUEST)) return;
+
+                    // Send an ARP request to resolve the next hop's MAC address.
+                    // The queued copy carries the RX timestamp, the ARP request sent instead does not.
+                    route->stamp = 0;
                     Request_ARP(route);
                 } else {
                     // Update the Ethernet frame with the destination MAC address
-                    memcpy(route->eth_hdr->ether_dhost, route->macs->addrs[entry_idx].mac, MAC_SIZE);
+                    memcpy(route->eth_hdr->ether_dhost, route->ctrl->macs->addrs[entry_idx].mac, MAC_SIZE);
                     // Get the source MAC address of the current interface
                     Get_MAC_Interface(route->interface, route->eth_hdr->ether_shost);
+                    // Forward the packet, whole or in fragments
+                    Send_IPV4(route->interface, route->buf, route->len, &route->offload, route->stamp, PATH_SLOW);
+                    return;
                 }
             } else {
-                // TTL expired, send ICMP Time Exceeded message
+                // TTL expired, send ICMP Time Exceeded message back where the packet came from
+                STATS_DROP(DROP_TTL, 1);
+                if (!Police(route->policer, ingress, POLICE_ICMP_ERROR)) return;
+                route->interface = ingress;
                 Reply_ICMP(route, ICMP_TIME_EXCED);
             }
         } else {
             // No valid route found, send ICMP Destination Unreachable message
+            STATS_DROP(DROP_NO_ROUTE, 1);
+            if (!Police(route->policer, ingress, POLICE_ICMP_ERROR)) return;
             Reply_ICMP(route, ICMP_DEST_UNREACH);
         }
+    } else if (Is_Echo_Request(route->buf, route->len)) {
+        // Echo request for the router, turned into the reply in place
+        if (!Police(route->policer, ingress, POLICE_ICMP_ECHO)) return;
+        Echo_ICMP(route->buf, route->interface);
     } else {
-        // Destination IP matches the interface's IP, send ICMP Response message
-        Reply_ICMP(route, ICMP_RESPONE);
+        // The router has no other local service
+        STATS_DROP(DROP_LOCAL, 1);
+        return;
     }
 
     // Continue with the main logic by forwarding the packet to the appropriate interface
-    Send_To_Link(route->interface, route->buf, route->len);
+    Send_Stamped_Link(route->interface, route->buf, route->len, route->stamp, PATH_SLOW);
 }
@@ -8,14 +8,93 @@
 #define     IPV4_VERSION    	4
 #define     IPV4_IHL        	5
 #define     DEFAULT_TTL     	64
+#define     IPV4_DF         	0x4000		/* Don't fragment flag, in frag_off */
+#define     IPV4_MF         	0x2000		/* More fragments flag, in frag_off */
+#define     IPV4_OFFSET     	0x1fff		/* Fragment offset mask, in frag_off */
+#define     IPV4_MAX_OPTIONS	40			/* Options of a 15 word header */
 
 #define 	ICMP_RESPONE 		(uint8_t)0
+#define 	ICMP_ECHO_REQUEST 	(uint8_t)8
 #define 	ICMP_TIME_EXCED 	(uint8_t)11
 #define 	ICMP_DEST_UNREACH 	(uint8_t)3
+#define 	ICMP_FRAG_NEEDED 	(uint8_t)4		/* Destination unreachable code, with the next-hop MTU */
+#define     IPV4_MIN_MTU    	68			/* Header with options and 8 bytes of data (RFC 791) */
+
+/**
+ * @brief Decrement the TTL and patch the header checksum incrementally (RFC 1624).
+ * The TTL shares its 16-bit word with the protocol; the word is copied out
+ * rather than read through a cast pointer, which the compiler may not reload.
+ */
+static inline void Decrement_TTL(struct iphdr *ip_hdr) {
+    uint16_t old_word, new_word;
+    memcpy(&old_word, &ip_hdr->ttl, sizeof(old_word));
+    ip_hdr->ttl -= 1;
+    memcpy(&new_word, &ip_hdr->ttl, sizeof(new_word));
+    ip_hdr->check = Checksum_Adjust(ip_hdr->check, old_word, new_word);
+}
+
+/**
+ * @brief Hash of a packet's flow: addresses, protocol and, for TCP / UDP, ports.
+ * Fragments hash without ports, so all the fragments of a packet take the same path.
+ * @param len Bytes of the packet from its IPv4 header on.
+ */
+static inline uint32_t Flow_Hash_IPV4(const struct iphdr *ip_hdr, size_t len) {
+    size_t header = (size_t)ip_hdr->ihl * 4;
+    uint32_t ports = 0;
+    if ((ip_hdr->protocol == IPPROTO_TCP || ip_hdr->protocol == IPPROTO_UDP) && len >= header + sizeof(ports) &&
+        !(ip_hdr->frag_off & htons(IPV4_MF | IPV4_OFFSET))) {
+        memcpy(&ports, (const char *)ip_hdr + header, sizeof(ports));
+    }
+
+    // MurmurHash3's 64-bit finalizer, every input bit reaches the high bits that pick the path.
+    uint64_t key = ((uint64_t)ip_hdr->saddr << 32 | ip_hdr->daddr) ^ ((uint64_t)ports << 8 | ip_hdr->protocol);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return (uint32_t)(key >> 32);
+}
+
+/**
+ * @brief Fields of a packet for the ACL: addresses, protocol and, for TCP / UDP, ports.
+ * Fragments past the first have no ports, they only match the rules for any port.
+ * @param len Bytes of the packet from its IPv4 header on.
+ */
+static inline void ACL_Key_IPV4(const struct iphdr *ip_hdr, size_t len, acl_key *key) {
+    size_t header = (size_t)ip_hdr->ihl * 4;
+    key->src = ntohl(ip_hdr->saddr);
+    key->dst = ntohl(ip_hdr->daddr);
+    key->proto = ip_hdr->protocol;
+    key->ports = (ip_hdr->protocol == IPPROTO_TCP || ip_hdr->protocol == IPPROTO_UDP) &&
+                 len >= header + 2 * sizeof(uint16_t) && !(ip_hdr->frag_off & htons(IPV4_OFFSET));
+    key->sport = key->dport = 0;
+    if (key->ports) {
+        uint16_t ports[2];
+        memcpy(ports, (const char *)ip_hdr + header, sizeof(ports));
+        key->sport = ntohs(ports[0]);
+        key->dport = ntohs(ports[1]);
+    }
+}
+
+/** @brief Whether the ingress ACL lets a packet in (one packet of the slow path), true without an ACL. */
+static inline bool Permit_IPV4(routing *route, const struct iphdr *ip_hdr, size_t len) {
+    if (!atomic_load_explicit(&route->ctrl->acl, memory_order_relaxed)) return true;
+
+    acl_key key;
+    ACL_Key_IPV4(ip_hdr, len, &key);
+    const acl_table *acl = Enter_ACL(route);
+    bool permit = !acl || Filter_ACL(acl, &key) == ACL_PERMIT;
+    Exit_ACL(route);
+    return permit;
+}
 
 /** @brief Create the IPv4 header for ICMP packets and update checksum. */
-extern void        Header_IPV4       (routing *route, uint8_t type);
+extern void        Header_IPV4       (routing *route);
 /** @brief  Handle incoming IPv4 packets. */
 extern void        Handler_IPV4      (routing *route);
+/** @brief  Send a routed IPv4 frame, in fragments if it is over the egress MTU. */
+extern void        Send_IPV4         (int interface, char *frame, size_t len, const link_offload *offload,
+                                      uint64_t stamp, int path);
 
 #endif /* IPV4_H_ */
\ No newline at end of file
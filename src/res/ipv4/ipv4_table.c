@@ -1,26 +1,31 @@
 #include "./ipv4_table.h"
 
+#include <arpa/inet.h>
+
 /* ----------------------------------------------- CREATE IPV4 TABLE ----------------------------------------------- */
 
 /**
  * @brief Create a new IPv4 routing table entry.
  * 
- * Allocate memory for a new IPv4 routing table entry,
+ * Take a new IPv4 routing table entry from the table's node pool,
  * initializes its fields, and returns a pointer to the
- * newly created entry.
+ * newly created entry. The nodes follow each other in the pool's
+ * 2 MB regions, so a walk down the trie touches few TLB entries.
  * 
+ * @param ip_table The IPv4 routing table the entry belongs to.
  * @return A pointer to the newly created IPv4 routing table entry,
  *         or NULL if memory allocation fails.
  */
-static ipv4_entry* Create_IPV4_Entry(void) {
-    // Allocate memory for the new IPv4 entry.
-    ipv4_entry *entry = (ipv4_entry*)malloc(sizeof(ipv4_entry));
+static ipv4_entry* Create_IPV4_Entry(ipv4_table *ip_table) {
+    // Take the memory of the new IPv4 entry from the pool (zeroed).
+    ipv4_entry *entry = (ipv4_entry*)Pool_Alloc(ip_table->pool);
     if (!entry) return NULL;
 
     // Initialize fields of the new entry, with default values.
     entry->interface = -1;
     entry->type = 0;
     entry->next_hop = 0;
+    entry->prefix = 0;
 
     // Initialize left and right pointers for tree-based data structures.
     entry->left = NULL;
@@ -44,9 +49,13 @@ ipv4_table* CreateEmpty_IPV4_Table(void) {
     ipv4_table *ip_table = (ipv4_table*)malloc(sizeof(ipv4_table));
     if (!ip_table) return NULL;
 
-    // Create the root entry for the routing table.
-    ip_table->root = Create_IPV4_Entry();
-    if (!ip_table->root) {
+    // Create the node pool and the root entry for the routing table.
+    ip_table->pool = Create_Huge_Pool(sizeof(ipv4_entry), HUGE_FIB);
+    ip_table->root = ip_table->pool ? Create_IPV4_Entry(ip_table) : NULL;
+    // Create the table of next-hop groups, for the multipath routes.
+    ip_table->groups = ip_table->root ? Create_NH_Table() : NULL;
+    if (!ip_table->groups) {
+        Free_Huge_Pool(&ip_table->pool);
         free(ip_table);
         return NULL;
     }
@@ -54,43 +63,65 @@ ipv4_table* CreateEmpty_IPV4_Table(void) {
     // Initialize fields of the new table, with default values.
     ip_table->root->type = -1;
     ip_table->size = 0;
+    ip_table->nodes = 1;
+    ip_table->garbage = 0;
+    ip_table->dropped = 0;
 
     // Return a pointer to the newly created IPv4 routing table.
     return ip_table;
 }
 
 /**
- * @brief Read IPv4 routing entries from a file and populates an array of route structures.
+ * @brief Read IPv4 routing entries from a file into an array of route structures.
  * 
  * Read IPv4 routing entries from a file, parses each line, and populates
- * an array of route structures with the parsed information.
+ * a growing array of route structures with the parsed information.
  * 
- * @param file   The name of the file containing IPv4 routing entries.
- * @param rtable An array of route structures to store the parsed routing entries.
- * @return The number of routing entries read from the file, or -1 on failure.
+ * @param file  The name of the file containing IPv4 routing entries.
+ * @param count Set to the number of routing entries read from the file.
+ * @return The routing entries (to be freed by the caller), or NULL on failure.
  */
-static int Read_IPV4_Table(char *file, route *rtable) {
+route* Read_IPV4_Routes(char *file, int *count) {
     FILE *fin = fopen(file, "r");
-    if (!fin) return -1; // File opening failed
+    if (!fin) return NULL; // File opening failed
+
+    int capacity = 1024;
+    route *rtable = (route*)malloc(capacity * sizeof(route));
+    if (!rtable) {
+        fclose(fin);
+        return NULL;
+    }
 
     int num_entries = 0;
     char line[MAX_LINE_SIZE];
 
     // Parse each line from the routing table.
     while (fgets(line, sizeof(line), fin)) {
+        if (num_entries == capacity) {
+            route *grown = (route*)realloc(rtable, 2 * capacity * sizeof(route));
+            if (!grown) {
+                free(rtable);
+                fclose(fin);
+                return NULL;
+            }
+            rtable = grown;
+            capacity *= 2;
+        }
+        memset(&rtable[num_entries], 0, sizeof(route));
+
         int byte = 0;
         char *token = strtok(line, " .");
         // Each line from the routing contains PREFIX NEXT_HOP MASK INTERFACE in this order.
         while (token && byte < 13) {
             switch (byte / 4) {
                 case 0: // 0 - 3 PREFIX
-                    rtable[num_entries].prefix |= atoi(token) << (byte % 4) * 8;
+                    rtable[num_entries].prefix |= (uint32_t)atoi(token) << (byte % 4) * 8;
                     break;
                 case 1: // 4 - 7 NEXT_HOP
-                    rtable[num_entries].next_hop |= atoi(token) << (byte % 4) * 8;
+                    rtable[num_entries].next_hop |= (uint32_t)atoi(token) << (byte % 4) * 8;
                     break;
                 case 2: // 8 - 11 MASK
-                    rtable[num_entries].mask |= atoi(token) << (byte % 4) * 8;
+                    rtable[num_entries].mask |= (uint32_t)atoi(token) << (byte % 4) * 8;
                     break;
                 case 3: // 12 INTERFACE
                     rtable[num_entries].interface = atoi(token);
@@ -101,11 +132,34 @@ static int Read_IPV4_Table(char *file, route *rtable) {
             byte++;
         }
 
-        num_entries++;
+        // Skip blank or truncated lines.
+        if (byte == 13) num_entries++;
     }
 
     fclose(fin);
-    return num_entries;
+    *count = num_entries;
+    return rtable;
+}
+
+/**
+ * @brief Build an IPv4 routing table from an array of routes.
+ * 
+ * @param routes The routes, the repeated prefixes become multipath routes.
+ * @param count  The number of routes.
+ * @return A pointer to the newly created IPv4 routing table,
+ *         or NULL if memory allocation fails.
+ */
+ipv4_table* Build_IPV4_Table(const route *routes, int count) {
+    // Create an empty IPv4 routing table.
+    ipv4_table *ip_table = CreateEmpty_IPV4_Table();
+    if (!ip_table) return NULL;
+
+    // Insert the routing entries into the routing table.
+    for (int entry = 0; entry < count; entry++) {
+        route new_entry = routes[entry];
+        Insert_IPV4_Table(ip_table, &new_entry);
+    }
+    return ip_table;
 }
 
 /**
@@ -122,24 +176,14 @@ static int Read_IPV4_Table(char *file, route *rtable) {
 ipv4_table* Create_IPV4_Table(char *file) {
     if (!file) return NULL;
 
-    // Create an empty IPv4 routing table.
-    ipv4_table *ip_table = CreateEmpty_IPV4_Table();
-    if (!ip_table) return NULL;
-
-    // Define an array to store parsed routing entries.
-    route rtable[MAX_LINES];
-
     // Read routing entries from the file and get the number of entries.
-    int num_entries = Read_IPV4_Table(file, rtable);
-    if (num_entries < 0) {
-        Free_IPV4_Table(&ip_table);
-        return NULL;
-    }
+    int num_entries = 0;
+    route *rtable = Read_IPV4_Routes(file, &num_entries);
+    if (!rtable) return NULL;
 
-    // Insert parsed routing entries into the routing table.
-    for (int entry = 0; entry < num_entries; entry++) {
-        Insert_IPV4_Table(ip_table, &rtable[entry]);
-    }
+    // Insert parsed routing entries into a new routing table.
+    ipv4_table *ip_table = Build_IPV4_Table(rtable, num_entries);
+    free(rtable);
 
     return ip_table;
 }
@@ -147,34 +191,12 @@ ipv4_table* Create_IPV4_Table(char *file) {
 /* ------------------------------------------------- CREATE IPV4 TABLE --------------------------------------------------- */
 /* -------------------------------------------------- FREE IPV4 TABLE ---------------------------------------------------- */
 
-/**
- * @brief Recursively frees the memory associated with an IPv4 routing table entry.
- * 
- * Recursively frees the memory associated with an IPv4 routing table entry
- * and its child entries in a tree-like structure, inorder traverse.
- * 
- * @param entry A pointer to the IPv4 routing table entry to be freed.
- */
-static void Rec_Free_IPV4_Table(ipv4_entry *entry) {
-    if (!entry) return;
-
-    // Store references to the left and right child entries.
-    ipv4_entry *left_entry = entry->left;
-    ipv4_entry *right_entry = entry->right;
-
-    // Free the memory associated with the current entry.
-    free(entry);
-
-    // Recursively free the memory for left and right child entries.
-    Rec_Free_IPV4_Table(left_entry);
-    Rec_Free_IPV4_Table(right_entry);
-}
-
 /**
  * @brief Free the memory associated with an IPv4 routing table.
  * 
  * Free the memory associated with an entire IPv4 routing table,
- * including its root entry and all child entries.
+ * its root entry and all child entries going with the node pool.
+ * The entries and groups of a table of a VRF set (no pool of its own) are the set's to free.
  * 
  * @param ip_table A pointer to a pointer to the IPv4 routing table to be freed.
  *                 After the function call, the pointer is set to NULL.
@@ -182,29 +204,83 @@ static void Rec_Free_IPV4_Table(ipv4_entry *entry) {
 void Free_IPV4_Table(ipv4_table **ip_table) {
     if (!ip_table || !(*ip_table)) return;
 
-    // Store references to the routing table and its root entry.
-    ipv4_table *ip4s = *ip_table;
-    ipv4_entry *root = ip4s->root;
-
-    // Free the memory associated with the routing table.
-    free(ip4s);
+    // Free every entry at once, the groups, then the routing table.
+    if ((*ip_table)->pool) {
+        Free_Huge_Pool(&(*ip_table)->pool);
+        Free_NH_Table(&(*ip_table)->groups);
+    }
+    free(*ip_table);
     // Avoid dangling pointer access.
     *ip_table = NULL;
+}
 
-    // Recursively free the memory,
-    // for the root entry and its children.
-    Rec_Free_IPV4_Table(root);
+/**
+ * @brief Bytes of memory taken by an IPv4 routing table: its nodes (the replaced ones too) and its next-hop groups.
+ */
+size_t Size_IPV4_Table(const ipv4_table *ip_table) {
+    if (!ip_table) return 0;
+    return sizeof(ipv4_table) + (ip_table->nodes + ip_table->garbage) * sizeof(ipv4_entry) +
+           ip_table->groups->count * sizeof(nh_group);
 }
 
 /* -------------------------------------------------- FREE IPV4 TABLE ---------------------------------------------------- */
 /* ------------------------------------------------- INSERT IPV4 TABLE --------------------------------------------------- */
 
+/**
+ * @brief Find the entry of a prefix, without creating it.
+ * 
+ * @param ip_table The IPv4 routing table.
+ * @param prefix   The prefix.
+ * @param mask     Its mask.
+ * @return The entry ending at the prefix, or NULL if the trie has none.
+ */
+static ipv4_entry* Find_IPV4_Entry(ipv4_table *ip_table, uint32_t prefix, uint32_t mask) {
+    ipv4_entry *ipv4s = ip_table->root;
+    uint32_t network = ntohl(prefix & mask);
+
+    for (int bits = __builtin_popcount(mask); bits && ipv4s; bits--, network <<= 1) {
+        ipv4s = (network & IPV4_TOP_BIT) ? ipv4s->right : ipv4s->left;
+    }
+    return ipv4s;
+}
+
+/**
+ * @brief Add a path to the route of an entry, making it a multipath route if it had another.
+ * 
+ * @param ip_table  The IPv4 routing table.
+ * @param ipv4s     The entry of the route.
+ * @param new_entry The routing entry with the new path.
+ */
+static void Add_IPV4_Path(ipv4_table *ip_table, ipv4_entry *ipv4s, const route *new_entry) {
+    nh_member path = { .next_hop = new_entry->next_hop, .interface = new_entry->interface };
+
+    if (ipv4s->interface == NH_GROUP) {
+        if (!Add_NH_Member(ip_table->groups, ipv4s->next_hop, &path)) ip_table->dropped++;
+        return;
+    }
+    if (ipv4s->next_hop == path.next_hop && ipv4s->interface == path.interface) return;
+
+    // The second path of a prefix moves both into a new group.
+    nh_member paths[2] = { { .next_hop = ipv4s->next_hop, .interface = ipv4s->interface }, path };
+    int group = Add_NH_Group(ip_table->groups, paths, 2);
+    if (group < 0) {
+        // Without room for the group, the later path replaces the earlier one.
+        ipv4s->next_hop = path.next_hop;
+        ipv4s->interface = path.interface;
+        ip_table->dropped++;
+        return;
+    }
+    ipv4s->next_hop = (uint32_t)group;
+    ipv4s->interface = NH_GROUP;
+}
+
 /**
  * @brief Insert a new IPv4 routing table entry into an IPv4 routing table.
  * 
  * Insert a new IPv4 routing table entry into an existing IPv4 routing table.
  * The entry is inserted based on its prefix and mask, creating any necessary intermediate nodes
- * in the routing table tree structure.
+ * in the routing table tree structure. Another entry for a prefix already in the table adds a
+ * path to its route (ECMP), up to NH_GROUP_SIZE paths, if it writes the prefix the same way.
  * 
  * @param ip_table  A pointer to the IPv4 routing table where the new entry should be inserted.
  * @param new_entry A pointer to the new routing entry to be inserted.
@@ -213,32 +289,425 @@ void Insert_IPV4_Table(ipv4_table *ip_table, route *new_entry) {
     if (!ip_table || !new_entry->mask) return;
 
     ipv4_entry *ipv4s = ip_table->root;
-    uint32_t network = new_entry->prefix & new_entry->mask;
+    // The trie is walked from the most significant bit of the address, in host order.
+    uint32_t network = ntohl(new_entry->prefix & new_entry->mask);
     uint32_t network_length = __builtin_popcount(new_entry->mask);
 
     while (network_length) {
         // Determine the next child entry (left or right) based on the network bit.
-        ipv4_entry **next_entry = (network & 1) ? &(ipv4s->right) : &(ipv4s->left);
+        ipv4_entry **next_entry = (network & IPV4_TOP_BIT) ? &(ipv4s->right) : &(ipv4s->left);
         // Create a new entry if the next entry is NULL.
-        if (!*next_entry) *next_entry = Create_IPV4_Entry();
+        if (!*next_entry) {
+            *next_entry = Create_IPV4_Entry(ip_table);
+            if (!*next_entry) return;
+            ip_table->nodes++;
+        }
 
         ipv4s = *next_entry;
-        network >>= 1;
+        network <<= 1;
         network_length--;
     }
 
-    // Update the attributes of the final entry if it exists.
-    if (ipv4s) {
-        ipv4s->type = 1;    // VALID ENTRY.
-        ipv4s->next_hop = new_entry->next_hop;
-        ipv4s->interface = new_entry->interface;
+    // A line repeating a prefix adds a path to its route.
+    if (ipv4s->type == 1 && ipv4s->prefix == new_entry->prefix) {
+        Add_IPV4_Path(ip_table, ipv4s, new_entry);
+        return;
+    }
+
+    // The same network written differently (host bits set) replaces the route, as a new one would.
+    if (ipv4s->type != 1) ip_table->size++;
+
+    // Update the attributes of the final entry.
+    ipv4s->type = 1;    // VALID ENTRY.
+    ipv4s->next_hop = new_entry->next_hop;
+    ipv4s->interface = new_entry->interface;
+    ipv4s->prefix = new_entry->prefix;
+}
+
+/**
+ * @brief Mark the groups the multipath routes of a subtrie use.
+ * 
+ * @param entry The root of the subtrie.
+ * @param owned One flag per group of the table of groups.
+ */
+static void Mark_IPV4_Groups(const ipv4_entry *entry, bool *owned) {
+    for (; entry; entry = entry->right) {
+        if (entry->type == 1 && entry->interface == NH_GROUP) owned[entry->next_hop] = true;
+        Mark_IPV4_Groups(entry->left, owned);
+    }
+}
+
+/**
+ * @brief Replace the paths of the multipath routes with those of a new set of routes.
+ * 
+ * The trie is left as it is: only the groups change, in place, while the workers look them up.
+ * Every group takes the paths the new routes give its prefix. The routes that would change
+ * the trie (a new prefix, a single path route that changes or gains paths, a multipath
+ * route left with no path) are skipped. The groups of the other tables of a VRF set, which
+ * share the table of groups, are left alone.
+ * 
+ * @param ip_table The IPv4 routing table.
+ * @param routes   The new routes.
+ * @param count    The number of routes.
+ * @param skipped  Receives the number of routes (or groups) left as they were.
+ * @return The number of groups updated, or -1 if memory allocation fails.
+ */
+int Update_IPV4_Paths(ipv4_table *ip_table, const route *routes, int count, int *skipped) {
+    nh_table *groups = ip_table->groups;
+    *skipped = 0;
+    if (!groups->count) return 0;
+
+    // The new paths of every group, gathered before any group changes.
+    nh_group *fresh = (nh_group*)calloc(groups->count, sizeof(nh_group));
+    bool *owned = (bool*)calloc(groups->count, sizeof(bool));
+    if (!fresh || !owned) {
+        free(fresh);
+        free(owned);
+        return -1;
+    }
+    Mark_IPV4_Groups(ip_table->root, owned);
+
+    for (int idx = 0; idx < count; idx++) {
+        if (!routes[idx].mask) continue;
+        ipv4_entry *ipv4s = Find_IPV4_Entry(ip_table, routes[idx].prefix, routes[idx].mask);
+
+        if (!ipv4s || ipv4s->type != 1) {
+            (*skipped)++;
+            continue;
+        }
+        // Another way of writing the network, it did not add a path when the table was loaded either.
+        if (ipv4s->prefix != routes[idx].prefix) continue;
+        if (ipv4s->interface != NH_GROUP) {
+            if (ipv4s->next_hop != routes[idx].next_hop || ipv4s->interface != routes[idx].interface) (*skipped)++;
+            continue;
+        }
+
+        nh_group *paths = &fresh[ipv4s->next_hop];
+        bool known = false;
+        for (uint32_t member = 0; member < paths->size; member++) {
+            known |= paths->members[member].next_hop == routes[idx].next_hop &&
+                     paths->members[member].interface == routes[idx].interface;
+        }
+        if (known) continue;
+        if (paths->size == NH_GROUP_SIZE) {
+            (*skipped)++;
+            continue;
+        }
+        paths->members[paths->size].next_hop = routes[idx].next_hop;
+        paths->members[paths->size++].interface = routes[idx].interface;
+    }
+
+    int updated = 0;
+    for (uint32_t group = 0; group < groups->count; group++) {
+        const nh_group *current = &groups->groups[group];
+        if (!owned[group]) continue;
+        if (!fresh[group].size) {
+            (*skipped)++;
+            continue;
+        }
+        if (fresh[group].size == current->size &&
+            !memcmp(fresh[group].members, current->members, current->size * sizeof(nh_member))) continue;
+
+        Update_NH_Group(groups, group, fresh[group].members, (int)fresh[group].size);
+        updated++;
     }
 
-    // Increase the size of the routing table.
-    ip_table->size++;
+    free(fresh);
+    free(owned);
+    return updated;
 }
 
 /* ------------------------------------------------- INSERT IPV4 TABLE --------------------------------------------------- */
+/* ------------------------------------------------- CHANGE IPV4 TABLE --------------------------------------------------- */
+
+// State of a batch of changes while the trie is copied.
+typedef struct change_walk {
+    ipv4_table *ip_table;
+    huge_pool *pool;            // Where the copies go.
+    size_t allocated;           // Nodes taken from the pool.
+    int changed;                // Changes that altered a route.
+    bool failed;                // The pool ran out, the copy is dropped.
+} change_walk;
+
+/**
+ * @brief Order the changes as the trie is walked: by network, then prefix length, then as given.
+ */
+static int Compare_Changes(const void *left, const void *right) {
+    const route_change *a = (const route_change*)left, *b = (const route_change*)right;
+    uint32_t na = ntohl(a->route.prefix & a->route.mask), nb = ntohl(b->route.prefix & b->route.mask);
+    if (na != nb) return na < nb ? -1 : 1;
+    int la = __builtin_popcount(a->route.mask), lb = __builtin_popcount(b->route.mask);
+    if (la != lb) return la < lb ? -1 : 1;
+    // The index of the change, kept in its interface while sorting.
+    return (a->route.interface > b->route.interface) - (a->route.interface < b->route.interface);
+}
+
+/**
+ * @brief Copy the node at a depth of the trie with the changes under it applied.
+ *
+ * The changes end at the node (their prefix length is its depth) or below it, sorted as
+ * Compare_Changes does: the node's own first, then those of its left subtrie, then those of
+ * its right one. A subtrie no change reaches is kept as it is, shared by the old trie and the
+ * new one. A node left with no route and no children goes.
+ *
+ * @param walk    The state of the batch.
+ * @param entry   The node, NULL where the trie has none yet.
+ * @param depth   Its depth, the root's is 0.
+ * @param changes The changes ending at or under the node.
+ * @param count   Their number.
+ * @return The new node (the old one if nothing changed), or NULL for none.
+ */
+static ipv4_entry* Change_IPV4_Entry(change_walk *walk, ipv4_entry *entry, int depth,
+                                     const route_change *changes, int count) {
+    if (!count || walk->failed) return entry;
+
+    ipv4_entry node = {.type = depth ? 0 : -1, .interface = -1};
+    if (entry) node = *entry;
+
+    // The node's own changes, the last one wins.
+    int own = 0;
+    for (; own < count && __builtin_popcount(changes[own].route.mask) == depth; own++) {
+        const route *path = &changes[own].route;
+        ipv4_entry was = node;
+        bool had = node.type == 1;
+        if (changes[own].withdraw) {
+            node.type = depth ? 0 : -1;
+            node.next_hop = 0;
+            node.interface = -1;
+            node.prefix = 0;
+        } else {
+            node.type = 1;
+            node.next_hop = path->next_hop;
+            node.interface = path->interface;
+            node.prefix = path->prefix & path->mask;
+        }
+        walk->changed += memcmp(&was, &node, sizeof(node)) != 0;
+        walk->ip_table->size += (size_t)(node.type == 1) - (size_t)had;
+    }
+
+    // The others split on the bit after the node's prefix.
+    int split = own;
+    while (split < count && !(ntohl(changes[split].route.prefix) & (IPV4_TOP_BIT >> depth))) split++;
+    node.left = Change_IPV4_Entry(walk, node.left, depth + 1, changes + own, split - own);
+    node.right = Change_IPV4_Entry(walk, node.right, depth + 1, changes + split, count - split);
+    if (walk->failed) return entry;
+
+    if (entry && !memcmp(&node, entry, sizeof(node))) return entry;
+    if (entry) walk->ip_table->garbage++;
+    if (depth && node.type != 1 && !node.left && !node.right) {
+        if (entry) walk->ip_table->nodes--;
+        return NULL;
+    }
+
+    ipv4_entry *copy = (ipv4_entry*)Pool_Alloc(walk->pool);
+    if (!copy) {
+        walk->failed = true;
+        return entry;
+    }
+    *copy = node;
+    walk->allocated++;
+    if (!entry) walk->ip_table->nodes++;
+    return copy;
+}
+
+/**
+ * @brief Copy a batch of route changes into the trie, the lookups switch to it at once when it is published.
+ *
+ * The nodes are never changed in place: every node on the path of a change is copied with the
+ * change applied, once for the whole batch, and the rest of the trie is shared with the copy.
+ * Publish_IPV4_Routes then stores the new root with one release store, so a lookup walks either
+ * the trie as it was or the trie with every change, never a mix; Drop_IPV4_Routes forgets the
+ * copy instead, for a transaction that fails later. The nodes replaced (or dropped) stay in the
+ * pool for the lookups still walking them (ip_table->garbage), until Compact_IPV4_Table.
+ *
+ * An addition sets the single path of its prefix, replacing the route (and the group of a
+ * multipath route) it had; a withdrawal removes the prefix. The prefixes are at least 1 bit
+ * long, as those Insert_IPV4_Table takes. Changes of the same prefix apply
+ * in their order in the batch. Runs on the control thread only, one writer at a time, with
+ * one batch at most copied and not yet published or dropped per table.
+ *
+ * @param ip_table The IPv4 routing table, its counters those of the copy until it is dropped.
+ * @param pool     The pool of the copies: the table's, or its VRF set's.
+ * @param changes  The changes, sorted in place.
+ * @param count    The number of changes.
+ * @param change   Receives the copy, the nodes taken from the pool even on failure.
+ * @return False if memory allocation fails (nothing is left to publish or drop).
+ */
+bool Prepare_IPV4_Routes(ipv4_table *ip_table, huge_pool *pool, route_change *changes, int count,
+                         ipv4_change *change) {
+    *change = (ipv4_change){.root = atomic_load_explicit(&ip_table->root, memory_order_relaxed),
+                            .size = ip_table->size, .nodes = ip_table->nodes, .garbage = ip_table->garbage};
+    if (!count) return true;
+
+    // The interface of every change holds its index while sorting, for the changes of a prefix to keep their order.
+    int *interfaces = (int*)malloc(count * sizeof(int));
+    if (!interfaces) return false;
+    for (int idx = 0; idx < count; idx++) {
+        interfaces[idx] = changes[idx].route.interface;
+        changes[idx].route.interface = idx;
+    }
+    qsort(changes, count, sizeof(route_change), Compare_Changes);
+    for (int idx = 0; idx < count; idx++) changes[idx].route.interface = interfaces[changes[idx].route.interface];
+    free(interfaces);
+
+    change_walk walk = {.ip_table = ip_table, .pool = pool};
+    ipv4_entry *copy = Change_IPV4_Entry(&walk, change->root, 0, changes, count);
+    change->allocated = walk.allocated;
+    change->changed = walk.changed;
+
+    if (walk.failed) {
+        Drop_IPV4_Routes(ip_table, change);
+        return false;
+    }
+    change->root = copy;
+    return true;
+}
+
+/**
+ * @brief Publish a batch of route changes copied by Prepare_IPV4_Routes to the lookups.
+ *
+ * @param ip_table The IPv4 routing table.
+ * @param change   The copy.
+ */
+void Publish_IPV4_Routes(ipv4_table *ip_table, const ipv4_change *change) {
+    atomic_store_explicit(&ip_table->root, change->root, memory_order_release);
+}
+
+/**
+ * @brief Forget a batch of route changes copied by Prepare_IPV4_Routes, the table is left as it was.
+ *
+ * The copies were never seen, they are garbage with the replaced nodes.
+ *
+ * @param ip_table The IPv4 routing table.
+ * @param change   The copy.
+ */
+void Drop_IPV4_Routes(ipv4_table *ip_table, const ipv4_change *change) {
+    ip_table->size = change->size;
+    ip_table->nodes = change->nodes;
+    ip_table->garbage = change->garbage + change->allocated;
+}
+
+/**
+ * @brief Copy a subtrie into a pool.
+ *
+ * @param pool   The pool.
+ * @param entry  The root of the subtrie.
+ * @param failed Set if the pool runs out.
+ * @return The copy of the subtrie.
+ */
+static ipv4_entry* Copy_IPV4_Entry(huge_pool *pool, const ipv4_entry *entry, bool *failed) {
+    if (!entry || *failed) return NULL;
+
+    ipv4_entry *copy = (ipv4_entry*)Pool_Alloc(pool);
+    if (!copy) {
+        *failed = true;
+        return NULL;
+    }
+    *copy = *entry;
+    copy->left = Copy_IPV4_Entry(pool, entry->left, failed);
+    copy->right = Copy_IPV4_Entry(pool, entry->right, failed);
+    return copy;
+}
+
+/**
+ * @brief Copy the live nodes of a table into a new pool, the old one is returned to be freed.
+ *
+ * The replaced nodes of the changes go with the old pool, which the lookups may still be
+ * walking: the caller frees it once none can be (after a grace period). The new root is
+ * published as Publish_IPV4_Routes does. Only for a table with a pool of its own.
+ *
+ * @param ip_table The IPv4 routing table.
+ * @param failed   Set if memory allocation fails (the table is left as it was).
+ * @return The old pool, NULL on failure.
+ */
+huge_pool* Compact_IPV4_Table(ipv4_table *ip_table, bool *failed) {
+    *failed = false;
+    huge_pool *pool = Create_Huge_Pool(sizeof(ipv4_entry), HUGE_FIB);
+    if (!pool) {
+        *failed = true;
+        return NULL;
+    }
+    ipv4_entry *root = Copy_IPV4_Entry(pool, atomic_load_explicit(&ip_table->root, memory_order_relaxed), failed);
+    if (*failed) {
+        Free_Huge_Pool(&pool);
+        return NULL;
+    }
+
+    huge_pool *old = ip_table->pool;
+    ip_table->pool = pool;
+    ip_table->garbage = 0;
+    atomic_store_explicit(&ip_table->root, root, memory_order_release);
+    return old;
+}
+
+// Routes gathered by List_IPV4_Routes.
+typedef struct route_list {
+    route *routes;
+    int count;
+    int capacity;
+} route_list;
+
+/**
+ * @brief Append a route to a list, growing it as Read_IPV4_Routes does.
+ *
+ * @return False if memory allocation fails.
+ */
+static bool Append_IPV4_Route(route_list *list, uint32_t prefix, uint32_t mask, uint32_t next_hop, int interface) {
+    if (list->count == list->capacity) {
+        route *grown = (route*)realloc(list->routes, 2 * list->capacity * sizeof(route));
+        if (!grown) return false;
+        list->routes = grown;
+        list->capacity *= 2;
+    }
+    list->routes[list->count++] = (route){.prefix = prefix, .next_hop = next_hop, .mask = mask, .interface = interface};
+    return true;
+}
+
+/**
+ * @brief Gather the routes of a subtrie, in prefix order.
+ *
+ * @return False if memory allocation fails.
+ */
+static bool List_IPV4_Entry(const ipv4_table *ip_table, const ipv4_entry *entry, int depth, route_list *list) {
+    for (; entry; entry = entry->right, depth++) {
+        if (entry->type == 1) {
+            uint32_t mask = htonl((uint32_t)(~0ull << (32 - depth)));
+            if (entry->interface != NH_GROUP) {
+                if (!Append_IPV4_Route(list, entry->prefix, mask, entry->next_hop, entry->interface)) return false;
+            } else {
+                const nh_group *paths = &ip_table->groups->groups[entry->next_hop];
+                for (uint32_t member = 0; member < paths->size; member++) {
+                    if (!Append_IPV4_Route(list, entry->prefix, mask, paths->members[member].next_hop,
+                                           paths->members[member].interface)) return false;
+                }
+            }
+        }
+        if (!List_IPV4_Entry(ip_table, entry->left, depth + 1, list)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief List the routes of an IPv4 routing table, one per path: a multipath route is listed as
+ *        the lines of a routing table file that would load it.
+ *
+ * @param ip_table The IPv4 routing table, unchanged meanwhile.
+ * @param count    Set to the number of routes.
+ * @return The routes (to be freed by the caller), or NULL if memory allocation fails.
+ */
+route* List_IPV4_Routes(const ipv4_table *ip_table, int *count) {
+    route_list list = {.routes = (route*)malloc(1024 * sizeof(route)), .count = 0, .capacity = 1024};
+    if (!list.routes) return NULL;
+
+    if (!List_IPV4_Entry(ip_table, atomic_load_explicit(&ip_table->root, memory_order_acquire), 0, &list)) {
+        free(list.routes);
+        return NULL;
+    }
+    *count = list.count;
+    return list.routes;
+}
+
+/* ------------------------------------------------- CHANGE IPV4 TABLE --------------------------------------------------- */
 /* -------------------------------------------------  LPM IPV4 TABLE  ---------------------------------------------------- */
 
 /**
@@ -253,10 +722,11 @@ void Insert_IPV4_Table(ipv4_table *ip_table, route *new_entry) {
  *         or NULL if no match is found.
  */
 forward* LPM_IPV4_Table(ipv4_table *ip_table, uint32_t ip) {
-    if (!ip_table || !ip_table->root) return NULL;
+    if (!ip_table) return NULL;
 
     forward *lpm = NULL;
-    ipv4_entry *entry = ip_table->root;
+    ipv4_entry *entry = atomic_load_explicit(&ip_table->root, memory_order_acquire);
+    ip = ntohl(ip);
 
     while (entry) {
         if (entry->type == 1) {
@@ -269,8 +739,8 @@ forward* LPM_IPV4_Table(ipv4_table *ip_table, uint32_t ip) {
             lpm->interface = entry->interface;
         }
         // Determine the next child entry (left or right) based on the network bit.
-        entry = (ip & 1) ? entry->right : entry->left;
-        ip >>= 1;
+        entry = (ip & IPV4_TOP_BIT) ? entry->right : entry->left;
+        ip <<= 1;
     }
 
     // Return the Longest Prefix Match result.
@@ -278,3 +748,116 @@ forward* LPM_IPV4_Table(ipv4_table *ip_table, uint32_t ip) {
 }
 
 /* -------------------------------------------------  LPM IPV4 TABLE  ---------------------------------------------------- */
+/* ------------------------------------------------ LOOKUP IPV4 TABLE ---------------------------------------------------- */
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) without allocating the result.
+ * 
+ * @param ip_table A pointer to the IPv4 routing table to search.
+ * @param ip       The destination IP address to perform LPM on.
+ * @param lpm      The forward structure receiving the LPM result.
+ * @return True if a route matched, false otherwise (lpm->status is set accordingly).
+ */
+bool Lookup_IPV4_Table(ipv4_table *ip_table, uint32_t ip, forward *lpm) {
+    lpm->status = false;
+    if (!ip_table) return false;
+
+    ip = ntohl(ip);
+    // One load of the root: a change published meanwhile is seen whole or not at all.
+    for (ipv4_entry *entry = atomic_load_explicit(&ip_table->root, memory_order_acquire); entry; ip <<= 1) {
+        if (entry->type == 1) {
+            lpm->status = true;
+            lpm->next_hop = entry->next_hop;
+            lpm->interface = entry->interface;
+        }
+        // Determine the next child entry (left or right) based on the network bit.
+        entry = (ip & IPV4_TOP_BIT) ? entry->right : entry->left;
+    }
+
+    return lpm->status;
+}
+
+/**
+ * @brief Walk the tries of a vector of lookups, one level at a time for the whole vector.
+ * 
+ * Each walk prefetches its next node, so the cache misses of independent lookups overlap
+ * instead of serializing.
+ * 
+ * @param walks  The root each lookup starts at (NULL for none), then its current node.
+ * @param ips    The destination IP addresses.
+ * @param count  The number of addresses (at most MAX_BATCH).
+ * @param lpms   The forward structures receiving the LPM results.
+ */
+static void Walk_IPV4_Batch(ipv4_entry **walks, const uint32_t *ips, int count, forward *lpms) {
+    uint32_t keys[MAX_BATCH];
+    int active = 0;
+
+    for (int idx = 0; idx < count; idx++) {
+        lpms[idx].status = false;
+        keys[idx] = ntohl(ips[idx]);
+        if (walks[idx]) active++;
+    }
+
+    while (active) {
+        active = 0;
+        for (int idx = 0; idx < count; idx++) {
+            ipv4_entry *entry = walks[idx];
+            if (!entry) continue;
+
+            if (entry->type == 1) {
+                lpms[idx].status = true;
+                lpms[idx].next_hop = entry->next_hop;
+                lpms[idx].interface = entry->interface;
+            }
+            // Determine the next child entry (left or right) based on the network bit.
+            entry = (keys[idx] & IPV4_TOP_BIT) ? entry->right : entry->left;
+            keys[idx] <<= 1;
+
+            walks[idx] = entry;
+            if (entry) {
+                __builtin_prefetch(entry);
+                active++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) for a vector of addresses at once.
+ * 
+ * The walks advance one level at a time for the whole vector, prefetching the next node of
+ * each walk, so the cache misses of independent lookups overlap instead of serializing.
+ * 
+ * @param ip_table A pointer to the IPv4 routing table to search.
+ * @param ips      The destination IP addresses.
+ * @param count    The number of addresses (at most MAX_BATCH).
+ * @param lpms     The forward structures receiving the LPM results.
+ */
+void Lookup_IPV4_Batch(ipv4_table *ip_table, const uint32_t *ips, int count, forward *lpms) {
+    ipv4_entry *walks[MAX_BATCH];
+    if (count > MAX_BATCH) count = MAX_BATCH;
+    ipv4_entry *root = ip_table ? atomic_load_explicit(&ip_table->root, memory_order_acquire) : NULL;
+    for (int idx = 0; idx < count; idx++) walks[idx] = root;
+    Walk_IPV4_Batch(walks, ips, count, lpms);
+}
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) for a vector of addresses, each in its own table.
+ * 
+ * The lookups of the packets of different VRFs share the walks of one vector.
+ * 
+ * @param tables The IPv4 routing table of every address.
+ * @param ips    The destination IP addresses.
+ * @param count  The number of addresses (at most MAX_BATCH).
+ * @param lpms   The forward structures receiving the LPM results.
+ */
+void Lookup_IPV4_Tables(ipv4_table *const *tables, const uint32_t *ips, int count, forward *lpms) {
+    ipv4_entry *walks[MAX_BATCH];
+    if (count > MAX_BATCH) count = MAX_BATCH;
+    for (int idx = 0; idx < count; idx++) {
+        walks[idx] = tables[idx] ? atomic_load_explicit(&tables[idx]->root, memory_order_acquire) : NULL;
+    }
+    Walk_IPV4_Batch(walks, ips, count, lpms);
+}
+
+/* ------------------------------------------------ LOOKUP IPV4 TABLE ---------------------------------------------------- */
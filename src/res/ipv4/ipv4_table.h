@@ -9,10 +9,12 @@
 #include <string.h>
 #include <stdbool.h>
 
-#define MAX_LINE_SIZE 64
-#define MAX_LINES 100001
+#include "../../utils/hugepage.h"
+#include "./nexthop.h"
 
-// ROUTES ARE STATIC ALLOCATED!
+#define MAX_LINE_SIZE 64
+#define MAX_BATCH 256
+#define IPV4_TOP_BIT 0x80000000u
 
 // Routing entry in an IPv4 routing table.
 typedef struct route {
@@ -22,39 +24,86 @@ typedef struct route {
     int interface;              // Interface index.
 } route;
 
-// Forwarding entry in an IPv4 routing table.
+// Forwarding entry in an IPv4 routing table, a multipath route until a path of its group is picked.
 typedef struct forward {
-    uint32_t next_hop;          // Next Hop IP address.
-    int interface;              // Interface index.
+    uint32_t next_hop;          // Next Hop IP address, the index of the group for NH_GROUP.
+    int interface;              // Interface index, or NH_GROUP.
     bool status;                // Status flag (INVALID / VALID).
 } forward;
 
 // Entry in an IPv4 routing table.
 typedef struct ipv4_entry {
-    uint32_t next_hop;          // Next Hop IP address.
+    uint32_t next_hop;          // Next Hop IP address, the index of the group for NH_GROUP.
     int type;                   // Type falg (INVALID -1 / EMPTY 0 / VALID 1)
-    int interface;              // Interface index.
+    int interface;              // Interface index, or NH_GROUP for a multipath route.
+    uint32_t prefix;            // Prefix as the table wrote it, only its repeated lines add paths.
     struct ipv4_entry *left;    // Left child entry.
     struct ipv4_entry *right;   // Right child entry.
 } ipv4_entry;
 
+// A change of one prefix of a routing table, as the control socket applies them.
+typedef struct route_change {
+    route route;                // The prefix and mask, and the path of an addition.
+    bool withdraw;              // Remove the prefix instead of setting its path.
+} route_change;
+
+// A batch of route changes copied into a table's trie, the lookups do not walk it until it is published.
+typedef struct ipv4_change {
+    ipv4_entry *root;           // Root of the trie with the changes.
+    size_t size;                // Counters of the table before the changes, restored if they are dropped.
+    size_t nodes;
+    size_t garbage;
+    size_t allocated;           // Nodes taken from the pool.
+    int changed;                // Changes that altered a route.
+} ipv4_change;
+
 // An IPv4 routing table.
 typedef struct ipv4_table {
-    ipv4_entry *root;           // Root entry of the routing table.
-    size_t size;                // Number of entries in the routing table.
+    _Atomic(ipv4_entry *) root; // Root entry of the routing table, replaced whole by Publish_IPV4_Routes.
+    size_t size;                // Number of prefixes in the routing table.
+    size_t nodes;               // Number of trie nodes, the root included.
+    size_t garbage;             // Nodes replaced by changes, in the pool until it is compacted.
+    size_t dropped;             // Paths left out, their group or the table of groups was full.
+    huge_pool *pool;            // Memory of the trie nodes, on 2 MB pages when the host has them; NULL in a VRF set.
+    nh_table *groups;           // Next hops of the multipath routes, those of every table in a VRF set.
 } ipv4_table;
 
 /** @brief Create an empty IPv4 routing table. */
 ipv4_table*     CreateEmpty_IPV4_Table          (void);
+/** @brief Read IPv4 routing entries from a file into an array of route structures. */
+route*          Read_IPV4_Routes                (char *file, int *count);
+/** @brief Build an IPv4 routing table from an array of routes. */
+ipv4_table*     Build_IPV4_Table                (const route *routes, int count);
 /** @brief Create an IPv4 routing table from a file containing routing entries. */
 ipv4_table*     Create_IPV4_Table               (char *file);
 
 /** @brief Free the memory associated with an IPv4 routing table. */
 void            Free_IPV4_Table                 (ipv4_table **ip_table);
+/** @brief Bytes of memory taken by an IPv4 routing table. */
+size_t          Size_IPV4_Table                 (const ipv4_table *ip_table);
 /** @brief Insert a new IPv4 routing table entry into an IPv4 routing table. */
 void            Insert_IPV4_Table               (ipv4_table *ip_table, route *new_entry);
+/** @brief Replace the paths of the multipath routes with those of a new set of routes. */
+int             Update_IPV4_Paths               (ipv4_table *ip_table, const route *routes, int count, int *skipped);
+/** @brief Copy a batch of route changes into the trie, the lookups switch to it at once when it is published. */
+bool            Prepare_IPV4_Routes             (ipv4_table *ip_table, huge_pool *pool, route_change *changes,
+                                                 int count, ipv4_change *change);
+/** @brief Publish a batch of route changes copied by Prepare_IPV4_Routes to the lookups. */
+void            Publish_IPV4_Routes             (ipv4_table *ip_table, const ipv4_change *change);
+/** @brief Forget a batch of route changes copied by Prepare_IPV4_Routes, the table is left as it was. */
+void            Drop_IPV4_Routes                (ipv4_table *ip_table, const ipv4_change *change);
+/** @brief Copy the live nodes of a table into a new pool, the old one is returned to be freed. */
+huge_pool*      Compact_IPV4_Table              (ipv4_table *ip_table, bool *failed);
+/** @brief List the routes of an IPv4 routing table, one per path. */
+route*          List_IPV4_Routes                (const ipv4_table *ip_table, int *count);
 
 /** @brief Perform Longest Prefix Match (LPM) in an IPv4 routing table. */
 forward*        LPM_IPV4_Table                  (ipv4_table *ip_table, uint32_t ip);
+/** @brief Perform Longest Prefix Match (LPM) without allocating the result. */
+bool            Lookup_IPV4_Table               (ipv4_table *ip_table, uint32_t ip, forward *lpm);
+/** @brief Perform Longest Prefix Match (LPM) for a vector of addresses at once. */
+void            Lookup_IPV4_Batch               (ipv4_table *ip_table, const uint32_t *ips, int count, forward *lpms);
+/** @brief Perform Longest Prefix Match (LPM) for a vector of addresses, each in its own table. */
+void            Lookup_IPV4_Tables              (ipv4_table *const *tables, const uint32_t *ips, int count, forward *lpms);
 
 #endif /* IPV4_TABLE_H_ */
@@ -0,0 +1,152 @@
+#include "./nexthop.h"
+
+#include <arpa/inet.h>
+
+/* ------------------------------------------------- CREATE NH TABLE ------------------------------------------------- */
+
+/**
+ * @brief Create an empty table of next-hop groups.
+ *
+ * @return A pointer to the new table or NULL if memory allocation fails.
+ */
+nh_table* Create_NH_Table(void) {
+    nh_table *table = (nh_table*)calloc(1, sizeof(nh_table));
+    if (!table) return NULL;
+
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+/**
+ * @brief Free a table of next-hop groups.
+ *
+ * @param table A pointer to the table pointer to be freed.
+ */
+void Free_NH_Table(nh_table **table) {
+    if (!table || !(*table)) return;
+    free((*table)->groups);
+    pthread_mutex_destroy(&(*table)->lock);
+    free(*table);
+    *table = NULL;
+}
+
+/* ------------------------------------------------- CREATE NH TABLE ------------------------------------------------- */
+/* -------------------------------------------------- BUILD NH GROUPS ------------------------------------------------ */
+
+/**
+ * @brief Add a group of paths to a table.
+ *
+ * The groups grow while the routing table is built, before any worker looks them up.
+ *
+ * @param table   The table.
+ * @param members The paths.
+ * @param count   The number of paths, 1 to NH_GROUP_SIZE.
+ * @return The index of the new group, or -1 if the table is full or memory allocation fails.
+ */
+int Add_NH_Group(nh_table *table, const nh_member *members, int count) {
+    if (!table || count < 1 || count > NH_GROUP_SIZE || table->count == NH_MAX_GROUPS) return -1;
+
+    if (table->count == table->capacity) {
+        uint32_t capacity = table->capacity ? 2 * table->capacity : 16;
+        nh_group *grown = (nh_group*)realloc(table->groups, capacity * sizeof(nh_group));
+        if (!grown) return -1;
+        table->groups = grown;
+        table->capacity = capacity;
+    }
+
+    nh_group *group = &table->groups[table->count];
+    memset(group, 0, sizeof(*group));
+    group->size = (uint32_t)count;
+    memcpy(group->members, members, count * sizeof(nh_member));
+    return (int)table->count++;
+}
+
+/**
+ * @brief Add a path to a group, while no worker uses the table.
+ *
+ * @param table  The table.
+ * @param group  The index of the group.
+ * @param member The path.
+ * @return True if the group has the path (it was added or already there), false if the group is full.
+ */
+bool Add_NH_Member(nh_table *table, uint32_t group, const nh_member *member) {
+    if (!table || group >= table->count) return false;
+    nh_group *paths = &table->groups[group];
+
+    for (uint32_t idx = 0; idx < paths->size; idx++) {
+        if (paths->members[idx].next_hop == member->next_hop &&
+            paths->members[idx].interface == member->interface) return true;
+    }
+    if (paths->size == NH_GROUP_SIZE) return false;
+
+    paths->members[paths->size++] = *member;
+    return true;
+}
+
+/* -------------------------------------------------- BUILD NH GROUPS ------------------------------------------------ */
+/* ------------------------------------------------- UPDATE NH GROUPS ------------------------------------------------ */
+
+/**
+ * @brief Replace the paths of a group, while the workers use it.
+ *
+ * The sequence count is odd while the members are rewritten, the lookups that overlap the
+ * update see it move and read the group again. The flows of the paths that stay may move
+ * between them, as the hash is scaled to the new size.
+ *
+ * @param table   The table.
+ * @param group   The index of the group.
+ * @param members The new paths.
+ * @param count   The number of paths, 1 to NH_GROUP_SIZE.
+ * @return False if the group does not exist or the number of paths is out of range.
+ */
+bool Update_NH_Group(nh_table *table, uint32_t group, const nh_member *members, int count) {
+    if (!table || group >= table->count || count < 1 || count > NH_GROUP_SIZE) return false;
+    nh_group *paths = &table->groups[group];
+
+    pthread_mutex_lock(&table->lock);
+    uint32_t seq = atomic_load_explicit(&paths->seq, memory_order_relaxed);
+    atomic_store_explicit(&paths->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    paths->size = (uint32_t)count;
+    memcpy(paths->members, members, count * sizeof(nh_member));
+
+    atomic_store_explicit(&paths->seq, seq + 2, memory_order_release);
+    pthread_mutex_unlock(&table->lock);
+    return true;
+}
+
+/* ------------------------------------------------- UPDATE NH GROUPS ------------------------------------------------ */
+
+/**
+ * @brief Print the packets sent through every path of every group, summed over the workers.
+ *
+ * The counters belong to the positions in the group: a path keeps its count when the group
+ * is updated only if it keeps its position.
+ *
+ * @param out      The output stream.
+ * @param groups   The groups.
+ * @param count    The number of groups.
+ * @param counters The counters of every worker.
+ * @param workers  The number of workers.
+ */
+void Dump_NH_Groups(FILE *out, const nh_group *groups, uint32_t count, nh_counters *const *counters, int workers) {
+    for (uint32_t group = 0; group < count && group < NH_MAX_GROUPS; group++) {
+        uint64_t packets[NH_GROUP_SIZE] = {0}, total = 0;
+        for (uint32_t member = 0; member < groups[group].size; member++) {
+            for (int worker = 0; worker < workers; worker++) {
+                packets[member] += COUNTER_GET(counters[worker]->packets[group][member]);
+            }
+            total += packets[member];
+        }
+
+        fprintf(out, "ecmp group %u:", group);
+        for (uint32_t member = 0; member < groups[group].size; member++) {
+            char hop[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &groups[group].members[member].next_hop, hop, sizeof(hop));
+            fprintf(out, " %s/%d %llu (%.1f%%)", hop, groups[group].members[member].interface,
+                    (unsigned long long)packets[member], total ? 100.0 * packets[member] / total : 0.0);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef NEXTHOP_H_
+#define NEXTHOP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "../../utils/lib.h"
+
+#define NH_GROUP        (INT32_MIN + 1)     // Interface of a multipath route, its next hop is the index of its group.
+#define NH_GROUP_SIZE   8                   // Paths of a group at most.
+#define NH_MAX_GROUPS   1024                // Groups of a table at most, every worker counts the packets of each path.
+
+// One path of a multipath route.
+typedef struct nh_member {
+    uint32_t next_hop;          // Next Hop IP address.
+    int32_t interface;          // Interface index.
+} nh_member;
+
+// Next hops of a multipath route. The members change in place, under a sequence count the
+// lookups check instead of locking: an odd or moved count means they raced with an update.
+typedef struct nh_group {
+    _Atomic uint32_t seq;       // Even when stable, bumped before and after every update.
+    uint32_t size;              // Members in use, 1 to NH_GROUP_SIZE.
+    nh_member members[NH_GROUP_SIZE];
+} nh_group;
+
+// Next-hop groups of a routing table, shared by its multipath routes.
+typedef struct nh_table {
+    nh_group *groups;           // Groups, never moved once the workers run.
+    uint32_t count;             // Groups in use.
+    uint32_t capacity;          // Groups allocated.
+    pthread_mutex_t lock;       // Serializes the updates, lookups never take it.
+} nh_table;
+
+// Packets a worker sent through every path, written by that worker only.
+typedef struct nh_counters {
+    counter packets[NH_MAX_GROUPS][NH_GROUP_SIZE];
+} nh_counters;
+
+/**
+ * @brief Pick the path of a flow in a group, the same one for all the packets of the flow.
+ *
+ * The hash is scaled to the group's size (multiply and shift, no division).
+ *
+ * @param group The group.
+ * @param hash  The hash of the packet's flow.
+ * @param path  Receives the path.
+ * @return The index of the path in the group.
+ */
+static inline int Select_NH_Member(const nh_group *group, uint32_t hash, nh_member *path) {
+    uint32_t seq, member;
+    do {
+        seq = atomic_load_explicit(&group->seq, memory_order_acquire);
+        // The size is at most NH_GROUP_SIZE even mid-update, so the index stays in the group.
+        member = (uint32_t)(((uint64_t)hash * group->size) >> 32);
+        *path = group->members[member];
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&group->seq, memory_order_relaxed));
+    return (int)member;
+}
+
+/** @brief Create an empty table of next-hop groups. */
+nh_table*       Create_NH_Table         (void);
+/** @brief Free a table of next-hop groups. */
+void            Free_NH_Table           (nh_table **table);
+
+/** @brief Add a group of paths to a table. */
+int             Add_NH_Group            (nh_table *table, const nh_member *members, int count);
+/** @brief Add a path to a group, while no worker uses the table. */
+bool            Add_NH_Member           (nh_table *table, uint32_t group, const nh_member *member);
+/** @brief Replace the paths of a group, while the workers use it. */
+bool            Update_NH_Group         (nh_table *table, uint32_t group, const nh_member *members, int count);
+
+/** @brief Print the packets sent through every path of every group, summed over the workers. */
+void            Dump_NH_Groups          (FILE *out, const nh_group *groups, uint32_t count,
+                                         nh_counters *const *counters, int workers);
+
+#endif /* NEXTHOP_H_ */
@@ -0,0 +1,469 @@
+#define _GNU_SOURCE
+
+#include "./shared_fib.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAP_RETRIES 8                   // Generations a reader chases before giving up for now.
+
+/* ----------------------------------------------------- FIB IMAGE ----------------------------------------------------- */
+
+/**
+ * @brief Bytes of the image of an IPv4 routing table.
+ *
+ * @param ip_table The IPv4 routing table.
+ * @return The size of its image, header included.
+ */
+size_t Size_FIB_Image(const ipv4_table *ip_table) {
+    return sizeof(fib_image) + ip_table->nodes * sizeof(fib_node) + ip_table->groups->count * sizeof(nh_group);
+}
+
+/**
+ * @brief Copy a subtrie into an image, depth first.
+ *
+ * A node's children land after it, so every child index is greater than its parent's.
+ *
+ * @param entry The root of the subtrie.
+ * @param nodes The nodes of the image.
+ * @param next  The index of the next free node, advanced.
+ * @return The index of the subtrie's root.
+ */
+static uint32_t Write_FIB_Node(const ipv4_entry *entry, fib_node *nodes, uint32_t *next) {
+    uint32_t index = (*next)++;
+    nodes[index].next_hop = entry->next_hop;
+    nodes[index].interface = entry->type == 1 ? entry->interface : FIB_NO_ROUTE;
+    nodes[index].child[0] = entry->left ? Write_FIB_Node(entry->left, nodes, next) : 0;
+    nodes[index].child[1] = entry->right ? Write_FIB_Node(entry->right, nodes, next) : 0;
+    return index;
+}
+
+/**
+ * @brief Write the image of an IPv4 routing table.
+ *
+ * @param ip_table   The IPv4 routing table.
+ * @param image      The Size_FIB_Image bytes receiving the image.
+ * @param generation The generation the image is published as.
+ */
+void Write_FIB_Image(const ipv4_table *ip_table, fib_image *image, uint64_t generation) {
+    uint32_t next = 0;
+    Write_FIB_Node(ip_table->root, image->nodes, &next);
+
+    image->layout = FIB_LAYOUT;
+    image->generation = generation;
+    image->size = Size_FIB_Image(ip_table);
+    image->routes = (uint32_t)ip_table->size;
+    image->count = next;
+    image->groups = ip_table->groups->count;
+    image->reserved = 0;
+
+    // The groups follow the nodes, their sequence counts stay even: an image never changes.
+    nh_group *groups = (nh_group *)(image->nodes + next);
+    memcpy(groups, ip_table->groups->groups, image->groups * sizeof(nh_group));
+    for (uint32_t group = 0; group < image->groups; group++) atomic_init(&groups[group].seq, 0);
+    image->magic = FIB_MAGIC;
+}
+
+/**
+ * @brief Check an image before looking anything up in it.
+ *
+ * Every child must come after its parent and inside the image, so no walk can loop or stray,
+ * and every multipath route must name a group of the image with 1 to NH_GROUP_SIZE paths.
+ *
+ * @param image      The image.
+ * @param size       The bytes mapped.
+ * @param generation The generation it was published as.
+ * @return True if the image can be used.
+ */
+static bool Check_FIB_Image(const fib_image *image, size_t size, uint64_t generation) {
+    if (size < sizeof(fib_image) || image->magic != FIB_MAGIC || image->layout != FIB_LAYOUT ||
+        image->generation != generation || image->size != size || !image->count ||
+        image->groups > NH_MAX_GROUPS ||
+        size != sizeof(fib_image) + (uint64_t)image->count * sizeof(fib_node) + image->groups * sizeof(nh_group)) {
+        return false;
+    }
+
+    for (uint32_t index = 0; index < image->count; index++) {
+        for (int bit = 0; bit < 2; bit++) {
+            uint32_t child = image->nodes[index].child[bit];
+            if (child && (child <= index || child >= image->count)) return false;
+        }
+        if (image->nodes[index].interface == NH_GROUP && image->nodes[index].next_hop >= image->groups) return false;
+    }
+
+    const nh_group *groups = FIB_Groups(image);
+    for (uint32_t group = 0; group < image->groups; group++) {
+        if (!groups[group].size || groups[group].size > NH_GROUP_SIZE) return false;
+    }
+    return true;
+}
+
+/* ----------------------------------------------------- FIB IMAGE ----------------------------------------------------- */
+/* ----------------------------------------------------- PUBLISH FIB --------------------------------------------------- */
+
+/**
+ * @brief Name the header object of a FIB, or one of its images.
+ *
+ * @param buf        The buffer receiving the name.
+ * @param len        Its size.
+ * @param name       The FIB's name.
+ * @param generation The image's generation, 0 for the header.
+ * @return False if the FIB's name is empty, too long or holds a '/'.
+ */
+static bool FIB_Object(char *buf, size_t len, const char *name, uint64_t generation) {
+    if (!*name || strchr(name, '/') || strlen(name) >= FIB_NAME_LEN) return false;
+
+    if (generation) snprintf(buf, len, FIB_PREFIX "%s.%llu", name, (unsigned long long)generation);
+    else snprintf(buf, len, FIB_PREFIX "%s", name);
+    return true;
+}
+
+/**
+ * @brief Open the header object of a FIB for writing, creating it if needed, and lock it.
+ *
+ * The lock serializes the loaders, the readers never take it.
+ *
+ * @param name The FIB's name.
+ * @param fd   Receives the locked descriptor.
+ * @return The header mapped read-write, NULL (with errno) on failure.
+ */
+static fib_header* Lock_FIB_Header(const char *name, int *fd) {
+    char object[FIB_NAME_LEN + 32];
+    if (!FIB_Object(object, sizeof(object), name, 0)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    *fd = shm_open(object, O_CREAT | O_RDWR, 0644);
+    if (*fd < 0) return NULL;
+
+    fib_header *header = MAP_FAILED;
+    if (flock(*fd, LOCK_EX) == 0 && ftruncate(*fd, sizeof(fib_header)) == 0) {
+        header = mmap(NULL, sizeof(fib_header), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    }
+    if (header == MAP_FAILED) {
+        close(*fd);
+        return NULL;
+    }
+
+    // A new header starts zeroed, at generation 0.
+    if (atomic_load_explicit(&header->magic, memory_order_acquire) != FIB_MAGIC) {
+        header->layout = FIB_LAYOUT;
+        atomic_store_explicit(&header->magic, FIB_MAGIC, memory_order_release);
+    }
+    return header;
+}
+
+/**
+ * @brief Unmap and unlock the header object of a FIB.
+ *
+ * @param header The header.
+ * @param fd     Its locked descriptor.
+ */
+static void Unlock_FIB_Header(fib_header *header, int fd) {
+    munmap(header, sizeof(fib_header));
+    close(fd);
+}
+
+/**
+ * @brief Publish an IPv4 routing table as the next generation of a shared FIB.
+ *
+ * The image is written in full into a new object, then the header's generation moves to it.
+ * The previous image loses its name only: the readers still looking up in it keep it mapped
+ * until they switch.
+ *
+ * @param name       The FIB's name.
+ * @param ip_table   The IPv4 routing table.
+ * @param generation Receives the generation published, may be NULL.
+ * @return 0, or -1 (with errno) on failure.
+ */
+int Publish_Shared_FIB(const char *name, const ipv4_table *ip_table, uint64_t *generation) {
+    int header_fd;
+    fib_header *header = Lock_FIB_Header(name, &header_fd);
+    if (!header) return -1;
+
+    uint64_t current = atomic_load_explicit(&header->generation, memory_order_relaxed);
+    uint64_t next = current + 1;
+    char object[FIB_NAME_LEN + 32];
+    FIB_Object(object, sizeof(object), name, next);
+
+    // A loader that died before publishing may have left the object behind.
+    shm_unlink(object);
+    int fd = shm_open(object, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        Unlock_FIB_Header(header, header_fd);
+        return -1;
+    }
+
+    size_t size = Size_FIB_Image(ip_table);
+    fib_image *image = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (image == MAP_FAILED) {
+        int saved = errno;
+        shm_unlink(object);
+        Unlock_FIB_Header(header, header_fd);
+        errno = saved;
+        return -1;
+    }
+
+    Write_FIB_Image(ip_table, image, next);
+    munmap(image, size);
+
+    // The image is complete before any reader can see its generation.
+    atomic_store_explicit(&header->generation, next, memory_order_release);
+    if (current) {
+        FIB_Object(object, sizeof(object), name, current);
+        shm_unlink(object);
+    }
+
+    Unlock_FIB_Header(header, header_fd);
+    if (generation) *generation = next;
+    return 0;
+}
+
+/**
+ * @brief Remove a shared FIB: its current image and its header lose their names.
+ *
+ * The routers using it keep looking up in their image.
+ *
+ * @param name The FIB's name.
+ * @return 0, or -1 (with errno) on failure.
+ */
+int Remove_Shared_FIB(const char *name) {
+    int header_fd;
+    fib_header *header = Lock_FIB_Header(name, &header_fd);
+    if (!header) return -1;
+
+    char object[FIB_NAME_LEN + 32];
+    uint64_t current = atomic_load_explicit(&header->generation, memory_order_relaxed);
+    if (current) {
+        FIB_Object(object, sizeof(object), name, current);
+        shm_unlink(object);
+    }
+    FIB_Object(object, sizeof(object), name, 0);
+    shm_unlink(object);
+
+    Unlock_FIB_Header(header, header_fd);
+    return 0;
+}
+
+/* ----------------------------------------------------- PUBLISH FIB --------------------------------------------------- */
+/* ------------------------------------------------------ READ FIB ----------------------------------------------------- */
+
+/**
+ * @brief Map an image of a FIB read-only and check it.
+ *
+ * The pages are populated up front, so the first lookups do not fault.
+ *
+ * @param name       The FIB's name.
+ * @param generation The image's generation.
+ * @return The image, NULL if it is gone (a newer one replaced it) or invalid.
+ */
+static const fib_image* Map_FIB_Image(const char *name, uint64_t generation) {
+    char object[FIB_NAME_LEN + 32];
+    if (!FIB_Object(object, sizeof(object), name, generation)) return NULL;
+
+    int fd = shm_open(object, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    const fib_image *image = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(fib_image)) {
+        image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    }
+    close(fd);
+    if (image == MAP_FAILED) return NULL;
+
+    if (!Check_FIB_Image(image, (size_t)st.st_size, generation)) {
+        munmap((void *)(uintptr_t)image, (size_t)st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * @brief Map the current image of a shared FIB, chasing the generations published meanwhile.
+ *
+ * @param fib The reader, its image and generation are set on success.
+ * @return True if an image newer than the reader's is mapped.
+ */
+static bool Map_Current_Image(shared_fib *fib) {
+    for (int retry = 0; retry < MAP_RETRIES; retry++) {
+        uint64_t generation = atomic_load_explicit(&fib->header->generation, memory_order_acquire);
+        if (!generation || generation == fib->generation) return false;
+
+        const fib_image *image = Map_FIB_Image(fib->name, generation);
+        if (image) {
+            if (fib->image) munmap((void *)(uintptr_t)fib->image, fib->image->size);
+            fib->image = image;
+            fib->generation = generation;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Map the header and the current image of a shared FIB read-only.
+ *
+ * @param name The FIB's name.
+ * @return The reader, or NULL (with errno) if the FIB does not exist or has no valid image.
+ */
+shared_fib* Open_Shared_FIB(const char *name) {
+    char object[FIB_NAME_LEN + 32];
+    if (!FIB_Object(object, sizeof(object), name, 0)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    shared_fib *fib = (shared_fib*)calloc(1, sizeof(shared_fib));
+    if (!fib) return NULL;
+    snprintf(fib->name, sizeof(fib->name), "%s", name);
+
+    int fd = shm_open(object, O_RDONLY, 0);
+    if (fd < 0) {
+        free(fib);
+        return NULL;
+    }
+
+    struct stat st;
+    const fib_header *header = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(fib_header)) {
+        header = mmap(NULL, sizeof(fib_header), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (header == MAP_FAILED) {
+        free(fib);
+        return NULL;
+    }
+    fib->header = header;
+
+    if (atomic_load_explicit(&header->magic, memory_order_acquire) != FIB_MAGIC ||
+        header->layout != FIB_LAYOUT || !Map_Current_Image(fib)) {
+        Close_Shared_FIB(&fib);
+        errno = ENOENT;
+        return NULL;
+    }
+    return fib;
+}
+
+/**
+ * @brief Switch to the current image of a shared FIB if a new one was published.
+ *
+ * One atomic load when nothing changed, the workers call it once per vector.
+ * If the new image cannot be mapped, the reader keeps the one it has and tries again next time.
+ *
+ * @param fib The reader.
+ * @return True if the reader switched images (the cached routes are stale).
+ */
+bool Refresh_Shared_FIB(shared_fib *fib) {
+    if (atomic_load_explicit(&fib->header->generation, memory_order_relaxed) == fib->generation) return false;
+    return Map_Current_Image(fib);
+}
+
+/**
+ * @brief Unmap a shared FIB.
+ *
+ * @param fib A pointer to the reader pointer to be freed.
+ */
+void Close_Shared_FIB(shared_fib **fib) {
+    if (!fib || !(*fib)) return;
+    if ((*fib)->image) munmap((void *)(uintptr_t)(*fib)->image, (*fib)->image->size);
+    if ((*fib)->header) munmap((void *)(uintptr_t)(*fib)->header, sizeof(fib_header));
+    free(*fib);
+    *fib = NULL;
+}
+
+/* ------------------------------------------------------ READ FIB ----------------------------------------------------- */
+/* ----------------------------------------------------- LOOKUP FIB ---------------------------------------------------- */
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) in an image.
+ *
+ * @param image The image.
+ * @param ip    The destination IP address to perform LPM on.
+ * @param lpm   The forward structure receiving the LPM result.
+ * @return True if a route matched, false otherwise (lpm->status is set accordingly).
+ */
+bool Lookup_FIB_Image(const fib_image *image, uint32_t ip, forward *lpm) {
+    lpm->status = false;
+    if (!image) return false;
+
+    const fib_node *nodes = image->nodes;
+    ip = ntohl(ip);
+    uint32_t index = 0;
+    do {
+        const fib_node *node = &nodes[index];
+        if (node->interface != FIB_NO_ROUTE) {
+            lpm->status = true;
+            lpm->next_hop = node->next_hop;
+            lpm->interface = node->interface;
+        }
+        // Determine the next child (0 / 1) based on the network bit.
+        index = node->child[ip >> 31];
+        ip <<= 1;
+    } while (index);
+
+    return lpm->status;
+}
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) in an image for a vector of addresses at once.
+ *
+ * The walks advance one level at a time for the whole vector, prefetching the next node of
+ * each walk, as Lookup_IPV4_Batch does.
+ *
+ * @param image The image.
+ * @param ips   The destination IP addresses.
+ * @param count The number of addresses (at most MAX_BATCH).
+ * @param lpms  The forward structures receiving the LPM results.
+ */
+void Lookup_FIB_Batch(const fib_image *image, const uint32_t *ips, int count, forward *lpms) {
+    uint32_t walks[MAX_BATCH];
+    uint32_t keys[MAX_BATCH];
+    bool live[MAX_BATCH];
+    int active = 0;
+
+    for (int idx = 0; idx < count; idx++) {
+        lpms[idx].status = false;
+        live[idx] = image && idx < MAX_BATCH;
+        walks[idx] = 0;
+        keys[idx] = ntohl(ips[idx]);
+        if (live[idx]) active++;
+    }
+
+    while (active) {
+        active = 0;
+        for (int idx = 0; idx < count; idx++) {
+            if (!live[idx]) continue;
+
+            const fib_node *node = &image->nodes[walks[idx]];
+            if (node->interface != FIB_NO_ROUTE) {
+                lpms[idx].status = true;
+                lpms[idx].next_hop = node->next_hop;
+                lpms[idx].interface = node->interface;
+            }
+            // Determine the next child (0 / 1) based on the network bit.
+            walks[idx] = node->child[keys[idx] >> 31];
+            keys[idx] <<= 1;
+
+            live[idx] = walks[idx] != 0;
+            if (live[idx]) {
+                __builtin_prefetch(&image->nodes[walks[idx]]);
+                active++;
+            }
+        }
+    }
+}
+
+/* ----------------------------------------------------- LOOKUP FIB ---------------------------------------------------- */
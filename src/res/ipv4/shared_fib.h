@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef SHARED_FIB_H_
+#define SHARED_FIB_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "./ipv4_table.h"
+
+// A FIB built once by a loader (fibload) and looked up in place by every router of the host.
+// Each version is an immutable image in its own shared memory object, /dev/shm/fib-<name>.<generation>,
+// and a small header object, /dev/shm/fib-<name>, tells which generation is current. Readers map both
+// read-only and switch to a new image when the generation changes, without locks: the loader only
+// removes the name of the image it replaced, the readers still using it unmap it when they switch.
+
+#define FIB_MAGIC       0x46494231u     // "FIB1", written last once the header is complete.
+#define FIB_LAYOUT      2               // Version of the image layout.
+#define FIB_PREFIX      "/fib-"         // Objects: the prefix followed by the FIB's name.
+#define FIB_NAME_LEN    64
+#define FIB_NO_ROUTE    INT32_MIN       // Interface of the nodes no route ends at.
+
+// Trie node of an image. The children are node indexes, not pointers, so the image means the same
+// at any address; index 0 is the root, which is nobody's child, so 0 also stands for no child.
+typedef struct fib_node {
+    uint32_t next_hop;                  // Next Hop IP address, the index of the group for NH_GROUP.
+    int32_t interface;                  // Interface index, NH_GROUP, or FIB_NO_ROUTE if no route ends here.
+    uint32_t child[2];                  // Children for a 0 / 1 bit, 0 for none.
+} fib_node;
+
+// Image of one generation of the FIB, immutable once published.
+typedef struct fib_image {
+    uint32_t magic;
+    uint32_t layout;
+    uint64_t generation;
+    uint64_t size;                      // Bytes of the image, header included.
+    uint32_t routes;                    // Routes installed.
+    uint32_t count;                     // Trie nodes.
+    uint32_t groups;                    // Next-hop groups, after the nodes.
+    uint32_t reserved;
+    fib_node nodes[];                   // Depth-first, nodes[0] the root.
+} fib_image;
+
+/** @brief Next-hop groups of an image, after its nodes. Changing them takes a new generation. */
+static inline const nh_group* FIB_Groups(const fib_image *image) {
+    return (const nh_group *)(image->nodes + image->count);
+}
+
+// Header object, the only part of the FIB that changes.
+typedef struct fib_header {
+    _Atomic uint32_t magic;
+    uint32_t layout;
+    _Atomic uint64_t generation;        // Current image, 0 before the first one.
+} fib_header;
+
+// A reader's view of a shared FIB: the header and the image of one generation.
+typedef struct shared_fib {
+    const fib_header *header;
+    const fib_image *image;
+    uint64_t generation;                // Generation of `image`.
+    char name[FIB_NAME_LEN];
+} shared_fib;
+
+/** @brief Bytes of the image of an IPv4 routing table. */
+size_t          Size_FIB_Image              (const ipv4_table *ip_table);
+/** @brief Write the image of an IPv4 routing table into Size_FIB_Image bytes. */
+void            Write_FIB_Image             (const ipv4_table *ip_table, fib_image *image, uint64_t generation);
+
+/** @brief Publish an IPv4 routing table as the next generation of a shared FIB. */
+int             Publish_Shared_FIB          (const char *name, const ipv4_table *ip_table, uint64_t *generation);
+/** @brief Remove a shared FIB, the routers using it keep their image. */
+int             Remove_Shared_FIB           (const char *name);
+
+/** @brief Map the current image of a shared FIB read-only. */
+shared_fib*     Open_Shared_FIB             (const char *name);
+/** @brief Switch to the current image if a new one was published. */
+bool            Refresh_Shared_FIB          (shared_fib *fib);
+/** @brief Unmap a shared FIB. */
+void            Close_Shared_FIB            (shared_fib **fib);
+
+/** @brief Perform Longest Prefix Match (LPM) in an image. */
+bool            Lookup_FIB_Image            (const fib_image *image, uint32_t ip, forward *lpm);
+/** @brief Perform Longest Prefix Match (LPM) in an image for a vector of addresses at once. */
+void            Lookup_FIB_Batch            (const fib_image *image, const uint32_t *ips, int count, forward *lpms);
+
+#endif /* SHARED_FIB_H_ */
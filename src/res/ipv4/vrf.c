@@ -0,0 +1,313 @@
+#include "./vrf.h"
+
+/* ---------------------------------------------------- PARSE VRF ---------------------------------------------------- */
+
+/**
+ * @brief Parse a `rtable=interface[,interface...]` option into a VRF's file and interfaces.
+ *
+ * The packets received on the interfaces are routed with the table of the file instead of the
+ * default one. The interfaces are named as on the command line (argc / argv), each in one VRF.
+ *
+ * @param vrfs The VRF of every interface, 0 for the default table.
+ * @param vrf  The VRF the option defines, from 1 on.
+ * @param spec The option, cut at the '=' and the commas.
+ * @param argc The number of interfaces.
+ * @param argv Their names.
+ * @param file Receives the routing table file of the VRF.
+ * @return 0, or -1 if the option is malformed or names an unknown interface or one of another VRF.
+ */
+int Parse_VRF(uint8_t vrfs[ROUTER_NUM_INTERFACES], int vrf, char *spec, int argc, char *argv[], char **file) {
+    char *equal = strchr(spec, '=');
+    if (!equal || equal == spec || !equal[1] || vrf < 1 || vrf >= MAX_VRFS) return -1;
+    *equal = '\0';
+    *file = spec;
+
+    for (char *name = strtok(equal + 1, ","); name; name = strtok(NULL, ",")) {
+        int interface;
+        for (interface = 0; interface < argc && interface < ROUTER_NUM_INTERFACES; interface++) {
+            if (!strcmp(name, argv[interface])) break;
+        }
+        if (interface == argc || interface == ROUTER_NUM_INTERFACES || vrfs[interface]) return -1;
+        vrfs[interface] = (uint8_t)vrf;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------- PARSE VRF ---------------------------------------------------- */
+/* --------------------------------------------------- SHARE TRIES --------------------------------------------------- */
+
+// Nodes of the pool by content, while the tables are shared (open addressing, linear probing).
+typedef struct node_index {
+    ipv4_entry **slots;
+    size_t mask;
+} node_index;
+
+/**
+ * @brief Hash of a node: its route and its children, which are already shared.
+ */
+static inline size_t Hash_IPV4_Entry(const ipv4_entry *entry) {
+    uint64_t hash = (uint64_t)entry->next_hop << 32 | entry->prefix;
+    hash ^= ((uint64_t)(uint32_t)entry->interface << 32 | (uint32_t)entry->type) * 0x9e3779b97f4a7c15ull;
+    hash ^= (uint64_t)(uintptr_t)entry->left * 0xc2b2ae3d27d4eb4full;
+    hash ^= (uint64_t)(uintptr_t)entry->right * 0x165667b19e3779f9ull;
+    hash ^= hash >> 29;
+    return (size_t)(hash * 0xbf58476d1ce4e5b9ull >> 17);
+}
+
+static inline bool Same_IPV4_Entry(const ipv4_entry *left, const ipv4_entry *right) {
+    return left->type == right->type && left->next_hop == right->next_hop && left->interface == right->interface &&
+           left->prefix == right->prefix && left->left == right->left && left->right == right->right;
+}
+
+/**
+ * @brief Copy a subtrie into the set's pool, bottom up, each distinct node once.
+ *
+ * A node whose route and children are those of a node already in the pool is that node: two
+ * identical subtrees end up as one. The groups of the multipath routes move to the set's table
+ * of groups.
+ *
+ * @param set    The VRF set.
+ * @param index  The nodes of the pool by content.
+ * @param entry  The root of the subtrie, in its table's own pool.
+ * @param table  The table of the subtrie.
+ * @param remap  The index of every group of the table in the set's groups, -1 if it has none;
+ *               NULL if the groups are the set's already.
+ * @param failed Set if memory allocation fails.
+ * @return The shared root of the subtrie, NULL for none.
+ */
+static ipv4_entry* Share_IPV4_Entry(vrf_set *set, node_index *index, const ipv4_entry *entry,
+                                    const ipv4_table *table, const int *remap, bool *failed) {
+    if (!entry || *failed) return NULL;
+
+    ipv4_entry node = *entry;
+    node.left = Share_IPV4_Entry(set, index, entry->left, table, remap, failed);
+    node.right = Share_IPV4_Entry(set, index, entry->right, table, remap, failed);
+    if (*failed) return NULL;
+
+    if (remap && node.type == 1 && node.interface == NH_GROUP) {
+        if (remap[node.next_hop] >= 0) {
+            node.next_hop = (uint32_t)remap[node.next_hop];
+        } else {
+            // Without room for its group, the route keeps its first path.
+            nh_member first = table->groups->groups[node.next_hop].members[0];
+            node.next_hop = first.next_hop;
+            node.interface = first.interface;
+            set->dropped++;
+        }
+    }
+
+    size_t slot = Hash_IPV4_Entry(&node) & index->mask;
+    for (; index->slots[slot]; slot = (slot + 1) & index->mask) {
+        if (Same_IPV4_Entry(index->slots[slot], &node)) return index->slots[slot];
+    }
+
+    ipv4_entry *shared = (ipv4_entry*)Pool_Alloc(set->pool);
+    if (!shared) {
+        *failed = true;
+        return NULL;
+    }
+    *shared = node;
+    index->slots[slot] = shared;
+    set->nodes++;
+    return shared;
+}
+
+/**
+ * @brief Share the tries of the routing tables of the VRFs, taking the tables over.
+ *
+ * Every table is copied into the set's pool, its identical subtrees shared with the tables
+ * before it, then its own nodes and groups are freed: it looks up as before, in the set's
+ * nodes and groups. The tables are freed with the set, on failure too.
+ *
+ * @param tables The routing table of every VRF, the default one first.
+ * @param count  The number of VRFs (at most MAX_VRFS).
+ * @return The set, or NULL if memory allocation fails.
+ */
+vrf_set* Create_VRF_Set(ipv4_table **tables, int count) {
+    vrf_set *set = (vrf_set*)calloc(1, sizeof(vrf_set));
+    node_index index = {NULL, 0};
+    size_t total = 0;
+
+    if (set) {
+        for (int vrf = 0; vrf < count && vrf < MAX_VRFS; vrf++) {
+            set->tables[vrf] = tables[vrf];
+            total += tables[vrf]->nodes;
+        }
+        set->count = count < MAX_VRFS ? count : MAX_VRFS;
+        set->pool = Create_Huge_Pool(sizeof(ipv4_entry), HUGE_FIB);
+        set->groups = Create_NH_Table();
+
+        // Twice as many slots as nodes, at most half full.
+        size_t slots = 1024;
+        while (slots < 2 * total) slots *= 2;
+        index.slots = (ipv4_entry**)calloc(slots, sizeof(ipv4_entry*));
+        index.mask = slots - 1;
+    }
+    if (!set || !set->pool || !set->groups || !index.slots) {
+        free(index.slots);
+        if (set) {
+            Free_VRF_Set(&set);
+        } else {
+            for (int vrf = 0; vrf < count; vrf++) Free_IPV4_Table(&tables[vrf]);
+        }
+        return NULL;
+    }
+
+    bool failed = false;
+    for (int vrf = 0; vrf < set->count && !failed; vrf++) {
+        ipv4_table *table = set->tables[vrf];
+
+        // The groups of the table follow those of the tables before it.
+        int *remap = (int*)malloc((table->groups->count + 1) * sizeof(int));
+        if (!remap) {
+            failed = true;
+            break;
+        }
+        for (uint32_t group = 0; group < table->groups->count; group++) {
+            const nh_group *paths = &table->groups->groups[group];
+            remap[group] = Add_NH_Group(set->groups, paths->members, (int)paths->size);
+        }
+
+        ipv4_entry *root = Share_IPV4_Entry(set, &index, atomic_load_explicit(&table->root, memory_order_relaxed),
+                                            table, remap, &failed);
+        free(remap);
+        if (failed) break;
+
+        Free_Huge_Pool(&table->pool);
+        Free_NH_Table(&table->groups);
+        atomic_store_explicit(&table->root, root, memory_order_relaxed);
+        table->groups = set->groups;
+        set->apart += table->nodes;
+    }
+    free(index.slots);
+
+    if (failed) {
+        Free_VRF_Set(&set);
+        return NULL;
+    }
+    return set;
+}
+
+/**
+ * @brief Free a VRF set and its tables.
+ *
+ * @param set A pointer to the set pointer to be freed.
+ */
+void Free_VRF_Set(vrf_set **set) {
+    if (!set || !(*set)) return;
+
+    // The tables not shared yet still have their own nodes and groups.
+    for (int vrf = 0; vrf < (*set)->count; vrf++) Free_IPV4_Table(&(*set)->tables[vrf]);
+    Free_Huge_Pool(&(*set)->pool);
+    Free_NH_Table(&(*set)->groups);
+    free(*set);
+    *set = NULL;
+}
+
+/**
+ * @brief Bytes of memory taken by a VRF set: its shared nodes and groups, and its tables.
+ */
+size_t Size_VRF_Set(const vrf_set *set) {
+    if (!set) return 0;
+    return sizeof(vrf_set) + set->count * sizeof(ipv4_table) + set->nodes * sizeof(ipv4_entry) +
+           set->groups->count * sizeof(nh_group);
+}
+
+/**
+ * @brief Copy a batch of route changes into the table of a VRF, its copied nodes in the set's pool.
+ *
+ * @param set     The VRF set.
+ * @param vrf     The VRF.
+ * @param changes The changes, sorted in place.
+ * @param count   The number of changes.
+ * @param change  Receives the copy, to publish or drop (see Prepare_IPV4_Routes).
+ * @return False if memory allocation fails.
+ */
+bool Prepare_VRF_Routes(vrf_set *set, int vrf, route_change *changes, int count, ipv4_change *change) {
+    bool prepared = Prepare_IPV4_Routes(set->tables[vrf], set->pool, changes, count, change);
+    set->nodes += change->allocated;
+    return prepared;
+}
+
+/**
+ * @brief Nodes of the set's pool that the changes replaced, at most: a node replaced in one table
+ *        may still be shared by another.
+ */
+size_t Garbage_VRF_Set(const vrf_set *set) {
+    size_t garbage = 0;
+    for (int vrf = 0; vrf < set->count; vrf++) garbage += set->tables[vrf]->garbage;
+    return garbage < set->nodes ? garbage : set->nodes;
+}
+
+/**
+ * @brief Share the tries of the tables again in a new pool, the old one is returned to be freed.
+ *
+ * The nodes the changes replaced go with the old pool, which the lookups may still be walking:
+ * the caller frees it once none can be (after a grace period). The tables switch to their new
+ * roots one by one, each root published with a release store.
+ *
+ * @param set    The VRF set.
+ * @param failed Set if memory allocation fails (the set is left as it was).
+ * @return The old pool, NULL on failure.
+ */
+huge_pool* Compact_VRF_Set(vrf_set *set, bool *failed) {
+    size_t total = 0, nodes = set->nodes;
+    for (int vrf = 0; vrf < set->count; vrf++) total += set->tables[vrf]->nodes;
+
+    size_t slots = 1024;
+    while (slots < 2 * total) slots *= 2;
+    node_index index = {(ipv4_entry**)calloc(slots, sizeof(ipv4_entry*)), slots - 1};
+    huge_pool *old = set->pool;
+    set->pool = Create_Huge_Pool(sizeof(ipv4_entry), HUGE_FIB);
+    set->nodes = 0;
+
+    *failed = !index.slots || !set->pool;
+    ipv4_entry *roots[MAX_VRFS];
+    for (int vrf = 0; vrf < set->count && !*failed; vrf++) {
+        ipv4_table *table = set->tables[vrf];
+        roots[vrf] = Share_IPV4_Entry(set, &index, atomic_load_explicit(&table->root, memory_order_relaxed),
+                                      table, NULL, failed);
+    }
+    free(index.slots);
+
+    if (*failed) {
+        Free_Huge_Pool(&set->pool);
+        set->pool = old;
+        set->nodes = nodes;
+        return NULL;
+    }
+    for (int vrf = 0; vrf < set->count; vrf++) {
+        set->tables[vrf]->garbage = 0;
+        atomic_store_explicit(&set->tables[vrf]->root, roots[vrf], memory_order_release);
+    }
+    return old;
+}
+
+/* --------------------------------------------------- SHARE TRIES --------------------------------------------------- */
+
+/**
+ * @brief Print the routes of every VRF, its interfaces, and the nodes the tables share.
+ *
+ * @param out   The output stream.
+ * @param set   The VRF set.
+ * @param files The routing table file of every VRF.
+ * @param vrfs  The VRF of every interface.
+ * @param argv  The names of the interfaces.
+ * @param argc  The number of interfaces.
+ */
+void Print_VRF_Set(FILE *out, const vrf_set *set, char *const *files, const uint8_t vrfs[ROUTER_NUM_INTERFACES],
+                   char *argv[], int argc) {
+    for (int vrf = 0; vrf < set->count; vrf++) {
+        fprintf(out, "vrf %d %s: %zu routes, interfaces", vrf, files[vrf], set->tables[vrf]->size);
+        int interfaces = 0;
+        for (int interface = 0; interface < argc && interface < ROUTER_NUM_INTERFACES; interface++) {
+            if (vrfs[interface] == vrf) fprintf(out, "%s %s", interfaces++ ? "," : "", argv[interface]);
+        }
+        fprintf(out, "%s\n", interfaces ? "" : " none");
+    }
+    fprintf(out, "vrfs: %zu nodes for %zu apart (%.1f%% shared), %u groups, %.1f MB",
+            set->nodes, set->apart, set->apart ? 100.0 * (1.0 - (double)set->nodes / set->apart) : 0.0,
+            set->groups->count, Size_VRF_Set(set) / 1048576.0);
+    if (set->dropped) fprintf(out, ", %zu multipath routes left with one path (no room for their groups)", set->dropped);
+    fprintf(out, "\n");
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef VRF_H_
+#define VRF_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../../utils/hugepage.h"
+#include "./ipv4_table.h"
+
+#define MAX_VRFS        (ROUTER_NUM_INTERFACES + 1)     // The default table, then one per interface at most.
+
+// IPv4 routing tables of several VRFs, their tries hash-consed into one pool: a subtree that is
+// the same in several tables (same routes, same next hops) is stored once and shared, so the
+// memory grows with what the tables do not have in common. The groups of the multipath routes
+// of every table are in one table of groups, each table keeping its own.
+typedef struct vrf_set {
+    ipv4_table *tables[MAX_VRFS];   // Routing table of every VRF, the default one first.
+    int count;                      // Number of VRFs.
+    huge_pool *pool;                // Trie nodes of every table, never changed in place.
+    nh_table *groups;               // Groups of every table, each table's group indices apart.
+    size_t nodes;                   // Nodes in the pool, those the changes replaced too.
+    size_t apart;                   // Nodes the tables would take each on its own.
+    size_t dropped;                 // Multipath routes left with their first path, no room for their group.
+} vrf_set;
+
+/** @brief Parse a `rtable=interface[,interface...]` option into a VRF's file and interfaces. */
+int             Parse_VRF               (uint8_t vrfs[ROUTER_NUM_INTERFACES], int vrf, char *spec,
+                                         int argc, char *argv[], char **file);
+/** @brief Share the tries of the routing tables of the VRFs, taking the tables over. */
+vrf_set*        Create_VRF_Set          (ipv4_table **tables, int count);
+/** @brief Free a VRF set and its tables. */
+void            Free_VRF_Set            (vrf_set **set);
+/** @brief Copy a batch of route changes into the table of a VRF, its copied nodes in the set's pool. */
+bool            Prepare_VRF_Routes      (vrf_set *set, int vrf, route_change *changes, int count,
+                                         ipv4_change *change);
+/** @brief Nodes of the set's pool that the changes replaced, at most. */
+size_t          Garbage_VRF_Set         (const vrf_set *set);
+/** @brief Share the tries of the tables again in a new pool, the old one is returned to be freed. */
+huge_pool*      Compact_VRF_Set         (vrf_set *set, bool *failed);
+/** @brief Bytes of memory taken by a VRF set: its shared nodes and groups. */
+size_t          Size_VRF_Set            (const vrf_set *set);
+/** @brief Print the routes of every VRF, its interfaces, and the nodes the tables share. */
+void            Print_VRF_Set           (FILE *out, const vrf_set *set, char *const *files,
+                                         const uint8_t vrfs[ROUTER_NUM_INTERFACES], char *argv[], int argc);
+
+#endif /* VRF_H_ */
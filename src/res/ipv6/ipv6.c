@@ -0,0 +1,292 @@
+#include "./ipv6.h"
+#include "../ndp/ndp.h"
+
+/* --------------------------------------------------- IPV6 ADDRESSES --------------------------------------------------- */
+
+/**
+ * @brief ICMPv6 checksum of a message, over its pseudo-header (RFC 8200 8.1).
+ *
+ * @param ip6_hdr The IPv6 header, for the addresses.
+ * @param msg     The ICMPv6 message.
+ * @param len     Its length.
+ * @return The checksum to store with the field zeroed, 0 if the message checks with its own.
+ */
+uint16_t Checksum_ICMPV6(const struct ip6hdr *ip6_hdr, const void *msg, size_t len) {
+    struct {
+        struct in6_addr saddr;
+        struct in6_addr daddr;
+        uint32_t len;
+        uint8_t zero[3];
+        uint8_t next_header;
+    } pseudo = {
+        .saddr = ip6_hdr->saddr, .daddr = ip6_hdr->daddr,
+        .len = htonl((uint32_t)len), .next_header = NEXT_ICMPV6,
+    };
+
+    uint64_t sum = Checksum_Sum_Scalar(&pseudo, sizeof(pseudo), 0);
+    return Checksum_Fold(Checksum_Sum_Scalar(msg, len, sum));
+}
+
+/**
+ * @brief Whether an address is one of an interface's.
+ *
+ * @param interface The interface.
+ * @param addr      The address.
+ * @return True if the interface has the address.
+ */
+bool Is_IPV6_Local(int interface, const struct in6_addr *addr) {
+    int count;
+    const struct in6_addr *addrs = Get_IPV6_Interface(interface, &count);
+    for (int idx = 0; idx < count; idx++) {
+        if (!memcmp(&addrs[idx], addr, sizeof(*addr))) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Address the router sends its messages from on an interface.
+ *
+ * A global address, reachable from beyond the link, is preferred to the link-local one.
+ *
+ * @param interface The interface.
+ * @param addr      Receives the address.
+ * @return True if the interface has an IPv6 address.
+ */
+bool Source_IPV6(int interface, struct in6_addr *addr) {
+    int count;
+    const struct in6_addr *addrs = Get_IPV6_Interface(interface, &count);
+    if (!count) return false;
+
+    *addr = addrs[0];
+    for (int idx = 0; idx < count; idx++) {
+        // fe80::/10 is link-local.
+        if (addrs[idx].s6_addr[0] != 0xfe || (addrs[idx].s6_addr[1] & 0xc0) != 0x80) {
+            *addr = addrs[idx];
+            break;
+        }
+    }
+    return true;
+}
+
+/* --------------------------------------------------- IPV6 ADDRESSES --------------------------------------------------- */
+/* ---------------------------------------------------- ICMPV6 REPLY ---------------------------------------------------- */
+
+/**
+ * @brief Generate an ICMPv6 error message in the route's packet buffer.
+ *
+ * As much of the offending packet as fits the minimum MTU follows the ICMPv6 header (RFC 4443);
+ * it is moved before the new headers overwrite it. Errors are not sent about errors, nor to
+ * multicast or unspecified sources.
+ *
+ * @param route Pointer to the routing information structure, the interface being the one the packet came in on.
+ * @param type  ICMPv6 message type (ICMPV6_TIME_EXCEED / ICMPV6_DEST_UNREACH / ICMPV6_PACKET_TOO_BIG).
+ * @param mtu   MTU of the egress interface for Packet Too Big, 0 otherwise.
+ * @return True if the message was built, false if the packet is not to be answered.
+ */
+static bool Reply_ICMPV6(routing *route, uint8_t type, uint32_t mtu) {
+    struct ip6hdr *ip6_hdr = route->ip6_hdr;
+    static const struct in6_addr unspecified;
+    if (Is_IPV6_Multicast(&ip6_hdr->saddr) || !memcmp(&ip6_hdr->saddr, &unspecified, sizeof(unspecified))) {
+        return false;
+    }
+
+    const struct icmp6hdr *offending = (const struct icmp6hdr *)(ip6_hdr + 1);
+    size_t available = route->len - sizeof *route->eth_hdr;
+    if (ip6_hdr->next_header == NEXT_ICMPV6 && available >= sizeof(*ip6_hdr) + sizeof(*offending) &&
+        offending->type < ICMPV6_INFO) {
+        return false;
+    }
+
+    struct in6_addr saddr, daddr = ip6_hdr->saddr;
+    if (!Source_IPV6(route->interface, &saddr)) return false;
+
+    if (type == ICMPV6_TIME_EXCEED) STATS_EVENT(ICMP_TIME_EXCEEDED, 1);
+    else if (type == ICMPV6_DEST_UNREACH) STATS_EVENT(ICMP_UNREACHABLE, 1);
+    else if (type == ICMPV6_PACKET_TOO_BIG) STATS_EVENT(ICMP_TOO_BIG, 1);
+
+    // Quote the offending packet after the new headers.
+    size_t quote = IPV6_MIN_MTU - sizeof(struct ip6hdr) - sizeof(struct icmp6hdr);
+    if (quote > available) quote = available;
+    struct icmp6hdr *icmp6_hdr = (struct icmp6hdr *)(ip6_hdr + 1);
+    memmove(icmp6_hdr + 1, ip6_hdr, quote);
+
+    icmp6_hdr->type = type;
+    icmp6_hdr->code = 0;
+    icmp6_hdr->un.mtu = htonl(mtu);
+
+    ip6_hdr->vtc_flow = htonl(IPV6_VERSION << 28);
+    ip6_hdr->payload_len = htons((uint16_t)(sizeof(*icmp6_hdr) + quote));
+    ip6_hdr->next_header = NEXT_ICMPV6;
+    ip6_hdr->hop_limit = DEFAULT_HOP_LIMIT;
+    ip6_hdr->saddr = saddr;
+    ip6_hdr->daddr = daddr;
+
+    icmp6_hdr->checksum = 0;
+    icmp6_hdr->checksum = Checksum_ICMPV6(ip6_hdr, icmp6_hdr, sizeof(*icmp6_hdr) + quote);
+
+    // Back where the packet came from.
+    memcpy(route->eth_hdr->ether_dhost, route->eth_hdr->ether_shost, MAC_SIZE);
+    Get_MAC_Interface(route->interface, route->eth_hdr->ether_shost);
+    route->len = sizeof *route->eth_hdr + sizeof(*ip6_hdr) + sizeof(*icmp6_hdr) + quote;
+    return true;
+}
+
+/**
+ * @brief Turn an ICMPv6 echo request into its reply, in place.
+ *
+ * Swapping the addresses leaves the pseudo-header sum unchanged and the hop limit is not
+ * covered by the checksum, so only the type word is patched (RFC 1624).
+ *
+ * @param route Pointer to the routing information structure.
+ */
+static void Echo_ICMPV6(routing *route) {
+    struct ip6hdr *ip6_hdr = route->ip6_hdr;
+    struct icmp6hdr *icmp6_hdr = (struct icmp6hdr *)(ip6_hdr + 1);
+    uint16_t old_word, new_word;
+
+    memcpy(&old_word, &icmp6_hdr->type, sizeof(old_word));
+    icmp6_hdr->type = ICMPV6_ECHO_REPLY;
+    memcpy(&new_word, &icmp6_hdr->type, sizeof(new_word));
+    icmp6_hdr->checksum = Checksum_Adjust(icmp6_hdr->checksum, old_word, new_word);
+
+    struct in6_addr saddr = ip6_hdr->saddr;
+    ip6_hdr->saddr = ip6_hdr->daddr;
+    ip6_hdr->daddr = saddr;
+    ip6_hdr->hop_limit = DEFAULT_HOP_LIMIT;
+
+    memcpy(route->eth_hdr->ether_dhost, route->eth_hdr->ether_shost, MAC_SIZE);
+    Get_MAC_Interface(route->interface, route->eth_hdr->ether_shost);
+
+    STATS_EVENT(ICMP_ECHO_REPLIES, 1);
+}
+
+/* ---------------------------------------------------- ICMPV6 REPLY ---------------------------------------------------- */
+/* ------------------------------------------------ HANDLER IPV6 PACKETS ------------------------------------------------ */
+
+/**
+ * @brief Handle the IPv6 packets for the router: neighbor discovery and echo requests.
+ *
+ * @param route Pointer to the routing information structure.
+ */
+static void Local_IPV6(routing *route) {
+    struct ip6hdr *ip6_hdr = route->ip6_hdr;
+    const struct icmp6hdr *icmp6_hdr = (const struct icmp6hdr *)(ip6_hdr + 1);
+
+    if (ip6_hdr->next_header != NEXT_ICMPV6 ||
+        route->len < sizeof *route->eth_hdr + sizeof(*ip6_hdr) + sizeof(*icmp6_hdr)) {
+        STATS_DROP(DROP_LOCAL, 1);
+        return;
+    }
+
+    if (icmp6_hdr->type == ND_SOLICIT || icmp6_hdr->type == ND_ADVERT) {
+        Handler_NDP(route);
+        return;
+    }
+
+    // Echo requests to a group are not answered.
+    if (icmp6_hdr->type != ICMPV6_ECHO_REQUEST || icmp6_hdr->code != 0 || Is_IPV6_Multicast(&ip6_hdr->daddr)) {
+        STATS_DROP(DROP_LOCAL, 1);
+        return;
+    }
+
+    if (!Police(route->policer, route->interface, POLICE_ICMP_ECHO)) return;
+    Echo_ICMPV6(route);
+    Send_Stamped_Link(route->interface, route->buf, route->len, route->stamp, PATH_SLOW);
+}
+
+/**
+ * @brief Handle incoming IPv6 packets.
+ *
+ * Packets for the router go to Local_IPV6; the others are routed, their hop limit decremented
+ * (IPv6 has no header checksum) and sent to the next hop's MAC, or queued while a Neighbor
+ * Solicitation resolves it. Unroutable, expiring and too big packets are answered with ICMPv6 errors.
+ *
+ * @param route Pointer to the routing information structure.
+ */
+void Handler_IPV6(routing *route) {
+    route->ip6_hdr = (struct ip6hdr *)(route->buf + sizeof *route->eth_hdr);
+    struct ip6hdr *ip6_hdr = route->ip6_hdr;
+    // The ICMPv6 messages are policed on the interface the packet came in on.
+    int ingress = route->interface;
+
+    if (route->len < sizeof *route->eth_hdr + sizeof(*ip6_hdr) || IPV6_Version(ip6_hdr) != IPV6_VERSION ||
+        route->len < sizeof *route->eth_hdr + sizeof(*ip6_hdr) + ntohs(ip6_hdr->payload_len)) {
+        STATS_DROP(DROP_MALFORMED, 1);
+        return;
+    }
+
+    if (Is_IPV6_Multicast(&ip6_hdr->daddr) || Is_IPV6_Local(ingress, &ip6_hdr->daddr)) {
+        Local_IPV6(route);
+        return;
+    }
+
+    // Look up the best route based on the destination address
+    forward6 best_route;
+    if (!Lookup_IPV6_Table(route->ctrl->ipv6s, &ip6_hdr->daddr, &best_route)) {
+        // No valid route found, send ICMPv6 Destination Unreachable (no route)
+        STATS_DROP(DROP_NO_ROUTE, 1);
+        if (!Police(route->policer, ingress, POLICE_ICMP_ERROR) || !Reply_ICMPV6(route, ICMPV6_DEST_UNREACH, 0)) return;
+        Send_Stamped_Link(ingress, route->buf, route->len, route->stamp, PATH_SLOW);
+        return;
+    }
+
+    // Routes through an interface the router was not started with are dropped.
+    if (best_route.interface < 0 || best_route.interface >= ROUTER_NUM_INTERFACES) {
+        STATS_DROP(DROP_NO_INTERFACE, 1);
+        return;
+    }
+
+    if (ip6_hdr->hop_limit <= 1) {
+        // Hop limit exceeded in transit, send ICMPv6 Time Exceeded back where the packet came from
+        STATS_DROP(DROP_TTL, 1);
+        if (!Police(route->policer, ingress, POLICE_ICMP_ERROR) || !Reply_ICMPV6(route, ICMPV6_TIME_EXCEED, 0)) return;
+        Send_Stamped_Link(ingress, route->buf, route->len, route->stamp, PATH_SLOW);
+        return;
+    }
+
+    // Over the egress MTU: IPv6 is never fragmented on the way, the sender is told the MTU (RFC 8201).
+    int mtu = Get_MTU_Interface(best_route.interface);
+    if (Wire_Packet_Len(route->buf, route->len, &route->offload) > (size_t)mtu) {
+        STATS_DROP(DROP_MTU, 1);
+        if (!Police(route->policer, ingress, POLICE_ICMP_ERROR) ||
+            !Reply_ICMPV6(route, ICMPV6_PACKET_TOO_BIG, (uint32_t)mtu)) return;
+        Send_Stamped_Link(ingress, route->buf, route->len, route->stamp, PATH_SLOW);
+        return;
+    }
+
+    ip6_hdr->hop_limit--;
+    route->next_hop6 = best_route.next_hop;
+    route->interface = best_route.interface;
+
+    // Check if there is a neighbor entry for the next hop
+    int entry_idx = Get_ND_Entry(route->ctrl->neighbors, &route->next_hop6);
+    if (entry_idx >= 0) {
+        memcpy(route->eth_hdr->ether_dhost, route->ctrl->neighbors->addrs[entry_idx].mac, MAC_SIZE);
+        Get_MAC_Interface(route->interface, route->eth_hdr->ether_shost);
+        Send_Offload_Link(route->interface, route->buf, route->len, &route->offload, route->stamp, PATH_SLOW);
+        return;
+    }
+
+    // Queue a copy of the packet, unless the queues are full (neighbor not answering).
+    bool queued = false;
+    pthread_mutex_lock(&route->ctrl->waiting_lock);
+    if (route->ctrl->waiting_len < MAX_WAITING) {
+        packet *pckg = Send_Packet(route);
+        if (pckg) {
+            Enqueue(route->ctrl->waiting6, (void *)pckg);
+            route->ctrl->waiting_len++;
+            queued = true;
+        }
+    }
+    pthread_mutex_unlock(&route->ctrl->waiting_lock);
+    if (!queued) STATS_DROP(DROP_ARP_QUEUE, 1);
+
+    // Over the request rate, a later packet for the same next hop asks again.
+    if (!Police(route->policer, route->interface, POLICE_ARP_REQUEST)) return;
+
+    // Solicit the next hop's MAC address, the queued copy carries the RX timestamp.
+    route->stamp = 0;
+    if (Solicit_NDP(route)) Send_Stamped_Link(route->interface, route->buf, route->len, route->stamp, PATH_SLOW);
+}
+
+/* ------------------------------------------------ HANDLER IPV6 PACKETS ------------------------------------------------ */
@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef IPV6_H_
+#define IPV6_H_
+
+#include "../../include/router.h"
+
+#define 	IPV6_TYPE 			htons(0x86DD)
+#define     IPV6_VERSION    	6
+#define     DEFAULT_HOP_LIMIT  	64
+#define     IPV6_MIN_MTU    	1280		/* ICMPv6 errors fit in it, quote included */
+#define     NEXT_ICMPV6     	58
+
+#define 	ICMPV6_DEST_UNREACH 	(uint8_t)1
+#define 	ICMPV6_PACKET_TOO_BIG	(uint8_t)2
+#define 	ICMPV6_TIME_EXCEED  	(uint8_t)3
+#define 	ICMPV6_ECHO_REQUEST 	(uint8_t)128
+#define 	ICMPV6_ECHO_REPLY   	(uint8_t)129
+#define 	ICMPV6_INFO         	(uint8_t)128	/* Types below are errors, never answered with one */
+
+/** @brief IP version of an IPv6 header, from its first word. */
+static inline int IPV6_Version(const struct ip6hdr *ip6_hdr) {
+    return (int)(ntohl(ip6_hdr->vtc_flow) >> 28);
+}
+
+/** @brief Whether an address is multicast (ff00::/8). */
+static inline bool Is_IPV6_Multicast(const struct in6_addr *addr) {
+    return addr->s6_addr[0] == 0xff;
+}
+
+/** @brief ICMPv6 checksum of a message over its pseudo-header, 0 when checking one that has its own. */
+extern uint16_t    Checksum_ICMPV6     (const struct ip6hdr *ip6_hdr, const void *msg, size_t len);
+/** @brief Whether an address is one of an interface's. */
+extern bool        Is_IPV6_Local       (int interface, const struct in6_addr *addr);
+/** @brief Address the router sends its messages from on an interface, a global one if it has one. */
+extern bool        Source_IPV6         (int interface, struct in6_addr *addr);
+/** @brief  Handle incoming IPv6 packets. */
+extern void        Handler_IPV6        (routing *route);
+
+#endif /* IPV6_H_ */
@@ -0,0 +1,439 @@
+#include "./ipv6_table.h"
+
+#include <arpa/inet.h>
+
+#define MAX_LINE6_SIZE  160
+#define MIN_SLOTS       1024
+
+/* ---------------------------------------------------- PREFIX KEYS ----------------------------------------------------- */
+
+/**
+ * @brief Split an address into two 64-bit halves, in host order.
+ *
+ * @param addr The address, in network order.
+ * @param hi   Receives the high 64 bits.
+ * @param lo   Receives the low 64 bits.
+ */
+static inline void Load_Key(const struct in6_addr *addr, uint64_t *hi, uint64_t *lo) {
+    uint64_t high = 0, low = 0;
+    for (int byte = 0; byte < 8; byte++) {
+        high = high << 8 | addr->s6_addr[byte];
+        low = low << 8 | addr->s6_addr[byte + 8];
+    }
+    *hi = high;
+    *lo = low;
+}
+
+/**
+ * @brief Clear the bits of a key past a prefix length.
+ *
+ * @param hi  The high 64 bits, masked in place.
+ * @param lo  The low 64 bits, masked in place.
+ * @param len The prefix length, 0 to 128.
+ */
+static inline void Mask_Key(uint64_t *hi, uint64_t *lo, int len) {
+    if (len <= 64) {
+        *hi = len ? *hi & (~0ull << (64 - len)) : 0;
+        *lo = 0;
+    } else {
+        *lo &= ~0ull << (128 - len);
+    }
+}
+
+/**
+ * @brief Hash a prefix and its length.
+ */
+static inline size_t Hash_Key(uint64_t hi, uint64_t lo, int len) {
+    uint64_t hash = hi * 0x9e3779b97f4a7c15ull ^ (lo + (uint64_t)len) * 0xc2b2ae3d27d4eb4full;
+    hash ^= hash >> 32;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 29;
+    return (size_t)hash;
+}
+
+/**
+ * @brief Find the slot of a prefix, starting the linear probe at a given slot.
+ *
+ * @return The slot, or NULL if the prefix is not in the table.
+ */
+static inline const ipv6_slot* Probe_Slot(const ipv6_table *ip_table, size_t idx, uint64_t hi, uint64_t lo, int len) {
+    size_t mask = ip_table->capacity - 1;
+    for (idx &= mask; ip_table->slots[idx].used; idx = (idx + 1) & mask) {
+        const ipv6_slot *slot = &ip_table->slots[idx];
+        if (slot->hi == hi && slot->lo == lo && slot->len == len) return slot;
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------- PREFIX KEYS ----------------------------------------------------- */
+/* ------------------------------------------------- CREATE IPV6 TABLE -------------------------------------------------- */
+
+/**
+ * @brief Allocate an empty open addressing table of a number of slots.
+ *
+ * @return True on success, false if out of memory (the table is left as it was).
+ */
+static bool Alloc_Slots(ipv6_table *ip_table, size_t capacity) {
+    ipv6_slot *slots = Huge_Alloc(capacity * sizeof(ipv6_slot), HUGE_FIB);
+    if (!slots) return false;
+
+    ipv6_slot *old = ip_table->slots;
+    size_t old_capacity = ip_table->capacity;
+    ip_table->slots = slots;
+    ip_table->capacity = capacity;
+
+    // Move the slots of the old table, none of them duplicated.
+    for (size_t idx = 0; idx < old_capacity; idx++) {
+        if (!old[idx].used) continue;
+        size_t pos = Hash_Key(old[idx].hi, old[idx].lo, old[idx].len) & (capacity - 1);
+        while (slots[pos].used) pos = (pos + 1) & (capacity - 1);
+        slots[pos] = old[idx];
+    }
+    Huge_Free(old);
+    return true;
+}
+
+/**
+ * @brief Get the slot of a prefix, taking a new one (a marker, with no route) if it is not in the table.
+ *
+ * The table doubles once half full, the slots it returned before are then stale.
+ *
+ * @return The slot, or NULL if out of memory.
+ */
+static ipv6_slot* Claim_Slot(ipv6_table *ip_table, uint64_t hi, uint64_t lo, int len) {
+    if (2 * (ip_table->used + 1) > ip_table->capacity && !Alloc_Slots(ip_table, 2 * ip_table->capacity)) {
+        return NULL;
+    }
+
+    size_t mask = ip_table->capacity - 1;
+    size_t idx = Hash_Key(hi, lo, len) & mask;
+    for (; ip_table->slots[idx].used; idx = (idx + 1) & mask) {
+        ipv6_slot *slot = &ip_table->slots[idx];
+        if (slot->hi == hi && slot->lo == lo && slot->len == len) return slot;
+    }
+
+    ipv6_slot *slot = &ip_table->slots[idx];
+    *slot = (ipv6_slot){.hi = hi, .lo = lo, .own = -1, .best = -1, .len = (uint8_t)len, .used = true};
+    ip_table->used++;
+    ip_table->markers++;
+    return slot;
+}
+
+/**
+ * @brief Read IPv6 routing entries from a file into an array of route6 structures.
+ *
+ * Each line holds PREFIX/LENGTH NEXT_HOP INTERFACE, e.g. "2001:db8:1::/48 fe80::1 0", a next hop
+ * of :: for a directly connected prefix. Blank, comment (#) and malformed lines are skipped.
+ *
+ * @param file  The name of the file containing IPv6 routing entries.
+ * @param count Set to the number of routing entries read from the file.
+ * @return The routing entries (to be freed by the caller), or NULL on failure.
+ */
+route6* Read_IPV6_Routes(char *file, int *count) {
+    FILE *fin = fopen(file, "r");
+    if (!fin) return NULL;
+
+    int capacity = 1024;
+    route6 *rtable = (route6*)malloc(capacity * sizeof(route6));
+    if (!rtable) {
+        fclose(fin);
+        return NULL;
+    }
+
+    int num_entries = 0;
+    char line[MAX_LINE6_SIZE];
+
+    while (fgets(line, sizeof(line), fin)) {
+        if (num_entries == capacity) {
+            route6 *grown = (route6*)realloc(rtable, 2 * capacity * sizeof(route6));
+            if (!grown) {
+                free(rtable);
+                fclose(fin);
+                return NULL;
+            }
+            rtable = grown;
+            capacity *= 2;
+        }
+
+        char prefix[INET6_ADDRSTRLEN], next_hop[INET6_ADDRSTRLEN];
+        route6 *entry = &rtable[num_entries];
+        if (sscanf(line, "%45[^/]/%d %45s %d", prefix, &entry->len, next_hop, &entry->interface) != 4) continue;
+        if (entry->len < 0 || entry->len > IPV6_BITS) continue;
+        if (inet_pton(AF_INET6, prefix, &entry->prefix) != 1) continue;
+        if (inet_pton(AF_INET6, next_hop, &entry->next_hop) != 1) continue;
+        num_entries++;
+    }
+
+    fclose(fin);
+    *count = num_entries;
+    return rtable;
+}
+
+/**
+ * @brief Build an IPv6 routing table from an array of routes.
+ *
+ * The routes are hashed first, which gives the distinct lengths; then every route leaves a
+ * marker at each length the binary search visits below it on its way to the route's length;
+ * last, every slot gets its best matching route, looked up among the shorter lengths.
+ *
+ * @param routes The routes, a later one replacing an earlier one of the same prefix.
+ * @param count  The number of routes.
+ * @return A pointer to the new IPv6 routing table, or NULL on failure.
+ */
+ipv6_table* Build_IPV6_Table(const route6 *routes, int count) {
+    ipv6_table *ip_table = calloc(1, sizeof(ipv6_table));
+    if (!ip_table) return NULL;
+    ip_table->fallback = -1;
+
+    size_t capacity = MIN_SLOTS;
+    while (capacity < 4 * (size_t)count) capacity *= 2;
+    ip_table->routes = malloc((count ? count : 1) * sizeof(route6));
+    if (!ip_table->routes || !Alloc_Slots(ip_table, capacity)) {
+        Free_IPV6_Table(&ip_table);
+        return NULL;
+    }
+    memcpy(ip_table->routes, routes, count * sizeof(route6));
+
+    // Routes, and the lengths they use.
+    bool present[IPV6_BITS + 1] = { false };
+    for (int entry = 0; entry < count; entry++) {
+        int len = routes[entry].len;
+        if (!len) {
+            if (ip_table->fallback < 0) ip_table->size++;
+            ip_table->fallback = entry;
+            continue;
+        }
+
+        uint64_t hi, lo;
+        Load_Key(&routes[entry].prefix, &hi, &lo);
+        Mask_Key(&hi, &lo, len);
+        ipv6_slot *slot = Claim_Slot(ip_table, hi, lo, len);
+        if (!slot) {
+            Free_IPV6_Table(&ip_table);
+            return NULL;
+        }
+        if (slot->own < 0) {
+            ip_table->markers--;
+            ip_table->size++;
+        }
+        slot->own = entry;
+        present[len] = true;
+    }
+
+    int position[IPV6_BITS + 1];
+    for (int len = 1; len <= IPV6_BITS; len++) {
+        position[len] = ip_table->num_lengths;
+        if (present[len]) ip_table->lengths[ip_table->num_lengths++] = (uint8_t)len;
+    }
+
+    // Markers on the search path of every route, where the search has to go on to longer lengths.
+    for (int entry = 0; entry < count; entry++) {
+        if (!routes[entry].len) continue;
+        int target = position[routes[entry].len];
+        uint64_t hi, lo;
+        Load_Key(&routes[entry].prefix, &hi, &lo);
+
+        int low = 0, high = ip_table->num_lengths - 1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            if (mid == target) break;
+            if (mid > target) {
+                high = mid - 1;
+                continue;
+            }
+
+            uint64_t marker_hi = hi, marker_lo = lo;
+            Mask_Key(&marker_hi, &marker_lo, ip_table->lengths[mid]);
+            if (!Claim_Slot(ip_table, marker_hi, marker_lo, ip_table->lengths[mid])) {
+                Free_IPV6_Table(&ip_table);
+                return NULL;
+            }
+            low = mid + 1;
+        }
+    }
+
+    // Best matching route of every slot: its own, else the longest shorter route covering it.
+    for (size_t idx = 0; idx < ip_table->capacity; idx++) {
+        ipv6_slot *slot = &ip_table->slots[idx];
+        if (!slot->used) continue;
+        slot->best = slot->own;
+
+        for (int pos = position[slot->len] - 1; slot->best < 0 && pos >= 0; pos--) {
+            int len = ip_table->lengths[pos];
+            uint64_t hi = slot->hi, lo = slot->lo;
+            Mask_Key(&hi, &lo, len);
+            const ipv6_slot *cover = Probe_Slot(ip_table, Hash_Key(hi, lo, len), hi, lo, len);
+            if (cover && cover->own >= 0) slot->best = cover->own;
+        }
+        if (slot->best < 0) slot->best = ip_table->fallback;
+    }
+
+    return ip_table;
+}
+
+/**
+ * @brief Create an IPv6 routing table from a file containing routing entries.
+ *
+ * @param file The name of the file containing IPv6 routing entries.
+ * @return A pointer to the newly created IPv6 routing table, or NULL on failure.
+ */
+ipv6_table* Create_IPV6_Table(char *file) {
+    if (!file) return NULL;
+
+    int num_entries = 0;
+    route6 *rtable = Read_IPV6_Routes(file, &num_entries);
+    if (!rtable) return NULL;
+
+    ipv6_table *ip_table = Build_IPV6_Table(rtable, num_entries);
+    free(rtable);
+    return ip_table;
+}
+
+/* ------------------------------------------------- CREATE IPV6 TABLE -------------------------------------------------- */
+/* -------------------------------------------------- FREE IPV6 TABLE --------------------------------------------------- */
+
+/**
+ * @brief Free the memory associated with an IPv6 routing table.
+ *
+ * @param ip_table A pointer to a pointer to the IPv6 routing table to be freed.
+ *                 After the function call, the pointer is set to NULL.
+ */
+void Free_IPV6_Table(ipv6_table **ip_table) {
+    if (!ip_table || !(*ip_table)) return;
+    Huge_Free((*ip_table)->slots);
+    free((*ip_table)->routes);
+    free(*ip_table);
+    *ip_table = NULL;
+}
+
+/**
+ * @brief Bytes of memory taken by an IPv6 routing table: its slots and its routes.
+ */
+size_t Size_IPV6_Table(const ipv6_table *ip_table) {
+    if (!ip_table) return 0;
+    return ip_table->capacity * sizeof(ipv6_slot) + ip_table->size * sizeof(route6);
+}
+
+/* -------------------------------------------------- FREE IPV6 TABLE --------------------------------------------------- */
+/* ------------------------------------------------- LOOKUP IPV6 TABLE -------------------------------------------------- */
+
+/**
+ * @brief Fill a forwarding entry from the route a search ended with.
+ *
+ * @param ip_table The IPv6 routing table.
+ * @param best     The route index, -1 for none.
+ * @param ip       The destination, the next hop of a directly connected prefix.
+ * @param lpm      The forward structure receiving the result.
+ */
+static inline void Fill_Forward(const ipv6_table *ip_table, int32_t best, const struct in6_addr *ip, forward6 *lpm) {
+    lpm->status = best >= 0;
+    if (!lpm->status) return;
+
+    const route6 *entry = &ip_table->routes[best];
+    static const struct in6_addr on_link;
+    lpm->next_hop = memcmp(&entry->next_hop, &on_link, sizeof(on_link)) ? entry->next_hop : *ip;
+    lpm->interface = entry->interface;
+}
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) in an IPv6 routing table.
+ *
+ * @param ip_table A pointer to the IPv6 routing table to search.
+ * @param ip       The destination address.
+ * @param lpm      The forward structure receiving the LPM result.
+ * @return True if a route matched, false otherwise (lpm->status is set accordingly).
+ */
+bool Lookup_IPV6_Table(const ipv6_table *ip_table, const struct in6_addr *ip, forward6 *lpm) {
+    lpm->status = false;
+    if (!ip_table) return false;
+
+    uint64_t hi, lo;
+    Load_Key(ip, &hi, &lo);
+
+    int32_t best = ip_table->fallback;
+    int low = 0, high = ip_table->num_lengths - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int len = ip_table->lengths[mid];
+        uint64_t key_hi = hi, key_lo = lo;
+        Mask_Key(&key_hi, &key_lo, len);
+
+        const ipv6_slot *slot = Probe_Slot(ip_table, Hash_Key(key_hi, key_lo, len), key_hi, key_lo, len);
+        if (slot) {
+            best = slot->best;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    Fill_Forward(ip_table, best, ip, lpm);
+    return lpm->status;
+}
+
+/**
+ * @brief Perform Longest Prefix Match (LPM) for a vector of addresses at once.
+ *
+ * The searches take their steps together: the slots of the step are all prefetched before any
+ * is probed, so the cache misses of independent lookups overlap instead of serializing.
+ *
+ * @param ip_table A pointer to the IPv6 routing table to search.
+ * @param ips      The destination addresses.
+ * @param count    The number of addresses (at most MAX_BATCH).
+ * @param lpms     The forward structures receiving the LPM results.
+ */
+void Lookup_IPV6_Batch(const ipv6_table *ip_table, const struct in6_addr *ips, int count, forward6 *lpms) {
+    uint64_t his[MAX_BATCH], los[MAX_BATCH], key_his[MAX_BATCH], key_los[MAX_BATCH];
+    int lows[MAX_BATCH], highs[MAX_BATCH], mids[MAX_BATCH];
+    int32_t bests[MAX_BATCH];
+    size_t hashes[MAX_BATCH];
+    uint16_t searching[MAX_BATCH];
+    int active = 0;
+
+    if (count > MAX_BATCH) count = MAX_BATCH;
+    for (int idx = 0; idx < count; idx++) {
+        lpms[idx].status = false;
+        if (!ip_table) continue;
+        Load_Key(&ips[idx], &his[idx], &los[idx]);
+        bests[idx] = ip_table->fallback;
+        lows[idx] = 0;
+        highs[idx] = ip_table->num_lengths - 1;
+        if (lows[idx] <= highs[idx]) searching[active++] = (uint16_t)idx;
+    }
+
+    while (active) {
+        // Hash every search's probe of this step and prefetch its slot.
+        for (int pos = 0; pos < active; pos++) {
+            int idx = searching[pos];
+            mids[idx] = (lows[idx] + highs[idx]) / 2;
+            int len = ip_table->lengths[mids[idx]];
+            key_his[idx] = his[idx];
+            key_los[idx] = los[idx];
+            Mask_Key(&key_his[idx], &key_los[idx], len);
+            hashes[idx] = Hash_Key(key_his[idx], key_los[idx], len) & (ip_table->capacity - 1);
+            __builtin_prefetch(&ip_table->slots[hashes[idx]]);
+        }
+
+        // Probe, and keep the searches with lengths left.
+        int kept = 0;
+        for (int pos = 0; pos < active; pos++) {
+            int idx = searching[pos];
+            const ipv6_slot *slot = Probe_Slot(ip_table, hashes[idx], key_his[idx], key_los[idx],
+                                               ip_table->lengths[mids[idx]]);
+            if (slot) {
+                bests[idx] = slot->best;
+                lows[idx] = mids[idx] + 1;
+            } else {
+                highs[idx] = mids[idx] - 1;
+            }
+            if (lows[idx] <= highs[idx]) searching[kept++] = (uint16_t)idx;
+        }
+        active = kept;
+    }
+
+    for (int idx = 0; ip_table && idx < count; idx++) {
+        Fill_Forward(ip_table, bests[idx], &ips[idx], &lpms[idx]);
+    }
+}
+
+/* ------------------------------------------------- LOOKUP IPV6 TABLE -------------------------------------------------- */
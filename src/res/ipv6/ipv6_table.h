@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef IPV6_TABLE_H_
+#define IPV6_TABLE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "../../utils/hugepage.h"
+#include "../ipv4/ipv4_table.h"
+
+#define IPV6_BITS 128
+
+// ROUTES ARE LOOKED UP BY BINARY SEARCH ON PREFIX LENGTHS (Waldvogel et al.), ONE HASH PROBE PER STEP:
+// a 128-bit trie walk costs up to 128 dependent loads, the search about log2 of the distinct lengths
+// (5 for the few dozen lengths of a BGP table). A hit sends the search to the longer lengths, a miss
+// to the shorter ones; markers left on the way to every prefix keep the longer ones reachable, each
+// carrying its best matching prefix for the searches that go no further.
+
+// Routing entry in an IPv6 routing table.
+typedef struct route6 {
+    struct in6_addr prefix;     // Destination prefix.
+    struct in6_addr next_hop;   // Next Hop address, :: for a directly connected prefix.
+    int len;                    // Prefix length, 0 to 128.
+    int interface;              // Interface index.
+} route6;
+
+// Forwarding entry in an IPv6 routing table.
+typedef struct forward6 {
+    struct in6_addr next_hop;   // Next Hop address, the destination itself if directly connected.
+    int interface;              // Interface index.
+    bool status;                // Status flag (INVALID / VALID).
+} forward6;
+
+// Hash table slot: a prefix of a given length, a route or a marker.
+typedef struct ipv6_slot {
+    uint64_t hi;                // High 64 bits of the prefix, host order, masked to its length.
+    uint64_t lo;                // Low 64 bits.
+    int32_t own;                // Route ending at this prefix, -1 for a marker only.
+    int32_t best;               // Longest route matching this prefix (itself included), -1 for none.
+    uint8_t len;                // Prefix length.
+    bool used;                  // Slot taken.
+} ipv6_slot;
+
+// An IPv6 routing table, rebuilt as a whole from its routes.
+typedef struct ipv6_table {
+    ipv6_slot *slots;           // Open addressing table of every length, on 2 MB pages when the host has them.
+    size_t capacity;            // Slots, a power of two.
+    size_t used;                // Slots taken, routes and markers.
+    size_t markers;             // Slots that are markers only.
+    route6 *routes;             // Routes installed, the slots' indexes.
+    size_t size;                // Number of routes installed.
+    int32_t fallback;           // Default route (::/0), -1 for none.
+    uint8_t lengths[IPV6_BITS]; // Distinct prefix lengths (1 to 128), ascending.
+    int num_lengths;
+} ipv6_table;
+
+/** @brief Read IPv6 routing entries (prefix/len next_hop interface) from a file. */
+route6*         Read_IPV6_Routes            (char *file, int *count);
+/** @brief Build an IPv6 routing table from an array of routes, the later of two duplicates kept. */
+ipv6_table*     Build_IPV6_Table            (const route6 *routes, int count);
+/** @brief Create an IPv6 routing table from a file containing routing entries. */
+ipv6_table*     Create_IPV6_Table           (char *file);
+/** @brief Free the memory associated with an IPv6 routing table. */
+void            Free_IPV6_Table             (ipv6_table **ip_table);
+/** @brief Bytes of memory taken by an IPv6 routing table. */
+size_t          Size_IPV6_Table             (const ipv6_table *ip_table);
+
+/** @brief Perform Longest Prefix Match (LPM) in an IPv6 routing table. */
+bool            Lookup_IPV6_Table           (const ipv6_table *ip_table, const struct in6_addr *ip, forward6 *lpm);
+/** @brief Perform Longest Prefix Match (LPM) for a vector of addresses (at most MAX_BATCH) at once. */
+void            Lookup_IPV6_Batch           (const ipv6_table *ip_table, const struct in6_addr *ips, int count, forward6 *lpms);
+
+#endif /* IPV6_TABLE_H_ */
@@ -0,0 +1,542 @@
+#include "./conntrack.h"
+#include "../../utils/hugepage.h"
+
+#include <netinet/in.h>
+
+#define CT_BATCH        32                  // Lookups whose buckets are prefetched together.
+#define CT_PORT_STEP    4001                // Stride through the ports, prime to their range.
+
+// A bucket of the search for a cuckoo path.
+typedef struct ct_path_node {
+    uint32_t bucket;
+    int16_t parent;                         // Node whose key would move here, -1 for the new key's buckets.
+    uint8_t slot;                           // Slot of that key in the parent's bucket.
+} ct_path_node;
+
+/* -------------------------------------------------- CREATE CONNTRACK -------------------------------------------------- */
+
+/**
+ * @brief Create a table of a number of flows, all its memory allocated up front.
+ *
+ * The buckets are the fewest, a power of two, that keep the two keys of every flow under
+ * CT_MAX_LOAD percent of their slots. Every slot is cleared and every flow put in the free
+ * list here, so the pages are touched before the first packet, not by it.
+ *
+ * @param flows The most flows tracked at once, 1 to CT_MAX_FLOWS.
+ * @return A pointer to the new table or NULL if memory allocation fails.
+ */
+conntrack* Create_Conntrack(uint32_t flows) {
+    if (!flows || flows > CT_MAX_FLOWS) return NULL;
+    conntrack *ct = (conntrack*)calloc(1, sizeof(conntrack));
+    if (!ct) return NULL;
+
+    uint32_t buckets = 1;
+    while ((uint64_t)buckets * CT_BUCKET_SLOTS * CT_MAX_LOAD < 2ull * flows * 100) buckets <<= 1;
+    ct->bucket_mask = buckets - 1;
+    ct->capacity = flows;
+    pthread_mutex_init(&ct->lock, NULL);
+
+    // The regions come zeroed: every tag 0, every sequence count even.
+    ct->buckets = (ct_bucket*)Huge_Alloc((size_t)buckets * sizeof(ct_bucket), HUGE_CONNTRACK);
+    ct->entries = (ct_entry*)Huge_Alloc((size_t)flows * sizeof(ct_entry), HUGE_CONNTRACK);
+    if (!ct->buckets || !ct->entries) {
+        Free_Conntrack(&ct);
+        return NULL;
+    }
+
+    for (uint32_t bucket = 0; bucket < buckets; bucket++) {
+        for (int slot = 0; slot < CT_BUCKET_SLOTS; slot++) {
+            atomic_init(&ct->buckets[bucket].refs[slot], CT_NONE);
+        }
+    }
+    for (uint32_t flow = 0; flow < flows; flow++) {
+        ct->entries[flow].next = flow + 1 < flows ? flow + 1 : CT_NONE;
+    }
+    ct->free_head = 0;
+    ct->free_tail = flows - 1;
+
+    for (int slot = 0; slot < CT_WHEEL_SLOTS; slot++) ct->wheel[slot] = CT_NONE;
+    atomic_init(&ct->moves, 0);
+    atomic_init(&ct->clock, 0);
+    ct->turned = 0;
+
+    return ct;
+}
+
+/**
+ * @brief Free a table.
+ *
+ * @param ct A pointer to the table pointer to be freed.
+ */
+void Free_Conntrack(conntrack **ct) {
+    if (!ct || !(*ct)) return;
+    Huge_Free((*ct)->buckets);
+    Huge_Free((*ct)->entries);
+    pthread_mutex_destroy(&(*ct)->lock);
+    free(*ct);
+    *ct = NULL;
+}
+
+/**
+ * @brief Bytes of memory taken by a table.
+ *
+ * @param ct The table.
+ * @return The bytes of its buckets, flows and header.
+ */
+size_t Size_Conntrack(const conntrack *ct) {
+    return sizeof(conntrack) + ((size_t)ct->bucket_mask + 1) * sizeof(ct_bucket) +
+           (size_t)ct->capacity * sizeof(ct_entry);
+}
+
+/* -------------------------------------------------- CREATE CONNTRACK -------------------------------------------------- */
+/* -------------------------------------------------- LOOKUP CONNTRACK -------------------------------------------------- */
+
+/**
+ * @brief Whether two tuples are the same, compared as two words.
+ */
+static inline bool Same_CT_Tuple(const ct_tuple *first, const ct_tuple *second) {
+    uint64_t a[2], b[2];
+    memcpy(a, first, sizeof(a));
+    memcpy(b, second, sizeof(b));
+    return a[0] == b[0] && a[1] == b[1];
+}
+
+/**
+ * @brief Look for a key in one bucket.
+ *
+ * A slot is only followed to its flow when its tag matches. The flow's tuples are copied
+ * under its sequence count: a flow being written, or rewritten meanwhile, has the search
+ * start over rather than compare a torn tuple.
+ *
+ * @param ct     The table.
+ * @param bucket The bucket.
+ * @param tag    The tag of the key.
+ * @param key    The key.
+ * @param other  Receives the tuple of the other direction of the flow found.
+ * @param retry  Set if the search is to start over.
+ * @return The reference of the key, CT_NONE if it is not in the bucket.
+ */
+static inline uint32_t Search_CT_Bucket(const conntrack *ct, const ct_bucket *bucket, uint16_t tag,
+                                        const ct_tuple *key, ct_tuple *other, bool *retry) {
+    for (int slot = 0; slot < CT_BUCKET_SLOTS; slot++) {
+        if (atomic_load_explicit(&bucket->tags[slot], memory_order_relaxed) != tag) continue;
+        uint32_t ref = atomic_load_explicit(&bucket->refs[slot], memory_order_acquire);
+        if (ref == CT_NONE) continue;
+
+        const ct_entry *entry = &ct->entries[ref >> 1];
+        uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        ct_tuple found = entry->tuples[ref & 1];
+        *other = entry->tuples[!(ref & 1)];
+        atomic_thread_fence(memory_order_acquire);
+        if ((seq & 1) || seq != atomic_load_explicit(&entry->seq, memory_order_relaxed)) {
+            *retry = true;
+            return CT_NONE;
+        }
+        if (Same_CT_Tuple(&found, key)) return ref;
+    }
+    return CT_NONE;
+}
+
+/**
+ * @brief Find the flow of a packet's tuple, without locking.
+ *
+ * Both buckets of the key are searched. A key moved from the bucket not searched yet to the
+ * one searched already would be missed, so a miss counts as one only if no key moved meanwhile.
+ *
+ * @param ct    The table.
+ * @param key   The tuple, as the packet carries it.
+ * @param hash  Its hash (Hash_CT_Tuple).
+ * @param other Receives the tuple of the other direction of the flow: the packet's translation.
+ * @return The flow's index << 1 | the direction of the key, CT_NONE if there is no such flow.
+ */
+uint32_t Lookup_Conntrack(const conntrack *ct, const ct_tuple *key, uint64_t hash, ct_tuple *other) {
+    uint16_t tag = (uint16_t)(hash >> 48);
+    uint32_t first = (uint32_t)hash & ct->bucket_mask;
+    uint32_t second = Alt_CT_Bucket(ct, first, tag);
+
+    while (true) {
+        uint32_t moves = atomic_load_explicit(&ct->moves, memory_order_acquire);
+        bool retry = false;
+        uint32_t ref = Search_CT_Bucket(ct, &ct->buckets[first], tag, key, other, &retry);
+        if (ref == CT_NONE && !retry) ref = Search_CT_Bucket(ct, &ct->buckets[second], tag, key, other, &retry);
+        if (ref != CT_NONE) return ref;
+        if (retry) continue;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&ct->moves, memory_order_relaxed) == moves) return CT_NONE;
+    }
+}
+
+/**
+ * @brief Find the flows of a vector of tuples, their buckets prefetched ahead.
+ *
+ * The tuples are hashed and their buckets prefetched CT_BATCH at a time, so the cache misses
+ * of a batch overlap instead of following one another.
+ *
+ * @param ct     The table.
+ * @param keys   The tuples.
+ * @param count  Their number.
+ * @param refs   Receives the reference of every tuple, CT_NONE for a miss.
+ * @param others Receives the tuple of the other direction of every flow found.
+ */
+void Lookup_Conntrack_Batch(const conntrack *ct, const ct_tuple *keys, int count, uint32_t *refs, ct_tuple *others) {
+    uint64_t hashes[CT_BATCH];
+
+    for (int base = 0; base < count; base += CT_BATCH) {
+        int batch = count - base < CT_BATCH ? count - base : CT_BATCH;
+        for (int key = 0; key < batch; key++) {
+            hashes[key] = Hash_CT_Tuple(&keys[base + key]);
+            Prefetch_Conntrack(ct, hashes[key]);
+        }
+        for (int key = 0; key < batch; key++) {
+            refs[base + key] = Lookup_Conntrack(ct, &keys[base + key], hashes[key], &others[base + key]);
+        }
+    }
+}
+
+/* -------------------------------------------------- LOOKUP CONNTRACK -------------------------------------------------- */
+/* -------------------------------------------------- INSERT CONNTRACK -------------------------------------------------- */
+
+/**
+ * @brief First free slot of a bucket, -1 if it is full.
+ */
+static inline int Free_CT_Slot(const ct_bucket *bucket) {
+    for (int slot = 0; slot < CT_BUCKET_SLOTS; slot++) {
+        if (atomic_load_explicit(&bucket->refs[slot], memory_order_relaxed) == CT_NONE) return slot;
+    }
+    return -1;
+}
+
+/**
+ * @brief Write a key in a slot: its tag first, its reference last, which publishes it.
+ */
+static inline void Set_CT_Slot(ct_bucket *bucket, int slot, uint16_t tag, uint32_t ref) {
+    atomic_store_explicit(&bucket->tags[slot], tag, memory_order_relaxed);
+    atomic_store_explicit(&bucket->refs[slot], ref, memory_order_release);
+}
+
+/**
+ * @brief Whether a bucket is on the path from a node back to the key's buckets.
+ */
+static bool On_CT_Path(const ct_path_node *nodes, int node, uint32_t bucket) {
+    for (; node >= 0; node = nodes[node].parent) {
+        if (nodes[node].bucket == bucket) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Free a slot in one of a key's buckets, moving keys to their other bucket if both are full.
+ *
+ * A breadth-first search from the two buckets finds the nearest bucket with a free slot,
+ * then the keys on the path to it move from its end back: every key is written in its new
+ * slot before its old one is reused, and the moves count bumped in between, so a lookup
+ * racing with the moves finds the key or retries.
+ *
+ * @param ct     The table, under its lock.
+ * @param first  The first bucket of the key.
+ * @param second Its other bucket.
+ * @param bucket Receives the bucket of the free slot, first or second.
+ * @param slot   Receives the free slot.
+ * @return False if no bucket within CT_BFS_NODES has a free slot.
+ */
+static bool Make_CT_Room(conntrack *ct, uint32_t first, uint32_t second, uint32_t *bucket, int *slot) {
+    ct_path_node nodes[CT_BFS_NODES];
+    int count = 0;
+    nodes[count++] = (ct_path_node){first, -1, 0};
+    if (second != first) nodes[count++] = (ct_path_node){second, -1, 0};
+
+    for (int node = 0; node < count; node++) {
+        ct_bucket *current = &ct->buckets[nodes[node].bucket];
+        int free_slot = Free_CT_Slot(current);
+        if (free_slot < 0) {
+            // Full: the keys of the bucket could move to their other bucket.
+            for (int key = 0; key < CT_BUCKET_SLOTS && count < CT_BFS_NODES; key++) {
+                uint16_t tag = atomic_load_explicit(&current->tags[key], memory_order_relaxed);
+                uint32_t alt = Alt_CT_Bucket(ct, nodes[node].bucket, tag);
+                if (On_CT_Path(nodes, node, alt)) continue;
+                nodes[count++] = (ct_path_node){alt, (int16_t)node, (uint8_t)key};
+            }
+            continue;
+        }
+
+        // Move the keys along the path, the last one into the free slot.
+        int at = node;
+        while (nodes[at].parent >= 0) {
+            ct_bucket *from = &ct->buckets[nodes[nodes[at].parent].bucket];
+            ct_bucket *to = &ct->buckets[nodes[at].bucket];
+            int moved = nodes[at].slot;
+            Set_CT_Slot(to, free_slot, atomic_load_explicit(&from->tags[moved], memory_order_relaxed),
+                        atomic_load_explicit(&from->refs[moved], memory_order_relaxed));
+            atomic_fetch_add_explicit(&ct->moves, 1, memory_order_release);
+            ct->displaced++;
+            free_slot = moved;
+            at = nodes[at].parent;
+        }
+        *bucket = nodes[at].bucket;
+        *slot = free_slot;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Insert a key of a flow.
+ *
+ * @param ct  The table, under its lock.
+ * @param key The tuple.
+ * @param ref The flow's index << 1 | the direction of the tuple.
+ * @return False if neither bucket of the key could be given a free slot.
+ */
+static bool Insert_CT_Key(conntrack *ct, const ct_tuple *key, uint32_t ref) {
+    uint64_t hash = Hash_CT_Tuple(key);
+    uint16_t tag = (uint16_t)(hash >> 48);
+    uint32_t first = (uint32_t)hash & ct->bucket_mask;
+
+    uint32_t bucket;
+    int slot;
+    if (!Make_CT_Room(ct, first, Alt_CT_Bucket(ct, first, tag), &bucket, &slot)) return false;
+    Set_CT_Slot(&ct->buckets[bucket], slot, tag, ref);
+    return true;
+}
+
+/**
+ * @brief Remove a key of a flow.
+ *
+ * @param ct  The table, under its lock.
+ * @param key The tuple.
+ * @param ref The flow's index << 1 | the direction of the tuple.
+ */
+static void Remove_CT_Key(conntrack *ct, const ct_tuple *key, uint32_t ref) {
+    uint64_t hash = Hash_CT_Tuple(key);
+    uint32_t first = (uint32_t)hash & ct->bucket_mask;
+    uint32_t buckets[2] = {first, Alt_CT_Bucket(ct, first, (uint16_t)(hash >> 48))};
+
+    for (int which = 0; which < 2; which++) {
+        ct_bucket *bucket = &ct->buckets[buckets[which]];
+        for (int slot = 0; slot < CT_BUCKET_SLOTS; slot++) {
+            if (atomic_load_explicit(&bucket->refs[slot], memory_order_relaxed) == ref) {
+                atomic_store_explicit(&bucket->refs[slot], CT_NONE, memory_order_release);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Arm the timer of a flow, in the wheel slot of its deadline.
+ *
+ * A deadline past the wheel's lap fires early, at the end of the lap, and is armed again then.
+ *
+ * @param ct       The table, under its lock.
+ * @param flow     The flow.
+ * @param deadline The clock it expires at if it sees no packet, after the wheel's last turn.
+ */
+static void Arm_CT_Timer(conntrack *ct, uint32_t flow, uint32_t deadline) {
+    if (deadline - ct->turned >= CT_WHEEL_SLOTS) deadline = ct->turned + CT_WHEEL_SLOTS - 1;
+    uint32_t slot = deadline % CT_WHEEL_SLOTS;
+    ct->entries[flow].next = ct->wheel[slot];
+    ct->wheel[slot] = flow;
+}
+
+/**
+ * @brief Pick the translated port of a new flow: its own if no other flow uses it, else a free one.
+ *
+ * The replies of the flow are told from those of the others by their tuple alone, so it must
+ * not be any other flow's key. Tuples without a source port (ICMP but the echoes, protocols
+ * without ports) are translated on the address alone: one such flow per remote host.
+ *
+ * @param ct       The table, under its lock.
+ * @param original The flow's tuple, from the host that opened it.
+ * @param hash     Its hash, where the search through the ports starts.
+ * @param reply    The reply tuple, its destination port set to the port picked.
+ * @return False if every port tried is taken.
+ */
+static bool Pick_CT_Port(conntrack *ct, const ct_tuple *original, uint64_t hash, ct_tuple *reply) {
+    ct_tuple other;
+    reply->dport = original->sport;
+    if (Lookup_Conntrack(ct, reply, Hash_CT_Tuple(reply), &other) == CT_NONE) return true;
+    if (!original->sport) return false;
+
+    uint32_t range = CT_PORT_MAX - CT_PORT_MIN + 1;
+    uint32_t start = (uint32_t)(hash >> 16) % range;
+    for (uint32_t attempt = 0; attempt < CT_PORT_TRIES; attempt++) {
+        reply->dport = htons((uint16_t)(CT_PORT_MIN + (start + attempt * CT_PORT_STEP) % range));
+        if (Lookup_Conntrack(ct, reply, Hash_CT_Tuple(reply), &other) == CT_NONE) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Create the flow of an outgoing tuple, translated to an address and a free port.
+ *
+ * The reply tuple comes from the remote end to the translated address and port. The flow is
+ * written under its sequence count before its keys are published, then its timer armed for
+ * a flow nothing came back to yet.
+ *
+ * @param ct       The table.
+ * @param original The tuple of the packet, from the host behind the router.
+ * @param nat_addr The address to translate its source to (network order).
+ * @param reply    Receives the reply tuple, the translation of the original one.
+ * @return The flow's index << 1 | CT_ORIGINAL, or the reference of the tuple if another worker
+ *         created the flow first, CT_NONE if the table is full or the tuple cannot be translated.
+ */
+uint32_t Insert_Conntrack(conntrack *ct, const ct_tuple *original, uint32_t nat_addr, ct_tuple *reply) {
+    uint64_t hash = Hash_CT_Tuple(original);
+    pthread_mutex_lock(&ct->lock);
+
+    uint32_t ref = Lookup_Conntrack(ct, original, hash, reply);
+    if (ref != CT_NONE) {
+        pthread_mutex_unlock(&ct->lock);
+        return ref;
+    }
+
+    memset(reply, 0, sizeof(*reply));
+    reply->saddr = original->daddr;
+    reply->daddr = nat_addr;
+    reply->sport = original->dport;
+    reply->proto = original->proto;
+
+    uint32_t flow = ct->free_head;
+    if (flow == CT_NONE || !Pick_CT_Port(ct, original, hash, reply)) {
+        ct->refused++;
+        pthread_mutex_unlock(&ct->lock);
+        return CT_NONE;
+    }
+
+    ct_entry *entry = &ct->entries[flow];
+    uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+    atomic_store_explicit(&entry->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry->tuples[CT_ORIGINAL] = *original;
+    entry->tuples[CT_REPLY] = *reply;
+    atomic_store_explicit(&entry->seen, atomic_load_explicit(&ct->clock, memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(&entry->flags, 0, memory_order_relaxed);
+    atomic_store_explicit(&entry->seq, seq + 2, memory_order_release);
+
+    if (!Insert_CT_Key(ct, original, flow << 1 | CT_ORIGINAL)) {
+        ct->refused++;
+        pthread_mutex_unlock(&ct->lock);
+        return CT_NONE;
+    }
+    if (!Insert_CT_Key(ct, reply, flow << 1 | CT_REPLY)) {
+        Remove_CT_Key(ct, original, flow << 1 | CT_ORIGINAL);
+        ct->refused++;
+        pthread_mutex_unlock(&ct->lock);
+        return CT_NONE;
+    }
+
+    ct->free_head = entry->next;
+    if (ct->free_head == CT_NONE) ct->free_tail = CT_NONE;
+    Arm_CT_Timer(ct, flow, atomic_load_explicit(&ct->clock, memory_order_relaxed) + CT_TIMEOUT_NEW);
+    ct->active++;
+    ct->created++;
+
+    pthread_mutex_unlock(&ct->lock);
+    return flow << 1 | CT_ORIGINAL;
+}
+
+/* -------------------------------------------------- INSERT CONNTRACK -------------------------------------------------- */
+/* -------------------------------------------------- EXPIRE CONNTRACK -------------------------------------------------- */
+
+/**
+ * @brief Seconds a flow lives after its last packet, by its protocol and what went through.
+ */
+static uint32_t CT_Timeout(const ct_entry *entry) {
+    uint8_t flags = atomic_load_explicit(&entry->flags, memory_order_relaxed);
+    if (flags & CT_CLOSING) return CT_TIMEOUT_CLOSE;
+    if (!(flags & CT_REPLIED)) return CT_TIMEOUT_NEW;
+
+    switch (entry->tuples[CT_ORIGINAL].proto) {
+        case IPPROTO_TCP: return CT_TIMEOUT_TCP;
+        case IPPROTO_UDP: return CT_TIMEOUT_UDP;
+        default: return CT_TIMEOUT_OTHER;
+    }
+}
+
+/**
+ * @brief Remove a flow: its keys, then the flow to the end of the free list.
+ *
+ * The flow is reused last, so a worker that found it just before still reads it whole; its
+ * tuples stay until it is reused, under a new sequence count.
+ *
+ * @param ct   The table, under its lock.
+ * @param flow The flow.
+ */
+static void Remove_CT_Flow(conntrack *ct, uint32_t flow) {
+    ct_entry *entry = &ct->entries[flow];
+    Remove_CT_Key(ct, &entry->tuples[CT_ORIGINAL], flow << 1 | CT_ORIGINAL);
+    Remove_CT_Key(ct, &entry->tuples[CT_REPLY], flow << 1 | CT_REPLY);
+
+    entry->next = CT_NONE;
+    if (ct->free_tail == CT_NONE) ct->free_head = flow;
+    else ct->entries[ct->free_tail].next = flow;
+    ct->free_tail = flow;
+    ct->active--;
+}
+
+/**
+ * @brief Advance the clock and remove the flows idle for longer than their timeout.
+ *
+ * The timers are lazy: the packets only stamp their flow, and a timer that fires checks the
+ * flow's last packet, arming itself again for the flow's new deadline if it saw one. The wheel
+ * turns a slot per second up to the clock; the lock is let go every CT_EXPIRE_BATCH timers so
+ * that a mass expiry does not hold the insertions.
+ *
+ * @param ct  The table.
+ * @param now The clock, in seconds, never going back.
+ * @return The number of flows removed.
+ */
+uint64_t Expire_Conntrack(conntrack *ct, uint32_t now) {
+    uint64_t expired = 0;
+    uint32_t fired = 0;
+    pthread_mutex_lock(&ct->lock);
+    atomic_store_explicit(&ct->clock, now, memory_order_relaxed);
+
+    while ((int32_t)(now - ct->turned) > 0) {
+        ct->turned++;
+        // The slot's flows are taken out whole, the timers armed meanwhile go to a fresh list.
+        uint32_t flow = ct->wheel[ct->turned % CT_WHEEL_SLOTS];
+        ct->wheel[ct->turned % CT_WHEEL_SLOTS] = CT_NONE;
+
+        while (flow != CT_NONE) {
+            ct_entry *entry = &ct->entries[flow];
+            uint32_t next = entry->next;
+            uint32_t deadline = atomic_load_explicit(&entry->seen, memory_order_relaxed) + CT_Timeout(entry);
+            if ((int32_t)(deadline - now) <= 0) {
+                Remove_CT_Flow(ct, flow);
+                expired++;
+            } else {
+                Arm_CT_Timer(ct, flow, deadline);
+            }
+            flow = next;
+
+            if (++fired % CT_EXPIRE_BATCH == 0) {
+                pthread_mutex_unlock(&ct->lock);
+                pthread_mutex_lock(&ct->lock);
+            }
+        }
+    }
+
+    ct->expired += expired;
+    pthread_mutex_unlock(&ct->lock);
+    return expired;
+}
+
+/* -------------------------------------------------- EXPIRE CONNTRACK -------------------------------------------------- */
+
+/**
+ * @brief Print the flows, load and memory of a table.
+ *
+ * @param out The output stream.
+ * @param ct  The table.
+ */
+void Dump_Conntrack(FILE *out, conntrack *ct) {
+    pthread_mutex_lock(&ct->lock);
+    uint64_t slots = ((uint64_t)ct->bucket_mask + 1) * CT_BUCKET_SLOTS;
+    fprintf(out, "conntrack: %llu/%u flows (%.1f%% of the slots), %llu created, %llu expired, %llu refused, "
+            "%llu keys displaced, %.1f MB\n", (unsigned long long)ct->active, ct->capacity,
+            100.0 * 2 * ct->active / slots, (unsigned long long)ct->created, (unsigned long long)ct->expired,
+            (unsigned long long)ct->refused, (unsigned long long)ct->displaced, Size_Conntrack(ct) / 1048576.0);
+    pthread_mutex_unlock(&ct->lock);
+}
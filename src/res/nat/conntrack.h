@@ -0,0 +1,169 @@
+#pragma once
+
+#ifndef CONNTRACK_H_
+#define CONNTRACK_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define CT_BUCKET_SLOTS     8               // Keys of a bucket, a bucket fills one cache line.
+#define CT_MAX_LOAD         90              // Keys per 100 slots at most, once every flow is in use.
+#define CT_BFS_NODES        512             // Buckets searched for a cuckoo path at most.
+#define CT_WHEEL_SLOTS      512             // Seconds of the timer wheel, more than the longest timeout.
+#define CT_EXPIRE_BATCH     1024            // Timers fired under one hold of the lock.
+#define CT_PORT_TRIES       64              // Ports tried for a new flow before it is refused.
+#define CT_PORT_MIN         1024            // Ports handed out to the translated flows.
+#define CT_PORT_MAX         65535
+#define CT_DEFAULT_FLOWS    (1u << 20)
+#define CT_MAX_FLOWS        (1u << 26)
+#define CT_NONE             UINT32_MAX      // Free slot, end of a list, flow not found.
+
+#define CT_ORIGINAL         0               // Direction of the packets of the host that opened the flow.
+#define CT_REPLY            1               // Direction of the packets answering them.
+
+#define CT_REPLIED          0x01            // A packet came back in the reply direction.
+#define CT_CLOSING          0x02            // A TCP FIN or RST went through.
+
+// Seconds a flow lives after its last packet.
+#define CT_TIMEOUT_NEW      30              // Nothing came back yet.
+#define CT_TIMEOUT_TCP      300
+#define CT_TIMEOUT_UDP      60
+#define CT_TIMEOUT_OTHER    30              // ICMP and the other protocols.
+#define CT_TIMEOUT_CLOSE    10              // TCP after a FIN or a RST.
+
+// CONNECTIONS ARE KEPT IN A BUCKETIZED CUCKOO HASH TABLE (MemC3, Fan et al.; DPDK's rte_hash):
+// every key, a flow's tuple in one direction, lives in one of two buckets of 8 slots, the second
+// derived from the first and a 16-bit tag of the key, so keys move between them without being
+// hashed again. A key is inserted in a free slot of its buckets or, when both are full, at the end
+// of a path of keys moved to their other bucket, found by a breadth-first search. The lookups take
+// no lock: a slot holds a reference to a preallocated flow, whose tuples are read under its
+// sequence count, and a key found in neither bucket is looked for again if a key moved meanwhile.
+
+// A flow's 5-tuple as the packets of one direction carry it, network order. ICMP echoes carry their
+// identifier in place of the source port of the requests and of the destination port of the replies.
+typedef struct ct_tuple {
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t proto;
+    uint8_t pad[3];             // Zero, tuples compare as 16 bytes.
+} ct_tuple;
+
+// A flow: the tuples of its two directions, either one being the translation of the other.
+typedef struct ct_entry {
+    _Atomic uint32_t seq;       // Even when stable, odd while the tuples are written.
+    uint32_t next;              // Next flow in its timer wheel slot, or in the free list.
+    ct_tuple tuples[2];         // CT_ORIGINAL then CT_REPLY.
+    _Atomic uint32_t seen;      // Clock of the last packet, stamped by the workers.
+    _Atomic uint8_t flags;      // CT_REPLIED / CT_CLOSING, set by the workers.
+} __attribute__((aligned(64))) ct_entry;
+
+// Keys of one bucket: a tag to skip the other keys without touching their flows, and a reference.
+typedef struct ct_bucket {
+    _Atomic uint16_t tags[CT_BUCKET_SLOTS];
+    _Atomic uint32_t refs[CT_BUCKET_SLOTS];  // Flow index << 1 | direction, CT_NONE for a free slot.
+} __attribute__((aligned(64))) ct_bucket;
+
+// Connection tracking table shared by the workers: lock-free lookups, insertions and expiry serialized.
+typedef struct conntrack {
+    ct_bucket *buckets;
+    uint32_t bucket_mask;       // Buckets minus one, a power of two.
+    ct_entry *entries;          // Flows, preallocated.
+    uint32_t capacity;
+
+    _Atomic uint32_t moves;     // Keys moved to their other bucket, a lookup that raced with one retries.
+    _Atomic uint32_t clock;     // Seconds since the table was created, advanced by Expire_Conntrack.
+
+    pthread_mutex_t lock;       // Serializes the insertions and the expiry, lookups never take it.
+    uint32_t free_head;         // Free flows, the longest free reused last.
+    uint32_t free_tail;
+    uint32_t wheel[CT_WHEEL_SLOTS]; // Flows by the second their timer fires.
+    uint32_t turned;            // Last second the wheel fired.
+
+    uint64_t active;            // Flows in the table, under the lock.
+    uint64_t created;
+    uint64_t expired;
+    uint64_t refused;           // Flows not created: table full, no free port, no cuckoo path.
+    uint64_t displaced;         // Keys moved by the insertions.
+} conntrack;
+
+/**
+ * @brief Hash of a tuple: the bucket is taken from the low bits, the tag from the high 16.
+ */
+static inline uint64_t Hash_CT_Tuple(const ct_tuple *key) {
+    uint64_t addrs, ports;
+    memcpy(&addrs, &key->saddr, sizeof(addrs));
+    memcpy(&ports, &key->sport, sizeof(ports));
+
+    // MurmurHash3's 64-bit finalizer over both words, every input bit reaches the tag.
+    uint64_t hash = addrs ^ (ports * 0xc2b2ae3d27d4eb4full);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief The other bucket of a key, from one of its buckets and its tag: each is the other's other.
+ */
+static inline uint32_t Alt_CT_Bucket(const conntrack *ct, uint32_t bucket, uint16_t tag) {
+    return (bucket ^ (((uint32_t)tag + 1) * 0x5bd1e995u)) & ct->bucket_mask;
+}
+
+/** @brief Prefetch the two buckets of a hash, ahead of its lookup. */
+static inline void Prefetch_Conntrack(const conntrack *ct, uint64_t hash) {
+    uint32_t bucket = (uint32_t)hash & ct->bucket_mask;
+    __builtin_prefetch(&ct->buckets[bucket]);
+    __builtin_prefetch(&ct->buckets[Alt_CT_Bucket(ct, bucket, (uint16_t)(hash >> 48))]);
+}
+
+/**
+ * @brief Record a packet of a flow: its clock, and whether it was a reply or closed the connection.
+ *
+ * The flow's line is only written when something changed, at most once a second.
+ *
+ * @param ct    The table.
+ * @param ref   The flow and direction the packet was found in.
+ * @param flags CT_CLOSING for a TCP FIN or RST, 0 otherwise.
+ */
+static inline void Touch_Conntrack(conntrack *ct, uint32_t ref, uint8_t flags) {
+    ct_entry *entry = &ct->entries[ref >> 1];
+    uint32_t now = atomic_load_explicit(&ct->clock, memory_order_relaxed);
+    if (atomic_load_explicit(&entry->seen, memory_order_relaxed) != now) {
+        atomic_store_explicit(&entry->seen, now, memory_order_relaxed);
+    }
+    if ((ref & 1) == CT_REPLY) flags |= CT_REPLIED;
+    if (flags & ~atomic_load_explicit(&entry->flags, memory_order_relaxed)) {
+        atomic_fetch_or_explicit(&entry->flags, flags, memory_order_relaxed);
+    }
+}
+
+/** @brief Create a table of a number of flows, all its memory allocated up front. */
+conntrack*      Create_Conntrack        (uint32_t flows);
+/** @brief Free a table. */
+void            Free_Conntrack          (conntrack **ct);
+/** @brief Bytes of memory taken by a table. */
+size_t          Size_Conntrack          (const conntrack *ct);
+
+/** @brief Find the flow of a packet's tuple, without locking. */
+uint32_t        Lookup_Conntrack        (const conntrack *ct, const ct_tuple *key, uint64_t hash, ct_tuple *other);
+/** @brief Find the flows of a vector of tuples, their buckets prefetched ahead. */
+void            Lookup_Conntrack_Batch  (const conntrack *ct, const ct_tuple *keys, int count,
+                                         uint32_t *refs, ct_tuple *others);
+/** @brief Create the flow of an outgoing tuple, translated to an address and a free port. */
+uint32_t        Insert_Conntrack        (conntrack *ct, const ct_tuple *original, uint32_t nat_addr, ct_tuple *reply);
+/** @brief Advance the clock and remove the flows idle for longer than their timeout. */
+uint64_t        Expire_Conntrack        (conntrack *ct, uint32_t now);
+
+/** @brief Print the flows, load and memory of a table. */
+void            Dump_Conntrack          (FILE *out, conntrack *ct);
+
+#endif /* CONNTRACK_H_ */
@@ -0,0 +1,161 @@
+#include "./nat.h"
+
+/* ---------------------------------------------------- TRANSLATE NAT ---------------------------------------------------- */
+
+/**
+ * @brief Patch a checksum in a header for one of the 16-bit words it covers (RFC 1624).
+ *
+ * A transport checksum left for the egress to finish (LINK_CSUM_PARTIAL) holds the sum of the
+ * pseudo-header, not its complement, and is patched as such.
+ *
+ * @param field    The checksum, wherever it lies in the header.
+ * @param old_word The word before, in the byte order of the packet.
+ * @param new_word The word after.
+ * @param partial  Whether the field is a partial sum.
+ */
+static inline void Patch_NAT_Check(uint8_t *field, uint16_t old_word, uint16_t new_word, bool partial) {
+    uint16_t check;
+    memcpy(&check, field, sizeof(check));
+    check = partial ? (uint16_t)~Checksum_Adjust((uint16_t)~check, old_word, new_word)
+                    : Checksum_Adjust(check, old_word, new_word);
+    memcpy(field, &check, sizeof(check));
+}
+
+/**
+ * @brief Patch a checksum for a changed address, its two words.
+ */
+static inline void Patch_NAT_Addr(uint8_t *field, uint32_t old_addr, uint32_t new_addr, bool partial) {
+    uint16_t old_words[2], new_words[2];
+    memcpy(old_words, &old_addr, sizeof(old_words));
+    memcpy(new_words, &new_addr, sizeof(new_words));
+    Patch_NAT_Check(field, old_words[0], new_words[0], partial);
+    Patch_NAT_Check(field, old_words[1], new_words[1], partial);
+}
+
+/**
+ * @brief Rewrite a packet's addresses and ports to the reverse of a tuple, its checksums patched.
+ *
+ * The packet of one direction of a flow is translated to the reverse of the other direction:
+ * an outgoing packet takes the source the replies are sent to, a reply the destination the
+ * flow came from. The IPv4 checksum is patched for the addresses, the TCP / UDP checksum for the
+ * addresses (pseudo-header) and the ports, the ICMP checksum for the echo identifier. A partial
+ * transport checksum covers the pseudo-header only, the egress sums the ports.
+ *
+ * @param ip_hdr  The IPv4 header, its transport header checked by NAT_Tuple_IPV4.
+ * @param offload The offload state of the frame.
+ * @param other   The tuple of the other direction of the packet's flow.
+ */
+void Translate_NAT_IPV4(struct iphdr *ip_hdr, const link_offload *offload, const ct_tuple *other) {
+    uint8_t *transport = (uint8_t *)ip_hdr + ip_hdr->ihl * 4;
+    bool partial = offload->flags & LINK_CSUM_PARTIAL;
+    uint16_t ports[2] = {other->dport, other->sport};
+
+    uint8_t *check = NULL;                  // Transport checksum, NULL if none.
+    bool pseudo = true;                     // It covers the addresses.
+    uint8_t *fields[2] = {NULL, NULL};      // Source and destination ports, NULL if none.
+    uint16_t udp_check = 0;
+
+    switch (ip_hdr->protocol) {
+        case IPPROTO_TCP:
+            check = transport + 16;
+            fields[0] = transport;
+            fields[1] = transport + 2;
+            break;
+        case IPPROTO_UDP:
+            // A UDP checksum of 0 means the sender did not compute one.
+            memcpy(&udp_check, transport + 6, sizeof(udp_check));
+            if (udp_check || partial) check = transport + 6;
+            fields[0] = transport;
+            fields[1] = transport + 2;
+            break;
+        case IPPROTO_ICMP:
+            check = transport + 2;
+            pseudo = false;
+            if (transport[0] == ICMP_ECHO_REQUEST) fields[0] = transport + 4;
+            else if (transport[0] == ICMP_RESPONE) fields[1] = transport + 4;
+            break;
+        default:
+            break;
+    }
+
+    if (ip_hdr->saddr != other->daddr) {
+        Patch_NAT_Addr((uint8_t *)&ip_hdr->check, ip_hdr->saddr, other->daddr, false);
+        if (check && pseudo) Patch_NAT_Addr(check, ip_hdr->saddr, other->daddr, partial);
+        ip_hdr->saddr = other->daddr;
+    }
+    if (ip_hdr->daddr != other->saddr) {
+        Patch_NAT_Addr((uint8_t *)&ip_hdr->check, ip_hdr->daddr, other->saddr, false);
+        if (check && pseudo) Patch_NAT_Addr(check, ip_hdr->daddr, other->saddr, partial);
+        ip_hdr->daddr = other->saddr;
+    }
+
+    for (int port = 0; port < 2; port++) {
+        if (!fields[port]) continue;
+        uint16_t old_port;
+        memcpy(&old_port, fields[port], sizeof(old_port));
+        if (old_port == ports[port]) continue;
+        if (check && !partial) Patch_NAT_Check(check, old_port, ports[port], false);
+        memcpy(fields[port], &ports[port], sizeof(ports[port]));
+    }
+
+    // A UDP checksum that comes to 0 is sent as all ones (RFC 768).
+    if (ip_hdr->protocol == IPPROTO_UDP && check && !partial) {
+        memcpy(&udp_check, check, sizeof(udp_check));
+        if (!udp_check) memset(check, 0xff, sizeof(udp_check));
+    }
+}
+
+/* ---------------------------------------------------- TRANSLATE NAT ---------------------------------------------------- */
+/* ------------------------------------------------------ SLOW PATH ------------------------------------------------------ */
+
+/**
+ * @brief Translate the destination of a reply to a translated flow back (DNAT), on the slow path.
+ *
+ * Only the packets from the outside to the address of the interface they came in on can be
+ * replies: the flows leave with the address of their egress, and their replies come back
+ * there. The others, and the packets of no flow, are left as they are.
+ *
+ * @param route The routing context, its IPv4 header set.
+ */
+void DNAT_IPV4(routing *route) {
+    conntrack *ct = route->ctrl->conntrack;
+    if (!ct || route->ctrl->nat_inside[route->interface] ||
+        route->ip_hdr->daddr != Get_IPV4_Interface(route->interface)) return;
+
+    ct_tuple key, other;
+    uint8_t flags;
+    if (!NAT_Tuple_IPV4(route->ip_hdr, route->len - sizeof(struct ethhdr), &key, &flags)) return;
+    uint32_t ref = Lookup_Conntrack(ct, &key, Hash_CT_Tuple(&key), &other);
+    if (ref == CT_NONE || (ref & 1) != CT_REPLY) return;
+
+    Touch_Conntrack(ct, ref, flags);
+    Translate_NAT_IPV4(route->ip_hdr, &route->offload, &other);
+}
+
+/**
+ * @brief Translate the source of a packet leaving the inside (SNAT), on the slow path.
+ *
+ * The first packet of a flow creates it, translated to the address of the egress interface.
+ *
+ * @param route   The routing context, its IPv4 header set and its interface the egress.
+ * @param ingress The interface the packet came in on.
+ * @return False if the packet is to be dropped: it cannot be tracked (a fragment, a truncated
+ *         header) or no flow could be created for it.
+ */
+bool SNAT_IPV4(routing *route, int ingress) {
+    if (!NAT_Outbound(route->ctrl, ingress, route->interface)) return true;
+    conntrack *ct = route->ctrl->conntrack;
+
+    ct_tuple key, other;
+    uint8_t flags;
+    if (!NAT_Tuple_IPV4(route->ip_hdr, route->len - sizeof(struct ethhdr), &key, &flags)) return false;
+    uint32_t ref = Lookup_Conntrack(ct, &key, Hash_CT_Tuple(&key), &other);
+    if (ref == CT_NONE) ref = Insert_Conntrack(ct, &key, Get_IPV4_Interface(route->interface), &other);
+    if (ref == CT_NONE || (ref & 1) != CT_ORIGINAL) return false;
+
+    Touch_Conntrack(ct, ref, flags);
+    Translate_NAT_IPV4(route->ip_hdr, &route->offload, &other);
+    return true;
+}
+
+/* ------------------------------------------------------ SLOW PATH ------------------------------------------------------ */
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef NAT_H_
+#define NAT_H_
+
+#include "../../include/router.h"
+#include "../ipv4/ipv4.h"
+
+#define     NAT_TCP_LEN         20          /* TCP header without options */
+#define     NAT_UDP_LEN         8
+#define     NAT_ICMP_LEN        8           /* ICMP header, with the echo identifier */
+#define     NAT_TCP_FLAGS       13          /* Offset of the TCP flags */
+#define     NAT_TCP_FIN         0x01
+#define     NAT_TCP_RST         0x04
+
+/**
+ * @brief Tuple of an IPv4 packet for the conntrack, and whether it closes its TCP connection.
+ *
+ * Fragments are not tracked: past the first they carry no ports to translate.
+ *
+ * @param ip_hdr The IPv4 header.
+ * @param len    Bytes of the packet from its IPv4 header on.
+ * @param key    Receives the tuple.
+ * @param flags  Receives CT_CLOSING for a TCP FIN or RST, 0 otherwise.
+ * @return False if the packet cannot be tracked: a fragment, or a truncated transport header.
+ */
+static inline bool NAT_Tuple_IPV4(const struct iphdr *ip_hdr, size_t len, ct_tuple *key, uint8_t *flags) {
+    if (ip_hdr->frag_off & htons(IPV4_MF | IPV4_OFFSET)) return false;
+    size_t header = (size_t)ip_hdr->ihl * 4;
+    const uint8_t *transport = (const uint8_t *)ip_hdr + header;
+
+    memset(key, 0, sizeof(*key));
+    key->saddr = ip_hdr->saddr;
+    key->daddr = ip_hdr->daddr;
+    key->proto = ip_hdr->protocol;
+    *flags = 0;
+
+    switch (ip_hdr->protocol) {
+        case IPPROTO_TCP:
+            if (len < header + NAT_TCP_LEN) return false;
+            memcpy(&key->sport, transport, 2 * sizeof(uint16_t));
+            if (transport[NAT_TCP_FLAGS] & (NAT_TCP_FIN | NAT_TCP_RST)) *flags = CT_CLOSING;
+            break;
+        case IPPROTO_UDP:
+            if (len < header + NAT_UDP_LEN) return false;
+            memcpy(&key->sport, transport, 2 * sizeof(uint16_t));
+            break;
+        case IPPROTO_ICMP:
+            if (len < header + NAT_ICMP_LEN) return false;
+            // The echoes are told apart by their identifier, the requests' source and the replies' destination.
+            if (transport[0] == ICMP_ECHO_REQUEST) memcpy(&key->sport, transport + 4, sizeof(uint16_t));
+            else if (transport[0] == ICMP_RESPONE) memcpy(&key->dport, transport + 4, sizeof(uint16_t));
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+/** @brief Whether a packet from an interface to another is translated (SNAT), true only with NAT. */
+static inline bool NAT_Outbound(const control *ctrl, int ingress, int egress) {
+    return ctrl->conntrack && ctrl->nat_inside[ingress] && !ctrl->nat_inside[egress];
+}
+
+/** @brief Rewrite a packet's addresses and ports to the reverse of a tuple, its checksums patched. */
+extern void        Translate_NAT_IPV4 (struct iphdr *ip_hdr, const link_offload *offload, const ct_tuple *other);
+/** @brief Translate the destination of a reply to a translated flow back (DNAT), on the slow path. */
+extern void        DNAT_IPV4          (routing *route);
+/** @brief Translate the source of a packet leaving the inside (SNAT), on the slow path. */
+extern bool        SNAT_IPV4          (routing *route, int ingress);
+
+#endif /* NAT_H_ */
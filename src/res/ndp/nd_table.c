@@ -0,0 +1,89 @@
+#include "./nd_table.h"
+#include "../../utils/hugepage.h"
+
+/* --------------------------------------------------  CREATE ND TABLE  --------------------------------------------------- */
+
+/**
+ * @brief Create a new neighbor cache.
+ * 
+ * @return A pointer to the newly created neighbor cache or NULL if memory allocation fails.
+ */
+nd_table* Create_ND_Table(void) {
+    nd_table *nd = malloc(sizeof(*nd));
+    if (!nd) return NULL;
+
+    // The entries share the 2 MB pages of the neighbors with the ARP table when the host has them.
+    nd->addrs = Huge_Alloc(sizeof(*nd->addrs) * ND_SIZE, HUGE_NEIGHBORS);
+    if (!nd->addrs) {
+        free(nd);
+        return NULL;
+    }
+
+    atomic_init(&nd->len, 0);
+    pthread_mutex_init(&nd->lock, NULL);
+    return nd;
+}
+
+/**
+ * @brief Free a neighbor cache.
+ * 
+ * @param nd A pointer to the neighbor cache pointer to be freed.
+ */
+void Free_ND_Table(nd_table **nd) {
+    if (!nd || !(*nd)) return;
+    Huge_Free((*nd)->addrs);
+    pthread_mutex_destroy(&(*nd)->lock);
+    free(*nd);
+    *nd = NULL;
+}
+
+/* --------------------------------------------------  CREATE ND TABLE  --------------------------------------------------- */
+/* ---------------------------------------------------  GET ND ENTRY  ----------------------------------------------------- */
+
+/**
+ * @brief Get the index of a neighbor cache entry.
+ * 
+ * Lock-free: only the entries published before the acquire load of the length are scanned.
+ * 
+ * @param nd The neighbor cache to search in.
+ * @param ip The IPv6 address to search for.
+ * @return The index of the entry in the neighbor cache or -1 if not found.
+ */
+int Get_ND_Entry(nd_table *nd, const struct in6_addr *ip) {
+    if (!nd || !nd->addrs) return -1;
+    int len = atomic_load_explicit(&nd->len, memory_order_acquire);
+    for (int entry = 0; entry < len; entry++) {
+        if (!memcmp(&nd->addrs[entry].ip, ip, sizeof(*ip))) return entry;
+    }
+    return -1;
+}
+
+/* ---------------------------------------------------  GET ND ENTRY  ----------------------------------------------------- */
+/* --------------------------------------------------  INSERT ND ENTRY  --------------------------------------------------- */
+
+/**
+ * @brief Insert a neighbor cache entry.
+ * 
+ * The entry is written first, then published to the lookups by a release store of the length.
+ * 
+ * @param nd        The neighbor cache to insert into.
+ * @param new_entry The address and MAC address of the neighbor.
+ * @return True if the entry was added, false if it was already there or the cache is full.
+ */
+bool Insert_ND_Entry(nd_table *nd, const nd_entry *new_entry) {
+    if (!nd || !nd->addrs) return false;
+
+    pthread_mutex_lock(&nd->lock);
+    int len = atomic_load_explicit(&nd->len, memory_order_relaxed);
+
+    bool inserted = Get_ND_Entry(nd, &new_entry->ip) < 0 && len < ND_SIZE;
+    if (inserted) {
+        nd->addrs[len] = *new_entry;
+        atomic_store_explicit(&nd->len, len + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&nd->lock);
+
+    return inserted;
+}
+
+/* --------------------------------------------------  INSERT ND ENTRY  --------------------------------------------------- */
@@ -0,0 +1,42 @@
+#pragma once
+
+#ifndef ND_TABLE_H_
+#define ND_TABLE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "../arp/arp_table.h"
+
+#define ND_SIZE ARP_SIZE
+
+// Neighbor cache entry, the IPv6 counterpart of an ARP entry.
+typedef struct nd_entry {
+    struct in6_addr ip;     // IPv6 address in network byte order
+    uint8_t mac[MAC_SIZE];  // MAC address in binary form
+} nd_entry;
+
+// Neighbor cache, filled by the advertisements of the neighbors.
+typedef struct nd_table {
+    nd_entry *addrs;        // Array of neighbor entries, never modified once published.
+    atomic_int len;         // Number entries in the table, published with release semantics.
+    pthread_mutex_t lock;   // Serializes writers, lookups never take it.
+} nd_table;
+
+/** @brief Create a new neighbor cache. */
+nd_table*       Create_ND_Table         (void);
+/** @brief Free a neighbor cache. */
+void            Free_ND_Table           (nd_table **nd);
+
+/** @brief Get the index of a neighbor cache entry. */
+int             Get_ND_Entry            (nd_table *nd, const struct in6_addr *ip);
+/** @brief Insert a neighbor cache entry. */
+bool            Insert_ND_Entry         (nd_table *nd, const nd_entry *new_entry);
+
+#endif /* ND_TABLE_H_ */
@@ -0,0 +1,191 @@
+#include "./ndp.h"
+
+#define ND_LEN (sizeof(struct ethhdr) + sizeof(struct ip6hdr) + sizeof(struct nd_msg))
+
+/* --------------------------------------------------- ND SOLICIT ------------------------------------------------------ */
+
+/**
+ * @brief Fill the IPv6 header of a neighbor discovery message and its checksum.
+ *
+ * @param ip6_hdr The IPv6 header, followed by the message.
+ * @param saddr   The source address.
+ * @param daddr   The destination address.
+ */
+static void Header_ND(struct ip6hdr *ip6_hdr, const struct in6_addr *saddr, const struct in6_addr *daddr) {
+    struct nd_msg *nd = (struct nd_msg *)(ip6_hdr + 1);
+
+    ip6_hdr->vtc_flow = htonl(IPV6_VERSION << 28);
+    ip6_hdr->payload_len = htons(sizeof(struct nd_msg));
+    ip6_hdr->next_header = NEXT_ICMPV6;
+    ip6_hdr->hop_limit = ND_HOP_LIMIT;
+    ip6_hdr->saddr = *saddr;
+    ip6_hdr->daddr = *daddr;
+
+    nd->icmp6.checksum = 0;
+    nd->icmp6.checksum = Checksum_ICMPV6(ip6_hdr, nd, sizeof(*nd));
+}
+
+/**
+ * @brief Generate a Neighbor Solicitation for the rout's IPv6 next hop in its buffer.
+ *
+ * The solicitation goes to the next hop's solicited-node multicast group (ff02::1:ffXX:XXXX),
+ * on its Ethernet multicast address (33:33:ff:XX:XX:XX), with the router's MAC in a source
+ * link-layer address option so the neighbor can answer without soliciting back.
+ *
+ * @param rout The rout structure, its next_hop6 and interface set.
+ * @return True if the solicitation was built, false if the interface has no IPv6 address to send it from.
+ */
+bool Solicit_NDP(routing *rout) {
+    struct in6_addr saddr, daddr = { .s6_addr = { 0xff, 0x02, [11] = 0x01, [12] = 0xff } };
+    if (!Source_IPV6(rout->interface, &saddr)) return false;
+    memcpy(&daddr.s6_addr[13], &rout->next_hop6.s6_addr[13], 3);
+
+    STATS_EVENT(ND_SOLICITS_OUT, 1);
+
+    rout->eth_hdr->ether_type = IPV6_TYPE;
+    Get_MAC_Interface(rout->interface, rout->eth_hdr->ether_shost);
+    const uint8_t dhost[MAC_SIZE] = { 0x33, 0x33, 0xff, daddr.s6_addr[13], daddr.s6_addr[14], daddr.s6_addr[15] };
+    memcpy(rout->eth_hdr->ether_dhost, dhost, MAC_SIZE);
+
+    rout->ip6_hdr = (struct ip6hdr *)(rout->buf + sizeof *rout->eth_hdr);
+    struct nd_msg *nd = (struct nd_msg *)(rout->ip6_hdr + 1);
+    memset(nd, 0, sizeof(*nd));
+    nd->icmp6.type = ND_SOLICIT;
+    nd->target = rout->next_hop6;
+    nd->opt_type = ND_OPT_SOURCE;
+    nd->opt_len = 1;
+    Get_MAC_Interface(rout->interface, nd->lladdr);
+
+    Header_ND(rout->ip6_hdr, &saddr, &daddr);
+    rout->len = ND_LEN;
+    return true;
+}
+
+/* --------------------------------------------------- ND SOLICIT ------------------------------------------------------ */
+/* ------------------------------------------------- HANDLER ND PACKETS ------------------------------------------------ */
+
+/**
+ * @brief Cache a neighbor's MAC address and send the IPv6 packets waiting for it.
+ *
+ * The packets leave whether the neighbor is new, already cached (with the cached address, as the
+ * fast path uses) or left out of a full cache (with the advertised one), as Handler_ARP does.
+ *
+ * @param rout The rout structure.
+ * @param ip   The neighbor's address.
+ * @param mac  The neighbor's MAC address.
+ */
+static void Learn_Neighbor(routing *rout, const struct in6_addr *ip, const uint8_t *mac) {
+    nd_table *neighbors = rout->ctrl->neighbors;
+    nd_entry entry = { .ip = *ip };
+    memcpy(entry.mac, mac, MAC_SIZE);
+
+    // Any neighbor change invalidates the decisions the workers cached.
+    if (Insert_ND_Entry(neighbors, &entry)) Bump_Generation(rout->ctrl);
+    int entry_idx = Get_ND_Entry(neighbors, ip);
+    if (entry_idx >= 0) mac = neighbors->addrs[entry_idx].mac;
+
+    // The queue is shared by the workers, walk it exactly once under its lock.
+    pthread_mutex_lock(&rout->ctrl->waiting_lock);
+    queue pending = Queue();
+    while (!EmptyQueue(rout->ctrl->waiting6)) {
+        packet *pkt = Dequeue(rout->ctrl->waiting6);
+
+        if (!memcmp(&pkt->next_hop6, ip, sizeof(*ip))) {
+            // Hop limit already decremented, only the Ethernet header is left to write.
+            struct ethhdr *eth_hdr = (struct ethhdr *)pkt->buf;
+            memcpy(eth_hdr->ether_dhost, mac, MAC_SIZE);
+            Get_MAC_Interface(pkt->interface, eth_hdr->ether_shost);
+
+            // Send the packet to the resolved MAC address, its latency counts the wait.
+            Send_Offload_Link(pkt->interface, pkt->buf, pkt->len, &pkt->offload, pkt->stamp, PATH_ARP);
+
+            free(pkt->buf);
+            free(pkt);
+            rout->ctrl->waiting_len--;
+        } else {
+            Enqueue(pending, (void *)pkt);
+        }
+    }
+    // Keep the unresolved packets in their original order.
+    while (!EmptyQueue(pending)) {
+        Enqueue(rout->ctrl->waiting6, Dequeue(pending));
+    }
+    pthread_mutex_unlock(&rout->ctrl->waiting_lock);
+    FreeQueue(pending);
+}
+
+/**
+ * @brief Answer a Neighbor Solicitation for one of the interface's addresses, in place.
+ *
+ * @param rout The rout structure containing the solicitation.
+ * @param nd   The solicitation.
+ */
+static void Advertise_NDP(routing *rout, struct nd_msg *nd) {
+    struct ip6hdr *ip6_hdr = rout->ip6_hdr;
+    struct in6_addr target = nd->target, sender = ip6_hdr->saddr;
+
+    STATS_EVENT(ND_ADVERTS_OUT, 1);
+
+    // Back to the sender's MAC, from the interface's.
+    memcpy(rout->eth_hdr->ether_dhost, rout->eth_hdr->ether_shost, MAC_SIZE);
+    Get_MAC_Interface(rout->interface, rout->eth_hdr->ether_shost);
+
+    memset(nd, 0, sizeof(*nd));
+    nd->icmp6.type = ND_ADVERT;
+    nd->icmp6.un.flags = ND_FLAG_ROUTER | ND_FLAG_SOLICITED | ND_FLAG_OVERRIDE;
+    nd->target = target;
+    nd->opt_type = ND_OPT_TARGET;
+    nd->opt_len = 1;
+    Get_MAC_Interface(rout->interface, nd->lladdr);
+
+    Header_ND(ip6_hdr, &target, &sender);
+    rout->len = ND_LEN;
+}
+
+/**
+ * @brief Handle incoming Neighbor Solicitations and Advertisements in the rout.
+ *
+ * A solicitation for one of the interface's addresses is answered, and teaches the sender's
+ * MAC address; an advertisement teaches the target's. Either releases the packets waiting for
+ * the neighbor. Messages that did not come from the link (hop limit below 255), with a bad
+ * checksum or too short are ignored.
+ *
+ * @param rout The rout structure containing the received packet, its IPv6 header set.
+ */
+void Handler_NDP(routing *rout) {
+    struct ip6hdr *ip6_hdr = rout->ip6_hdr;
+    size_t payload = ntohs(ip6_hdr->payload_len);
+    if (payload < sizeof(struct icmp6hdr) + sizeof(struct in6_addr) ||
+        rout->len < sizeof *rout->eth_hdr + sizeof(*ip6_hdr) + payload) return;
+
+    struct nd_msg *nd = (struct nd_msg *)(ip6_hdr + 1);
+    if (ip6_hdr->hop_limit != ND_HOP_LIMIT || nd->icmp6.code != 0) return;
+    if (Checksum_ICMPV6(ip6_hdr, nd, payload) != 0) return;
+
+    // The link-layer address option, when it is the first one.
+    bool has_option = payload >= sizeof(*nd) && nd->opt_len == 1;
+
+    if (nd->icmp6.type == ND_SOLICIT) {
+        STATS_EVENT(ND_SOLICITS_IN, 1);
+        if (!Is_IPV6_Local(rout->interface, &nd->target)) return;
+
+        // Duplicate address detection (from ::) is not answered, the router does not defend its addresses.
+        static const struct in6_addr unspecified;
+        if (!memcmp(&ip6_hdr->saddr, &unspecified, sizeof(unspecified))) return;
+        if (has_option && nd->opt_type == ND_OPT_SOURCE) Learn_Neighbor(rout, &ip6_hdr->saddr, nd->lladdr);
+
+        // Over the reply rate, the solicitation is dropped before anything is rewritten.
+        if (!Police(rout->policer, rout->interface, POLICE_ARP_REPLY)) return;
+        Advertise_NDP(rout, nd);
+        Send_To_Link(rout->interface, rout->buf, rout->len);
+        return;
+    }
+
+    if (nd->icmp6.type != ND_ADVERT) return;
+    STATS_EVENT(ND_ADVERTS_IN, 1);
+
+    // Without the option, the advertisement came from the MAC it is about.
+    Learn_Neighbor(rout, &nd->target, has_option && nd->opt_type == ND_OPT_TARGET ? nd->lladdr : rout->eth_hdr->ether_shost);
+}
+
+/* ------------------------------------------------- HANDLER ND PACKETS ------------------------------------------------ */
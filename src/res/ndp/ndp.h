@@ -0,0 +1,24 @@
+#pragma once
+
+#ifndef NDP_H_
+#define NDP_H_
+
+#include "../ipv6/ipv6.h"
+
+#define 	ND_SOLICIT 			(uint8_t)135
+#define 	ND_ADVERT 			(uint8_t)136
+
+#define 	ND_OPT_SOURCE 		(uint8_t)1		/* Source link-layer address option */
+#define 	ND_OPT_TARGET 		(uint8_t)2		/* Target link-layer address option */
+#define 	ND_HOP_LIMIT 		(uint8_t)255	/* Sent and expected, so the message comes from the link */
+
+#define 	ND_FLAG_ROUTER 		htonl(0x80000000u)
+#define 	ND_FLAG_SOLICITED 	htonl(0x40000000u)
+#define 	ND_FLAG_OVERRIDE 	htonl(0x20000000u)
+
+/** @brief Generate a Neighbor Solicitation for the rout's IPv6 next hop in its buffer. */
+extern bool        Solicit_NDP         (routing *rout);
+/** @brief Handle incoming Neighbor Solicitations and Advertisements in the rout. */
+extern void        Handler_NDP         (routing *rout);
+
+#endif /* NDP_H_ */
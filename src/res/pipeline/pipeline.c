@@ -0,0 +1,776 @@
+#include "./pipeline.h"
+#include "../ipv4/ipv4.h"
+#include "../ipv6/ipv6.h"
+#include "../arp/arp.h"
+#include "../icmp/icmp.h"
+#include "../nat/nat.h"
+#include "../../utils/profile.h"
+#include "../../utils/hugepage.h"
+
+/* ------------------------------------------------- CREATE PIPELINE ------------------------------------------------- */
+
+/**
+ * @brief Create a pipeline and its frame buffers.
+ *
+ * The frame buffers come from a single block on 2 MB pages when the host has them, one
+ * slot per frame as large as the link's frames: the largest MTU, or a super-packet with -g.
+ *
+ * @return A pointer to the new pipeline or NULL if memory allocation fails.
+ */
+pipeline* Create_Pipeline(void) {
+    pipeline *pipe = (pipeline*)calloc(1, sizeof(pipeline));
+    if (!pipe) return NULL;
+
+    // The block is page aligned and the frame size a multiple of the cache line, so is every slot.
+    // Slots a page multiple apart would put all the headers in the same cache sets, shift them a line.
+    size_t slot = Get_Frame_Size();
+    if (slot % 4096 == 0) slot += 64;
+
+    pipe->memory = Huge_Alloc((size_t)VECTOR_SIZE * slot, HUGE_PACKETS);
+    if (!pipe->memory) {
+        free(pipe);
+        return NULL;
+    }
+
+    for (int frame = 0; frame < VECTOR_SIZE; frame++) {
+        pipe->bufs[frame] = pipe->memory + (size_t)frame * slot;
+    }
+
+    return pipe;
+}
+
+/**
+ * @brief Free a pipeline and its frame buffers.
+ *
+ * @param pipe A pointer to the pipeline pointer to be freed.
+ */
+void Free_Pipeline(pipeline **pipe) {
+    if (!pipe || !(*pipe)) return;
+    Huge_Free((*pipe)->memory);
+    free(*pipe);
+    *pipe = NULL;
+}
+
+/* ------------------------------------------------- CREATE PIPELINE ------------------------------------------------- */
+/* ------------------------------------------------- PIPELINE STAGES ------------------------------------------------- */
+
+/**
+ * @brief Append a frame to a vector.
+ *
+ * @param vec   The vector.
+ * @param frame The frame index.
+ */
+static inline void Push_Frame(vector *vec, int frame) {
+    vec->idx[vec->len++] = (uint16_t)frame;
+}
+
+/**
+ * @brief Parse stage: validate the Ethernet and IPv4 headers of the whole vector.
+ *
+ * ARP frames go to the ARP vector, IPv4 frames with a valid checksum to the IPv4 vector and
+ * IPv6 frames, if IPv6 is routed, to the IPv6 vector. IPv4 headers with options are left to
+ * the scalar handler, everything else is dropped. The headers of super-packets (-g) are not
+ * checked again: the kernel checked them when GRO coalesced the packets, or wrote them.
+ *
+ * @param pipe The pipeline.
+ * @param ipv6 Whether IPv6 is routed.
+ */
+static void Stage_Parse(pipeline *pipe, bool ipv6) {
+    for (int frame = 0; frame < pipe->count; frame++) {
+        pipe->filtered[frame] = false;
+        pipe->translated[frame] = false;
+        if (pipe->lens[frame] < sizeof(struct ethhdr)) {
+            STATS_DROP(DROP_MALFORMED, 1);
+            continue;
+        }
+        struct ethhdr *eth_hdr = (struct ethhdr *)pipe->bufs[frame];
+
+        if (eth_hdr->ether_type == ARP_TYPE) {
+            if (pipe->lens[frame] >= sizeof(struct ethhdr) + sizeof(struct arphdr)) {
+                Push_Frame(&pipe->arp, frame);
+            } else {
+                STATS_DROP(DROP_MALFORMED, 1);
+            }
+            continue;
+        }
+
+        if (ipv6 && eth_hdr->ether_type == IPV6_TYPE) {
+            if (pipe->lens[frame] >= sizeof(struct ethhdr) + sizeof(struct ip6hdr)) {
+                Push_Frame(&pipe->ipv6, frame);
+            } else {
+                STATS_DROP(DROP_MALFORMED, 1);
+            }
+            continue;
+        }
+
+        if (eth_hdr->ether_type != IP_TYPE) {
+            STATS_DROP(DROP_ETHERTYPE, 1);
+            continue;
+        }
+        if (pipe->lens[frame] < sizeof(struct ethhdr) + sizeof(struct iphdr)) {
+            STATS_DROP(DROP_MALFORMED, 1);
+            continue;
+        }
+
+        // Headers no handler can follow are dropped here, those with options go to the scalar handler.
+        struct iphdr *ip_hdr = (struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+        if (ip_hdr->version != IPV4_VERSION || ip_hdr->ihl < IPV4_IHL ||
+            ip_hdr->ihl * 4u > pipe->lens[frame] - sizeof(struct ethhdr)) {
+            STATS_DROP(DROP_MALFORMED, 1);
+            continue;
+        }
+        if (ip_hdr->ihl != IPV4_IHL) {
+            Push_Frame(&pipe->slow, frame);
+            continue;
+        }
+
+        // The packet is left untouched, invalid headers are dropped before their line is dirtied.
+        if (pipe->offloads[frame].gso_type == LINK_GSO_NONE && !Checksum_Valid(ip_hdr, sizeof(struct iphdr))) {
+            STATS_DROP(DROP_CHECKSUM, 1);
+            continue;
+        }
+        Push_Frame(&pipe->ipv4, frame);
+    }
+}
+
+/**
+ * @brief ACL stage: drop the IPv4 packets the ingress ACL denies, before any of them is looked up.
+ *
+ * The whole vector is classified within one read-side section, so with the same rule set even
+ * if it is replaced meanwhile. Nothing is done without an ACL.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_ACL(routing *route, pipeline *pipe) {
+    if (!pipe->ipv4.len || !atomic_load_explicit(&route->ctrl->acl, memory_order_relaxed)) return;
+
+    const acl_table *acl = Enter_ACL(route);
+    if (!acl) {
+        Exit_ACL(route);
+        return;
+    }
+
+    int kept = 0;
+    for (int pos = 0; pos < pipe->ipv4.len; pos++) {
+        int frame = pipe->ipv4.idx[pos];
+        const struct iphdr *ip_hdr = (const struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+
+        acl_key key;
+        ACL_Key_IPV4(ip_hdr, pipe->lens[frame] - sizeof(struct ethhdr), &key);
+        if (Filter_ACL(acl, &key) != ACL_PERMIT) {
+            STATS_DROP(DROP_ACL, 1);
+            continue;
+        }
+        pipe->filtered[frame] = true;
+        pipe->ipv4.idx[kept++] = (uint16_t)frame;
+    }
+    pipe->ipv4.len = kept;
+    Exit_ACL(route);
+}
+
+/**
+ * @brief DNAT stage: translate the replies of the translated flows back to the hosts they go to.
+ *
+ * The IPv4 packets from the outside to the address of the interface they came in on are looked
+ * up in the conntrack, as a batch. The replies of a flow take the destination of the host that
+ * opened it and are forwarded from then on, the other packets stay for the router. Nothing is
+ * done without NAT.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_DNAT(routing *route, pipeline *pipe) {
+    conntrack *ct = route->ctrl->conntrack;
+    if (!ct || !pipe->ipv4.len) return;
+
+    ct_tuple keys[VECTOR_SIZE], others[VECTOR_SIZE];
+    uint32_t refs[VECTOR_SIZE];
+    uint8_t flags[VECTOR_SIZE];
+    uint16_t frames[VECTOR_SIZE];
+    int count = 0;
+
+    for (int pos = 0; pos < pipe->ipv4.len; pos++) {
+        int frame = pipe->ipv4.idx[pos];
+        const struct iphdr *ip_hdr = (const struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+
+        if (route->ctrl->nat_inside[pipe->ifaces[frame]] || ip_hdr->daddr != Get_IPV4_Interface(pipe->ifaces[frame])) {
+            continue;
+        }
+        if (NAT_Tuple_IPV4(ip_hdr, pipe->lens[frame] - sizeof(struct ethhdr), &keys[count], &flags[count])) {
+            frames[count++] = (uint16_t)frame;
+        }
+    }
+    if (!count) return;
+
+    Lookup_Conntrack_Batch(ct, keys, count, refs, others);
+    for (int key = 0; key < count; key++) {
+        if (refs[key] == CT_NONE || (refs[key] & 1) != CT_REPLY) continue;
+        int frame = frames[key];
+        Touch_Conntrack(ct, refs[key], flags[key]);
+        Translate_NAT_IPV4((struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr)), &pipe->offloads[frame],
+                           &others[key]);
+    }
+}
+
+/**
+ * @brief Classify stage: split the IPv4 vector between local delivery and forwarding.
+ *
+ * Echo requests addressed to the router itself are answered on the fast path, its other
+ * packets take the slow path.
+ *
+ * @param pipe The pipeline.
+ */
+static void Stage_Classify(pipeline *pipe) {
+    for (int pos = 0; pos < pipe->ipv4.len; pos++) {
+        int frame = pipe->ipv4.idx[pos];
+        struct iphdr *ip_hdr = (struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+
+        if (ip_hdr->daddr == Get_IPV4_Interface(pipe->ifaces[frame])) {
+            Push_Frame(Is_Echo_Request(pipe->bufs[frame], pipe->lens[frame]) ? &pipe->local : &pipe->slow, frame);
+        } else {
+            pipe->daddrs[pipe->forward.len] = ip_hdr->daddr;
+            Push_Frame(&pipe->forward, frame);
+        }
+    }
+}
+
+/**
+ * @brief Local stage: turn the echo requests into their replies in place, within the echo rate.
+ *
+ * The echo buckets are refilled at one clock read for the whole vector. The replies leave
+ * with the forwarded frames, in the TX burst of the interface they came in on.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_Local(routing *route, pipeline *pipe) {
+    if (!pipe->local.len) return;
+
+    uint64_t now = Police_Now();
+    for (int pos = 0; pos < pipe->local.len; pos++) {
+        int frame = pipe->local.idx[pos];
+        int interface = pipe->ifaces[frame];
+
+        if (!Police_At(route->policer, interface, POLICE_ICMP_ECHO, now)) continue;
+        Echo_ICMP(pipe->bufs[frame], interface);
+        Push_Frame(&pipe->tx[interface], frame);
+    }
+}
+
+/**
+ * @brief Lookup stage: flow cache probe, then batched LPM for the misses of the whole vector.
+ *
+ * Every frame is looked up in the VRF of its ingress interface. Multipath routes take the
+ * path of the frame's flow. Unroutable and TTL-expired packets leave for the slow path (ICMP
+ * errors), as do the packets over the egress MTU (fragmentation).
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_Lookup(routing *route, pipeline *pipe) {
+    // A new shared FIB image makes every cached route stale.
+    if (route->fib && Refresh_Shared_FIB(route->fib)) Bump_Generation(route->ctrl);
+    uint32_t generation = atomic_load_explicit(&route->ctrl->generation, memory_order_acquire);
+    uint32_t miss_daddrs[VECTOR_SIZE];
+    int miss_ifaces[VECTOR_SIZE];
+    forward miss_routes[VECTOR_SIZE];
+    uint16_t miss_pos[VECTOR_SIZE];
+    int misses = 0;
+
+    // Most of the traffic goes to a few destinations, answer those from the cache.
+    for (int pos = 0; pos < pipe->forward.len; pos++) {
+        int iface = pipe->ifaces[pipe->forward.idx[pos]];
+        const flow_entry *flow = Lookup_Flow(route->flows, pipe->daddrs[pos], route->ctrl->vrf[iface], generation);
+        pipe->cached[pos] = flow != NULL;
+
+        if (flow) {
+            pipe->routes[pos].status = true;
+            pipe->routes[pos].next_hop = flow->next_hop;
+            pipe->routes[pos].interface = flow->interface == FLOW_GROUP ? NH_GROUP : flow->interface;
+            memcpy(pipe->l2[pos], flow->dhost, MAC_SIZE);
+            memcpy(pipe->l2[pos] + MAC_SIZE, flow->shost, MAC_SIZE);
+        } else {
+            miss_daddrs[misses] = pipe->daddrs[pos];
+            miss_ifaces[misses] = iface;
+            miss_pos[misses++] = (uint16_t)pos;
+        }
+    }
+
+    if (misses) Lookup_Routes(route, miss_daddrs, miss_ifaces, misses, miss_routes);
+    for (int miss = 0; miss < misses; miss++) {
+        pipe->routes[miss_pos[miss]] = miss_routes[miss];
+    }
+
+    int kept = 0;
+    for (int pos = 0; pos < pipe->forward.len; pos++) {
+        int frame = pipe->forward.idx[pos];
+        struct iphdr *ip_hdr = (struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+
+        pipe->groups[pos] = -1;
+        if (pipe->routes[pos].status && pipe->routes[pos].interface == NH_GROUP) {
+            pipe->groups[pos] = (int32_t)pipe->routes[pos].next_hop;
+            pipe->members[pos] = (uint8_t)Select_Path(route, &pipe->routes[pos],
+                                                      Flow_Hash_IPV4(ip_hdr, pipe->lens[frame] - sizeof(struct ethhdr)));
+        }
+
+        if (!pipe->routes[pos].status || ip_hdr->ttl <= 1) {
+            Push_Frame(&pipe->slow, frame);
+            continue;
+        }
+        // Routes through an interface the router was not started with are dropped.
+        if (pipe->routes[pos].interface < 0 || pipe->routes[pos].interface >= ROUTER_NUM_INTERFACES) {
+            STATS_DROP(DROP_NO_INTERFACE, 1);
+            continue;
+        }
+        if (Wire_Packet_Len(pipe->bufs[frame], pipe->lens[frame], &pipe->offloads[frame]) >
+            (size_t)Get_MTU_Interface(pipe->routes[pos].interface)) {
+            Push_Frame(&pipe->slow, frame);
+            continue;
+        }
+
+        pipe->routes[kept] = pipe->routes[pos];
+        pipe->daddrs[kept] = pipe->daddrs[pos];
+        pipe->cached[kept] = pipe->cached[pos];
+        pipe->groups[kept] = pipe->groups[pos];
+        pipe->members[kept] = pipe->members[pos];
+        memcpy(pipe->l2[kept], pipe->l2[pos], sizeof(pipe->l2[pos]));
+        pipe->forward.idx[kept++] = (uint16_t)frame;
+    }
+    pipe->forward.len = kept;
+}
+
+/**
+ * @brief SNAT stage: translate the source of the packets leaving the inside for the outside.
+ *
+ * The forwarded packets from an inside interface to an outside one are looked up in the
+ * conntrack as a batch; the first packet of a flow creates it, translated to the address of
+ * its egress interface and a free port. Packets that cannot be tracked or translated are
+ * dropped rather than leak the inside addresses. Nothing is done without NAT.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_SNAT(routing *route, pipeline *pipe) {
+    conntrack *ct = route->ctrl->conntrack;
+    if (!ct || !pipe->forward.len) return;
+
+    ct_tuple keys[VECTOR_SIZE], others[VECTOR_SIZE];
+    uint32_t refs[VECTOR_SIZE];
+    uint8_t flags[VECTOR_SIZE];
+    uint16_t positions[VECTOR_SIZE];
+    bool dropped[VECTOR_SIZE] = {false};
+    int count = 0, drops = 0;
+
+    for (int pos = 0; pos < pipe->forward.len; pos++) {
+        int frame = pipe->forward.idx[pos];
+        if (!NAT_Outbound(route->ctrl, pipe->ifaces[frame], pipe->routes[pos].interface)) continue;
+
+        const struct iphdr *ip_hdr = (const struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+        if (NAT_Tuple_IPV4(ip_hdr, pipe->lens[frame] - sizeof(struct ethhdr), &keys[count], &flags[count])) {
+            positions[count++] = (uint16_t)pos;
+        } else {
+            dropped[pos] = true;
+            drops++;
+        }
+    }
+
+    if (count) Lookup_Conntrack_Batch(ct, keys, count, refs, others);
+    for (int key = 0; key < count; key++) {
+        int pos = positions[key];
+        int frame = pipe->forward.idx[pos];
+        if (refs[key] == CT_NONE) {
+            refs[key] = Insert_Conntrack(ct, &keys[key], Get_IPV4_Interface(pipe->routes[pos].interface), &others[key]);
+        }
+        if (refs[key] == CT_NONE || (refs[key] & 1) != CT_ORIGINAL) {
+            dropped[pos] = true;
+            drops++;
+            continue;
+        }
+        Touch_Conntrack(ct, refs[key], flags[key]);
+        Translate_NAT_IPV4((struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr)), &pipe->offloads[frame],
+                           &others[key]);
+        pipe->translated[frame] = true;
+    }
+    if (!drops) return;
+
+    STATS_DROP(DROP_NAT, drops);
+    int kept = 0;
+    for (int pos = 0; pos < pipe->forward.len; pos++) {
+        if (dropped[pos]) continue;
+        pipe->routes[kept] = pipe->routes[pos];
+        pipe->daddrs[kept] = pipe->daddrs[pos];
+        pipe->cached[kept] = pipe->cached[pos];
+        pipe->groups[kept] = pipe->groups[pos];
+        pipe->members[kept] = pipe->members[pos];
+        memcpy(pipe->l2[kept], pipe->l2[pos], sizeof(pipe->l2[pos]));
+        pipe->forward.idx[kept++] = pipe->forward.idx[pos];
+    }
+    pipe->forward.len = kept;
+}
+
+/**
+ * @brief Rewrite stage: resolve the next hop, decrement the TTL and rewrite the Ethernet header.
+ *
+ * The checksum is patched incrementally for the TTL change. Frames whose next hop is not in
+ * the ARP table are left for the unresolved stage, which queues them and sends the requests.
+ * Destinations resolved down to their MACs are added to the flow cache, multipath destinations
+ * with their group only: the MACs of their frames are looked up per path.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_Rewrite(routing *route, pipeline *pipe) {
+    arp_table *macs = route->ctrl->macs;
+    // Read before the ARP lookups, a neighbor change racing with them leaves the entries stale.
+    uint32_t generation = atomic_load_explicit(&route->ctrl->generation, memory_order_acquire);
+
+    for (int pos = 0; pos < pipe->forward.len; pos++) {
+        int frame = pipe->forward.idx[pos];
+        forward *best_route = &pipe->routes[pos];
+
+        int32_t group = pipe->groups[pos];
+
+        if (!pipe->cached[pos] || group >= 0) {
+            PROFILE_START(arp_probe, 1);
+            int entry_idx = Get_ARP_Entry(macs, best_route->next_hop);
+            PROFILE_END(STAGE_ARP, arp_probe);
+            if (entry_idx < 0) {
+                if (group >= 0) COUNTER_ADD(route->paths->packets[group][pipe->members[pos]], 1);
+                pipe->held[pipe->unresolved.len] = *best_route;
+                Push_Frame(&pipe->unresolved, frame);
+                continue;
+            }
+
+            flow_entry flow = {
+                .daddr = pipe->daddrs[pos],
+                .next_hop = group >= 0 ? (uint32_t)group : best_route->next_hop,
+                .generation = generation,
+                .interface = group >= 0 ? FLOW_GROUP : (int16_t)best_route->interface,
+                .vrf = route->ctrl->vrf[pipe->ifaces[frame]],
+            };
+            memcpy(flow.dhost, macs->addrs[entry_idx].mac, MAC_SIZE);
+            Get_MAC_Interface(best_route->interface, flow.shost);
+            if (!pipe->cached[pos]) Insert_Flow(route->flows, &flow);
+
+            memcpy(pipe->l2[pos], flow.dhost, MAC_SIZE);
+            memcpy(pipe->l2[pos] + MAC_SIZE, flow.shost, MAC_SIZE);
+        }
+        if (group >= 0) COUNTER_ADD(route->paths->packets[group][pipe->members[pos]], 1);
+
+        struct ethhdr *eth_hdr = (struct ethhdr *)pipe->bufs[frame];
+        struct iphdr *ip_hdr = (struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+
+        Decrement_TTL(ip_hdr);
+
+        // Destination and source MACs are contiguous in both the header and the cache.
+        memcpy(eth_hdr->ether_dhost, pipe->l2[pos], sizeof(pipe->l2[pos]));
+
+        Push_Frame(&pipe->tx[best_route->interface], frame);
+    }
+}
+
+/**
+ * @brief IPv6 stage: batched LPM, neighbor lookup, hop limit and MAC rewrite of the IPv6 vector.
+ *
+ * IPv6 has no header checksum, so forwarding only decrements the hop limit and rewrites the
+ * Ethernet header. Packets for the router or a group, expiring, unroutable, over the egress MTU
+ * or whose next hop is not in the neighbor cache are left unmodified for the scalar handler.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_IPV6(routing *route, pipeline *pipe) {
+    nd_table *neighbors = route->ctrl->neighbors;
+    int forwarded = 0;
+
+    for (int pos = 0; pos < pipe->ipv6.len; pos++) {
+        int frame = pipe->ipv6.idx[pos];
+        const struct ip6hdr *ip6_hdr = (const struct ip6hdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+
+        if (IPV6_Version(ip6_hdr) != IPV6_VERSION || ip6_hdr->hop_limit <= 1 ||
+            pipe->lens[frame] < sizeof(struct ethhdr) + sizeof(*ip6_hdr) + ntohs(ip6_hdr->payload_len) ||
+            Is_IPV6_Multicast(&ip6_hdr->daddr) || Is_IPV6_Local(pipe->ifaces[frame], &ip6_hdr->daddr)) {
+            Push_Frame(&pipe->slow6, frame);
+            continue;
+        }
+        pipe->daddrs6[forwarded] = ip6_hdr->daddr;
+        pipe->ipv6.idx[forwarded++] = (uint16_t)frame;
+    }
+    pipe->ipv6.len = forwarded;
+
+    if (forwarded) Lookup_IPV6_Batch(route->ctrl->ipv6s, pipe->daddrs6, forwarded, pipe->routes6);
+
+    for (int pos = 0; pos < forwarded; pos++) {
+        int frame = pipe->ipv6.idx[pos];
+        const forward6 *best_route = &pipe->routes6[pos];
+
+        if (!best_route->status) {
+            Push_Frame(&pipe->slow6, frame);
+            continue;
+        }
+        // Routes through an interface the router was not started with are dropped.
+        if (best_route->interface < 0 || best_route->interface >= ROUTER_NUM_INTERFACES) {
+            STATS_DROP(DROP_NO_INTERFACE, 1);
+            continue;
+        }
+        if (Wire_Packet_Len(pipe->bufs[frame], pipe->lens[frame], &pipe->offloads[frame]) >
+            (size_t)Get_MTU_Interface(best_route->interface)) {
+            Push_Frame(&pipe->slow6, frame);
+            continue;
+        }
+
+        int entry_idx = Get_ND_Entry(neighbors, &best_route->next_hop);
+        if (entry_idx < 0) {
+            Push_Frame(&pipe->slow6, frame);
+            continue;
+        }
+
+        struct ethhdr *eth_hdr = (struct ethhdr *)pipe->bufs[frame];
+        struct ip6hdr *ip6_hdr = (struct ip6hdr *)(pipe->bufs[frame] + sizeof(struct ethhdr));
+        ip6_hdr->hop_limit--;
+        memcpy(eth_hdr->ether_dhost, neighbors->addrs[entry_idx].mac, MAC_SIZE);
+        Get_MAC_Interface(best_route->interface, eth_hdr->ether_shost);
+
+        Push_Frame(&pipe->tx[best_route->interface], frame);
+    }
+}
+
+/**
+ * @brief Count the rewritten frames waiting for the TX stage.
+ *
+ * @param pipe The pipeline.
+ * @return     The number of frames in the TX vectors.
+ */
+static inline int Pending_TX(const pipeline *pipe) {
+    int pending = 0;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        pending += pipe->tx[interface].len;
+    }
+    return pending;
+}
+
+/**
+ * @brief TX stage: send the rewritten frames, one burst per egress interface.
+ *
+ * Super-packets keep the offload state they came with, for the kernel to segment them and
+ * finish their transport checksum: one lookup and rewrite for up to 64 KB of segments.
+ * The frames of an interface with egress queues (-Q) are queued by class instead, their buffers
+ * swapped for free ones of the queues, then the queues send what their schedulers and shapers
+ * let through, the frames queued by the previous vectors included.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_TX(routing *route, pipeline *pipe) {
+    char *frames[VECTOR_SIZE];
+    size_t lengths[VECTOR_SIZE];
+    uint64_t stamps[VECTOR_SIZE];
+    link_offload offloads[VECTOR_SIZE];
+    uint64_t now = route->qos ? QoS_Now() : 0;
+
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        vector *tx = &pipe->tx[interface];
+        if (!tx->len) continue;
+
+        if (QoS_Enabled(route->qos, interface)) {
+            for (int pos = 0; pos < tx->len; pos++) {
+                int frame = tx->idx[pos];
+                Enqueue_QoS(route->qos, interface, &pipe->bufs[frame], pipe->lens[frame], pipe->stamps[frame],
+                            &pipe->offloads[frame], now);
+            }
+            continue;
+        }
+
+        for (int pos = 0; pos < tx->len; pos++) {
+            frames[pos] = pipe->bufs[tx->idx[pos]];
+            lengths[pos] = pipe->lens[tx->idx[pos]];
+            stamps[pos] = pipe->stamps[tx->idx[pos]];
+            offloads[pos] = pipe->offloads[tx->idx[pos]];
+        }
+        Send_Burst_Link(interface, frames, lengths, tx->len, stamps, offloads, PATH_FAST);
+    }
+
+    if (route->qos) Drain_QoS(route->qos, now);
+}
+
+/**
+ * @brief Point the worker's scalar context at a frame of the vector.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ * @param frame The frame index.
+ */
+static void Load_Frame(routing *route, pipeline *pipe, int frame) {
+    route->buf = pipe->bufs[frame];
+    route->len = pipe->lens[frame];
+    route->interface = pipe->ifaces[frame];
+    route->stamp = pipe->stamps[frame];
+    route->offload = pipe->offloads[frame];
+    route->filtered = pipe->filtered[frame];
+    route->translated = pipe->translated[frame];
+    route->eth_hdr = (struct ethhdr *)route->buf;
+}
+
+/**
+ * @brief Unresolved stage: queue the frames whose next hop is not in the ARP table and ask for the next hops.
+ *
+ * The frames of the whole vector are copied to the waiting queue under one lock, their TTL decremented,
+ * and one ARP request is sent per next hop of the vector (within the request rate), not one per frame.
+ * The replies release them all in one walk of the queue (Stage_Slow).
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_Unresolved(routing *route, pipeline *pipe) {
+    vector *unresolved = &pipe->unresolved;
+    if (!unresolved->len) return;
+
+    int queued = 0;
+    pthread_mutex_lock(&route->ctrl->waiting_lock);
+    for (; queued < unresolved->len && route->ctrl->waiting_len < MAX_WAITING; queued++) {
+        int frame = unresolved->idx[queued];
+        Decrement_TTL((struct iphdr *)(pipe->bufs[frame] + sizeof(struct ethhdr)));
+
+        Load_Frame(route, pipe, frame);
+        route->next_hop = pipe->held[queued].next_hop;
+        route->interface = pipe->held[queued].interface;
+        packet *pckg = Send_Packet(route);
+        if (!pckg) break;
+        Enqueue(route->ctrl->waiting, (void *)pckg);
+        route->ctrl->waiting_len++;
+    }
+    pthread_mutex_unlock(&route->ctrl->waiting_lock);
+    if (queued < unresolved->len) STATS_DROP(DROP_ARP_QUEUE, unresolved->len - queued);
+
+    // The requests are built apart from the frames, every frame of the vector was copied already.
+    char request[sizeof(struct ethhdr) + sizeof(struct arphdr)];
+    uint64_t now = Police_Now();
+    uint32_t asked[VECTOR_SIZE];
+    int num_asked = 0;
+    for (int pos = 0; pos < unresolved->len; pos++) {
+        const forward *held = &pipe->held[pos];
+        int seen = 0;
+        while (seen < num_asked && asked[seen] != held->next_hop) seen++;
+        if (seen < num_asked) continue;
+        asked[num_asked++] = held->next_hop;
+
+        // Over the request rate, a later vector for the same next hop asks again.
+        if (!Police_At(route->policer, held->interface, POLICE_ARP_REQUEST, now)) continue;
+        route->buf = request;
+        route->eth_hdr = (struct ethhdr *)request;
+        route->next_hop = held->next_hop;
+        route->interface = held->interface;
+        Request_ARP(route);
+        Send_Stamped_Link(route->interface, route->buf, route->len, 0, PATH_SLOW);
+    }
+}
+
+/**
+ * @brief Slow path stages: the ARP frames first (their replies release the waiting packets, in one
+ * walk of the queue for the vector), then the IPv4 and IPv6 frames diverted from the fast path,
+ * all through the scalar handlers.
+ *
+ * @param route The worker's routing context.
+ * @param pipe  The pipeline.
+ */
+static void Stage_Slow(routing *route, pipeline *pipe) {
+    arp_entry learned[VECTOR_SIZE];
+    int num_learned = 0;
+    for (int pos = 0; pos < pipe->arp.len; pos++) {
+        Load_Frame(route, pipe, pipe->arp.idx[pos]);
+        num_learned += Learn_ARP(route, &learned[num_learned]);
+    }
+    if (num_learned) Release_Waiting(route, learned, num_learned);
+
+    for (int pos = 0; pos < pipe->slow.len; pos++) {
+        Load_Frame(route, pipe, pipe->slow.idx[pos]);
+        Handler_IPV4(route);
+    }
+
+    for (int pos = 0; pos < pipe->slow6.len; pos++) {
+        Load_Frame(route, pipe, pipe->slow6.idx[pos]);
+        Handler_IPV6(route);
+    }
+}
+
+/* ------------------------------------------------- PIPELINE STAGES ------------------------------------------------- */
+/* --------------------------------------------------- RUN PIPELINE -------------------------------------------------- */
+
+/**
+ * @brief Receive a vector of frames and run it through all the stages.
+ *
+ * Parse -> ACL -> DNAT -> classify (echo replies included) -> lookup -> SNAT -> rewrite -> IPv6 -> TX on the
+ * fast path, each stage over the whole vector, then the frames waiting for ARP into the queue and the
+ * diverted frames through the scalar handlers.
+ * With egress queues, the receive only waits as long as the shapers hold the queued frames back:
+ * an empty vector still drains them. The vector is handled in one read-side section on the FIB,
+ * so the routes and neighbors a control socket transaction replaces stay valid until it is sent.
+ *
+ * @param route The worker's routing context.
+ */
+void Run_Pipeline(routing *route) {
+    pipeline *pipe = route->pipe;
+
+    pipe->ipv4.len = pipe->local.len = pipe->forward.len = pipe->arp.len = pipe->unresolved.len = pipe->slow.len = 0;
+    pipe->ipv6.len = pipe->slow6.len = 0;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        pipe->tx[interface].len = 0;
+    }
+
+    // The receive stage is timed by the link layer, which knows when the wait ended.
+    if (route->qos) Set_Link_Wait(Wait_QoS(route->qos, QoS_Now()));
+    pipe->count = Recv_Burst_Link(pipe->bufs, pipe->lens, pipe->ifaces, pipe->stamps, pipe->offloads, VECTOR_SIZE);
+    Enter_FIB(route);
+
+    // Every stage is timed as a whole, its cycles shared by the frames it was given.
+    PROFILE_START(parse_probe, pipe->count);
+    Stage_Parse(pipe, route->ctrl->ipv6s != NULL);
+    PROFILE_END(STAGE_PARSE, parse_probe);
+
+    PROFILE_START(acl_probe, pipe->ipv4.len);
+    Stage_ACL(route, pipe);
+    PROFILE_END(STAGE_ACL, acl_probe);
+
+    // Both NAT stages are counted as one, each over the frames it was given.
+    PROFILE_START(dnat_probe, pipe->ipv4.len);
+    Stage_DNAT(route, pipe);
+    PROFILE_END(STAGE_NAT, dnat_probe);
+
+    // The echo replies are counted with the classification, which picked them.
+    PROFILE_START(classify_probe, pipe->ipv4.len);
+    Stage_Classify(pipe);
+    Stage_Local(route, pipe);
+    PROFILE_END(STAGE_CLASSIFY, classify_probe);
+
+    PROFILE_START(lookup_probe, pipe->forward.len);
+    Stage_Lookup(route, pipe);
+    PROFILE_END(STAGE_LOOKUP, lookup_probe);
+
+    PROFILE_START(snat_probe, pipe->forward.len);
+    Stage_SNAT(route, pipe);
+    PROFILE_END(STAGE_NAT, snat_probe);
+
+    PROFILE_START(rewrite_probe, pipe->forward.len);
+    Stage_Rewrite(route, pipe);
+    PROFILE_END(STAGE_REWRITE, rewrite_probe);
+
+    if (pipe->ipv6.len) {
+        PROFILE_START(ipv6_probe, pipe->ipv6.len);
+        Stage_IPV6(route, pipe);
+        PROFILE_END(STAGE_IPV6, ipv6_probe);
+    }
+
+    PROFILE_START(tx_probe, Pending_TX(pipe));
+    Stage_TX(route, pipe);
+    PROFILE_END(STAGE_TX, tx_probe);
+
+    // The unresolved frames are counted with the slow path, which queued them before.
+    PROFILE_START(slow_probe, pipe->unresolved.len + pipe->arp.len + pipe->slow.len + pipe->slow6.len);
+    Stage_Unresolved(route, pipe);
+    Stage_Slow(route, pipe);
+    PROFILE_END(STAGE_SLOW, slow_probe);
+    Exit_FIB(route);
+}
+
+/* --------------------------------------------------- RUN PIPELINE -------------------------------------------------- */
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "../../include/router.h"
+
+#define VECTOR_SIZE MAX_BURST
+
+// Frames selected by a stage, as indexes in the pipeline's frame vector.
+typedef struct vector {
+    uint16_t idx[VECTOR_SIZE];      // Indexes of the frames.
+    int len;                        // Number of frames.
+} vector;
+
+// Vector of frames received together and handled stage by stage.
+typedef struct pipeline {
+    char *memory;                   // Backing store of the frame buffers.
+    char *bufs[VECTOR_SIZE];        // Frame buffers, Get_Frame_Size() bytes each.
+    size_t lens[VECTOR_SIZE];       // Frame lengths.
+    int ifaces[VECTOR_SIZE];        // Ingress interfaces.
+    uint64_t stamps[VECTOR_SIZE];   // Kernel RX timestamps (ns), 0 without -t.
+    link_offload offloads[VECTOR_SIZE]; // Offload states, zero for plain frames (always without -g).
+    int count;                      // Number of frames received.
+    bool filtered[VECTOR_SIZE];     // Let in by the ACL stage, the slow path does not classify them again.
+    bool translated[VECTOR_SIZE];   // Source translated by the SNAT stage, the slow path does not translate it again.
+
+    uint32_t daddrs[VECTOR_SIZE];   // Destinations of the forwarded frames.
+    forward routes[VECTOR_SIZE];    // Routes of the forwarded frames.
+    bool cached[VECTOR_SIZE];       // Whether the route (and L2 rewrite) came from the flow cache.
+    uint8_t l2[VECTOR_SIZE][12];    // Cached destination and source MACs.
+    int32_t groups[VECTOR_SIZE];    // Group of a multipath route, -1 for a single path.
+    uint8_t members[VECTOR_SIZE];   // Path of the group the frame's flow takes.
+    struct in6_addr daddrs6[VECTOR_SIZE]; // Destinations of the forwarded IPv6 frames.
+    forward6 routes6[VECTOR_SIZE];  // Routes of the forwarded IPv6 frames.
+    forward held[VECTOR_SIZE];      // Routes of the unresolved frames, in their vector's order.
+
+    vector ipv4;                    // Valid IPv4 frames.
+    vector local;                   // Echo requests for the router, answered in place.
+    vector forward;                 // Frames on the fast path.
+    vector arp;                     // ARP frames.
+    vector ipv6;                    // IPv6 frames, when IPv6 is routed.
+    vector unresolved;              // Frames whose next hop is not in the ARP table, queued for its reply.
+    vector slow;                    // Frames for the scalar handlers (other local, ICMP errors, fragmentation).
+    vector slow6;                   // IPv6 frames for the scalar handler (local, ND miss, ICMPv6 errors).
+    vector tx[ROUTER_NUM_INTERFACES]; // Rewritten frames, per egress interface.
+} pipeline;
+
+/** @brief Create a pipeline and its frame buffers. */
+pipeline*       Create_Pipeline         (void);
+/** @brief Free a pipeline and its frame buffers. */
+void            Free_Pipeline           (pipeline **pipe);
+
+/** @brief Receive a vector of frames and run it through all the stages. */
+void            Run_Pipeline            (routing *route);
+
+#endif /* PIPELINE_H_ */
@@ -1,172 +1,429 @@
+#define _GNU_SOURCE
+
 #include "./include/router.h"
-#include "./res/ipv4/ipv4.h"
-#include "./res/arp/arp.h"
+#include "./res/pipeline/pipeline.h"
+#include "./res/ipv4/aggregate.h"
+#include "./res/ipv4/fib.h"
+#include "./res/ctl/ctl_server.h"
+
+#include <sched.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#define MAX_POLICE_OPTIONS 64
 
-packet*     Send_Packet         (routing *route);
-void        Waiting_Packet      (routing *route, packet *pkt);
+#define USAGE "Usage: %s [-w workers] [-c cpu,...] [-t] [-g] [-p type[@interface]=rate[/burst]]... [-H off|thp|on] [-6 rtable6] [-A acl] [-n inside]... [-N flows] [-Q interface[=Mbit]]... [-V rtable=interface[,interface...]]... [-C socket] [-i] ([-a] rtable | -f fib) interfaces...\n"
+
+/**
+ * @brief Parse a comma separated list of cores (e.g. "0,2,4").
+ * 
+ * @param list  The list given on the command line.
+ * @param cpus  Array receiving the cores.
+ * @return      The number of cores parsed.
+ */
+static int Parse_CPUs(char *list, int *cpus) {
+    int num_cpus = 0;
+    for (char *token = strtok(list, ","); token && num_cpus < MAX_WORKERS; token = strtok(NULL, ",")) {
+        cpus[num_cpus++] = atoi(token);
+    }
+    return num_cpus;
+}
 
 /**
- * @brief Initialize a routing structure with required tables and queues.
+ * @brief Forwarding loop run by every worker thread.
  * 
- * Allocate memory for a routing structure and initializes its fields,
- * including an IPv4 routing table, an ARP table, and a waiting queue. If any of the
- * initialization steps fail, it deallocates previously allocated memory and returns NULL.
+ * Pin the worker to its core (if any), then receive and handle packets forever.
  * 
- * @param file A path to the file containing IPv4 routing table information.
- * @return     A pointer to the initialized routing structure or NULL on failure.
+ * @param arg  The worker's routing context.
+ * @return     Never returns on success.
  */
-static routing* Create_Router(char *file) {
-    routing *route = (routing*)malloc(sizeof(routing));
-    if (!route) return NULL;
+static void* Worker_Loop(void *arg) {
+    routing *route = (routing*)arg;
+    Bind_Worker_Link(route->worker);
+    Bind_Stats(route->ctrl->stats, route->worker);
+    Bind_Profile(route->profile);
 
-    // Initialize the IPv4 routing table.
-    route->ipv4s = Create_IPV4_Table(file);
-    if (!route->ipv4s) {
-        free(route);
-        return NULL;
+    if (route->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(route->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+            fprintf(stderr, "WARNING: WORKER %d CANNOT PIN TO CPU %d...\n", route->worker, route->cpu);
+        }
     }
 
-    // Initialize the ARP table.
-    route->macs = Create_ARP_Table();
-    if (!route->macs) {
-        Free_IPV4_Table(&route->ipv4s);
-        free(route);
-        return NULL;
+    // Receive and handle the frames a vector at a time.
+    while (true) {
+        Run_Pipeline(route);
     }
 
-    // Initialize the waiting queue
-    route->waiting = Queue();
-    if (!route->waiting) {
-        Free_ARP_Table(&route->macs);
-        Free_IPV4_Table(&route->ipv4s);
-        free(route);
-        return NULL;
+    return NULL;
+}
+
+/**
+ * @brief Replace the paths of the multipath routes with those of the routing table file (SIGHUP).
+ * 
+ * The FIB stays as it is, only its next-hop groups change; a shared FIB changes with fibload.
+ * 
+ * @param table     The routing table (of a VRF), NULL with a shared FIB.
+ * @param rtable    The routing table file, NULL with a shared FIB.
+ * @param aggregate True if the table was loaded aggregated, its routes are aggregated again.
+ */
+static void Reload_Paths(ipv4_table *table, char *rtable, bool aggregate) {
+    if (!table || !rtable) {
+        fprintf(stderr, "ecmp: the paths of a shared FIB change with fibload\n");
+        return;
     }
 
-    // Initialize other route fields.
-    route->next_hop = 0;
-    route->interface = 0;
+    int count = 0, skipped = 0;
+    route *routes = Read_IPV4_Routes(rtable, &count);
+    if (!routes) {
+        fprintf(stderr, "ERROR: CANNOT READ %s...\n", rtable);
+        return;
+    }
+    if (aggregate) {
+        // The groups belong to the aggregated prefixes.
+        route *written = routes;
+        routes = Aggregate_IPV4_Routes(written, count, &count);
+        free(written);
+        if (!routes) {
+            fprintf(stderr, "ERROR: CANNOT AGGREGATE %s...\n", rtable);
+            return;
+        }
+    }
+    int updated = Update_IPV4_Paths(table, routes, count, &skipped);
+    free(routes);
+    fprintf(stderr, "ecmp: %d groups updated from %s, %d routes or groups left as they were\n", updated, rtable, skipped);
+}
 
-    return route;
+/**
+ * @brief Load the rules of the ACL file and install them while the workers run (start and SIGHUP).
+ *
+ * A file that cannot be read or has a bad line leaves the rules in place as they were.
+ *
+ * @param ctrl The shared control state.
+ * @param file The ACL file.
+ * @return     True if the new rules are installed.
+ */
+static bool Reload_ACL(control *ctrl, const char *file) {
+    acl_table *acl = Create_ACL_Table(file);
+    if (!acl) {
+        fprintf(stderr, "ERROR: CANNOT LOAD ACL %s, THE RULES STAY AS THEY WERE...\n", file);
+        return false;
+    }
+    Print_ACL_Table(stderr, file, acl);
+    Replace_ACL(ctrl, acl);
+    return true;
 }
 
 /**
- * @brief Free the memory allocated for a routing structure and its associated data structures.
+ * @brief Print the packets sent through every ECMP path, summed over the workers.
  * 
- * Deallocate memory for a routing structure, including its IPv4 routing table,
- * ARP table, and waiting queue. It also takes care of freeing any associated 
- * memory within these data structures.
+ * @param ctrl        The shared control state.
+ * @param workers     The workers.
+ * @param num_workers The number of workers.
+ */
+static void Dump_Paths(control *ctrl, routing *const *workers, int num_workers) {
+    nh_counters *counters[MAX_WORKERS];
+    for (int worker = 0; worker < num_workers; worker++) counters[worker] = workers[worker]->paths;
+
+    if (ctrl->ipv4s) {
+        Dump_NH_Groups(stderr, ctrl->ipv4s->groups->groups, ctrl->ipv4s->groups->count, counters, num_workers);
+        return;
+    }
+    // The groups of the current image, the workers count by group index across generations.
+    shared_fib *fib = Open_Shared_FIB(ctrl->fib_name);
+    if (!fib) return;
+    Dump_NH_Groups(stderr, FIB_Groups(fib->image), fib->image->groups, counters, num_workers);
+    Close_Shared_FIB(&fib);
+}
+
+/**
+ * @brief Print the time the frames of every class waited in the egress queues, merged over the workers.
  * 
- * @param route   A pointer to the routing structure to be freed.
+ * @param workers        The workers.
+ * @param num_workers    The number of workers.
+ * @param interfaces     The names of the interfaces.
+ * @param num_interfaces The number of interfaces.
  */
-static void Free_Router(routing *route) {
-    if (!route) return;
-    if (route->waiting) FreeQueue(route->waiting);
-    if (route->macs)    Free_ARP_Table(&route->macs);
-    if (route->ipv4s)   Free_IPV4_Table(&route->ipv4s);
-    free(route);
+static void Dump_Queues(routing *const *workers, int num_workers, char **interfaces, int num_interfaces) {
+    qos *queues[MAX_WORKERS];
+    for (int worker = 0; worker < num_workers; worker++) queues[worker] = workers[worker]->qos;
+    Dump_QoS(stderr, queues, num_workers, interfaces, num_interfaces);
 }
 
 int main(int argc, char **argv) {
-    // Initialize network interfaces based on command line arguments
-	// (excluding the program name and router configuration file).
-    Init_Network(argc - 2, argv + 2);
+    int num_workers = 1;
+    int num_cpus = 0;
+    int cpus[MAX_WORKERS];
+    int num_police = 0;
+    char *police_options[MAX_POLICE_OPTIONS];
+    const char *fib_name = NULL;
+    char *rtable6 = NULL;
+    const char *acl_file = NULL;
+    int num_inside = 0;
+    const char *inside[ROUTER_NUM_INTERFACES];
+    uint32_t flows = CT_DEFAULT_FLOWS;
+    int num_qos = 0;
+    const char *qos_options[ROUTER_NUM_INTERFACES];
+    int num_vrfs = 0;
+    char *vrf_options[MAX_VRFS - 1];
+    const char *ctl_path = NULL;
+    bool aggregate = false, inspect = false;
 
-    // Initialize the router based on the provided configuration file.
-    routing *route = Create_Router(argv[1]);
-    if (!route) return EXIT_FAILURE;
+    // Parse the options: -w <workers> -c <cpu,cpu,...> -t (kernel timestamps, wire-to-wire latency)
+    // -p <type[@interface]=rate[/burst]> (rate of the ICMP / ARP messages the router generates)
+    // -H <off|thp|on> (pages of the FIB, neighbor table, flow caches and packet buffers)
+    // -f <fib> (look up in the shared FIB published by fibload, in place of an rtable)
+    // -6 <rtable6> (route IPv6 too, with the routes of that file)
+    // -A <acl> (filter the incoming IPv4 packets with the rules of that file, reloaded on SIGHUP)
+    // -n <interface> (translate the sources of the packets from that interface to the others, repeated per inside interface)
+    // -N <flows> (connections the NAT tracks at most)
+    // -Q <interface[=Mbit]> (queue the frames forwarded to that interface by DSCP class, shaped to the rate if given)
+    // -V <rtable=interface[,interface...]> (route the packets from those interfaces with that table, repeated per VRF)
+    // -C <socket> (change routes and neighbors at runtime through a control socket at that path, see routerctl)
+    // -a (aggregate the routes of the rtable into the fewest prefixes that forward the same way)
+    // -i (print the nodes, routes, prefix lengths and lookup depths of the FIB)
+    int opt, huge;
+    while ((opt = getopt(argc, argv, "+w:c:tgp:H:f:6:A:n:N:Q:V:C:ai")) != -1) {
+        switch (opt) {
+            case 'w': num_workers = atoi(optarg); break;
+            case 'c': num_cpus = Parse_CPUs(optarg, cpus); break;
+            case 't': Enable_Link_Timestamps(); break;
+            case 'g': Enable_Link_Offload(); break;
+            case 'p':
+                if (num_police < MAX_POLICE_OPTIONS) police_options[num_police++] = optarg;
+                break;
+            case 'H':
+                if ((huge = Parse_Huge_Mode(optarg)) < 0) {
+                    fprintf(stderr, USAGE, argv[0]);
+                    return EXIT_FAILURE;
+                }
+                Set_Huge_Mode((huge_mode)huge);
+                break;
+            case 'f': fib_name = optarg; break;
+            case '6': rtable6 = optarg; break;
+            case 'A': acl_file = optarg; break;
+            case 'n':
+                if (num_inside < ROUTER_NUM_INTERFACES) inside[num_inside++] = optarg;
+                break;
+            case 'N': flows = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'Q':
+                if (num_qos < ROUTER_NUM_INTERFACES) qos_options[num_qos++] = optarg;
+                break;
+            case 'V':
+                if (num_vrfs < MAX_VRFS - 1) vrf_options[num_vrfs++] = optarg;
+                break;
+            case 'C': ctl_path = optarg; break;
+            case 'a': aggregate = true; break;
+            case 'i': inspect = true; break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    // The interfaces follow the routing table file, or the options with a shared FIB.
+    char *rtable = fib_name ? NULL : argv[optind];
+    int num_interfaces = argc - optind - (fib_name ? 0 : 1);
+    char **interfaces = argv + argc - num_interfaces;
+    if (num_workers < 1 || num_workers > MAX_WORKERS || num_interfaces < 1 || flows < 1 || flows > CT_MAX_FLOWS ||
+        (num_vrfs && fib_name)) {
+        fprintf(stderr, USAGE, argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    while (true) {
-        // Receive a network message on any network interface.
-        route->len = 0;
-        route->interface = Recv_FromAny_Link(route->buf, &route->len);
-
-        // Check for errors when receiving a message.
-        if (route->interface < 0) {
-            Free_Router(route);
-            fprintf(stderr, "ERROR: INTERFACE...");
-            exit(EXIT_FAILURE);
+    // The rates name the interfaces, they can only be parsed once the interfaces are known.
+    police_rate police[ROUTER_NUM_INTERFACES][POLICE_TYPES];
+    Default_Police(police);
+    for (int option = 0; option < num_police; option++) {
+        if (Parse_Police(police, police_options[option], num_interfaces, interfaces) < 0) {
+            fprintf(stderr, "ERROR: BAD RATE %s (types:", police_options[option]);
+            for (int type = 0; type < POLICE_TYPES; type++) fprintf(stderr, " %s", police_names[type]);
+            fprintf(stderr, ")...\n");
+            return EXIT_FAILURE;
+        }
+    }
+    qos_rate queues[ROUTER_NUM_INTERFACES];
+    memset(queues, 0, sizeof(queues));
+    for (int option = 0; option < num_qos; option++) {
+        if (Parse_QoS(queues, qos_options[option], num_interfaces, interfaces) < 0) {
+            fprintf(stderr, "ERROR: BAD QUEUES %s (interface[=Mbit])...\n", qos_options[option]);
+            return EXIT_FAILURE;
         }
+    }
 
-        // Initialize message fields in the routing structure.
-        route->eth_hdr = (struct ethhdr *)route->buf;
+    // Every VRF has its table, the default one routes the interfaces no VRF names.
+    uint8_t vrfs[ROUTER_NUM_INTERFACES] = {0};
+    char *rtables[MAX_VRFS] = {rtable};
+    for (int option = 0; option < num_vrfs; option++) {
+        if (Parse_VRF(vrfs, option + 1, vrf_options[option], num_interfaces, interfaces, &rtables[option + 1]) < 0) {
+            fprintf(stderr, "ERROR: BAD VRF %s (rtable=interface[,interface...], each interface in one VRF)...\n",
+                    vrf_options[option]);
+            return EXIT_FAILURE;
+        }
+    }
 
-        // Determine the type of the received packet.
-        uint16_t PACKET_TYPE = route->eth_hdr->ether_type;
+    // Initialize network interfaces based on command line arguments
+	// (excluding the program name, options and router configuration file, if any).
+    Init_Network(num_interfaces, interfaces, num_workers);
 
-        // Check if the received packet type is valid (not NULL)
-        if (!route || PACKET_TYPE != IP_TYPE || PACKET_TYPE != ARP_TYPE) {
-            fprintf(stderr, "ERROR: TYPE PACKET...");
-        }
+    // Initialize the shared control state based on the provided configuration file.
+    control *ctrl = Create_Control(rtable, rtable6, aggregate);
+    if (!ctrl) return EXIT_FAILURE;
 
-        // Handle the received packet based on its type.
-        if (PACKET_TYPE == IP_TYPE) {
-            Handler_IPV4(route); // Handle IPv4 packets.
+    // Without a file, every worker maps the shared FIB, check it is there first.
+    if (fib_name) {
+        shared_fib *fib = Open_Shared_FIB(fib_name);
+        if (!fib) {
+            fprintf(stderr, "ERROR: NO SHARED FIB %s (%s)...\n", fib_name, strerror(errno));
+            Free_Control(ctrl);
+            return EXIT_FAILURE;
         }
-        if (PACKET_TYPE == ARP_TYPE) {
-            Handler_ARP(route); // Handle ARP packets.
+        fprintf(stderr, "shared FIB %s: generation %llu, %u routes\n", fib_name,
+                (unsigned long long)fib->generation, fib->image->routes);
+        if (inspect) {
+            fib_stats stats;
+            Inspect_FIB_Image(fib->image, &stats);
+            Print_FIB_Stats(stderr, fib_name, &stats);
         }
+        Close_Shared_FIB(&fib);
+        ctrl->fib_name = fib_name;
     }
+    if (num_vrfs) {
+        if (Load_VRFs(ctrl, rtables + 1, num_vrfs, aggregate) < 0) {
+            fprintf(stderr, "ERROR: CANNOT LOAD THE ROUTING TABLES OF THE VRFS...\n");
+            Free_Control(ctrl);
+            return EXIT_FAILURE;
+        }
+        memcpy(ctrl->vrf, vrfs, sizeof(vrfs));
+        Print_VRF_Set(stderr, ctrl->vrfs, rtables, vrfs, interfaces, num_interfaces);
+    }
+    for (int vrf = 0; inspect && ctrl->ipv4s && vrf <= num_vrfs; vrf++) {
+        fib_stats stats;
+        Inspect_IPV4_Table(ctrl->vrfs ? ctrl->vrfs->tables[vrf] : ctrl->ipv4s, &stats);
+        Print_FIB_Stats(stderr, rtables[vrf], &stats);
+    }
+    memcpy(ctrl->police, police, sizeof(police));
+    memcpy(ctrl->qos, queues, sizeof(queues));
+    ctrl->workers = num_workers;
 
-    return EXIT_SUCCESS;
-}
+    // The ACL is in place before the first packet comes in.
+    if (acl_file && !Reload_ACL(ctrl, acl_file)) {
+        Free_Control(ctrl);
+        return EXIT_FAILURE;
+    }
 
-/**
- * @brief Create and initialize a new packet based on the provided routing information.
- * 
- * Allocate memory for a new packet, copies the packet data and routing
- * information from the given routing structure, and returns the newly created packet.
- * 
- * @param route   A pointer to the routing structure containing packet and routing information.
- * @return        A pointer to the newly created packet, or NULL if memory allocation fails.
- */
-packet* Send_Packet(routing *route) {
-    if (!route) return NULL;
+    // The inside interfaces name the interfaces too, the flows are tracked from the first packet on.
+    if (num_inside) {
+        for (int option = 0; option < num_inside; option++) {
+            int iface = 0;
+            while (iface < num_interfaces && strcmp(inside[option], interfaces[iface])) iface++;
+            if (iface == num_interfaces) {
+                fprintf(stderr, "ERROR: NO INTERFACE %s...\n", inside[option]);
+                Free_Control(ctrl);
+                return EXIT_FAILURE;
+            }
+            ctrl->nat_inside[iface] = true;
+        }
+        ctrl->conntrack = Create_Conntrack(flows);
+        if (!ctrl->conntrack) {
+            fprintf(stderr, "ERROR: CONNTRACK OF %u FLOWS...\n", flows);
+            Free_Control(ctrl);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "conntrack: %u flows, %.1f MB\n", flows, Size_Conntrack(ctrl->conntrack) / 1048576.0);
+    }
 
-    // Allocate memory for a new packet structure.
-    packet *pkt = (packet*)malloc(sizeof(packet));
-    if (!pkt) return NULL;
+    // Export the workers' counters to routerstat.
+    ctrl->stats = Create_Stats(num_workers, num_interfaces, interfaces);
+    if (!ctrl->stats) {
+        Free_Control(ctrl);
+        return EXIT_FAILURE;
+    }
 
-    // Allocate memory for the packet buffer.
-    pkt->buf = malloc(MAX_PACKET_LEN);
+    // The workers inherit this mask, the signals are only taken by the main thread.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
-    if (!pkt->buf) {
-        free(pkt);
-        return NULL;
+    // Start the workers, pinned round-robin on the given cores.
+    routing *workers[MAX_WORKERS];
+    for (int worker = 0; worker < num_workers; worker++) {
+        int cpu = num_cpus ? cpus[worker % num_cpus] : -1;
+        workers[worker] = Create_Router(ctrl, worker, cpu);
+        if (!workers[worker] ||
+            pthread_create(&workers[worker]->thread, NULL, Worker_Loop, workers[worker])) {
+            fprintf(stderr, "ERROR: WORKER %d...", worker);
+            Free_Router(workers[worker]);
+            // The control state can only go while no worker is using it.
+            if (!worker) Free_Control(ctrl);
+            exit(EXIT_FAILURE);
+        }
     }
 
-    // Copy packet data, length, interface, and next hop information.
-    memcpy(pkt->buf, route->buf, route->len);
-    pkt->len = route->len;
-    pkt->interface = route->interface;
-    pkt->next_hop = route->next_hop;
+    // The control socket changes the FIB the workers use, it opens once they run.
+    ctl_server *server = NULL;
+    if (ctl_path) {
+        server = Create_Control_Server(ctrl, ctl_path);
+        if (!server) {
+            fprintf(stderr, "ERROR: CONTROL SOCKET %s (%s)...\n", ctl_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "control socket %s\n", ctl_path);
+    }
 
-    return pkt;
-}
+    // Pages the FIB and the workers' memory ended up on (THP backs the buffers once touched).
+    Dump_Huge_Memory(stderr);
 
-/**
- * @brief Initialize the routing structure using a waiting packet.
- * 
- * Extract relevant information from a waiting packet and sets up
- * the routing structure for further processing.
- * 
- * @param route A pointer to the routing structure to be initialized.
- * @param pkt   A pointer to the waiting packet containing Ethernet and IP headers.
- */
-void Waiting_Packet(routing *route, packet *pkt) {
-    // Extract Ethernet and IP headers from the waiting packet.
-	route->eth_hdr = (struct ethhdr *)pkt->buf;
-	route->ip_hdr = (struct iphdr *)(pkt->buf + sizeof *route->eth_hdr);
-
-    // Set packet length, interface, and next hop information.
-	route->len = pkt->len;
-	route->interface = pkt->interface;
-	route->next_hop = pkt->next_hop;
-    // Set the Ethernet frame type to IP.
-	route->eth_hdr->ether_type = IP_TYPE;
-
-    // Copy the destination MAC address from the ARP header to the Ethernet header.
-	memcpy(route->eth_hdr->ether_dhost, route->arp_hdr->sha, MAC_SIZE);
-    // Get the source MAC address of the current interface.
-	Get_MAC_Interface(route->interface, route->eth_hdr->ether_shost);
+    // The conntrack's clock counts the seconds from here on.
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const struct timespec second = {.tv_sec = 1, .tv_nsec = 0};
+
+    // SIGUSR1 dumps the per-worker counters (and stage histograms), SIGINT / SIGTERM dump them
+    // and stop the router, SIGHUP reloads the ECMP paths of the routing tables and the ACL. With
+    // NAT, the idle flows are expired once a second in between.
+    while (true) {
+        int sig = 0;
+        if (ctrl->conntrack) {
+            sig = sigtimedwait(&signals, NULL, &second);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            Expire_Conntrack(ctrl->conntrack, (uint32_t)(now.tv_sec - start.tv_sec));
+            if (sig < 0) continue;
+        } else if (sigwait(&signals, &sig)) {
+            continue;
+        }
+        if (sig == SIGHUP) {
+            // The control socket's transactions change the tries meanwhile.
+            pthread_mutex_lock(&ctrl->fib_lock);
+            for (int vrf = 0; vrf <= num_vrfs; vrf++) {
+                Reload_Paths(ctrl->vrfs ? ctrl->vrfs->tables[vrf] : ctrl->ipv4s, rtables[vrf], aggregate);
+            }
+            pthread_mutex_unlock(&ctrl->fib_lock);
+            if (acl_file) Reload_ACL(ctrl, acl_file);
+            continue;
+        }
+        Dump_Stats(stderr, ctrl->stats);
+        Dump_Huge_Memory(stderr);
+        Dump_Link_Latency(stderr);
+        for (int worker = 0; worker < num_workers; worker++) {
+            Dump_Flow_Cache(stderr, workers[worker]->flows, worker);
+            Dump_Profile(stderr, workers[worker]->profile, worker);
+        }
+        Dump_Paths(ctrl, workers, num_workers);
+        if (Any_QoS(ctrl->qos)) Dump_Queues(workers, num_workers, interfaces, num_interfaces);
+        if (ctrl->conntrack) Dump_Conntrack(stderr, ctrl->conntrack);
+        if (sig != SIGUSR1) break;
+    }
+
+    // The workers keep writing their counters until exit, only the segment's name goes.
+    Unlink_Stats(ctrl->stats);
+    Unlink_Control_Server(server);
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+
+#include "../res/ipv4/shared_fib.h"
+#include "../res/ipv4/aggregate.h"
+#include "../res/ipv4/fib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#define USAGE "Usage: %s [-a] [-i] name rtable (publish, -a aggregated) | %s [-i] name (show) | %s -d name (remove)\n" \
+              "       -i: nodes, routes, prefix lengths and lookup depths of the FIB\n"
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Build the trie of a routing table file and publish it as the next generation of a FIB.
+ *
+ * @param name      The FIB's name.
+ * @param rtable    The routing table file.
+ * @param aggregate True to aggregate the routes (ORTC) before building the trie.
+ * @param inspect   True to print the structure of the FIB.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int Publish(const char *name, char *rtable, bool aggregate, bool inspect) {
+    double start = Now();
+    aggregate_report report;
+    ipv4_table *ip_table = aggregate ? Create_Aggregated_IPV4_Table(rtable, &report) : Create_IPV4_Table(rtable);
+    if (!ip_table) {
+        fprintf(stderr, "cannot load %s\n", rtable);
+        return EXIT_FAILURE;
+    }
+    double built = Now();
+    if (aggregate) Print_Aggregate_Report(stdout, rtable, &report);
+
+    uint64_t generation;
+    if (Publish_Shared_FIB(name, ip_table, &generation) < 0) {
+        fprintf(stderr, "cannot publish %s: %s\n", name, strerror(errno));
+        Free_IPV4_Table(&ip_table);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "%s generation %llu: %zu routes, %zu nodes, %.2f MB, built in %.1f ms, published in %.1f ms\n",
+            name, (unsigned long long)generation, ip_table->size, ip_table->nodes,
+            Size_FIB_Image(ip_table) / 1048576.0, (built - start) * 1e3, (Now() - built) * 1e3);
+    if (inspect) {
+        fib_stats stats;
+        Inspect_IPV4_Table(ip_table, &stats);
+        // The image has the trie's nodes and routes, in its own layout.
+        stats.bytes = Size_FIB_Image(ip_table);
+        Print_FIB_Stats(stdout, name, &stats);
+    }
+    Free_IPV4_Table(&ip_table);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Print the current generation of a FIB.
+ *
+ * @param name    The FIB's name.
+ * @param inspect True to print the structure of the FIB.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int Show(const char *name, bool inspect) {
+    shared_fib *fib = Open_Shared_FIB(name);
+    if (!fib) {
+        fprintf(stderr, "no FIB %s: %s\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "%s generation %llu: %u routes, %u nodes, %.2f MB\n", name,
+            (unsigned long long)fib->generation, fib->image->routes, fib->image->count,
+            fib->image->size / 1048576.0);
+    if (inspect) {
+        fib_stats stats;
+        Inspect_FIB_Image(fib->image, &stats);
+        Print_FIB_Stats(stdout, name, &stats);
+    }
+    Close_Shared_FIB(&fib);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    bool remove = false, aggregate = false, inspect = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "dai")) != -1) {
+        switch (opt) {
+            case 'd': remove = true; break;
+            case 'a': aggregate = true; break;
+            case 'i': inspect = true; break;
+            default:
+                fprintf(stderr, USAGE, argv[0], argv[0], argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    int args = argc - optind;
+    if (args < 1 || args > 2 || (remove && (args != 1 || inspect)) || (aggregate && args != 2)) {
+        fprintf(stderr, USAGE, argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *name = argv[optind];
+    if (remove) {
+        if (Remove_Shared_FIB(name) < 0) {
+            fprintf(stderr, "cannot remove %s: %s\n", name, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    return args == 2 ? Publish(name, argv[optind + 1], aggregate, inspect) : Show(name, inspect);
+}
@@ -0,0 +1,400 @@
+#define _GNU_SOURCE
+
+#include "../res/ctl/ctl_proto.h"
+#include "../utils/stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_SOCKET  "/run/router.ctl"
+#define DEFAULT_BATCH   4096            // Changes of a file sent per request, each request one transaction.
+#define MAX_WORDS       12
+
+#define USAGE "Usage: %s [-s socket] route add PREFIX/LEN via NEXT_HOP dev INTERFACE [vrf VRF]\n" \
+              "       %s [-s socket] route del PREFIX/LEN [vrf VRF]\n" \
+              "       %s [-s socket] neigh add IP lladdr MAC | neigh del IP\n" \
+              "       %s [-s socket] [-b changes] -f file (one change per line as above, - for stdin)\n" \
+              "       %s [-s socket] dump fib [VRF] | dump stats\n"
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *Status_Name(int status) {
+    switch (status) {
+        case CTL_OK:        return "ok";
+        case CTL_EREQUEST:  return "bad request";
+        case CTL_EOP:       return "bad change";
+        case CTL_ENOFIB:    return "no such routing table (shared FIB or VRF)";
+        case CTL_ENOMEM:    return "router out of memory";
+        case CTL_EFULL:     return "ARP table full";
+        default:            return "unknown error";
+    }
+}
+
+/* ----------------------------------------------------- CHANGES ----------------------------------------------------- */
+
+/**
+ * @brief Parse one change, as the words of a command line.
+ *
+ * @param words The words, from "route" or "neigh" on.
+ * @param count The number of words.
+ * @param op    Receives the change.
+ * @return True if the words are a change.
+ */
+static bool Parse_Change(char **words, int count, ctl_op *op) {
+    memset(op, 0, sizeof(*op));
+    if (count < 3) return false;
+
+    bool add = !strcmp(words[1], "add");
+    if (!add && strcmp(words[1], "del")) return false;
+
+    if (!strcmp(words[0], "route")) {
+        op->op = add ? CTL_ROUTE_ADD : CTL_ROUTE_DEL;
+        char *slash = strchr(words[2], '/');
+        if (!slash) return false;
+        *slash = '\0';
+        int length = atoi(slash + 1);
+        if (inet_pton(AF_INET, words[2], &op->address) != 1 || length < 1 || length > 32) return false;
+        op->length = (uint8_t)length;
+
+        bool via = false, dev = false;
+        for (int word = 3; word < count; word += 2) {
+            if (word + 1 == count) return false;
+            if (!strcmp(words[word], "via") && add) {
+                if (inet_pton(AF_INET, words[word + 1], &op->next_hop) != 1) return false;
+                via = true;
+            } else if (!strcmp(words[word], "dev") && add) {
+                op->interface = (int8_t)atoi(words[word + 1]);
+                dev = true;
+            } else if (!strcmp(words[word], "vrf")) {
+                op->vrf = (uint8_t)atoi(words[word + 1]);
+            } else {
+                return false;
+            }
+        }
+        return !add || (via && dev);
+    }
+
+    if (!strcmp(words[0], "neigh")) {
+        op->op = add ? CTL_NEIGH_ADD : CTL_NEIGH_DEL;
+        if (inet_pton(AF_INET, words[2], &op->address) != 1) return false;
+        if (!add) return count == 3;
+        return count == 5 && !strcmp(words[3], "lladdr") &&
+               sscanf(words[4], "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &op->mac[0], &op->mac[1], &op->mac[2],
+                      &op->mac[3], &op->mac[4], &op->mac[5]) == 6;
+    }
+    return false;
+}
+
+/**
+ * @brief Read the changes of a file, one per line; blank lines and # comments are skipped.
+ *
+ * @param file  The file, "-" for stdin.
+ * @param count Receives the number of changes.
+ * @param lines Receives the line of every change (to be freed by the caller).
+ * @return The changes (to be freed by the caller), or NULL on failure (reported).
+ */
+static ctl_op* Read_Changes(const char *file, uint32_t *count, uint32_t **lines) {
+    FILE *fin = strcmp(file, "-") ? fopen(file, "r") : stdin;
+    if (!fin) {
+        fprintf(stderr, "cannot open %s: %s\n", file, strerror(errno));
+        return NULL;
+    }
+
+    uint32_t capacity = 1024, line = 0;
+    ctl_op *ops = (ctl_op*)malloc(capacity * sizeof(ctl_op));
+    *lines = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    *count = 0;
+    char text[512];
+    while (ops && *lines && fgets(text, sizeof(text), fin)) {
+        line++;
+        char *words[MAX_WORDS];
+        int num_words = 0;
+        for (char *word = strtok(text, " \t\r\n"); word && num_words < MAX_WORDS; word = strtok(NULL, " \t\r\n")) {
+            words[num_words++] = word;
+        }
+        if (!num_words || words[0][0] == '#') continue;
+
+        if (*count == capacity) {
+            ctl_op *grown = (ctl_op*)realloc(ops, 2 * capacity * sizeof(ctl_op));
+            uint32_t *grown_lines = grown ? (uint32_t*)realloc(*lines, 2 * capacity * sizeof(uint32_t)) : NULL;
+            if (grown) ops = grown;
+            if (grown_lines) *lines = grown_lines;
+            if (!grown || !grown_lines) {
+                fprintf(stderr, "%s:%u: out of memory\n", file, line);
+                free(ops);
+                ops = NULL;
+                break;
+            }
+            capacity *= 2;
+        }
+        if (!Parse_Change(words, num_words, &ops[*count])) {
+            fprintf(stderr, "%s:%u: bad change\n", file, line);
+            free(ops);
+            ops = NULL;
+            break;
+        }
+        (*lines)[(*count)++] = line;
+    }
+    if (fin != stdin) fclose(fin);
+
+    if (!ops || !*lines) {
+        free(ops);
+        free(*lines);
+        *lines = NULL;
+        return NULL;
+    }
+    return ops;
+}
+
+/* ----------------------------------------------------- CHANGES ----------------------------------------------------- */
+/* ----------------------------------------------------- REQUESTS ---------------------------------------------------- */
+
+static int Connect_Router(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static bool Send_All(int fd, const void *data, size_t len) {
+    const char *bytes = (const char*)data;
+    while (len) {
+        ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        bytes += sent;
+        len -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool Recv_All(int fd, void *data, size_t len) {
+    char *bytes = (char*)data;
+    while (len) {
+        ssize_t got = recv(fd, bytes, len, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        bytes += got;
+        len -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * @brief Send a request and wait for its reply.
+ *
+ * @param fd    The control socket.
+ * @param type  The request.
+ * @param count Its count: changes that follow, or the VRF of a FIB dump.
+ * @param ops   The changes of an APPLY, NULL otherwise.
+ * @param reply Receives the reply, its records are left to read.
+ * @return False if the router is gone (reported).
+ */
+static bool Request(int fd, uint8_t type, uint32_t count, const ctl_op *ops, ctl_reply *reply) {
+    ctl_header header = {.magic = CTL_MAGIC, .version = CTL_VERSION, .type = type, .count = count};
+    if (!Send_All(fd, &header, sizeof(header)) || (ops && !Send_All(fd, ops, count * sizeof(ctl_op))) ||
+        !Recv_All(fd, reply, sizeof(*reply)) || reply->magic != CTL_MAGIC) {
+        fprintf(stderr, "router closed the control socket\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Apply changes in requests of at most batch changes, each one transaction.
+ *
+ * @param fd    The control socket.
+ * @param ops   The changes.
+ * @param count The number of changes.
+ * @param batch Changes per request.
+ * @param lines The line of every change, NULL for the command line.
+ * @param file  The file of the changes, for the errors.
+ * @return EXIT_SUCCESS or EXIT_FAILURE, at the first request that fails.
+ */
+static int Apply(int fd, const ctl_op *ops, uint32_t count, uint32_t batch, const uint32_t *lines, const char *file) {
+    double start = Now();
+    uint32_t applied = 0, requests = 0;
+    for (uint32_t first = 0; first < count || (!count && !requests); first += batch) {
+        uint32_t size = count - first < batch ? count - first : batch;
+        ctl_reply reply;
+        if (!Request(fd, CTL_APPLY, size, ops + first, &reply)) return EXIT_FAILURE;
+        requests++;
+        if (reply.status != CTL_OK) {
+            if (lines) {
+                fprintf(stderr, "%s:%u: %s\n", file, lines[first + reply.index], Status_Name(reply.status));
+            } else {
+                fprintf(stderr, "%s\n", Status_Name(reply.status));
+            }
+            fprintf(stderr, "%u changes applied before\n", applied);
+            return EXIT_FAILURE;
+        }
+        applied += reply.count;
+    }
+
+    double took = Now() - start;
+    if (lines) {
+        printf("%u changes applied in %u transactions, %.1f ms (%.0f changes/s)\n", applied, requests, took * 1e3,
+               took > 0 ? applied / took : 0.0);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Print the routes of a VRF as the lines of a routing table file (PREFIX NEXT_HOP MASK INTERFACE).
+ */
+static int Dump_FIB(int fd, uint32_t vrf) {
+    ctl_reply reply;
+    if (!Request(fd, CTL_DUMP_FIB, vrf, NULL, &reply)) return EXIT_FAILURE;
+    if (reply.status != CTL_OK) {
+        fprintf(stderr, "%s\n", Status_Name(reply.status));
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t record = 0; record < reply.count; record++) {
+        ctl_op op;
+        if (!Recv_All(fd, &op, sizeof(op))) {
+            fprintf(stderr, "router closed the control socket\n");
+            return EXIT_FAILURE;
+        }
+        char prefix[INET_ADDRSTRLEN], next_hop[INET_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+        uint32_t bits = htonl((uint32_t)(~0ull << (32 - op.length)));
+        inet_ntop(AF_INET, &op.address, prefix, sizeof(prefix));
+        inet_ntop(AF_INET, &op.next_hop, next_hop, sizeof(next_hop));
+        inet_ntop(AF_INET, &bits, mask, sizeof(mask));
+        printf("%s %s %s %d\n", prefix, next_hop, mask, op.interface);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Print the counters of the router and of its FIB.
+ */
+static int Dump_Counters(int fd) {
+    static const char *const link_names[] = {"rx_packets", "rx_bytes", "tx_packets", "tx_bytes"};
+    static const char *const fib_names[] = {"routes", "nodes", "garbage", "generation", "transactions"};
+
+    ctl_reply reply;
+    if (!Request(fd, CTL_DUMP_STATS, 0, NULL, &reply)) return EXIT_FAILURE;
+    if (reply.status != CTL_OK) {
+        fprintf(stderr, "%s\n", Status_Name(reply.status));
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t record = 0; record < reply.count; record++) {
+        ctl_counter counter;
+        if (!Recv_All(fd, &counter, sizeof(counter))) {
+            fprintf(stderr, "router closed the control socket\n");
+            return EXIT_FAILURE;
+        }
+        unsigned long long value = (unsigned long long)counter.value;
+        switch (counter.kind) {
+            case CTL_STAT_LINK:
+                if (counter.index < 4) printf("link %d %s %llu\n", counter.interface, link_names[counter.index], value);
+                break;
+            case CTL_STAT_DROP:
+                if (counter.index < DROP_REASONS) printf("drop %s %llu\n", drop_names[counter.index], value);
+                break;
+            case CTL_STAT_EVENT:
+                if (counter.index < STATS_EVENTS) printf("event %s %llu\n", event_names[counter.index], value);
+                break;
+            case CTL_STAT_FIB:
+                if (counter.index >= 5) break;
+                if (counter.interface >= 0) {
+                    printf("fib vrf %d %s %llu\n", counter.interface, fib_names[counter.index], value);
+                } else {
+                    printf("fib %s %llu\n", fib_names[counter.index], value);
+                }
+                break;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* ----------------------------------------------------- REQUESTS ---------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    const char *path = DEFAULT_SOCKET, *file = NULL;
+    uint32_t batch = DEFAULT_BATCH;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+s:b:f:")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'b': batch = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'f': file = optarg; break;
+            default:
+                fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0], argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    char **words = argv + optind;
+    int num_words = argc - optind;
+    bool dump = num_words >= 2 && !strcmp(words[0], "dump");
+    if (batch < 1 || batch > CTL_MAX_OPS || (file ? num_words != 0 : num_words < 2) ||
+        (dump && strcmp(words[1], "stats") && (strcmp(words[1], "fib") || num_words > 3))) {
+        fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ctl_op change;
+    ctl_op *ops = &change;
+    uint32_t count = 1, *lines = NULL;
+    if (file) {
+        ops = Read_Changes(file, &count, &lines);
+        if (!ops) return EXIT_FAILURE;
+    } else if (!dump && !Parse_Change(words, num_words, &change)) {
+        fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int fd = Connect_Router(path);
+    if (fd < 0) {
+        fprintf(stderr, "cannot connect to %s: %s\n", path, strerror(errno));
+        if (file) {
+            free(ops);
+            free(lines);
+        }
+        return EXIT_FAILURE;
+    }
+
+    int result;
+    if (dump && !strcmp(words[1], "fib")) {
+        result = Dump_FIB(fd, num_words == 3 ? (uint32_t)atoi(words[2]) : 0);
+    } else if (dump) {
+        result = Dump_Counters(fd);
+    } else {
+        result = Apply(fd, ops, count, batch, lines, file);
+    }
+
+    close(fd);
+    if (file) {
+        free(ops);
+        free(lines);
+    }
+    return result;
+}
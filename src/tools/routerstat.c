@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+
+#include "../utils/stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#define SHM_DIR         "/dev/shm"
+#define HEADER_EVERY    20          // Lines between two headers.
+
+// Counters of a router summed over its workers.
+typedef struct totals {
+    uint64_t rx_packets[ROUTER_NUM_INTERFACES], rx_bytes[ROUTER_NUM_INTERFACES];
+    uint64_t tx_packets[ROUTER_NUM_INTERFACES], tx_bytes[ROUTER_NUM_INTERFACES];
+    uint64_t drops[DROP_REASONS];
+    uint64_t events[STATS_EVENTS];
+    uint64_t policed;
+    uint64_t queue_drops;               // Egress queues (-Q), all classes.
+    uint64_t queue_depth;
+} totals;
+
+/**
+ * @brief Find the only running router with a counters segment.
+ *
+ * @return The router's pid, -1 if there is none or several (listed on stderr).
+ */
+static int Find_Router(void) {
+    DIR *dir = opendir(SHM_DIR);
+    if (!dir) return -1;
+
+    const char *prefix = STATS_PREFIX + 1;
+    int found = -1, count = 0;
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix))) continue;
+
+        int pid;
+        char tail;
+        if (sscanf(entry->d_name + strlen(prefix), "%d%c", &pid, &tail) != 1) continue;
+        // Segments left by a router that was killed outright.
+        if (kill(pid, 0) < 0 && errno == ESRCH) continue;
+
+        fprintf(stderr, "%s %d", count++ ? "" : "routers running:", pid);
+        found = pid;
+    }
+    closedir(dir);
+
+    if (!count) {
+        fprintf(stderr, "no router running (no " SHM_DIR STATS_PREFIX "<pid>)\n");
+        return -1;
+    }
+    fprintf(stderr, count > 1 ? ", pick one\n" : "\n");
+    return count > 1 ? -1 : found;
+}
+
+/**
+ * @brief Sum the counters of every worker.
+ *
+ * @param stats The counters segment.
+ * @param sum   The totals to fill.
+ */
+static void Sum_Stats(const router_stats *stats, totals *sum) {
+    memset(sum, 0, sizeof(*sum));
+    for (uint32_t worker = 0; worker < stats->workers; worker++) {
+        const stats_worker *counters = &stats->worker[worker];
+        for (uint32_t interface = 0; interface < stats->interfaces; interface++) {
+            sum->rx_packets[interface] += COUNTER_GET(counters->links[interface].rx_packets);
+            sum->rx_bytes[interface] += COUNTER_GET(counters->links[interface].rx_bytes);
+            sum->tx_packets[interface] += COUNTER_GET(counters->links[interface].tx_packets);
+            sum->tx_bytes[interface] += COUNTER_GET(counters->links[interface].tx_bytes);
+            for (int type = 0; type < POLICE_TYPES; type++) {
+                sum->policed += COUNTER_GET(counters->links[interface].policed[type]);
+            }
+            for (int class = 0; class < QOS_CLASSES; class++) {
+                sum->queue_drops += COUNTER_GET(counters->links[interface].queue_drops[class]);
+                sum->queue_depth += COUNTER_GET(counters->links[interface].queue_depth[class]);
+            }
+        }
+        for (int reason = 0; reason < DROP_REASONS; reason++) {
+            sum->drops[reason] += COUNTER_GET(counters->drops[reason]);
+        }
+        for (int event = 0; event < STATS_EVENTS; event++) {
+            sum->events[event] += COUNTER_GET(counters->events[event]);
+        }
+    }
+}
+
+/**
+ * @brief Print the column headers: per interface rx / tx rates, then drops, ARP, ICMP, policed and
+ *        queue drop rates, and the frames queued.
+ *
+ * @param stats The counters segment.
+ */
+static void Print_Header(const router_stats *stats) {
+    for (uint32_t interface = 0; interface < stats->interfaces; interface++) {
+        fprintf(stdout, "  %-33s", stats->names[interface]);
+    }
+    fprintf(stdout, "  %8s %8s %8s %8s %8s %8s\n", "drops", "arp+nd", "icmp", "policed", "qdrops", "queued");
+    for (uint32_t interface = 0; interface < stats->interfaces; interface++) {
+        fprintf(stdout, "  %7s %8s %7s %8s", "rx kpps", "rx Mbps", "tx kpps", "tx Mbps");
+    }
+    fprintf(stdout, "  %8s %8s %8s %8s %8s %8s\n", "pkts/s", "msgs/s", "msgs/s", "msgs/s", "pkts/s", "pkts");
+}
+
+/**
+ * @brief Print the rates between two samples.
+ *
+ * @param stats   The counters segment.
+ * @param now     The latest sample.
+ * @param before  The previous sample.
+ * @param seconds The time between them.
+ */
+static void Print_Rates(const router_stats *stats, const totals *now, const totals *before, double seconds) {
+    for (uint32_t interface = 0; interface < stats->interfaces; interface++) {
+        fprintf(stdout, "  %7.1f %8.1f %7.1f %8.1f",
+                (now->rx_packets[interface] - before->rx_packets[interface]) / seconds / 1e3,
+                (now->rx_bytes[interface] - before->rx_bytes[interface]) * 8 / seconds / 1e6,
+                (now->tx_packets[interface] - before->tx_packets[interface]) / seconds / 1e3,
+                (now->tx_bytes[interface] - before->tx_bytes[interface]) * 8 / seconds / 1e6);
+    }
+
+    uint64_t drops = 0, arp = 0, icmp = 0;
+    for (int reason = 0; reason < DROP_REASONS; reason++) drops += now->drops[reason] - before->drops[reason];
+    for (int event = ARP_REQUESTS_IN; event <= ND_ADVERTS_OUT; event++) arp += now->events[event] - before->events[event];
+    for (int event = ICMP_ECHO_REPLIES; event <= ICMP_TOO_BIG; event++) icmp += now->events[event] - before->events[event];
+    fprintf(stdout, "  %8.0f %8.0f %8.0f %8.0f %8.0f %8llu\n", drops / seconds, arp / seconds, icmp / seconds,
+            (now->policed - before->policed) / seconds, (now->queue_drops - before->queue_drops) / seconds,
+            (unsigned long long)now->queue_depth);
+    fflush(stdout);
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    double interval = 1;
+    long count = 0;
+    bool once = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:c:t")) != -1) {
+        switch (opt) {
+            case 'i': interval = atof(optarg); break;
+            case 'c': count = atol(optarg); break;
+            case 't': once = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-i interval seconds] [-c count, 0 = forever] [-t totals and exit] [pid]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (interval <= 0) interval = 1;
+
+    int pid = optind < argc ? atoi(argv[optind]) : Find_Router();
+    if (pid <= 0) return EXIT_FAILURE;
+
+    const router_stats *stats = Open_Stats(pid);
+    if (!stats) {
+        fprintf(stderr, "router %d: %s\n", pid, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (once) {
+        fprintf(stdout, "router %d, %u workers, up %llus\n", pid, stats->workers,
+                (unsigned long long)(time(NULL) - (time_t)stats->started));
+        Dump_Stats(stdout, stats);
+        Close_Stats(stats);
+        return EXIT_SUCCESS;
+    }
+
+    totals samples[2];
+    int current = 0;
+    Sum_Stats(stats, &samples[current]);
+    double last = Now();
+
+    for (long line = 0; !count || line < count; line++) {
+        struct timespec pause = {.tv_sec = (time_t)interval, .tv_nsec = (long)((interval - (time_t)interval) * 1e9)};
+        nanosleep(&pause, NULL);
+        // The segment outlives a router that was killed outright, stop with it.
+        if (kill(pid, 0) < 0 && errno == ESRCH) break;
+
+        double now = Now();
+        Sum_Stats(stats, &samples[!current]);
+        if (line % HEADER_EVERY == 0) Print_Header(stats);
+        Print_Rates(stats, &samples[!current], &samples[current], now - last);
+        current = !current;
+        last = now;
+    }
+
+    Close_Stats(stats);
+    return EXIT_SUCCESS;
+}
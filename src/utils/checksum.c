@@ -0,0 +1,211 @@
+#include "./checksum.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*********************************************************************************/
+
+// Calculate the Internet Checksum for a sequence of 16-bit data values.
+// This function takes a pointer to an array of 16-bit data values (data) and the 
+// length of the data in bytes (len) as input.
+// Returns the calculated checksum value as a 16-bit integer.
+uint16_t Checksum(uint16_t *data, size_t len) {
+    unsigned long checksum = 0;
+    uint16_t extra_byte;
+
+    // Process 16-bit data values in the array.
+    while (len > 1) {
+        checksum += ntohs(*data++);
+        len -= 2;
+    }
+
+    // If there is an odd byte left, process it.
+    if (len) {
+        *(uint8_t *)&extra_byte = *(uint8_t *)data; // Extract the remaining byte.
+        checksum += extra_byte; // Add the byte to the checksum.
+    }
+
+    // Add any carry bits and perform one's complement 
+	// to obtain the final checksum.
+    checksum = (checksum >> 16) + (checksum & 0xffff);
+    checksum += (checksum >> 16);
+
+    return (uint16_t)(~checksum); // Complement checksum.
+}
+
+// Update a checksum after one of the 16-bit words it covers changed (RFC 1624, eqn. 3).
+// This function takes the stored checksum (check) and the old and new values of the word,
+// all in the same byte order as they are in the packet.
+// Returns the new checksum, in that same byte order.
+uint16_t Checksum_Adjust(uint16_t check, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = (uint16_t)~check + (uint16_t)~old_word + new_word;
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/*********************************************************************************/
+
+// Add the data to a one's complement partial sum, 8 bytes at a time.
+// This function takes the data (data), its length in bytes (len) and the running sum (sum).
+// The carries out of the 64-bit accumulator are added back in (end-around carry).
+// Returns the new partial sum, in the byte order of the data.
+uint64_t Checksum_Sum_Scalar(const void *data, size_t len, uint64_t sum) {
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    while (len >= 32) {
+        uint64_t words[4];
+        memcpy(words, bytes, sizeof(words));
+        for (int word = 0; word < 4; word++) {
+            sum += words[word];
+            sum += (sum < words[word]);
+        }
+        bytes += 32;
+        len -= 32;
+    }
+
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        sum += word;
+        sum += (sum < word);
+        bytes += 8;
+        len -= 8;
+    }
+
+    // Tail: fewer than 8 bytes. Words at even offsets may be added with any width, as
+    // 2^16 and 2^32 are both 1 modulo 0xffff; the odd byte is padded with a zero.
+    if (len & 4) {
+        uint32_t word;
+        memcpy(&word, bytes, sizeof(word));
+        sum += word;
+        sum += (sum < word);
+        bytes += 4;
+    }
+    if (len & 2) {
+        uint16_t word;
+        memcpy(&word, bytes, sizeof(word));
+        sum += word;
+        sum += (sum < word);
+        bytes += 2;
+    }
+    if (len & 1) {
+        uint16_t word = 0;
+        memcpy(&word, bytes, 1);
+        sum += word;
+        sum += (sum < word);
+    }
+
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Lanes of 32 bits absorb two 16-bit words per iteration; flushing them to the 64-bit
+// accumulator every block keeps them from overflowing on arbitrarily long data.
+#define CHECKSUM_SIMD_BLOCK 16384
+
+// Add the data to a one's complement partial sum, 16 bytes at a time with SSE2.
+// Returns the new partial sum, in the byte order of the data.
+uint64_t Checksum_Sum_SSE2(const void *data, size_t len, uint64_t sum) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    const __m128i zero = _mm_setzero_si128();
+
+    while (len >= 16) {
+        __m128i lanes = zero;
+        for (int block = 0; block < CHECKSUM_SIMD_BLOCK && len >= 16; block++) {
+            __m128i words = _mm_loadu_si128((const __m128i *)bytes);
+            lanes = _mm_add_epi32(lanes, _mm_unpacklo_epi16(words, zero));
+            lanes = _mm_add_epi32(lanes, _mm_unpackhi_epi16(words, zero));
+            bytes += 16;
+            len -= 16;
+        }
+
+        uint32_t partial[4];
+        _mm_storeu_si128((__m128i *)partial, lanes);
+        sum += (uint64_t)partial[0] + partial[1] + partial[2] + partial[3];
+    }
+
+    return Checksum_Sum_Scalar(bytes, len, sum);
+}
+
+// Add the data to a one's complement partial sum, 32 bytes at a time with AVX2.
+// Only call it when the CPU supports AVX2 (see Checksum_Fast).
+// Returns the new partial sum, in the byte order of the data.
+__attribute__((target("avx2")))
+uint64_t Checksum_Sum_AVX2(const void *data, size_t len, uint64_t sum) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (len >= 32) {
+        __m256i lanes = zero;
+        for (int block = 0; block < CHECKSUM_SIMD_BLOCK && len >= 32; block++) {
+            __m256i words = _mm256_loadu_si256((const __m256i *)bytes);
+            lanes = _mm256_add_epi32(lanes, _mm256_unpacklo_epi16(words, zero));
+            lanes = _mm256_add_epi32(lanes, _mm256_unpackhi_epi16(words, zero));
+            bytes += 32;
+            len -= 32;
+        }
+
+        uint32_t partial[8];
+        _mm256_storeu_si256((__m256i *)partial, lanes);
+        for (int lane = 0; lane < 8; lane++) {
+            sum += partial[lane];
+        }
+    }
+
+    return Checksum_Sum_SSE2(bytes, len, sum);
+}
+
+// Whether the CPU has AVX2, detected once at load time before any worker checksums.
+static bool has_avx2;
+
+__attribute__((constructor))
+static void Detect_Checksum_Kernels(void) {
+    __builtin_cpu_init();   // Constructors may run before the compiler's own CPU detection.
+    has_avx2 = __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+// Fold a partial sum to 16 bits and complement it.
+// This function takes the partial sum (sum) returned by the kernels.
+// Returns the checksum, in the byte order of the summed data.
+uint16_t Checksum_Fold(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// Sum data with the widest kernel worth using for its length.
+static uint64_t Checksum_Sum(const void *data, size_t len) {
+#if defined(__x86_64__) || defined(__i386__)
+    // Headers are too short to amortize the vector setup.
+    if (len >= 128) {
+        return has_avx2 ? Checksum_Sum_AVX2(data, len, 0) : Checksum_Sum_SSE2(data, len, 0);
+    }
+#endif
+    return Checksum_Sum_Scalar(data, len, 0);
+}
+
+// Calculate the Internet Checksum with the widest kernel the CPU has.
+// This function takes the data (data) and its length in bytes (len).
+// Returns the checksum in network byte order, to be stored as is in the header.
+uint16_t Checksum_Fast(const void *data, size_t len) {
+    return Checksum_Fold(Checksum_Sum(data, len));
+}
+
+// Check that a header or message (checksum field included) sums to 0xFFFF.
+// This function takes the data (data) and its length in bytes (len), and never writes to it.
+// Returns true if the checksum is valid.
+bool Checksum_Valid(const void *data, size_t len) {
+    return Checksum_Fold(Checksum_Sum(data, len)) == 0;
+}
+
+/*********************************************************************************/
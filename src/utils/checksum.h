@@ -0,0 +1,28 @@
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Calculate the Internet Checksum for a sequence of 16-bit data values (host byte order result).
+uint16_t Checksum(uint16_t *data, size_t len);
+// Update a checksum after one of the 16-bit words it covers changed (RFC 1624).
+uint16_t Checksum_Adjust(uint16_t check, uint16_t old_word, uint16_t new_word);
+
+// One's complement partial sums, in the byte order of the data (RFC 1071 byte order independence).
+// Each kernel adds data to the running sum and returns the new, unfolded, sum.
+uint64_t Checksum_Sum_Scalar(const void *data, size_t len, uint64_t sum);
+#if defined(__x86_64__) || defined(__i386__)
+uint64_t Checksum_Sum_SSE2(const void *data, size_t len, uint64_t sum);
+uint64_t Checksum_Sum_AVX2(const void *data, size_t len, uint64_t sum);
+#endif
+// Fold a partial sum to 16 bits and complement it, ready to be stored in a header.
+uint16_t Checksum_Fold(uint64_t sum);
+
+// Calculate the Internet Checksum with the widest kernel the CPU has (network byte order result).
+uint16_t Checksum_Fast(const void *data, size_t len);
+// Check that data (checksum field included) sums to 0xFFFF, without modifying it.
+bool Checksum_Valid(const void *data, size_t len);
+
+#endif /* CHECKSUM_H_ */
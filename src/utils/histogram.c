@@ -0,0 +1,40 @@
+#include "./histogram.h"
+
+/*********************************************************************************/
+
+// Add the buckets of a histogram to a snapshot (HIST_BUCKETS long), so several histograms
+// can be merged. The owner keeps recording meanwhile, the snapshot is only close to atomic.
+// Returns the number of samples added.
+uint64_t Hist_Snapshot(const histogram *hist, uint64_t *buckets) {
+    uint64_t samples = 0;
+    for (int bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        uint64_t count = COUNTER_GET(hist->buckets[bucket]);
+        buckets[bucket] += count;
+        samples += count;
+    }
+    return samples;
+}
+
+// Highest value of a bucket, so the percentiles never understate a sample.
+static uint64_t Bucket_Ceiling(int bucket) {
+    if (bucket < HIST_SUB_COUNT) return (uint64_t)bucket;
+
+    int shift = (bucket - HIST_SUB_COUNT) / HIST_SUB_COUNT;
+    uint64_t sub = (uint64_t)((bucket - HIST_SUB_COUNT) % HIST_SUB_COUNT);
+    return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+// Value below which a fraction of the samples of a snapshot fall, rounded up to its bucket.
+// Returns 0 for an empty snapshot.
+uint64_t Hist_Percentile(const uint64_t *buckets, uint64_t samples, double fraction) {
+    if (!samples) return 0;
+
+    uint64_t rank = (uint64_t)(fraction * (double)samples), seen = 0;
+    if (rank >= samples) rank = samples - 1;
+
+    for (int bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += buckets[bucket];
+        if (seen > rank) return Bucket_Ceiling(bucket);
+    }
+    return Bucket_Ceiling(HIST_BUCKETS - 1);
+}
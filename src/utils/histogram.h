@@ -0,0 +1,48 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lib.h"
+
+// Log-linear (HDR) buckets: exact below 2^HIST_SUB_BITS, then 2^HIST_SUB_BITS buckets per
+// power of two, i.e. a relative error under 1 / 2^HIST_SUB_BITS.
+#define HIST_SUB_BITS   5
+#define HIST_SUB_COUNT  (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS   40          // Larger values land in the last bucket.
+#define HIST_BUCKETS    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// Histogram written by a single thread, readable by any other without locking.
+typedef struct histogram {
+    counter buckets[HIST_BUCKETS];
+    counter samples;                // Samples recorded.
+    counter sum;                    // Sum of the samples, for the mean.
+    counter max;                    // Largest sample.
+} histogram;
+
+// Bucket of a value: its top HIST_SUB_BITS + 1 bits.
+static inline int Hist_Bucket(uint64_t value) {
+    if (value < HIST_SUB_COUNT) return (int)value;
+
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= HIST_MAX_BITS) return HIST_BUCKETS - 1;
+
+    int shift = msb - HIST_SUB_BITS;
+    return HIST_SUB_COUNT + shift * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+// Record `samples` samples of a value, by the owner of the histogram only.
+static inline void Hist_Record(histogram *hist, uint64_t value, uint64_t samples) {
+    COUNTER_ADD(hist->buckets[Hist_Bucket(value)], samples);
+    COUNTER_ADD(hist->samples, samples);
+    COUNTER_ADD(hist->sum, value * samples);
+    if (value > COUNTER_GET(hist->max)) atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+}
+
+// Add the buckets of a histogram to a snapshot, returns the number of samples added.
+uint64_t Hist_Snapshot(const histogram *hist, uint64_t *buckets);
+// Value below which a fraction of the samples of a snapshot fall (rounded up to its bucket).
+uint64_t Hist_Percentile(const uint64_t *buckets, uint64_t samples, double fraction);
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+
+#include "./hugepage.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*********************************************************************************/
+
+const char *const huge_mode_names[HUGE_MODES] = {
+    [HUGE_OFF] = "off", [HUGE_THP] = "thp", [HUGE_ON] = "on",
+};
+
+const char *const huge_tag_names[HUGE_TAGS] = {
+    [HUGE_FIB] = "fib", [HUGE_NEIGHBORS] = "neighbors", [HUGE_FLOWS] = "flows", [HUGE_PACKETS] = "packets",
+    [HUGE_CONNTRACK] = "conntrack",
+};
+
+// Pages a region ended up on.
+typedef enum huge_backing {
+    BACKING_NORMAL,
+    BACKING_THP,                        // Hugepages if the kernel found 2 MB to give, checked in smaps.
+    BACKING_HUGETLB,
+} huge_backing;
+
+// Allocated region, registered for Huge_Free and the report.
+typedef struct huge_region {
+    char *mem;                          // Start of the region, as returned.
+    size_t len;                         // Usable bytes.
+    size_t mapped;                      // Bytes mapped from `mem`, the guard page included.
+    huge_tag tag;
+    huge_backing backing;
+    struct huge_region *next;
+} huge_region;
+
+static huge_mode mode = HUGE_ON;
+static huge_region *regions;
+static pthread_mutex_t regions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set the pages of the next allocations.
+void Set_Huge_Mode(huge_mode new_mode) {
+    mode = new_mode;
+}
+
+// Mode of a name (off, thp, on), -1 if unknown.
+int Parse_Huge_Mode(const char *name) {
+    for (int index = 0; index < HUGE_MODES; index++) {
+        if (!strcmp(name, huge_mode_names[index])) return index;
+    }
+    return -1;
+}
+
+// Map a region of normal pages, on a 2 MB boundary if THP may back it, followed by an inaccessible
+// guard page: the region is then a VMA of its own, never merged with its neighbors, so smaps tells
+// exactly how much of it THP backs. Returns the region, MAP_FAILED if out of memory.
+static void *Map_Normal(size_t len, int advice) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t align = advice == MADV_HUGEPAGE ? HUGE_PAGE_SIZE : page;
+    size_t total = len + align + page;
+
+    char *raw = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return MAP_FAILED;
+
+    char *mem = (char *)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if (mem > raw) munmap(raw, (size_t)(mem - raw));
+    char *end = mem + len + page;
+    if (raw + total > end) munmap(end, (size_t)(raw + total - end));
+
+    mprotect(mem + len, page, PROT_NONE);
+    madvise(mem, len, advice);
+    return mem;
+}
+
+// Allocate a zeroed region: on hugetlbfs pages if the host reserved some (HUGE_ON), else advised
+// for THP (HUGE_ON, HUGE_THP), else on normal pages. The size is rounded up to 2 MB, the region
+// aligned on 2 MB, unless HUGE_OFF. Returns the region, NULL if out of memory.
+void *Huge_Alloc(size_t size, huge_tag tag) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t unit = mode == HUGE_OFF ? page : HUGE_PAGE_SIZE;
+    size_t len = (size + unit - 1) / unit * unit;
+    if (!len) len = unit;
+
+    huge_region *region = malloc(sizeof(*region));
+    if (!region) return NULL;
+
+    void *mem = MAP_FAILED;
+    if (mode == HUGE_ON) {
+        mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        *region = (huge_region){.mem = mem, .len = len, .mapped = len, .backing = BACKING_HUGETLB};
+    }
+    if (mem == MAP_FAILED) {
+        bool thp = mode != HUGE_OFF;
+        mem = Map_Normal(len, thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+        *region = (huge_region){.mem = mem, .len = len, .mapped = len + page,
+                                .backing = thp ? BACKING_THP : BACKING_NORMAL};
+    }
+    if (mem == MAP_FAILED) {
+        free(region);
+        return NULL;
+    }
+    region->tag = tag;
+
+    pthread_mutex_lock(&regions_lock);
+    region->next = regions;
+    regions = region;
+    pthread_mutex_unlock(&regions_lock);
+    return mem;
+}
+
+// Free a region of Huge_Alloc (nothing if NULL or not one).
+void Huge_Free(void *mem) {
+    if (!mem) return;
+
+    pthread_mutex_lock(&regions_lock);
+    huge_region **link = &regions;
+    while (*link && (*link)->mem != mem) link = &(*link)->next;
+    huge_region *region = *link;
+    if (region) *link = region->next;
+    pthread_mutex_unlock(&regions_lock);
+
+    if (!region) return;
+    munmap(region->mem, region->mapped);
+    free(region);
+}
+
+/*********************************************************************************/
+
+// Create an empty pool of objects of a size, its regions are only allocated by Pool_Alloc.
+huge_pool *Create_Huge_Pool(size_t object, huge_tag tag) {
+    if (!object || object > HUGE_PAGE_SIZE) return NULL;
+
+    huge_pool *pool = calloc(1, sizeof(huge_pool));
+    if (!pool) return NULL;
+    pool->object = (object + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+    pool->tag = tag;
+    return pool;
+}
+
+// Take a zeroed object from a pool, the objects follow each other in 2 MB regions.
+// Returns the object, NULL if out of memory.
+void *Pool_Alloc(huge_pool *pool) {
+    if (!pool->chunk || pool->used + pool->object > HUGE_PAGE_SIZE) {
+        if (pool->count == pool->capacity) {
+            size_t capacity = pool->capacity ? pool->capacity * 2 : 16;
+            void **chunks = realloc(pool->chunks, capacity * sizeof(*chunks));
+            if (!chunks) return NULL;
+            pool->chunks = chunks;
+            pool->capacity = capacity;
+        }
+
+        char *chunk = Huge_Alloc(HUGE_PAGE_SIZE, pool->tag);
+        if (!chunk) return NULL;
+        pool->chunks[pool->count++] = chunk;
+        pool->chunk = chunk;
+        pool->used = 0;
+    }
+
+    void *object = pool->chunk + pool->used;
+    pool->used += pool->object;
+    return object;
+}
+
+// Free a pool and every object taken from it.
+void Free_Huge_Pool(huge_pool **pool) {
+    if (!pool || !(*pool)) return;
+    for (size_t index = 0; index < (*pool)->count; index++) {
+        Huge_Free((*pool)->chunks[index]);
+    }
+    free((*pool)->chunks);
+    free(*pool);
+    *pool = NULL;
+}
+
+/*********************************************************************************/
+
+// Bytes of the THP regions of a tag actually backed by hugepages, summed from the AnonHugePages
+// of their VMAs in /proc/self/smaps (each region is a VMA of its own, see Map_Normal).
+// Called with the regions locked.
+static size_t THP_Backed(huge_tag tag) {
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) return 0;
+
+    size_t backed = 0;
+    uintptr_t start = 0, end = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long low, high, kbytes;
+        if (sscanf(line, "%lx-%lx ", &low, &high) == 2) {
+            start = low;
+            end = high;
+            continue;
+        }
+        if (sscanf(line, "AnonHugePages: %lu kB", &kbytes) != 1 || !kbytes) continue;
+
+        for (huge_region *region = regions; region; region = region->next) {
+            if (region->tag != tag || region->backing != BACKING_THP) continue;
+            uintptr_t low_end = (uintptr_t)region->mem > start ? (uintptr_t)region->mem : start;
+            uintptr_t high_end = (uintptr_t)region->mem + region->len < end ? (uintptr_t)region->mem + region->len : end;
+            if (low_end >= high_end) continue;
+            size_t overlap = high_end - low_end;
+            backed += (size_t)kbytes * 1024 < overlap ? (size_t)kbytes * 1024 : overlap;
+        }
+    }
+    fclose(smaps);
+    return backed;
+}
+
+// Bytes of the regions of a tag, and how many of them are on 2 MB pages (hugetlbfs, or THP once
+// the pages are touched).
+void Huge_Usage(huge_tag tag, size_t *bytes, size_t *huge) {
+    *bytes = *huge = 0;
+
+    pthread_mutex_lock(&regions_lock);
+    for (huge_region *region = regions; region; region = region->next) {
+        if (region->tag != tag) continue;
+        *bytes += region->len;
+        if (region->backing == BACKING_HUGETLB) *huge += region->len;
+    }
+    *huge += THP_Backed(tag);
+    pthread_mutex_unlock(&regions_lock);
+}
+
+// Print the bytes of every tag and how many of them are on 2 MB pages.
+void Dump_Huge_Memory(FILE *out) {
+    fprintf(out, "hugepages (%s, MB on 2 MB pages / mapped):", huge_mode_names[mode]);
+    for (int tag = 0; tag < HUGE_TAGS; tag++) {
+        size_t bytes, huge;
+        Huge_Usage((huge_tag)tag, &bytes, &huge);
+        fprintf(out, " %s %.1f/%.1f MB", huge_tag_names[tag], huge / 1048576.0, bytes / 1048576.0);
+    }
+    fprintf(out, "\n");
+}
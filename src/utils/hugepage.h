@@ -0,0 +1,67 @@
+#ifndef HUGEPAGE_H_
+#define HUGEPAGE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Memory of the data the forwarding walks on every packet (trie nodes, neighbor table, flow caches,
+// packet buffers, conntrack) on 2 MB pages, so it is covered by a few TLB entries instead of thousands.
+// Explicit hugetlbfs pages are tried first, then transparent hugepages, then normal pages:
+// the router runs on any host, only faster when the host has hugepages.
+
+#define HUGE_PAGE_SIZE  (2u << 20)
+
+// Pages to allocate on, set once at startup.
+typedef enum huge_mode {
+    HUGE_OFF,                           // Normal pages only, THP disabled on the regions.
+    HUGE_THP,                           // Transparent hugepages (madvise), normal pages if refused.
+    HUGE_ON,                            // Hugetlbfs pages, then as HUGE_THP.
+    HUGE_MODES
+} huge_mode;
+
+// What a region holds, for the report.
+typedef enum huge_tag {
+    HUGE_FIB,                           // Trie nodes.
+    HUGE_NEIGHBORS,                     // ARP table.
+    HUGE_FLOWS,                         // Per-worker flow caches.
+    HUGE_PACKETS,                       // Per-worker packet buffers.
+    HUGE_CONNTRACK,                     // Connection tracking table of the NAT.
+    HUGE_TAGS
+} huge_tag;
+
+// Fixed-size objects carved out of 2 MB regions, all freed at once.
+typedef struct huge_pool {
+    size_t object;                      // Size of an object, rounded up to 16 bytes.
+    huge_tag tag;
+    char *chunk;                        // Region being carved.
+    size_t used;                        // Bytes of it handed out.
+    void **chunks;                      // Every region, to free them.
+    size_t count, capacity;
+} huge_pool;
+
+extern const char *const huge_mode_names[HUGE_MODES];
+extern const char *const huge_tag_names[HUGE_TAGS];
+
+// Set the pages of the next allocations (HUGE_ON by default).
+void Set_Huge_Mode(huge_mode mode);
+// Mode of a name (off, thp, on), -1 if unknown.
+int Parse_Huge_Mode(const char *name);
+
+// Allocate a zeroed, page aligned region, NULL if out of memory.
+void *Huge_Alloc(size_t size, huge_tag tag);
+// Free a region of Huge_Alloc.
+void Huge_Free(void *mem);
+
+// Create an empty pool of objects of a size.
+huge_pool *Create_Huge_Pool(size_t object, huge_tag tag);
+// Take a zeroed object from a pool, NULL if out of memory.
+void *Pool_Alloc(huge_pool *pool);
+// Free a pool and every object taken from it.
+void Free_Huge_Pool(huge_pool **pool);
+
+// Bytes of the regions of a tag, and how many of them are on 2 MB pages.
+void Huge_Usage(huge_tag tag, size_t *bytes, size_t *huge);
+// Print the bytes of every tag and their pages.
+void Dump_Huge_Memory(FILE *out);
+
+#endif /* HUGEPAGE_H_ */
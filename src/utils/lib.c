@@ -1,10 +1,16 @@
+#define _GNU_SOURCE
+
 #include "./lib.h"
+#include "./profile.h"
+#include "./histogram.h"
+#include "./stats.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdbool.h>
 
 #include <net/if.h>
 #include <arpa/inet.h>
@@ -12,22 +18,85 @@
 
 #include <linux/if.h>
 #include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/if_ether.h>
+#include <linux/virtio_net.h>
 
 #include <asm/byteorder.h>
 
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <sys/select.h>
 
-int interfaces[ROUTER_NUM_INTERFACES];
+#include <ifaddrs.h>
+
+// One socket per (worker, interface); the workers of an interface share a fanout group.
+int interfaces[MAX_WORKERS][ROUTER_NUM_INTERFACES];
+static int num_link_workers = 1;
+
+// Worker owning the calling thread, selects the row of sockets it reads and writes.
+static _Thread_local int link_worker;
+// Longest Recv_Burst_Link of the calling thread sleeps for frames (ns), -1 until one arrives.
+static _Thread_local int64_t link_wait = -1;
+
+// Interface table, filled once by Init_Network and only read afterwards,
+// so the workers can query addresses without a syscall per packet.
+static struct interface_info {
+	char name[IFNAMSIZ];
+	uint32_t ip;
+	uint8_t mac[6];
+	struct in6_addr ip6[IPV6_ADDRS];
+	int num_ip6;
+	int mtu;
+} interfaces_info[ROUTER_NUM_INTERFACES];
+
+// Offload (-g): every frame read or written on a socket is preceded by its link_offload header,
+// which the link keeps apart from the frame so the buffers still start at the Ethernet header.
+static bool link_vnet;
+static link_offload plain_frame;
+_Static_assert(sizeof(link_offload) == sizeof(struct virtio_net_hdr), "link_offload is a virtio_net_hdr");
+
+// Size of the frame buffers, set by Init_Network from the MTUs: a cache line multiple.
+static size_t frame_size = MAX_PACKET_LEN;
+
+// Kernel timestamps (-t): the RX timestamp travels with its frame, the TX timestamp comes back
+// on the error queue of the sending socket, keyed by the number of frames sent before (OPT_ID).
+#define TX_PENDING      4096                // Frames sent and not yet timestamped, per socket.
+#define STAMP_CONTROL   CMSG_SPACE(sizeof(struct timespec) * 3)
+#define STAMP_ERROR     (STAMP_CONTROL + CMSG_SPACE(sizeof(struct sock_extended_err)))
+
+// Linux 4.20 and later, missing from older headers.
+#ifndef PACKET_FANOUT_FLAG_IGNORE_OUTGOING
+#define PACKET_FANOUT_FLAG_IGNORE_OUTGOING 0x4000
+#endif
+
+static bool link_timestamps;
+
+// Per-worker TX tracking and latency histograms, allocated when timestamps are enabled.
+static struct link_latency {
+	uint32_t next_key[ROUTER_NUM_INTERFACES];				// Key of the next frame sent on a socket.
+	struct tx_pending {
+		uint64_t stamp;										// RX timestamp (ns), 0 when not measured.
+		uint32_t key;
+		int path;
+	} pending[ROUTER_NUM_INTERFACES][TX_PENDING];
+	histogram latency[ROUTER_NUM_INTERFACES][LINK_PATHS];	// Wire-to-wire latency (ns).
+} *link_latency[MAX_WORKERS];
+
+static const char *path_names[LINK_PATHS] = { "fast", "slow", "arp" };
 
 /*********************************************************************************/
 
 // Function to obtain a socket for a specified network interface.
-// Takes the interface name as input.
+// Takes the interface name and the fanout group to join (NULL for none) as input.
+// Sockets of one fanout group get the interface's frames spread by flow hash,
+// so every flow keeps its order on a single worker. A group of -1 is created with
+// an id the kernel picks, unused by any other process, and set to it.
 // Returns the socket descriptor.
-static int Get_Socket(const char *if_name) {    
+static int Get_Socket(const char *if_name, int *fanout_group) {    
     // Create a raw socket for packet communication
     int s = socket(AF_PACKET, SOCK_RAW, 768);
     DIE(s == -1, "socket %s", strerror(errno)); // Check if socket creation failed
@@ -49,28 +118,255 @@ static int Get_Socket(const char *if_name) {
     // Bind the socket to the specified network interface
     res = bind(s, (struct sockaddr *)&addr, sizeof(addr));
     DIE(res == -1, "bind %s", strerror(errno)); // Check if binding failed
+
+    // A fanout group is not the sender of the frames its members write, so without this
+    // every worker would read back the frames the others transmit.
+    int ignore_outgoing = 1;
+    res = setsockopt(s, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore_outgoing, sizeof(ignore_outgoing));
+    DIE(res == -1, "setsockopt PACKET_IGNORE_OUTGOING %s", strerror(errno));
+
+    // Join the interface's fanout group, in flow hash mode. The group receives through its own hook,
+    // which ignores outgoing frames only when asked to at creation.
+    if (fanout_group) {
+        int mode = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_IGNORE_OUTGOING;
+        if (*fanout_group < 0) mode |= PACKET_FANOUT_FLAG_UNIQUEID;
+        int fanout = (*fanout_group < 0 ? 0 : *fanout_group) | (mode << 16);
+        res = setsockopt(s, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout));
+        DIE(res == -1, "setsockopt PACKET_FANOUT %s", strerror(errno));
+        if (*fanout_group < 0) {
+            socklen_t len = sizeof(fanout);
+            res = getsockopt(s, SOL_PACKET, PACKET_FANOUT, &fanout, &len);
+            DIE(res == -1, "getsockopt PACKET_FANOUT %s", strerror(errno));
+            *fanout_group = fanout & 0xffff;
+        }
+    }
+
+    // Software timestamps of the frames received and sent, the sent ones numbered per socket.
+    if (link_timestamps) {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                    SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        res = setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+        DIE(res == -1, "setsockopt SO_TIMESTAMPING %s", strerror(errno));
+    }
+
+    // Offload headers on every frame: the kernel no longer segments what GRO coalesced before
+    // handing it over, and segments what is sent with a segment size (GSO).
+    if (link_vnet) {
+        int vnet = 1;
+        res = setsockopt(s, SOL_PACKET, PACKET_VNET_HDR, &vnet, sizeof(vnet));
+        DIE(res == -1, "setsockopt PACKET_VNET_HDR %s", strerror(errno));
+    }
     
     return s; // Return the socket descriptor
 }
 
+// Cache the IPv4 and MAC addresses of a network interface in the interface table.
+// This function takes the interface index (interface) and its name (if_name) as input.
+static void Load_Interface(int interface, const char *if_name) {
+	struct ifreq ifr;
+	struct interface_info *info = &interfaces_info[interface];
+
+	snprintf(info->name, sizeof(info->name), "%s", if_name);
+
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", if_name);
+	int ret = ioctl(interfaces[0][interface], SIOCGIFADDR, &ifr);
+	DIE(ret == -1, "ioctl SIOCGIFADDR %s", strerror(errno));
+	info->ip = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
+
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", if_name);
+	ret = ioctl(interfaces[0][interface], SIOCGIFHWADDR, &ifr);
+	DIE(ret == -1, "ioctl SIOCGIFHWADDR %s", strerror(errno));
+	memcpy(info->mac, ifr.ifr_addr.sa_data, 6);
+
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", if_name);
+	ret = ioctl(interfaces[0][interface], SIOCGIFMTU, &ifr);
+	DIE(ret == -1, "ioctl SIOCGIFMTU %s", strerror(errno));
+	info->mtu = ifr.ifr_mtu;
+
+	// IPv6 has no ioctl for its addresses, several per interface (link-local and global).
+	struct ifaddrs *addrs;
+	ret = getifaddrs(&addrs);
+	DIE(ret == -1, "getifaddrs %s", strerror(errno));
+	info->num_ip6 = 0;
+	for (struct ifaddrs *addr = addrs; addr; addr = addr->ifa_next) {
+		if (!addr->ifa_addr || addr->ifa_addr->sa_family != AF_INET6 || strcmp(addr->ifa_name, if_name)) continue;
+		if (info->num_ip6 == IPV6_ADDRS) break;
+		info->ip6[info->num_ip6++] = ((struct sockaddr_in6 *)addr->ifa_addr)->sin6_addr;
+	}
+	freeifaddrs(addrs);
+}
+
+// Have the kernel timestamp every frame received and sent, must run before Init_Network.
+void Enable_Link_Timestamps(void) {
+	link_timestamps = true;
+}
+
+// Have the kernel hand over GRO super-packets and segment GSO ones, must run before Init_Network.
+void Enable_Link_Offload(void) {
+	link_vnet = true;
+}
+
+// Size the frame buffers for the largest frame any interface receives: its MTU, the Ethernet and
+// a VLAN header, or a whole super-packet with offload. Never below MAX_PACKET_LEN.
+static void Size_Frames(int count) {
+	size_t largest = link_vnet ? MAX_GSO_LEN : 0;
+	for (int byte = 0; byte < count; byte++) {
+		if ((size_t)interfaces_info[byte].mtu > largest) largest = (size_t)interfaces_info[byte].mtu;
+	}
+	largest += ETH_HLEN + 4;
+
+	frame_size = MAX_PACKET_LEN;
+	if (largest > frame_size) frame_size = (largest + 63) & ~(size_t)63;
+}
+
 // Initialize network interfaces based on command line arguments.
-// This function takes the number of arguments (argc) and an array of interface names (argv).
-// It sets up sockets for each specified network interface.
-void Init_Network(int argc, char *argv[]) {
+// This function takes the number of arguments (argc), an array of interface names (argv)
+// and the number of workers. It sets up a socket per worker for each specified network
+// interface; with several workers the sockets of an interface form a PACKET_FANOUT group.
+void Init_Network(int argc, char *argv[], int workers) {
+    DIE(argc > ROUTER_NUM_INTERFACES, "too many interfaces %d", argc);
+    DIE(workers < 1 || workers > MAX_WORKERS, "bad number of workers %d", workers);
+    num_link_workers = workers;
+
+    for (int worker = 0; link_timestamps && worker < workers; worker++) {
+        link_latency[worker] = calloc(1, sizeof(struct link_latency));
+        DIE(!link_latency[worker], "calloc %s", strerror(errno));
+    }
+
     for (int byte = 0; byte < argc; ++byte) {
         printf("Setting up interface: %s\n", argv[byte]);
-        interfaces[byte] = Get_Socket(argv[byte]); // Create a socket for the specified interface.
+        // The fanout group ids are shared by every process of the network namespace, the
+        // first socket lets the kernel pick one no other router uses, the others join it.
+        int fanout_group = -1;
+        for (int worker = 0; worker < workers; worker++) {
+            interfaces[worker][byte] = Get_Socket(argv[byte], workers > 1 ? &fanout_group : NULL); // Create a socket for the specified interface.
+        }
+        Load_Interface(byte, argv[byte]);          // Cache its addresses in the interface table.
+        printf("Interface %s: MTU %d\n", argv[byte], interfaces_info[byte].mtu);
+    }
+    Size_Frames(argc);
+    if (link_vnet) printf("Offload: GRO / GSO super-packets, %zu byte frame buffers\n", frame_size);
+}
+
+// Size of the frame buffers to receive in (Recv_Burst_Link, Recv_FromAny_Link), known once
+// Init_Network read the MTUs: the largest frame of any interface, or a super-packet with offload.
+size_t Get_Frame_Size(void) {
+    return frame_size;
+}
+
+// Bind the calling thread to a worker's sockets.
+void Bind_Worker_Link(int worker) {
+    link_worker = worker;
+}
+
+// Bound the sleep of the calling thread's next Recv_Burst_Link calls when every interface is idle:
+// `ns` nanoseconds, 0 not to sleep, -1 to sleep until a frame arrives.
+void Set_Link_Wait(int64_t ns) {
+    link_wait = ns;
+}
+
+// Print the wire-to-wire latency of the forwarded frames per egress interface and path, merged
+// over the workers: from the kernel RX timestamp to the kernel TX timestamp.
+void Dump_Link_Latency(FILE *out) {
+    if (!link_timestamps) return;
+
+    static uint64_t buckets[HIST_BUCKETS];
+    for (int byte = 0; byte < ROUTER_NUM_INTERFACES; byte++) {
+        for (int path = 0; path < LINK_PATHS; path++) {
+            memset(buckets, 0, sizeof(buckets));
+            uint64_t samples = 0, max = 0;
+            for (int worker = 0; worker < num_link_workers; worker++) {
+                histogram *hist = &link_latency[worker]->latency[byte][path];
+                samples += Hist_Snapshot(hist, buckets);
+                if (COUNTER_GET(hist->max) > max) max = COUNTER_GET(hist->max);
+            }
+            if (!samples) continue;
+
+            fprintf(out, "%-8s tx %-4s %10llu pkts: p50 %.1f us p99 %.1f us p99.9 %.1f us max %.1f us\n",
+                    interfaces_info[byte].name, path_names[path], (unsigned long long)samples,
+                    Hist_Percentile(buckets, samples, 0.50) / 1e3, Hist_Percentile(buckets, samples, 0.99) / 1e3,
+                    Hist_Percentile(buckets, samples, 0.999) / 1e3, max / 1e3);
+        }
     }
 }
 
+/*********************************************************************************/
+
+// Timestamp of a SCM_TIMESTAMPING control message (the software one), in ns.
+static uint64_t Stamp_NS(struct msghdr *msg) {
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+			struct timespec ts;
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+		}
+	}
+	return 0;
+}
+
+// Remember the RX timestamps of the frames just sent on a socket, under the keys the kernel
+// numbers their TX timestamps with. Frames without one still take a key.
+static void Track_TX(int intidx, int count, const uint64_t *stamps, int path) {
+	struct link_latency *latency = link_latency[link_worker];
+
+	for (int frame = 0; frame < count; frame++) {
+		uint32_t key = latency->next_key[intidx]++;
+		struct tx_pending *pending = &latency->pending[intidx][key & (TX_PENDING - 1)];
+		pending->stamp = stamps ? stamps[frame] : 0;
+		pending->key = key;
+		pending->path = path;
+	}
+}
+
+// Read the TX timestamps waiting on a socket's error queue, and record the latency of the frames
+// they match. The queue is charged to the socket's receive buffer, so it is drained every sweep.
+static void Drain_TX_Stamps(int intidx) {
+	struct link_latency *latency = link_latency[link_worker];
+	struct mmsghdr msgs[MAX_BURST / 4];
+	char controls[MAX_BURST / 4][STAMP_ERROR];
+	int max = MAX_BURST / 4;
+
+	while (1) {
+		for (int msg = 0; msg < max; msg++) {
+			memset(&msgs[msg].msg_hdr, 0, sizeof(msgs[msg].msg_hdr));
+			msgs[msg].msg_hdr.msg_control = controls[msg];
+			msgs[msg].msg_hdr.msg_controllen = sizeof(controls[msg]);
+		}
+
+		int ret = recvmmsg(interfaces[link_worker][intidx], msgs, max, MSG_ERRQUEUE | MSG_DONTWAIT, NULL);
+		if (ret <= 0) return;
+
+		for (int msg = 0; msg < ret; msg++) {
+			struct msghdr *hdr = &msgs[msg].msg_hdr;
+			uint64_t sent = Stamp_NS(hdr);
+
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+				if (cmsg->cmsg_level != SOL_PACKET || cmsg->cmsg_type != PACKET_TX_TIMESTAMP) continue;
+
+				struct sock_extended_err err;
+				memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+				if (err.ee_origin != SO_EE_ORIGIN_TIMESTAMPING) continue;
+
+				// A slot reused before its timestamp came back no longer holds the key.
+				struct tx_pending *pending = &latency->pending[intidx][err.ee_data & (TX_PENDING - 1)];
+				if (pending->key != err.ee_data || !pending->stamp || sent < pending->stamp) continue;
+
+				Hist_Record(&latency->latency[intidx][pending->path], sent - pending->stamp, 1);
+				pending->stamp = 0;
+			}
+		}
+		if (ret < max) return;
+	}
+}
+
 // Receive a network packet from the specified socket.
 // This function takes a socket descriptor (sockfd), a buffer (frame_data) to store the received data,
 // and a pointer (len) to store the length of the received data.
-// Note: The "frame_data" buffer should be large enough to accommodate the maximum transmission unit 
-// (MTU) of the interface, e.g., 1500 bytes.
+// Note: The "frame_data" buffer should be Get_Frame_Size() bytes, enough for the MTU of the
+// interface; with offload it receives the offload header first.
 // Returns 0 on success, or an error code on failure.
 int Recv_Socket_Msg(int sockfd, char *frame_data, size_t *len) {
-    int ret = read(sockfd, frame_data, MAX_PACKET_LEN); // Read data from the socket.
+    int ret = read(sockfd, frame_data, frame_size); // Read data from the socket.
     DIE(ret < 0, "read %s", strerror(errno)); // Check for read errors.
     *len = ret; // Store the length of the received data.
     return 0;
@@ -83,37 +379,207 @@ int Recv_Socket_Msg(int sockfd, char *frame_data, size_t *len) {
 // and the length of the data (len) as inputs.
 // Returns the number of bytes sent on success or an error code on failure.
 int Send_To_Link(int intidx, char *frame_data, size_t len) {
-	int ret = write(interfaces[intidx], frame_data, len);
+	return Send_Stamped_Link(intidx, frame_data, len, 0, PATH_SLOW);
+}
+
+// Send a network message received at a given kernel timestamp (stamp, in ns, 0 if unknown) that
+// took a given path through the router, so its TX timestamp measures the router's latency.
+// Returns the number of bytes sent on success or an error code on failure.
+int Send_Stamped_Link(int intidx, char *frame_data, size_t len, uint64_t stamp, int path) {
+	return Send_Offload_Link(intidx, frame_data, len, NULL, stamp, path);
+}
+
+// Send a network message with its offload state (offload, NULL for a plain frame): a super-packet
+// is segmented by the kernel, a partial transport checksum finished. Without offload the state
+// is not sent and the frame must be plain.
+// Returns the number of bytes of the frame sent on success or an error code on failure.
+int Send_Offload_Link(int intidx, char *frame_data, size_t len, const link_offload *offload, uint64_t stamp, int path) {
+	int ret;
+	if (link_vnet) {
+		link_offload header = offload ? *offload : plain_frame;
+		struct iovec iov[2] = {
+			{ .iov_base = &header, .iov_len = sizeof(header) },
+			{ .iov_base = frame_data, .iov_len = len },
+		};
+		ret = writev(interfaces[link_worker][intidx], iov, 2);
+		if (ret >= (int)sizeof(link_offload)) ret -= (int)sizeof(link_offload);
+	} else {
+		ret = write(interfaces[link_worker][intidx], frame_data, len);
+	}
 	DIE(ret == -1, "write %s", strerror(errno));
+	COUNTER_ADD(STATS_LINK(intidx).tx_packets, 1);
+	COUNTER_ADD(STATS_LINK(intidx).tx_bytes, ret);
+	if (link_timestamps) Track_TX(intidx, 1, &stamp, path);
 	return ret;
 }
 
 // Receive a network message from any available network interface using non-blocking I/O.
 // This function takes a pointer to frame data (frame_data) and a pointer to store the received data length (length).
 // Returns the interface index where data was received on success, or -1 on failure.
+// The read never blocks: several workers may be woken for the same frame and only one gets it.
+// With offload the frame's state is dropped: the buffer is Get_Frame_Size() bytes, enough for a
+// super-packet, and its transport checksum may be left partial.
 ssize_t Recv_From_Link(int intidx, char *frame_data) {
-	ssize_t ret = read(interfaces[intidx], frame_data, MAX_PACKET_LEN);
+	ssize_t ret;
+	if (link_vnet) {
+		link_offload offload;
+		struct iovec iov[2] = {
+			{ .iov_base = &offload, .iov_len = sizeof(offload) },
+			{ .iov_base = frame_data, .iov_len = frame_size },
+		};
+		struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+		ret = recvmsg(interfaces[link_worker][intidx], &msg, MSG_DONTWAIT);
+		if (ret >= (ssize_t)sizeof(offload)) ret -= (ssize_t)sizeof(offload);
+	} else {
+		ret = recv(interfaces[link_worker][intidx], frame_data, frame_size, MSG_DONTWAIT);
+	}
+	if (ret > 0) {
+		COUNTER_ADD(STATS_LINK(intidx).rx_packets, 1);
+		COUNTER_ADD(STATS_LINK(intidx).rx_bytes, ret);
+	}
 	return ret;
 }
 
+// Send a burst of network messages to a specific network interface, with as few syscalls as possible.
+// This function takes the interface index (intidx), the frames (frames), their lengths (lengths)
+// and their number (count) as inputs, with their RX timestamps (stamps, NULL if unknown), offload
+// states (offloads, NULL if all plain) and path.
+// Returns the number of frames sent.
+int Send_Burst_Link(int intidx, char **frames, size_t *lengths, int count, const uint64_t *stamps,
+                    link_offload *offloads, int path) {
+	struct mmsghdr msgs[MAX_BURST];
+	struct iovec iovs[MAX_BURST][2];
+	int sent = 0;
+	// The offload header goes in the first vector of every message, the frame in the second.
+	int first = link_vnet ? 0 : 1;
+
+	while (sent < count) {
+		int burst = count - sent < MAX_BURST ? count - sent : MAX_BURST;
+		for (int frame = 0; frame < burst; frame++) {
+			iovs[frame][0].iov_base = offloads ? &offloads[sent + frame] : &plain_frame;
+			iovs[frame][0].iov_len = sizeof(link_offload);
+			iovs[frame][1].iov_base = frames[sent + frame];
+			iovs[frame][1].iov_len = lengths[sent + frame];
+			memset(&msgs[frame].msg_hdr, 0, sizeof(msgs[frame].msg_hdr));
+			msgs[frame].msg_hdr.msg_iov = &iovs[frame][first];
+			msgs[frame].msg_hdr.msg_iovlen = 2 - first;
+		}
+
+		int ret = sendmmsg(interfaces[link_worker][intidx], msgs, burst, 0);
+		DIE(ret == -1, "sendmmsg %s", strerror(errno));
+		uint64_t bytes = 0;
+		for (int frame = 0; frame < ret; frame++) bytes += lengths[sent + frame];
+		COUNTER_ADD(STATS_LINK(intidx).tx_packets, ret);
+		COUNTER_ADD(STATS_LINK(intidx).tx_bytes, bytes);
+		if (link_timestamps) Track_TX(intidx, ret, stamps ? stamps + sent : NULL, path);
+		sent += ret;
+	}
+
+	return sent;
+}
+
+// Receive a burst of network messages from all the network interfaces.
+// This function takes the buffers to fill (frames, each Get_Frame_Size() bytes long), arrays to store
+// the received lengths (lengths), interfaces (ifaces), kernel timestamps (stamps, in ns, may be
+// NULL; 0 without timestamps) and offload states (offloads, may be NULL; zero without offload),
+// and the maximum number of frames (max).
+// A frame cut to its buffer (an MTU raised since Init_Network) gets a zero length, for the caller to drop.
+// The interfaces are drained without blocking first; select only runs when all of them are idle,
+// for as long as Set_Link_Wait allows.
+// Returns the number of frames received, 0 only if the wait ran out.
+int Recv_Burst_Link(char **frames, size_t *lengths, int *ifaces, uint64_t *stamps, link_offload *offloads, int max) {
+	int *sockets = interfaces[link_worker];
+	struct mmsghdr msgs[MAX_BURST];
+	struct iovec iovs[MAX_BURST][2];
+	char controls[MAX_BURST][STAMP_CONTROL];
+	link_offload dropped[MAX_BURST];
+	bool stamped = stamps && link_timestamps;
+	int first = link_vnet ? 0 : 1;
+	if (max > MAX_BURST) max = MAX_BURST;
+
+	for (int frame = 0; frame < max; frame++) {
+		iovs[frame][0].iov_base = offloads ? &offloads[frame] : &dropped[frame];
+		iovs[frame][0].iov_len = sizeof(link_offload);
+		iovs[frame][1].iov_base = frames[frame];
+		iovs[frame][1].iov_len = frame_size;
+		if (offloads && !link_vnet) offloads[frame] = plain_frame;
+		memset(&msgs[frame].msg_hdr, 0, sizeof(msgs[frame].msg_hdr));
+		msgs[frame].msg_hdr.msg_iov = &iovs[frame][first];
+		msgs[frame].msg_hdr.msg_iovlen = 2 - first;
+		if (stamped) {
+			msgs[frame].msg_hdr.msg_control = controls[frame];
+			msgs[frame].msg_hdr.msg_controllen = sizeof(controls[frame]);
+		}
+	}
+
+	while (1) {
+		// Only the sweep that finds frames is timed, not the wait for them.
+		PROFILE_START(sweep, 0);
+		int count = 0;
+		for (int byte = 0; byte < ROUTER_NUM_INTERFACES && count < max; byte++) {
+			// The TX timestamps also wake select, read them first.
+			if (link_timestamps) Drain_TX_Stamps(byte);
+
+			int ret = recvmmsg(sockets[byte], msgs + count, max - count, MSG_DONTWAIT, NULL);
+			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+			DIE(ret < 0, "recvmmsg %s", strerror(errno));
+
+			uint64_t bytes = 0;
+			for (int frame = count; frame < count + ret; frame++) {
+				lengths[frame] = msgs[frame].msg_len - (link_vnet ? sizeof(link_offload) : 0);
+				ifaces[frame] = byte;
+				bytes += lengths[frame];
+				if (msgs[frame].msg_hdr.msg_flags & MSG_TRUNC) lengths[frame] = 0;
+				if (stamps) stamps[frame] = stamped ? Stamp_NS(&msgs[frame].msg_hdr) : 0;
+			}
+			COUNTER_ADD(STATS_LINK(byte).rx_packets, ret);
+			COUNTER_ADD(STATS_LINK(byte).rx_bytes, bytes);
+			count += ret;
+		}
+		if (count) {
+			PROFILE_COUNT(sweep, count);
+			PROFILE_END(STAGE_RECV, sweep);
+			return count;
+		}
+
+		// Every interface is idle, sleep until one of them is readable or the wait runs out.
+		if (link_wait == 0) return 0;
+		fd_set set;
+		FD_ZERO(&set);
+		int max_fd = 0;
+		for (int byte = 0; byte < ROUTER_NUM_INTERFACES; byte++) {
+			FD_SET(sockets[byte], &set);
+			if (sockets[byte] > max_fd) max_fd = sockets[byte];
+		}
+		struct timeval timeout = Link_Timeout(link_wait);
+		int res = select(max_fd + 1, &set, NULL, NULL, link_wait < 0 ? NULL : &timeout);
+		DIE(res == -1 && errno != EINTR, "select %s", strerror(errno));
+		if (res == 0) return 0;
+	}
+}
+
 // Receive a network message from any available network interface using non-blocking I/O.
 // This function takes a pointer to frame data (frame_data) and a pointer to store the received data length (length).
 // Returns the interface index where data was received on success, or -1 on failure.
 int Recv_FromAny_Link(char *frame_data, size_t *length) {
+	int *sockets = interfaces[link_worker];
 	fd_set set;
 	FD_ZERO(&set);
 
 	while (1) {
+		int max_fd = 0;
 		for (int byte = 0; byte < ROUTER_NUM_INTERFACES; byte++) {
-			FD_SET(interfaces[byte], &set);
+			FD_SET(sockets[byte], &set);
+			if (sockets[byte] > max_fd) max_fd = sockets[byte];
 		}
 
-		int res = select(interfaces[ROUTER_NUM_INTERFACES - 1] + 1, &set, NULL, NULL, NULL);
+		int res = select(max_fd + 1, &set, NULL, NULL, NULL);
 		DIE(res == -1, "select %s", strerror(errno));
 
 		for (int byte = 0; byte < ROUTER_NUM_INTERFACES; byte++) {
-			if (FD_ISSET(interfaces[byte], &set)) {
+			if (FD_ISSET(sockets[byte], &set)) {
 				ssize_t ret = Recv_From_Link(byte, frame_data);
+				if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
 				DIE(ret < 0, "Recv_From_Link %s", strerror(errno));
 				*length = ret;
 				return byte;
@@ -130,51 +596,34 @@ int Recv_FromAny_Link(char *frame_data, size_t *length) {
 // This function takes the interface index (interface) as input.
 // Returns a string representing the IP address.
 char *Get_IP_Interface(int interface) {
-	struct ifreq ifr;
-
-	if (interface == 0)
-		sprintf(ifr.ifr_name, "rr-0-1");
-	else {
-		sprintf(ifr.ifr_name, "r-%u", interface - 1);
-	}
-
-	int ret = ioctl(interfaces[interface], SIOCGIFADDR, &ifr);
-	DIE(ret == -1, "ioctl SIOCGIFADDR %s", strerror(errno));
-	return inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr);
+	struct in_addr addr = { .s_addr = interfaces_info[interface].ip };
+	return inet_ntoa(addr);
 }
 
 // Get the IPv4 address as an integer for a given network interface.
 // This function takes the interface index (interface) as input.
-// Returns the IPv4 address as an integer.
+// Returns the IPv4 address as an integer, read from the interface table.
 uint32_t Get_IPV4_Interface(int interface) {
-	struct ifreq ifr;
-
-	if (interface == 0)
-		sprintf(ifr.ifr_name, "rr-0-1");
-	else {
-		sprintf(ifr.ifr_name, "r-%u", interface - 1);
-	}
+	return interfaces_info[interface].ip;
+}
 
-	int ret = ioctl(interfaces[interface], SIOCGIFADDR, &ifr);
-	DIE(ret == -1, "ioctl SIOCGIFADDR %s", strerror(errno));
-	return ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
+// Get the IPv6 addresses of a given network interface, and how many there are.
+const struct in6_addr *Get_IPV6_Interface(int interface, int *count) {
+	*count = interfaces_info[interface].num_ip6;
+	return interfaces_info[interface].ip6;
 }
 
 // Get the MAC address for a given network interface.
 // This function takes the interface index (interface) and a pointer
-// to store the MAC address (mac) as input.
+// to store the MAC address (mac) as input, read from the interface table.
 void Get_MAC_Interface(int interface, uint8_t *mac) {
-	struct ifreq ifr;
-
-	if (interface == 0)
-		sprintf(ifr.ifr_name, "rr-0-1");
-	else {
-		sprintf(ifr.ifr_name, "r-%u", interface - 1);
-	}
+	memcpy(mac, interfaces_info[interface].mac, 6);
+}
 
-	int ret = ioctl(interfaces[interface], SIOCGIFHWADDR, &ifr);
-	DIE(ret == -1, "ioctl SIOCGIFHWADDR %s", strerror(errno));
-	memcpy(mac, ifr.ifr_addr.sa_data, 6);
+// Get the MTU of a given network interface, the largest IP packet (or segment of a super-packet)
+// it sends. This function takes the interface index (interface) as input, read from the interface table.
+int Get_MTU_Interface(int interface) {
+	return interfaces_info[interface].mtu;
 }
 
 /*********************************************************************************/
@@ -220,35 +669,3 @@ int HW_MAC_Addr(const char *txt, uint8_t *addr) {
 }
 
 /*********************************************************************************/
-
-// Calculate the Internet Checksum for a sequence of 16-bit data values.
-// This function takes a pointer to an array of 16-bit data values (data) and the 
-// length of the data in bytes (len) as input.
-// Returns the calculated checksum value as a 16-bit integer.
-uint16_t Checksum(uint16_t *data, size_t len) {
-    unsigned long checksum = 0;
-    uint16_t extra_byte;
-
-    // Process 16-bit data values in the array.
-    while (len > 1) {
-        checksum += ntohs(*data++);
-        len -= 2;
-    }
-
-    // If there is an odd byte left, process it.
-    if (len) {
-        *(uint8_t *)&extra_byte = *(uint8_t *)data; // Extract the remaining byte.
-        checksum += extra_byte; // Add the byte to the checksum.
-    }
-
-    // Add any carry bits and perform one's complement 
-	// to obtain the final checksum.
-    checksum = (checksum >> 16) + (checksum & 0xffff);
-    checksum += (checksum >> 16);
-
-    return (uint16_t)(~checksum); // Complement checksum.
-}
-
-
-/*********************************************************************************/
-
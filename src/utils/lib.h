@@ -5,29 +5,106 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+#include <sys/time.h>
 
-#define MAX_PACKET_LEN          1600
+#define MAX_PACKET_LEN          1600    // Smallest frame buffer, a 1500 byte MTU and its headers.
+#define MAX_GSO_LEN             65536   // Largest super-packet the kernel hands over or segments.
 #define ROUTER_NUM_INTERFACES   3
+#define MAX_WORKERS             64
+#define MAX_BURST               256
+#define IPV6_ADDRS              4       // IPv6 addresses kept per interface, link-local included.
 
-// Initialize network interfaces and the router based on command line arguments.
-void Init_Network(int argc, char *argv[]);
+// Single-writer counter: only its owner adds to it, anyone may read it without tearing.
+typedef _Atomic uint64_t counter;
+#define COUNTER_ADD(c, n) \
+    atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (n), memory_order_relaxed)
+#define COUNTER_GET(c) atomic_load_explicit(&(c), memory_order_relaxed)
+#define COUNTER_SET(c, v) atomic_store_explicit(&(c), (v), memory_order_relaxed)
+
+// Path a frame took through the router, for its wire-to-wire latency.
+enum link_path {
+    PATH_FAST,                  // Vector pipeline.
+    PATH_SLOW,                  // Scalar handlers (IP options, ICMP messages).
+    PATH_ARP,                   // Held in the waiting queue until its next hop resolved.
+    LINK_PATHS
+};
+
+// Offload state of a frame on a PACKET_VNET_HDR socket (-g), the kernel's struct virtio_net_hdr
+// (its header clashes with protocols.h): the segment size and protocol of a super-packet, and
+// whether its transport checksum is left for the egress to finish or was checked by the kernel.
+// In host byte order, all zero for a plain frame.
+typedef struct link_offload {
+    uint8_t flags;              // LINK_CSUM_PARTIAL, LINK_CSUM_VALID.
+    uint8_t gso_type;           // LINK_GSO_*, LINK_GSO_NONE for a plain frame.
+    uint16_t hdr_len;           // Headers in front of the payload, a hint.
+    uint16_t gso_size;          // Payload of every segment.
+    uint16_t csum_start;        // Transport header, from the Ethernet header.
+    uint16_t csum_offset;       // Transport checksum, from csum_start.
+} link_offload;
+
+#define LINK_CSUM_PARTIAL       1       // The transport checksum is the pseudo-header's, left to finish.
+#define LINK_CSUM_VALID         2       // The kernel checked the transport checksum.
+#define LINK_GSO_NONE           0
+#define LINK_GSO_TCPV4          1
+#define LINK_GSO_TCPV6          4
+#define LINK_GSO_UDP_L4         5
+#define LINK_GSO_ECN            0x80    // Flag of the TCP types, CWR set on the first segment only.
+
+// Have the kernel timestamp every frame received and sent (before Init_Network).
+void Enable_Link_Timestamps(void);
+// Have the kernel hand over GRO super-packets and segment the GSO ones sent (before Init_Network).
+void Enable_Link_Offload(void);
+// Initialize network interfaces (a socket per worker) based on command line arguments.
+void Init_Network(int argc, char *argv[], int workers);
+// Bind the calling thread to a worker's sockets.
+void Bind_Worker_Link(int worker);
+// Bound the sleep of the calling thread's Recv_Burst_Link for frames (ns), -1 for no bound.
+void Set_Link_Wait(int64_t ns);
+// Select timeout of a link wait (ns, not negative): rounded up to the microsecond, so the
+// wait is not cut short, and carried into the seconds, as select takes no tv_usec of a second.
+static inline struct timeval Link_Timeout(int64_t ns) {
+    int64_t usec = (ns + 999) / 1000;
+    return (struct timeval){.tv_sec = usec / 1000000, .tv_usec = usec % 1000000};
+}
+// Print the wire-to-wire latency per egress interface and path (with timestamps enabled).
+void Dump_Link_Latency(FILE *out);
 // Send a network message to a specific network interface.
 int Send_To_Link(int interface, char *frame_data, size_t length);
+// Send a network message received at `stamp` (ns, 0 if unknown) that took a given path.
+int Send_Stamped_Link(int interface, char *frame_data, size_t length, uint64_t stamp, int path);
+// Send a network message with its offload state (NULL for a plain frame), received at `stamp`.
+int Send_Offload_Link(int interface, char *frame_data, size_t length, const link_offload *offload,
+                      uint64_t stamp, int path);
 // Receive a network message from any available network interface.
 int Recv_FromAny_Link(char *frame_data, size_t *length);
+// Send a burst of network messages, received at `stamps` and with `offloads` (NULL if unknown / plain),
+// to a specific network interface.
+int Send_Burst_Link(int interface, char **frames, size_t *lengths, int count, const uint64_t *stamps,
+                    link_offload *offloads, int path);
+// Receive a burst of network messages, and their kernel timestamps if `stamps` and offload states if
+// `offloads`, from all the network interfaces; 0 if none arrived within the Set_Link_Wait bound.
+int Recv_Burst_Link(char **frames, size_t *lengths, int *ifaces, uint64_t *stamps, link_offload *offloads, int max);
+// Size of the frame buffers to receive in: the largest frame of any interface, a super-packet with -g.
+size_t Get_Frame_Size(void);
 
 // Get the IP address as a string for a given network interface.
 char *Get_IP_Interface(int interface);
 // Get the IPv4 address as an integer for a given network interface.
 uint32_t Get_IPV4_Interface(int interface);
+// Get the IPv6 addresses (at most IPV6_ADDRS) of a given network interface.
+const struct in6_addr *Get_IPV6_Interface(int interface, int *count);
 
 // Get the MAC address for a given network interface.
 void Get_MAC_Interface(int interface, uint8_t *mac);
+// Get the MTU (largest IP packet it sends) of a given network interface.
+int Get_MTU_Interface(int interface);
 // Convert a hardware address represented as a hexadecimal string to a byte array.
 int HW_MAC_Addr(const char *txt, uint8_t *addr);
 
-// Calculate the Internet Checksum for a sequence of 16-bit data values.
-uint16_t Checksum(uint16_t *data, size_t len);
+// Internet Checksum kernels.
+#include "checksum.h"
 
 // Custom error handling macro.
 #define DIE(condition, message, ...) \
@@ -0,0 +1,136 @@
+#include "./policer.h"
+#include "./stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_SEC 1000000000ull
+
+/*********************************************************************************/
+
+const char *const police_names[POLICE_TYPES] = {
+    [POLICE_ICMP_ERROR] = "icmp-error", [POLICE_ICMP_ECHO] = "icmp-echo",
+    [POLICE_ARP_REPLY] = "arp-reply", [POLICE_ARP_REQUEST] = "arp-request",
+};
+
+// Default rates, close to Linux's icmp_msgs_per_sec / icmp_msgs_burst for ICMP.
+static const police_rate default_rates[POLICE_TYPES] = {
+    [POLICE_ICMP_ERROR] = {1000, 50}, [POLICE_ICMP_ECHO] = {1000, 50},
+    [POLICE_ARP_REPLY] = {1000, 50}, [POLICE_ARP_REQUEST] = {100, 10},
+};
+
+// Fill the default rates of every interface and type.
+void Default_Police(police_rate rates[ROUTER_NUM_INTERFACES][POLICE_TYPES]) {
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        memcpy(rates[interface], default_rates, sizeof(default_rates));
+    }
+}
+
+// Apply a `type[@interface]=rate[/burst]` option (e.g. `icmp-error@r-0=100/10`), to every
+// interface without `@interface`. The burst defaults to a tenth of the rate, a rate of 0 lifts the limit.
+// The interfaces are named as on the command line (argc / argv).
+// Returns 0, or -1 if the option is malformed.
+int Parse_Police(police_rate rates[ROUTER_NUM_INTERFACES][POLICE_TYPES], const char *spec, int argc, char *argv[]) {
+    const char *equal = strchr(spec, '=');
+    if (!equal) return -1;
+
+    const char *at = memchr(spec, '@', (size_t)(equal - spec));
+    size_t type_len = (size_t)((at ? at : equal) - spec);
+
+    int type = 0;
+    while (type < POLICE_TYPES && (strlen(police_names[type]) != type_len || strncmp(spec, police_names[type], type_len))) {
+        type++;
+    }
+    if (type == POLICE_TYPES) return -1;
+
+    int first = 0, last = ROUTER_NUM_INTERFACES - 1;
+    if (at) {
+        size_t name_len = (size_t)(equal - at - 1);
+        for (first = 0; first < argc && first < ROUTER_NUM_INTERFACES; first++) {
+            if (strlen(argv[first]) == name_len && !strncmp(at + 1, argv[first], name_len)) break;
+        }
+        if (first == argc || first == ROUTER_NUM_INTERFACES) return -1;
+        last = first;
+    }
+
+    char *end;
+    unsigned long rate = strtoul(equal + 1, &end, 10), burst = rate / 10 ? rate / 10 : 1;
+    if (end == equal + 1 || rate > UINT32_MAX) return -1;
+    if (*end == '/') {
+        const char *value = end + 1;
+        burst = strtoul(value, &end, 10);
+        if (end == value || !burst || burst > UINT32_MAX) return -1;
+    }
+    if (*end) return -1;
+
+    for (int interface = first; interface <= last; interface++) {
+        rates[interface][type] = (police_rate){.rate = (uint32_t)rate, .burst = (uint32_t)burst};
+    }
+    return 0;
+}
+
+// Create the buckets of a worker, full. Each of the `workers` workers polices its share of a rate:
+// the flows are spread over them, so together they send about the configured rate.
+// Returns the buckets, NULL if out of memory.
+policer *Create_Policer(police_rate rates[ROUTER_NUM_INTERFACES][POLICE_TYPES], int workers) {
+    policer *pol = (policer *)calloc(1, sizeof(policer));
+    if (!pol) return NULL;
+    if (workers < 1) workers = 1;
+
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        for (int type = 0; type < POLICE_TYPES; type++) {
+            token_bucket *bucket = &pol->buckets[interface][type];
+            police_rate *config = &rates[interface][type];
+            uint64_t burst = config->burst / workers ? config->burst / workers : 1;
+
+            bucket->rate = config->rate ? (config->rate / workers ? config->rate / workers : 1) : 0;
+            bucket->depth = burst * NS_PER_SEC;
+            bucket->tokens = bucket->depth;
+        }
+    }
+    return pol;
+}
+
+// Free the buckets of a worker.
+void Free_Policer(policer **pol) {
+    if (!pol || !(*pol)) return;
+    free(*pol);
+    *pol = NULL;
+}
+
+// Take a token for a message of a type to be sent on (or in answer to a frame from) an interface.
+// The slow path calls it per message, reading the clock there costs nothing to the forwarding.
+// Returns true if the message may be sent, false if it must be dropped (counted as policed).
+bool Police(policer *pol, int interface, police_type type) {
+    if (!pol->buckets[interface][type].rate) return true;
+    return Police_At(pol, interface, type, Police_Now());
+}
+
+// Take a token for a message as Police, at a time (ns, Police_Now) the caller read once for
+// a whole vector: the fast path answers echo requests without a clock read per packet.
+// Returns true if the message may be sent, false if it must be dropped (counted as policed).
+bool Police_At(policer *pol, int interface, police_type type, uint64_t now) {
+    token_bucket *bucket = &pol->buckets[interface][type];
+    if (!bucket->rate) return true;
+
+    // Refill, the elapsed time is capped first so the product cannot overflow. A vector's time
+    // may predate a message the slow path policed since, it then refills nothing.
+    uint64_t elapsed = now > bucket->last ? now - bucket->last : 0;
+    if (!elapsed) now = bucket->last;
+    bucket->last = now;
+    if (elapsed >= bucket->depth / bucket->rate) {
+        bucket->tokens = bucket->depth;
+    } else {
+        bucket->tokens += elapsed * bucket->rate;
+        if (bucket->tokens > bucket->depth) bucket->tokens = bucket->depth;
+    }
+
+    if (bucket->tokens < NS_PER_SEC) {
+        COUNTER_ADD(STATS_LINK(interface).policed[type], 1);
+        return false;
+    }
+    bucket->tokens -= NS_PER_SEC;
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef POLICER_H_
+#define POLICER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lib.h"
+
+// Token bucket rate limiters of the messages the router generates itself, per interface and type,
+// so a traceroute storm or an ARP scan cannot take the forwarding cores. Every worker polices its
+// own share of the rates, without locks.
+
+// Messages generated by the router.
+typedef enum police_type {
+    POLICE_ICMP_ERROR,                  // Time Exceeded and Destination Unreachable.
+    POLICE_ICMP_ECHO,                   // Echo replies.
+    POLICE_ARP_REPLY,                   // Replies to the ARP requests received.
+    POLICE_ARP_REQUEST,                 // Requests for the next hops of queued packets.
+    POLICE_TYPES
+} police_type;
+
+// Rate of a message type, as configured.
+typedef struct police_rate {
+    uint32_t rate;                      // Messages per second, 0 for no limit.
+    uint32_t burst;                     // Messages sent back to back after an idle period.
+} police_rate;
+
+// Token bucket, one message is NS_PER_SEC tokens so the refill is exact in nanoseconds.
+typedef struct token_bucket {
+    uint64_t tokens;
+    uint64_t depth;                     // Burst, in tokens.
+    uint64_t rate;                      // Messages per second, 0 for no limit.
+    uint64_t last;                      // Time of the last refill (ns).
+} token_bucket;
+
+// Buckets of one worker.
+typedef struct policer {
+    token_bucket buckets[ROUTER_NUM_INTERFACES][POLICE_TYPES];
+} policer;
+
+extern const char *const police_names[POLICE_TYPES];
+
+// Fill the default rates of every interface and type.
+void Default_Police(police_rate rates[ROUTER_NUM_INTERFACES][POLICE_TYPES]);
+// Apply a `type[@interface]=rate[/burst]` option, -1 if it is malformed.
+int Parse_Police(police_rate rates[ROUTER_NUM_INTERFACES][POLICE_TYPES], const char *spec, int argc, char *argv[]);
+// Create the buckets of a worker, with its share of the rates of `workers` workers.
+policer *Create_Policer(police_rate rates[ROUTER_NUM_INTERFACES][POLICE_TYPES], int workers);
+// Free the buckets of a worker.
+void Free_Policer(policer **pol);
+// Take a token for a message, false (counted as policed) if it must be dropped.
+bool Police(policer *pol, int interface, police_type type);
+// Take a token for a message at a time read once per vector (Police_Now), as Police.
+bool Police_At(policer *pol, int interface, police_type type, uint64_t now);
+
+// Clock of the buckets (ns), for the fast path to read once per vector.
+static inline uint64_t Police_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* POLICER_H_ */
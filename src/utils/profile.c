@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+
+#include "./profile.h"
+
+#include <string.h>
+#include <time.h>
+
+/*********************************************************************************/
+
+#ifdef ROUTER_PROFILE
+
+_Thread_local stage_profile *profile_worker;
+
+// Timestamp ticks per nanosecond, measured by the first Create_Profile.
+static double ticks_per_ns;
+
+static const char *stage_names[PROFILE_STAGES] = {
+    [STAGE_RECV] = "recv", [STAGE_PARSE] = "parse", [STAGE_ACL] = "acl", [STAGE_CLASSIFY] = "classify",
+    [STAGE_LOOKUP] = "lookup", [STAGE_NAT] = "nat", [STAGE_ARP] = "arp", [STAGE_REWRITE] = "rewrite",
+    [STAGE_IPV6] = "ipv6", [STAGE_TX] = "tx", [STAGE_SLOW] = "slow",
+};
+
+// Nanoseconds of CLOCK_MONOTONIC.
+static uint64_t Monotonic_NS(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Measure the timestamp frequency against the monotonic clock, over 20 ms.
+static void Calibrate_Profile(void) {
+    uint64_t ns = Monotonic_NS(), ticks = Profile_Now();
+    struct timespec wait = { .tv_nsec = 20000000 };
+    nanosleep(&wait, NULL);
+    ticks_per_ns = (double)(Profile_Now() - ticks) / (double)(Monotonic_NS() - ns);
+}
+
+// Allocate zeroed histograms for a worker, calibrating the timestamps on the first call.
+stage_profile *Create_Profile(void) {
+    if (ticks_per_ns == 0) Calibrate_Profile();
+    return (stage_profile *)calloc(1, sizeof(stage_profile));
+}
+
+// Free the histograms of a worker.
+void Free_Profile(stage_profile **profile) {
+    if (!profile || !(*profile)) return;
+    free(*profile);
+    *profile = NULL;
+}
+
+// Record the calling thread's probes into a worker's histograms.
+void Bind_Profile(stage_profile *profile) {
+    profile_worker = profile;
+}
+
+// Print p50 / p99 / p99.9 of every stage of a worker, in cycles and ns per packet.
+// The worker keeps recording meanwhile, a line may mix samples from around the dump.
+void Dump_Profile(FILE *out, stage_profile *profile, int worker) {
+    if (!profile) return;
+
+    fprintf(out, "worker %d profile (cycles / ns per packet, %.2f cycles/ns):\n", worker, ticks_per_ns);
+    fprintf(out, "  %-9s %14s %14s %14s %14s %14s\n", "stage", "packets", "mean", "p50", "p99", "p99.9");
+
+    static uint64_t buckets[HIST_BUCKETS];
+    for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+        histogram *hist = &profile->stages[stage];
+        memset(buckets, 0, sizeof(buckets));
+        uint64_t packets = Hist_Snapshot(hist, buckets);
+        if (!packets) continue;
+
+        // The buckets and the totals are separate stores, a racing dump may see only the bucket.
+        uint64_t recorded = COUNTER_GET(hist->samples);
+        uint64_t values[4] = {
+            COUNTER_GET(hist->sum) / (recorded ? recorded : packets),
+            Hist_Percentile(buckets, packets, 0.50),
+            Hist_Percentile(buckets, packets, 0.99),
+            Hist_Percentile(buckets, packets, 0.999),
+        };
+
+        fprintf(out, "  %-9s %14llu", stage_names[stage], (unsigned long long)packets);
+        for (int value = 0; value < 4; value++) {
+            fprintf(out, " %7llu/%6.1f", (unsigned long long)values[value], (double)values[value] / ticks_per_ns);
+        }
+        fputc('\n', out);
+    }
+}
+
+#else
+
+// Profiling is compiled out, there is nothing to record.
+stage_profile *Create_Profile(void) {
+    return NULL;
+}
+
+void Free_Profile(stage_profile **profile) {
+    (void)profile;
+}
+
+void Bind_Profile(stage_profile *profile) {
+    (void)profile;
+}
+
+void Dump_Profile(FILE *out, stage_profile *profile, int worker) {
+    (void)out;
+    (void)profile;
+    (void)worker;
+}
+
+#endif /* ROUTER_PROFILE */
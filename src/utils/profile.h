@@ -0,0 +1,92 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lib.h"
+#include "histogram.h"
+
+// Per-stage latency histograms of the forwarding path, built with `make PROFILE=1`
+// (-DROUTER_PROFILE). Without it the probes expand to nothing.
+
+// Stages of the forwarding path, as recorded by the probes.
+typedef enum profile_stage {
+    STAGE_RECV,                 // Receive burst, the idle wait excluded.
+    STAGE_PARSE,                // Ethernet / IPv4 / IPv6 parsing and checksum verification.
+    STAGE_ACL,                  // Ingress ACL of the IPv4 packets.
+    STAGE_CLASSIFY,             // Local delivery vs. forwarding, echo replies.
+    STAGE_LOOKUP,               // Flow cache and LPM.
+    STAGE_NAT,                  // Conntrack lookups and address / port translation.
+    STAGE_ARP,                  // Neighbor lookup of a flow cache miss.
+    STAGE_REWRITE,              // TTL, checksum and MAC rewrite, the neighbor lookups included.
+    STAGE_IPV6,                 // IPv6 LPM, neighbor lookup and rewrite.
+    STAGE_TX,                   // Send bursts.
+    STAGE_SLOW,                 // Scalar handlers (ARP / ND, local, ICMP errors, neighbor misses).
+    PROFILE_STAGES
+} profile_stage;
+
+// Histograms of the cycles per packet spent in every stage, one set per worker.
+typedef struct stage_profile {
+    histogram stages[PROFILE_STAGES];
+} stage_profile;
+
+#ifdef ROUTER_PROFILE
+
+#define PROFILE_ENABLED 1
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+// Timestamp counter, invariant on the CPUs the router targets.
+static inline uint64_t Profile_Now(void) { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t Profile_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+// Histograms of the calling worker, set by Bind_Profile.
+extern _Thread_local stage_profile *profile_worker;
+
+// Record a stage that took `cycles` for `packets` packets, as that many samples of its mean.
+static inline void Profile_Record(profile_stage stage, uint64_t cycles, uint64_t packets) {
+    if (!profile_worker || !packets) return;
+
+    Hist_Record(&profile_worker->stages[stage], cycles / packets, packets);
+}
+
+// Timestamp and packet count of an open probe.
+typedef struct profile_probe {
+    uint64_t start;
+    uint64_t packets;
+} profile_probe;
+
+// Open a probe over a stage about to handle `n` packets.
+#define PROFILE_START(probe, n)         profile_probe probe = { Profile_Now(), (uint64_t)(n) }
+// Set the packet count of a probe, when the stage learns it on the way.
+#define PROFILE_COUNT(probe, n)         ((probe).packets = (uint64_t)(n))
+// Close a probe: record the cycles since it was opened.
+#define PROFILE_END(stage, probe)       Profile_Record((stage), Profile_Now() - (probe).start, (probe).packets)
+
+#else
+
+#define PROFILE_ENABLED 0
+#define PROFILE_START(probe, n)         do {} while (0)
+#define PROFILE_COUNT(probe, n)         do {} while (0)
+#define PROFILE_END(stage, probe)       do {} while (0)
+
+#endif /* ROUTER_PROFILE */
+
+// Allocate the histograms of a worker, NULL when profiling is compiled out (or on failure).
+stage_profile *Create_Profile(void);
+// Free the histograms of a worker.
+void Free_Profile(stage_profile **profile);
+// Record the calling thread's probes into a worker's histograms.
+void Bind_Profile(stage_profile *profile);
+// Print p50 / p99 / p99.9 of every stage of a worker, in cycles and ns per packet.
+void Dump_Profile(FILE *out, stage_profile *profile, int worker);
+
+#endif /* PROFILE_H_ */
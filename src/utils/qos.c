@@ -0,0 +1,309 @@
+#include "./qos.h"
+#include "./stats.h"
+#include "./hugepage.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+
+#define NS_PER_SEC 1000000000ull
+
+/*********************************************************************************/
+
+// RFC 4594: telephony (EF, VOICE-ADMIT), signaling (CS5) and network control (CS6, CS7) first, then the
+// interactive and multimedia classes, the best effort and the low priority data (CS1, AF1x, LE).
+#define P QOS_PRIORITY
+#define I QOS_INTERACTIVE
+#define D QOS_DEFAULT
+#define B QOS_BULK
+const uint8_t qos_dscp[64] = {
+    D, B, D, D, D, D, D, D,   // 0-7
+    B, D, B, D, B, D, B, D,   // 8-15
+    I, D, I, D, I, D, I, D,   // 16-23
+    I, D, I, D, I, D, I, D,   // 24-31
+    I, D, I, D, I, D, I, D,   // 32-39
+    P, D, D, D, P, D, P, D,   // 40-47
+    P, D, D, D, D, D, D, D,   // 48-55
+    P, D, D, D, D, D, D, D,   // 56-63
+};
+#undef P
+#undef I
+#undef D
+#undef B
+
+// DRR weights, in quanta per round: the interactive class gets twice the default one, four times the bulk one.
+static const uint32_t qos_weights[QOS_CLASSES] = {
+    [QOS_PRIORITY] = 0, [QOS_INTERACTIVE] = 4, [QOS_DEFAULT] = 2, [QOS_BULK] = 1,
+};
+
+// Apply a `interface[=rate]` option (e.g. `r-0=95`, rate in Mbit/s, fractions allowed): the frames
+// forwarded to the interface are queued by class, and sent at most at the rate if one is given.
+// The interfaces are named as on the command line (argc / argv).
+// Returns 0, or -1 if the option is malformed.
+int Parse_QoS(qos_rate rates[ROUTER_NUM_INTERFACES], const char *spec, int argc, char *argv[]) {
+    const char *equal = strchr(spec, '=');
+    size_t name_len = equal ? (size_t)(equal - spec) : strlen(spec);
+
+    int interface;
+    for (interface = 0; interface < argc && interface < ROUTER_NUM_INTERFACES; interface++) {
+        if (strlen(argv[interface]) == name_len && !strncmp(spec, argv[interface], name_len)) break;
+    }
+    if (interface == argc || interface == ROUTER_NUM_INTERFACES) return -1;
+
+    double mbits = 0;
+    if (equal) {
+        char *end;
+        mbits = strtod(equal + 1, &end);
+        if (end == equal + 1 || *end || !(mbits > 0) || mbits > 1e7) return -1;
+    }
+
+    rates[interface] = (qos_rate){.enabled = true, .rate = (uint64_t)(mbits * 1e6)};
+    return 0;
+}
+
+// Create the queues of a worker. Every class of a queued interface gets its ring and a buffer per
+// slot, QOS_RING frames or QOS_RING_BYTES of buffers, whichever is fewer. Each of the `workers`
+// workers shapes its share of a rate: the flows are spread over them, so together they send about
+// the configured rate.
+// Returns the queues, NULL if out of memory.
+qos *Create_QoS(const qos_rate rates[ROUTER_NUM_INTERFACES], int workers) {
+    qos *queues = (qos *)calloc(1, sizeof(qos));
+    if (!queues) return NULL;
+    if (workers < 1) workers = 1;
+
+    // Slots a page multiple apart would put all the headers in the same cache sets, shift them a line.
+    size_t slot = Get_Frame_Size();
+    if (slot % 4096 == 0) slot += 64;
+    uint32_t depth = QOS_RING;
+    while (depth > QOS_MIN_RING && (size_t)depth * slot > QOS_RING_BYTES) depth >>= 1;
+
+    size_t frames = 0;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        if (rates[interface].enabled) frames += (size_t)QOS_CLASSES * depth;
+    }
+    if (frames) queues->memory = (char *)Huge_Alloc(frames * slot, HUGE_PACKETS);
+    if (frames && !queues->memory) {
+        free(queues);
+        return NULL;
+    }
+
+    char *buffer = queues->memory;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        qos_port *port = &queues->ports[interface];
+        if (!rates[interface].enabled) continue;
+
+        for (int class = 0; class < QOS_CLASSES; class++) {
+            qos_queue *queue = &port->queues[class];
+            queue->ring = (qos_frame *)calloc(depth, sizeof(qos_frame));
+            if (!queue->ring) {
+                Free_QoS(&queues);
+                return NULL;
+            }
+            for (uint32_t pos = 0; pos < depth; pos++, buffer += slot) queue->ring[pos].buf = buffer;
+            queue->mask = depth - 1;
+            queue->quantum = qos_weights[class] * QOS_QUANTUM;
+        }
+        port->enabled = true;
+        port->current = QOS_INTERACTIVE;
+
+        // The burst is a millisecond of the rate, never less than two of the largest frames.
+        port->rate = rates[interface].rate / 8 / (uint64_t)workers;
+        if (rates[interface].rate && !port->rate) port->rate = 1;
+        uint64_t burst = port->rate * QOS_BURST_US / 1000000;
+        if (burst < 2 * slot) burst = 2 * slot;
+        port->depth = (int64_t)(burst * NS_PER_SEC);
+        port->tokens = port->depth;
+        port->last = QoS_Now();
+    }
+    return queues;
+}
+
+// Free the queues of a worker, and the frames waiting in them.
+void Free_QoS(qos **queues) {
+    if (!queues || !(*queues)) return;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        for (int class = 0; class < QOS_CLASSES; class++) free((*queues)->ports[interface].queues[class].ring);
+    }
+    Huge_Free((*queues)->memory);
+    free(*queues);
+    *queues = NULL;
+}
+
+/*********************************************************************************/
+
+// Class of an Ethernet frame, by the DSCP of its IPv4 TOS or IPv6 traffic class; QOS_DEFAULT if
+// it is neither IPv4 nor IPv6.
+qos_class Classify_QoS(const char *frame, size_t len) {
+    if (len < ETH_HLEN + 2) return QOS_DEFAULT;
+    const uint8_t *bytes = (const uint8_t *)frame;
+    uint16_t type = (uint16_t)(bytes[12] << 8 | bytes[13]);
+
+    uint8_t tos;
+    if (type == ETH_P_IP) tos = bytes[ETH_HLEN + 1];
+    else if (type == ETH_P_IPV6) tos = (uint8_t)((bytes[ETH_HLEN] & 0x0f) << 4 | bytes[ETH_HLEN + 1] >> 4);
+    else return QOS_DEFAULT;
+    return (qos_class)qos_dscp[tos >> 2];
+}
+
+// Queue a frame for an interface by its class. The frame's buffer goes into the slot, the slot's
+// buffer comes back in its place (*frame), for the caller to receive into.
+// Returns true, or false if the class is full: the frame is dropped (tail drop) and counted.
+bool Enqueue_QoS(qos *queues, int interface, char **frame, size_t len, uint64_t stamp,
+                 const link_offload *offload, uint64_t now) {
+    qos_port *port = &queues->ports[interface];
+    qos_class class = Classify_QoS(*frame, len);
+    qos_queue *queue = &port->queues[class];
+
+    if (queue->tail - queue->head > queue->mask) {
+        COUNTER_ADD(STATS_LINK(interface).queue_drops[class], 1);
+        return false;
+    }
+
+    qos_frame *slot = &queue->ring[queue->tail & queue->mask];
+    char *spare = slot->buf;
+    slot->buf = *frame;
+    slot->len = len;
+    slot->stamp = stamp;
+    slot->queued = now;
+    slot->offload = *offload;
+    *frame = spare;
+
+    queue->tail++;
+    port->backlog++;
+    COUNTER_ADD(STATS_LINK(interface).queued[class], 1);
+    COUNTER_SET(STATS_LINK(interface).queue_depth[class], queue->tail - queue->head);
+    return true;
+}
+
+// Refill the shaper of a port, the elapsed time capped first so the product cannot overflow.
+static void Refill_Port(qos_port *port, uint64_t now) {
+    uint64_t elapsed = now - port->last;
+    port->last = now;
+    if (elapsed >= (uint64_t)(port->depth - port->tokens) / port->rate) {
+        port->tokens = port->depth;
+    } else {
+        port->tokens += (int64_t)(elapsed * port->rate);
+    }
+}
+
+// Class whose head frame goes next: the priority class while it has frames, else the DRR class
+// being served if its deficit covers its head frame. A class whose deficit does not passes its
+// turn, and gets its quantum again on its next one; an empty class loses its deficit.
+// The port must have a frame waiting.
+static qos_queue *Next_Queue(qos_port *port) {
+    qos_queue *priority = &port->queues[QOS_PRIORITY];
+    if (priority->head != priority->tail) return priority;
+
+    while (true) {
+        qos_queue *queue = &port->queues[port->current];
+        if (queue->head != queue->tail) {
+            if (!port->credited) {
+                queue->deficit += queue->quantum;
+                port->credited = true;
+            }
+            int64_t len = (int64_t)queue->ring[queue->head & queue->mask].len;
+            if (len <= queue->deficit) {
+                queue->deficit -= len;
+                return queue;
+            }
+        } else {
+            queue->deficit = 0;
+        }
+        port->current = port->current == QOS_CLASSES - 1 ? QOS_INTERACTIVE : port->current + 1;
+        port->credited = false;
+    }
+}
+
+// Send the frames of a port the shaper lets through, a burst of MAX_BURST at a time. A frame may
+// leave the shaper in debt, the next ones wait until it is paid back.
+// Returns the frames sent.
+static int Drain_Port(qos_port *port, int interface, uint64_t now) {
+    char *frames[MAX_BURST];
+    size_t lengths[MAX_BURST];
+    uint64_t stamps[MAX_BURST];
+    link_offload offloads[MAX_BURST];
+    int count = 0, sent = 0;
+
+    if (port->rate) Refill_Port(port, now);
+    while (port->backlog && (!port->rate || port->tokens > 0)) {
+        qos_queue *queue = Next_Queue(port);
+        qos_frame *frame = &queue->ring[queue->head & queue->mask];
+        frames[count] = frame->buf;
+        lengths[count] = frame->len;
+        stamps[count] = frame->stamp;
+        offloads[count] = frame->offload;
+        count++;
+
+        queue->head++;
+        port->backlog--;
+        if (port->rate) port->tokens -= (int64_t)(frame->len * NS_PER_SEC);
+        Hist_Record(&queue->sojourn, now - frame->queued, 1);
+
+        qos_class class = (qos_class)(queue - port->queues);
+        COUNTER_SET(STATS_LINK(interface).queue_depth[class], queue->tail - queue->head);
+
+        // The slots sent are only refilled by the next vector, after the burst went out.
+        if (count == MAX_BURST) {
+            sent += Send_Burst_Link(interface, frames, lengths, count, stamps, offloads, PATH_FAST);
+            count = 0;
+        }
+    }
+    if (count) sent += Send_Burst_Link(interface, frames, lengths, count, stamps, offloads, PATH_FAST);
+    return sent;
+}
+
+// Send the frames the shapers let through, every port's classes by priority then DRR.
+// Returns the frames sent.
+int Drain_QoS(qos *queues, uint64_t now) {
+    int sent = 0;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        if (queues->ports[interface].backlog) sent += Drain_Port(&queues->ports[interface], interface, now);
+    }
+    return sent;
+}
+
+// Nanoseconds until the shapers let a waiting frame through: 0 if one may go now, -1 if none is waiting.
+int64_t Wait_QoS(const qos *queues, uint64_t now) {
+    int64_t wait = -1;
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        const qos_port *port = &queues->ports[interface];
+        if (!port->backlog) continue;
+        if (!port->rate) return 0;
+
+        // The tokens the port lacks, less those earned since its last refill.
+        int64_t lacking = -port->tokens - (int64_t)((now - port->last) * port->rate);
+        int64_t ns = lacking < 0 ? 0 : lacking / (int64_t)port->rate + 1;
+        if (wait < 0 || ns < wait) wait = ns;
+    }
+    return wait;
+}
+
+// Print the time the frames of every class of every queued interface waited, merged over the workers.
+void Dump_QoS(FILE *out, qos *const *queues, int workers, char *names[], int interfaces) {
+    static uint64_t buckets[HIST_BUCKETS];
+    for (int interface = 0; interface < interfaces; interface++) {
+        for (int class = 0; class < QOS_CLASSES; class++) {
+            memset(buckets, 0, sizeof(buckets));
+            uint64_t samples = 0, max = 0;
+            for (int worker = 0; worker < workers; worker++) {
+                if (!QoS_Enabled(queues[worker], interface)) continue;
+                const histogram *hist = &queues[worker]->ports[interface].queues[class].sojourn;
+                samples += Hist_Snapshot(hist, buckets);
+                if (COUNTER_GET(hist->max) > max) max = COUNTER_GET(hist->max);
+            }
+            if (!samples) continue;
+
+            // The percentiles are bucket edges, they cannot be above the largest wait recorded.
+            static const double fractions[] = {0.50, 0.99, 0.999};
+            uint64_t waits[3];
+            for (int pct = 0; pct < 3; pct++) {
+                waits[pct] = Hist_Percentile(buckets, samples, fractions[pct]);
+                if (waits[pct] > max) waits[pct] = max;
+            }
+            fprintf(out, "%-8s queue %-11s %10llu pkts: p50 %.1f us p99 %.1f us p99.9 %.1f us max %.1f us\n",
+                    names[interface], qos_names[class], (unsigned long long)samples,
+                    waits[0] / 1e3, waits[1] / 1e3, waits[2] / 1e3, max / 1e3);
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef QOS_H_
+#define QOS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lib.h"
+#include "histogram.h"
+
+// Egress queues of the forwarded frames, per interface and class of DSCP: a strict priority class
+// served first, then the others by deficit round robin (Shreedhar and Varghese), in bursts, under
+// an optional rate shaper. Every worker queues and shapes its own share of an interface, without
+// locks. A queued frame keeps its buffer: the slot it goes into hands its own buffer back in
+// exchange, so no frame is copied.
+
+// Classes of the frames, by the DSCP of their IPv4 TOS / IPv6 traffic class (RFC 4594).
+typedef enum qos_class {
+    QOS_PRIORITY,                       // EF, VOICE-ADMIT, CS5 to CS7: served before all the others.
+    QOS_INTERACTIVE,                    // CS2 to CS4, AF2x to AF4x.
+    QOS_DEFAULT,                        // CS0 and the code points not mapped to another class.
+    QOS_BULK,                           // CS1, AF1x, LE.
+    QOS_CLASSES
+} qos_class;
+
+#define QOS_RING            256         // Frames a class holds at most.
+#define QOS_RING_BYTES      (512u << 10) // Buffers of a class at most: fewer frames with super-packets.
+#define QOS_MIN_RING        8
+#define QOS_QUANTUM         1514        // Bytes a DRR class may send per round and weight.
+#define QOS_BURST_US        1000        // Shaper burst, in microseconds of the rate.
+
+// Queues of an interface, as configured.
+typedef struct qos_rate {
+    bool enabled;                       // Frames of the interface go through the queues.
+    uint64_t rate;                      // Shaper rate in bits per second, 0 for the line rate.
+} qos_rate;
+
+// A queued frame: the buffer it sits in is the slot's until it is sent.
+typedef struct qos_frame {
+    char *buf;
+    size_t len;
+    uint64_t stamp;                     // Kernel RX timestamp (ns), 0 without -t.
+    uint64_t queued;                    // Time it was queued (ns).
+    link_offload offload;
+} qos_frame;
+
+// Ring of a class, its head and tail running free.
+typedef struct qos_queue {
+    qos_frame *ring;
+    uint32_t mask;
+    uint32_t head;
+    uint32_t tail;
+    int64_t deficit;                    // Bytes the class may still send this round (DRR).
+    uint32_t quantum;                   // Bytes added to its deficit per round, 0 for the priority class.
+    histogram sojourn;                  // Time its frames waited (ns).
+} qos_queue;
+
+// Queues and shaper of one interface.
+typedef struct qos_port {
+    bool enabled;
+    qos_queue queues[QOS_CLASSES];
+    uint32_t backlog;                   // Frames waiting in all the classes.
+    int current;                        // DRR class being served.
+    bool credited;                      // It got its quantum for this round.
+
+    // Token bucket of the shaper, one byte is NS_PER_SEC tokens; in debt after a frame larger than the tokens left.
+    int64_t tokens;
+    int64_t depth;
+    uint64_t rate;                      // Bytes per second, 0 for the line rate.
+    uint64_t last;                      // Time of the last refill (ns).
+} qos_port;
+
+// Queues of one worker.
+typedef struct qos {
+    qos_port ports[ROUTER_NUM_INTERFACES];
+    char *memory;                       // Frame buffers of every slot.
+} qos;
+
+// Class of each DSCP.
+extern const uint8_t qos_dscp[64];
+
+// Whether any interface is queued.
+static inline bool Any_QoS(const qos_rate rates[ROUTER_NUM_INTERFACES]) {
+    for (int interface = 0; interface < ROUTER_NUM_INTERFACES; interface++) {
+        if (rates[interface].enabled) return true;
+    }
+    return false;
+}
+
+// Clock of the queues and shapers (ns), read once per vector.
+static inline uint64_t QoS_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Apply a `interface[=rate]` option (rate in Mbit/s), -1 if it is malformed.
+int Parse_QoS(qos_rate rates[ROUTER_NUM_INTERFACES], const char *spec, int argc, char *argv[]);
+// Create the queues of a worker, shaped to its share of the rates of `workers` workers; NULL if out of memory.
+qos *Create_QoS(const qos_rate rates[ROUTER_NUM_INTERFACES], int workers);
+// Free the queues of a worker, and the frames waiting in them.
+void Free_QoS(qos **queues);
+
+// Whether the frames of an interface go through the queues.
+static inline bool QoS_Enabled(const qos *queues, int interface) {
+    return queues && queues->ports[interface].enabled;
+}
+
+// Class of an Ethernet frame by its DSCP, QOS_DEFAULT if it is not IP.
+qos_class Classify_QoS(const char *frame, size_t len);
+// Queue a frame; its buffer is swapped with a free one. False (counted as dropped) if its class is full.
+bool Enqueue_QoS(qos *queues, int interface, char **frame, size_t len, uint64_t stamp,
+                 const link_offload *offload, uint64_t now);
+// Send the frames the shapers let through, by class. Returns the frames sent.
+int Drain_QoS(qos *queues, uint64_t now);
+// Nanoseconds until a waiting frame may be sent, -1 if none is waiting.
+int64_t Wait_QoS(const qos *queues, uint64_t now);
+// Print the time the frames of every class waited, per interface, merged over the workers.
+void Dump_QoS(FILE *out, qos *const *queues, int workers, char *names[], int interfaces);
+
+#endif /* QOS_H_ */
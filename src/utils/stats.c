@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+
+#include "./stats.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*********************************************************************************/
+
+const char *const drop_names[DROP_REASONS] = {
+    [DROP_MALFORMED] = "malformed", [DROP_ETHERTYPE] = "ethertype", [DROP_CHECKSUM] = "checksum",
+    [DROP_TTL] = "ttl", [DROP_NO_ROUTE] = "no-route", [DROP_NO_INTERFACE] = "no-interface",
+    [DROP_ARP_QUEUE] = "arp-queue", [DROP_LOCAL] = "local", [DROP_MTU] = "mtu",
+    [DROP_ACL] = "acl", [DROP_NAT] = "nat",
+};
+
+const char *const event_names[STATS_EVENTS] = {
+    [ARP_REQUESTS_IN] = "arp-requests-in", [ARP_REPLIES_IN] = "arp-replies-in",
+    [ARP_REQUESTS_OUT] = "arp-requests-out", [ARP_REPLIES_OUT] = "arp-replies-out",
+    [ND_SOLICITS_IN] = "nd-solicits-in", [ND_ADVERTS_IN] = "nd-adverts-in",
+    [ND_SOLICITS_OUT] = "nd-solicits-out", [ND_ADVERTS_OUT] = "nd-adverts-out",
+    [ICMP_ECHO_REPLIES] = "icmp-echo-replies", [ICMP_TIME_EXCEEDED] = "icmp-time-exceeded",
+    [ICMP_UNREACHABLE] = "icmp-unreachable", [ICMP_TOO_BIG] = "icmp-too-big",
+    [IPV4_FRAGMENTS] = "ipv4-fragments",
+};
+
+const char *const qos_names[QOS_CLASSES] = {
+    [QOS_PRIORITY] = "priority", [QOS_INTERACTIVE] = "interactive", [QOS_DEFAULT] = "default", [QOS_BULK] = "bulk",
+};
+
+// Threads not bound to a worker (setup, benchmarks) count here, the counters are never read.
+static stats_worker unbound_stats;
+_Thread_local stats_worker *worker_stats = &unbound_stats;
+
+// Name of the segment of a router.
+static void Stats_Name(char *name, size_t len, int pid) {
+    snprintf(name, len, STATS_PREFIX "%d", pid);
+}
+
+// Create the counters segment (/dev/shm/router-<pid>) for a number of workers and the interfaces
+// named on the command line. Without shared memory the counters stay private, only routerstat
+// loses them. Returns the segment, NULL if no memory at all.
+router_stats *Create_Stats(int workers, int argc, char *argv[]) {
+    char name[64];
+    Stats_Name(name, sizeof(name), getpid());
+
+    router_stats *stats = MAP_FAILED;
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (ftruncate(fd, sizeof(router_stats)) == 0) {
+            stats = mmap(NULL, sizeof(router_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (stats == MAP_FAILED) {
+        fprintf(stderr, "WARNING: NO STATS SEGMENT %s (%s)...\n", name, strerror(errno));
+        if (fd >= 0) shm_unlink(name);
+        stats = mmap(NULL, sizeof(router_stats), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (stats == MAP_FAILED) return NULL;
+    }
+
+    // The mapping starts zeroed, only the header needs filling.
+    stats->version = STATS_VERSION;
+    stats->pid = getpid();
+    stats->workers = (uint32_t)workers;
+    stats->interfaces = (uint32_t)(argc < ROUTER_NUM_INTERFACES ? argc : ROUTER_NUM_INTERFACES);
+    for (uint32_t interface = 0; interface < stats->interfaces; interface++) {
+        snprintf(stats->names[interface], STATS_NAME_LEN, "%s", argv[interface]);
+    }
+    stats->started = (uint64_t)time(NULL);
+    atomic_store_explicit(&stats->magic, STATS_MAGIC, memory_order_release);
+
+    return stats;
+}
+
+// Remove the name of the counters segment, so routerstat no longer finds it. The mapping stays
+// valid for the workers still writing to it.
+void Unlink_Stats(const router_stats *stats) {
+    char name[64];
+    Stats_Name(name, sizeof(name), stats->pid);
+    shm_unlink(name);
+}
+
+// Unmap the counters segment and remove its name.
+void Free_Stats(router_stats **stats) {
+    if (!stats || !(*stats)) return;
+
+    Unlink_Stats(*stats);
+    munmap(*stats, sizeof(router_stats));
+    *stats = NULL;
+}
+
+// Record the calling thread's counters into a worker's block.
+void Bind_Stats(router_stats *stats, int worker) {
+    worker_stats = &stats->worker[worker];
+}
+
+// Print the traffic of every interface (with each worker's share of the received packets),
+// then the drops and control messages, summed over the workers.
+void Dump_Stats(FILE *out, const router_stats *stats) {
+    for (uint32_t interface = 0; interface < stats->interfaces; interface++) {
+        uint64_t rx = 0, tx = 0, tx_bytes = 0;
+        for (uint32_t worker = 0; worker < stats->workers; worker++) {
+            const stats_link *link = &stats->worker[worker].links[interface];
+            rx += COUNTER_GET(link->rx_packets);
+            tx += COUNTER_GET(link->tx_packets);
+            tx_bytes += COUNTER_GET(link->tx_bytes);
+        }
+
+        fprintf(out, "%-8s rx %10llu pkts:", stats->names[interface], (unsigned long long)rx);
+        for (uint32_t worker = 0; worker < stats->workers; worker++) {
+            const stats_link *link = &stats->worker[worker].links[interface];
+            uint64_t packets = COUNTER_GET(link->rx_packets);
+            fprintf(out, " w%u %llu (%.1f%%, %llu B)", worker, (unsigned long long)packets,
+                    rx ? 100.0 * packets / rx : 0.0, (unsigned long long)COUNTER_GET(link->rx_bytes));
+        }
+        fprintf(out, "\n%-8s tx %10llu pkts: %llu B\n", stats->names[interface], (unsigned long long)tx,
+                (unsigned long long)tx_bytes);
+
+        fprintf(out, "%-8s policed:", stats->names[interface]);
+        for (int type = 0; type < POLICE_TYPES; type++) {
+            uint64_t policed = 0;
+            for (uint32_t worker = 0; worker < stats->workers; worker++) {
+                policed += COUNTER_GET(stats->worker[worker].links[interface].policed[type]);
+            }
+            fprintf(out, " %s %llu", police_names[type], (unsigned long long)policed);
+        }
+        fprintf(out, "\n");
+
+        // Egress queues (-Q), only those of the interfaces that queued anything.
+        uint64_t queued[QOS_CLASSES] = {0}, queue_drops[QOS_CLASSES] = {0}, queue_depth[QOS_CLASSES] = {0};
+        uint64_t any = 0;
+        for (int class = 0; class < QOS_CLASSES; class++) {
+            for (uint32_t worker = 0; worker < stats->workers; worker++) {
+                const stats_link *link = &stats->worker[worker].links[interface];
+                queued[class] += COUNTER_GET(link->queued[class]);
+                queue_drops[class] += COUNTER_GET(link->queue_drops[class]);
+                queue_depth[class] += COUNTER_GET(link->queue_depth[class]);
+            }
+            any += queued[class] + queue_drops[class];
+        }
+        if (!any) continue;
+        fprintf(out, "%-8s queues:", stats->names[interface]);
+        for (int class = 0; class < QOS_CLASSES; class++) {
+            fprintf(out, " %s %llu (%llu dropped, %llu waiting)", qos_names[class], (unsigned long long)queued[class],
+                    (unsigned long long)queue_drops[class], (unsigned long long)queue_depth[class]);
+        }
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "drops:");
+    for (int reason = 0; reason < DROP_REASONS; reason++) {
+        uint64_t drops = 0;
+        for (uint32_t worker = 0; worker < stats->workers; worker++) {
+            drops += COUNTER_GET(stats->worker[worker].drops[reason]);
+        }
+        fprintf(out, " %s %llu", drop_names[reason], (unsigned long long)drops);
+    }
+
+    fprintf(out, "\nevents:");
+    for (int event = 0; event < STATS_EVENTS; event++) {
+        uint64_t events = 0;
+        for (uint32_t worker = 0; worker < stats->workers; worker++) {
+            events += COUNTER_GET(stats->worker[worker].events[event]);
+        }
+        fprintf(out, " %s %llu", event_names[event], (unsigned long long)events);
+    }
+    fprintf(out, "\n");
+}
+
+/*********************************************************************************/
+
+// Map the counters segment of a running router read-only.
+// Returns NULL (with errno set) if it is missing, too small or not a counters segment.
+const router_stats *Open_Stats(int pid) {
+    char name[64];
+    Stats_Name(name, sizeof(name), pid);
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(router_stats)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const router_stats *stats = mmap(NULL, sizeof(router_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED) return NULL;
+
+    if (atomic_load_explicit(&stats->magic, memory_order_acquire) != STATS_MAGIC ||
+        stats->version != STATS_VERSION) {
+        Close_Stats(stats);
+        errno = EINVAL;
+        return NULL;
+    }
+    return stats;
+}
+
+// Unmap a segment mapped by Open_Stats.
+void Close_Stats(const router_stats *stats) {
+    munmap((void *)(uintptr_t)stats, sizeof(router_stats));
+}
@@ -0,0 +1,111 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lib.h"
+#include "policer.h"
+#include "qos.h"
+
+// Runtime counters of the router, in a shared memory segment (/dev/shm/router-<pid>) that
+// routerstat maps read-only. Every worker writes its own cache-line aligned block, without locks.
+
+#define STATS_MAGIC     0x52535431u     // "RST1", written last once the header is complete.
+#define STATS_VERSION   8
+#define STATS_PREFIX    "/router-"      // Segment name: the prefix followed by the router's pid.
+#define STATS_NAME_LEN  16
+
+// Why a frame was dropped.
+typedef enum drop_reason {
+    DROP_MALFORMED,                     // Truncated Ethernet, ARP, IPv4 or IPv6 header.
+    DROP_ETHERTYPE,                     // Neither IPv4, IPv6 nor ARP.
+    DROP_CHECKSUM,                      // Bad IPv4 header checksum.
+    DROP_TTL,                           // TTL / hop limit expired, answered with Time Exceeded.
+    DROP_NO_ROUTE,                      // No route, answered with Destination Unreachable.
+    DROP_NO_INTERFACE,                  // Route through an interface the router was not started with.
+    DROP_ARP_QUEUE,                     // ARP / ND waiting queue full.
+    DROP_LOCAL,                         // For the router, but not an echo request.
+    DROP_MTU,                           // Over the egress MTU and not to fragment, answered with Too Big.
+    DROP_ACL,                           // Denied by the ingress ACL.
+    DROP_NAT,                           // Not translated: a fragment, table full or no free port.
+    DROP_REASONS
+} drop_reason;
+
+// Control plane messages received and generated.
+typedef enum stats_event {
+    ARP_REQUESTS_IN,
+    ARP_REPLIES_IN,
+    ARP_REQUESTS_OUT,
+    ARP_REPLIES_OUT,
+    ND_SOLICITS_IN,                     // IPv6 neighbor discovery, the ARP of IPv6.
+    ND_ADVERTS_IN,
+    ND_SOLICITS_OUT,
+    ND_ADVERTS_OUT,
+    ICMP_ECHO_REPLIES,                  // ICMP and ICMPv6.
+    ICMP_TIME_EXCEEDED,
+    ICMP_UNREACHABLE,
+    ICMP_TOO_BIG,                       // Fragmentation Needed and ICMPv6 Packet Too Big.
+    IPV4_FRAGMENTS,                     // Fragments sent for the IPv4 packets over the egress MTU.
+    STATS_EVENTS
+} stats_event;
+
+// Traffic of one interface.
+typedef struct stats_link {
+    counter rx_packets;
+    counter rx_bytes;
+    counter tx_packets;
+    counter tx_bytes;
+    counter policed[POLICE_TYPES];      // Messages the router did not generate, over their rate.
+    counter queued[QOS_CLASSES];        // Frames queued for the interface by class (-Q).
+    counter queue_drops[QOS_CLASSES];   // Frames dropped with their class full.
+    counter queue_depth[QOS_CLASSES];   // Frames waiting in the class now.
+} stats_link;
+
+// Counters of one worker, written by that worker only.
+typedef struct stats_worker {
+    stats_link links[ROUTER_NUM_INTERFACES];
+    counter drops[DROP_REASONS];
+    counter events[STATS_EVENTS];
+} __attribute__((aligned(64))) stats_worker;
+
+// Layout of the shared memory segment.
+typedef struct router_stats {
+    _Atomic uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t workers;
+    uint32_t interfaces;
+    char names[ROUTER_NUM_INTERFACES][STATS_NAME_LEN];
+    uint64_t started;                   // Start time, seconds since the epoch.
+    stats_worker worker[MAX_WORKERS];
+} router_stats;
+
+extern const char *const drop_names[DROP_REASONS];
+extern const char *const event_names[STATS_EVENTS];
+extern const char *const qos_names[QOS_CLASSES];
+
+// Counters of the calling worker, set by Bind_Stats (a scratch block before that).
+extern _Thread_local stats_worker *worker_stats;
+
+#define STATS_DROP(reason, n)   COUNTER_ADD(worker_stats->drops[(reason)], (n))
+#define STATS_EVENT(event, n)   COUNTER_ADD(worker_stats->events[(event)], (n))
+#define STATS_LINK(interface)   (worker_stats->links[(interface)])
+
+// Create the segment for a number of workers and the named interfaces (private memory if it fails).
+router_stats *Create_Stats(int workers, int argc, char *argv[]);
+// Remove the segment's name, the mapping stays valid.
+void Unlink_Stats(const router_stats *stats);
+// Unmap and remove the segment.
+void Free_Stats(router_stats **stats);
+// Record the calling thread's counters into a worker's block.
+void Bind_Stats(router_stats *stats, int worker);
+// Print the traffic of every interface, then the drops and control messages, summed over the workers.
+void Dump_Stats(FILE *out, const router_stats *stats);
+
+// Map the segment of a running router read-only, NULL (with errno) if it is missing or invalid.
+const router_stats *Open_Stats(int pid);
+// Unmap a segment mapped by Open_Stats.
+void Close_Stats(const router_stats *stats);
+
+#endif /* STATS_H_ */